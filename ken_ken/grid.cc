@@ -57,13 +57,16 @@ absl::Status Grid<kWidth>::Setup() {
           cols));
     }
   } else if (absl::GetFlag(FLAGS_sudoku_problem_setup) == "pairwise") {
-    for (int i = 0; i < kWidth; ++i) {
-      for (int j = i + 1; j < kWidth; ++j) {
-        RETURN_IF_ERROR(AddAllEntryPredicate(
-            absl::StrCat("No row dupes (", i + 1, ", ", j + 1, ")"),
-            [i, j](const puzzle::Entry& e) { return e.Class(i) != e.Class(j); },
-            {i, j}));
+    // Permuters which don't honor all-different groups get a `!=` filter per
+    // pair of cells in each row: kWidth times as many filters as one
+    // all-entry filter per pair of columns, but each reads a single entry.
+    for (int row = 0; row < kWidth; ++row) {
+      std::vector<Cell> cells;
+      for (int col = 0; col < kWidth; ++col) {
+        cells.push_back({.entry_id = row, .class_int = col});
       }
+      RETURN_IF_ERROR(AddAllDifferentPredicate(
+          absl::StrCat("No row dupes ", row + 1), std::move(cells)));
     }
   }
 
@@ -124,6 +127,17 @@ absl::StatusOr<typename Grid<kWidth>::Board> Grid<kWidth>::ToBoard(
 }
 
 // static
+template <int64_t kWidth>
+std::vector<puzzle::Solver::Cell> Grid<kWidth>::ToCells(
+    absl::Span<const Box> boxes) {
+  std::vector<Cell> cells;
+  cells.reserve(boxes.size());
+  for (const Box& box : boxes) {
+    cells.push_back({.entry_id = box.entry_id, .class_int = box.class_id});
+  }
+  return cells;
+}
+
 template <int64_t kWidth>
 std::string Grid<kWidth>::ToString(const ::puzzle::SolutionView& solution) {
   DCHECK(solution.IsValid());
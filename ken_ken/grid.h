@@ -2,7 +2,9 @@
 #define KEN_KEN_GRID_H
 
 #include <cstdint>
+#include <vector>
 
+#include "absl/types/span.h"
 #include "puzzle/problem.h"
 
 namespace ken_ken {
@@ -45,6 +47,7 @@ class Grid : public puzzle::Problem {
   virtual absl::Status AddGridPredicates(Orientation o) = 0;
 
   static std::string ToString(const ::puzzle::SolutionView& solution);
+  static std::vector<Cell> ToCells(absl::Span<const Box> boxes);
   static absl::StatusOr<Board> ToBoard(absl::string_view line);
 
   virtual absl::StatusOr<Board> GetSolutionBoard() const = 0;
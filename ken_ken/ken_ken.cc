@@ -77,25 +77,21 @@ absl::Status KenKen<kWidth>::AddSumPredicate(int val,
           std::max(count_by_entry[box.entry_id], count_by_class[box.class_id]);
       int max_cage_val = val - (min_cage - biggest_remove);
       if (max_cage_val < 9) {
-        RETURN_IF_ERROR(AddSpecificEntryPredicate(
+        // Value is 0 indexed.
+        RETURN_IF_ERROR(AddConstraint(
             absl::StrCat("Cage max for ", box, " = ", max_cage_val),
-            [box, max_cage_val](const puzzle::Entry& e) {
-              // Value is 0 indexed.
-              return e.Class(box.class_id) <= max_cage_val - 1;
-            },
-            {box.class_id}, box.entry_id));
+            puzzle::expr::Id(box.entry_id).Class(box.class_id) <=
+                max_cage_val - 1));
       }
 
       int smallest_remove = kWidth + 1 - biggest_remove;
       int min_cage_val = val - (max_cage - smallest_remove);
       if (min_cage_val > 1) {
-        RETURN_IF_ERROR(AddSpecificEntryPredicate(
+        // Value is 0 indexed.
+        RETURN_IF_ERROR(AddConstraint(
             absl::StrCat("Cage min for ", box, " = ", min_cage_val),
-            [box, min_cage_val](const puzzle::Entry& e) {
-              // Value is 0 indexed.
-              return e.Class(box.class_id) >= min_cage_val - 1;
-            },
-            {box.class_id}, box.entry_id));
+            puzzle::expr::Id(box.entry_id).Class(box.class_id) >=
+                min_cage_val - 1));
       }
     }
 
@@ -104,29 +100,11 @@ absl::Status KenKen<kWidth>::AddSumPredicate(int val,
     // constraints.
   }
 
-  if (single_entry) {
-    return AddSpecificEntryPredicate(
-        absl::StrCat("Box #", box_id),
-        [val, boxes](const puzzle::Entry& e) {
-          int sum = 0;
-          for (const Box& b : boxes) {
-            sum += e.Class(b.class_id);
-          }
-          return sum + boxes.size() == val;  // Fenceposts.
-        },
-        classes, *single_entry);
-  }
-
-  return AddPredicate(
+  // Fenceposts.
+  return AddConstraint(
       absl::StrCat("Box #", box_id),
-      [val, boxes](const puzzle::SolutionView& s) {
-        int sum = 0;
-        for (const Box& b : boxes) {
-          sum += s.Id(b.entry_id).Class(b.class_id);
-        }
-        return sum + boxes.size() == val;  // Fenceposts.
-      },
-      classes);
+      puzzle::expr::Sum(ToCells(boxes)) + static_cast<int>(boxes.size()) ==
+          val);
 }
 
 template <int64_t kWidth>
@@ -160,8 +138,6 @@ absl::Status KenKen<kWidth>::AddMulPredicate(int val,
             },
             {box.class_id, box2.class_id}, box.entry_id));
       } else {
-        std::vector<int> cols = {box.class_id};
-        if (box2.class_id != box.class_id) cols.push_back(box2.class_id);
         RETURN_IF_ERROR(AddPredicate(
             absl::StrCat("Cage factors for ", box, " * ", box2, " = ", val),
             [box, box2, val](const puzzle::SolutionView& s) {
@@ -170,34 +146,15 @@ absl::Status KenKen<kWidth>::AddMulPredicate(int val,
               factor *= s.Id(box2.entry_id).Class(box2.class_id) + 1;
               return val % factor == 0;
             },
-            cols));
+            ToCells({box, box2})));
       }
     }
   }
 
-  if (single_entry) {
-    return AddSpecificEntryPredicate(
-        absl::StrCat("Box #", box_id),
-        [val, boxes](const puzzle::Entry& e) {
-          int product = 1;
-          for (const Box& b : boxes) {
-            product *= e.Class(b.class_id) + 1;
-          }
-          return product == val;
-        },
-        classes, *single_entry);
-  }
-
-  return AddPredicate(
+  // Values are 0 indexed.
+  return AddConstraint(
       absl::StrCat("Box #", box_id),
-      [val, boxes](const puzzle::SolutionView& s) {
-        int product = 1;
-        for (const Box& b : boxes) {
-          product *= s.Id(b.entry_id).Class(b.class_id) + 1;
-        }
-        return product == val;
-      },
-      classes);
+      puzzle::expr::Product(ToCells(boxes), /*offset=*/1) == val);
 }
 
 template <int64_t kWidth>
@@ -228,7 +185,7 @@ absl::Status KenKen<kWidth>::AddSubPredicate(int val,
         int b2 = s.Id(boxes[1].entry_id).Class(boxes[1].class_id);
         return b2 - b1 == val || b1 - b2 == val;
       },
-      classes);
+      ToCells(boxes));
 }
 
 template <int64_t kWidth>
@@ -278,7 +235,7 @@ absl::Status KenKen<kWidth>::AddDivPredicate(int val,
         int b2 = s.Id(boxes[1].entry_id).Class(boxes[1].class_id) + 1;
         return b1 == val * b2 || b2 == val * b1;
       },
-      classes);
+      ToCells(boxes));
 }
 
 template <int64_t kWidth>
@@ -11,8 +11,10 @@ template <int64_t kWidth>
 class KenKen : public Grid<kWidth> {
  public:
   using Box = Grid<kWidth>::Box;
+  using ::puzzle::Solver::AddConstraint;
   using ::puzzle::Solver::AddPredicate;
   using ::puzzle::Solver::AddSpecificEntryPredicate;
+  using Grid<kWidth>::ToCells;
 
   struct Cage {
     int val;
@@ -42,6 +42,8 @@ class DraculaAndFriendsProblem
 };
 
 absl::Status DraculaAndFriendsProblem::AddPredicates() {
+  using ::puzzle::expr::Id;
+
   RETURN_IF_ERROR(AddPredicate(
       "1. One, and only one, of the vampires had the same initials "
       "of his name and of his birthplace.",
@@ -96,27 +98,19 @@ absl::Status DraculaAndFriendsProblem::AddPredicates() {
         return (in_xvi || hated_thornbrush) && !(in_xvi && hated_thornbrush);
       },
       {PLANT, CENTURY}, P::OCTAVIAN));
-  RETURN_IF_ERROR(AddPredicate(
+  RETURN_IF_ERROR(AddConstraint(
       "6. If Bogdan hated wolfsbane, then Matei lived in Buchovia.",
-      [](const puzzle::SolutionView& s) {
-        if (s.Id(P::BOGDAN).Class(PLANT) == P::WOLFSBANE) {
-          return s.Id(P::MATEI).Class(REGION) == P::BUCOVINA;
-        }
-        return true;
-      },
-      {{REGION, P::MATEI}, {PLANT, P::BOGDAN}}));
-  RETURN_IF_ERROR(AddSpecificEntryPredicate(
+      Id(P::BOGDAN).Class(PLANT) != P::WOLFSBANE ||
+          Id(P::MATEI).Class(REGION) == P::BUCOVINA));
+  RETURN_IF_ERROR(AddConstraint(
       "7a. The vampire from XIV century wasn't Octavian nor Bogdan. (Octavian)",
-      [](const puzzle::Entry& e) { return e.Class(CENTURY) != P::XIV; },
-      {CENTURY}, P::OCTAVIAN));
-  RETURN_IF_ERROR(AddSpecificEntryPredicate(
+      Id(P::OCTAVIAN).Class(CENTURY) != P::XIV));
+  RETURN_IF_ERROR(AddConstraint(
       "7b. The vampire from XIV century wasn't Octavian nor Bogdan. (Bogdan)",
-      [](const puzzle::Entry& e) { return e.Class(CENTURY) != P::XIV; },
-      {CENTURY}, P::BOGDAN));
-  RETURN_IF_ERROR(AddSpecificEntryPredicate(
+      Id(P::BOGDAN).Class(CENTURY) != P::XIV));
+  RETURN_IF_ERROR(AddConstraint(
       "8. Villagers didn't grow thornbrush against Dorian.",
-      [](const puzzle::Entry& e) { return e.Class(PLANT) != P::THORNBRUSH; },
-      {PLANT}, P::DORIAN));
+      Id(P::DORIAN).Class(PLANT) != P::THORNBRUSH));
   RETURN_IF_ERROR(AddPredicate(
       "9. Chronicles of XVII century claimed that ivy was "
       "ineffective and that Debrogea was free from vamipres.",
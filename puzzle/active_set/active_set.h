@@ -2,6 +2,7 @@
 #define PUZZLE_ACTIVE_SET_H
 
 #include "puzzle/active_set/bit_vector.h"
+#include "puzzle/active_set/hybrid.h"
 #include "puzzle/active_set/run_length.h"
 #include "puzzle/active_set/run_position.h"
 
@@ -9,6 +10,8 @@ namespace puzzle {
 
 #ifdef ACTIVE_SET_BIT_VECTOR
 using ActiveSet = ActiveSetBitVector;
+#elif defined(ACTIVE_SET_HYBRID)
+using ActiveSet = ActiveSetHybrid;
 #else
 #ifdef ACTIVE_SET_RUN_LENGTH
 using ActiveSet = ActiveSetRunLength;
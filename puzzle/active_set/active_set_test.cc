@@ -1,6 +1,7 @@
 #include "puzzle/active_set/active_set.h"
 
 #include <iostream>
+#include <random>
 
 #include "absl/log/check.h"
 #include "absl/log/log.h"
@@ -8,6 +9,8 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "puzzle/active_set/bit_vector.h"
+#include "puzzle/active_set/bit_vector_kernels.h"
+#include "puzzle/active_set/hybrid.h"
 #include "puzzle/active_set/run_length.h"
 #include "puzzle/active_set/run_position.h"
 #include "vlog.h"
@@ -22,8 +25,9 @@ namespace puzzle {
 template <typename T>
 class ActiveSetTest : public ::testing::Test {};
 
-using ActiveSetTypes = ::testing::Types<ActiveSetRunLength, ActiveSetBitVector,
-                                        ActiveSetRunPosition>;
+using ActiveSetTypes =
+    ::testing::Types<ActiveSetRunLength, ActiveSetBitVector,
+                     ActiveSetRunPosition, ActiveSetHybrid>;
 TYPED_TEST_SUITE(ActiveSetTest, ActiveSetTypes);
 
 TYPED_TEST(ActiveSetTest, EmptyIsTrivial) {
@@ -305,4 +309,85 @@ TYPED_TEST(ActiveSetTest, Empirical) {
       {3, 7, 11, 12, 13, 14, 15, 16, 17, 18, 19, 23}, 24, 24);
 }
 
+std::vector<const bit_vector_internal::Kernels*> AvailableKernels() {
+  std::vector<const bit_vector_internal::Kernels*> ret = {
+      &bit_vector_internal::ScalarKernels()};
+  if (auto* k = bit_vector_internal::Avx2Kernels()) ret.push_back(k);
+  if (auto* k = bit_vector_internal::Avx512Kernels()) ret.push_back(k);
+  return ret;
+}
+
+TEST(BitVectorKernelsTest, IntersectMatchesScalar) {
+  std::mt19937_64 rng(17);
+  for (const bit_vector_internal::Kernels* kernels : AvailableKernels()) {
+    for (int num_words = 0; num_words < 40; ++num_words) {
+      std::vector<uint64_t> a(num_words), b(num_words);
+      for (int i = 0; i < num_words; ++i) {
+        a[i] = rng();
+        b[i] = rng();
+      }
+      std::vector<uint64_t> expected = a;
+      int expected_count = bit_vector_internal::ScalarKernels().intersect(
+          expected.data(), b.data(), num_words);
+      EXPECT_EQ(kernels->intersect(a.data(), b.data(), num_words),
+                expected_count)
+          << kernels->name << " " << num_words;
+      EXPECT_EQ(a, expected) << kernels->name << " " << num_words;
+    }
+  }
+}
+
+TEST(BitVectorKernelsTest, FindWordNotEqual) {
+  for (const bit_vector_internal::Kernels* kernels : AvailableKernels()) {
+    for (uint64_t skip : {uint64_t{0}, BitVector::kAllBitsSet}) {
+      for (int num_words = 0; num_words < 40; ++num_words) {
+        std::vector<uint64_t> buf(num_words, skip);
+        for (int begin = 0; begin <= num_words; ++begin) {
+          EXPECT_EQ(kernels->find_word_not_equal(buf.data(), begin, num_words,
+                                                 skip),
+                    num_words)
+              << kernels->name;
+        }
+        for (int diff = 0; diff < num_words; ++diff) {
+          buf[diff] = skip ^ (1ull << (diff % 64));
+          for (int begin = 0; begin <= num_words; ++begin) {
+            EXPECT_EQ(kernels->find_word_not_equal(buf.data(), begin,
+                                                   num_words, skip),
+                      begin <= diff ? diff : num_words)
+                << kernels->name << " " << begin << " " << diff;
+          }
+          buf[diff] = skip;
+        }
+      }
+    }
+  }
+}
+
+TEST(BitVectorTest, GetRangeMatchesBits) {
+  std::mt19937 rng(17);
+  for (int num_bits : {1, 63, 64, 65, 128, 200, 511, 512, 1000}) {
+    // Long runs exercise the whole-word skipping in GetRange.
+    for (int run_scale : {1, 50, 300}) {
+      std::vector<bool> bits;
+      bool value = false;
+      while (bits.size() < num_bits) {
+        int run = 1 + rng() % run_scale;
+        for (int i = 0; i < run && bits.size() < num_bits; ++i) {
+          bits.push_back(value);
+        }
+        value = !value;
+      }
+      BitVector::UniquePtr bv = BitVector::Make(num_bits);
+      for (int i = 0; i < num_bits; ++i) bv->SetBit(bits[i], i);
+      for (int i = 0; i < num_bits; ++i) {
+        int expected = 0;
+        while (i + expected < num_bits && bits[i + expected] == bits[i]) {
+          ++expected;
+        }
+        ASSERT_EQ(bv->GetRange(i), expected) << num_bits << " @" << i;
+      }
+    }
+  }
+}
+
 }  // namespace puzzle
@@ -1,16 +1,14 @@
 #include "puzzle/active_set/bit_vector.h"
 
 #include <algorithm>
+#include <bit>
 #include <iostream>
-#ifdef _MSC_VER
-#include <intrin.h>
-#include <nmmintrin.h>
-#endif
 
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
+#include "puzzle/active_set/bit_vector_kernels.h"
 #include "vlog.h"
 
 namespace puzzle {
@@ -51,43 +49,24 @@ void BitVector::SetRange(bool value, Word start, Word end) {
 
 int BitVector::GetRange(Word position) const {
   DCHECK_LT(position, num_bits_);
-  Word read_word = position / kBitsPerWord;
-  Word end_word = num_bits_ / kBitsPerWord;
+  const Word start_word = position / kBitsPerWord;
   const Word start_bit = position % kBitsPerWord;
-  const bool is_run_set = buf_[read_word] & (1ull << start_bit);
-  Word mask = kAllBitsSet << start_bit;
-  Word run_size = -start_bit;
-  for (; read_word != end_word; ++read_word) {
-    Word read_bits = mask & (is_run_set ? ~buf_[read_word] : buf_[read_word]);
-    if (read_bits) {
-      static_assert(sizeof(Word) == 8,
-                    "ffs implementation calls uint64_t override");
-#ifdef _MSC_VER
-      unsigned long index;
-      CHECK(_BitScanForward64(&index, read_bits));
-      run_size += index;
-#else
-      run_size += __builtin_ffsll(read_bits) - 1;
-#endif
-      return run_size;
-    }
-    run_size += kBitsPerWord;
-    mask = kAllBitsSet;
+  const bool is_run_set = buf_[start_word] & (1ull << start_bit);
+  // XOR-ing with `flip` leaves bits in the run cleared, so the run ends at the
+  // first set bit.
+  const Word flip = is_run_set ? kAllBitsSet : 0;
+  Word read_word = start_word;
+  Word read_bits = (buf_[read_word] ^ flip) & (kAllBitsSet << start_bit);
+  if (!read_bits) {
+    read_word = bit_vector_internal::SelectedKernels().find_word_not_equal(
+        buf_, start_word + 1, num_words_, flip);
+    if (read_word == num_words_) return num_bits_ - position;
+    read_bits = buf_[read_word] ^ flip;
   }
-  mask &= ~(kAllBitsSet << (num_bits_ % kBitsPerWord));
-  Word read_bits = mask & (is_run_set ? ~buf_[read_word] : buf_[read_word]);
-  if (read_bits) {
-#ifdef _MSC_VER
-    unsigned long index;
-    CHECK(_BitScanForward64(&index, read_bits));
-    run_size += index;
-#else
-    run_size += __builtin_ffsll(read_bits) - 1;
-#endif
-  } else {
-    run_size += num_bits_ % kBitsPerWord;
-  }
-  return run_size;
+  // Bits past `num_bits_` in the last word are unspecified, so clamp.
+  const Word run_end =
+      read_word * kBitsPerWord + std::countr_zero(read_bits);
+  return std::min(run_end, num_bits_) - position;
 }
 
 std::string BitVector::DebugString() const {
@@ -101,24 +80,12 @@ std::string BitVector::DebugString() const {
 
 int BitVector::Intersect(const BitVector* other) {
   CHECK_EQ(num_bits_, other->num_bits_) << "Mismatched lengths not supported";
-  int ret = 0;
-  for (int i = 0; i < num_words(); ++i) {
-    buf_[i] &= other->buf_[i];
-#ifdef _MSC_VER
-    ret += _mm_popcnt_u64(buf_[i]);
-#else
-    ret += __builtin_popcountll(buf_[i]);
-#endif
-  }
+  int ret = bit_vector_internal::SelectedKernels().intersect(
+      buf_, other->buf_, num_words());
   if (num_words() > 0 && (num_bits() % kBitsPerWord) != 0) {
     // Don't count the bits in the last word past the end.
-#ifdef _MSC_VER
-    ret -= _mm_popcnt_u64(buf_[num_words() - 1] &
-                          (kAllBitsSet << (num_bits() % kBitsPerWord)));
-#else
-    ret -= __builtin_popcountll(buf_[num_words() - 1] &
-                                (kAllBitsSet << (num_bits() % kBitsPerWord)));
-#endif
+    ret -= std::popcount(buf_[num_words() - 1] &
+                         (kAllBitsSet << (num_bits() % kBitsPerWord)));
   }
   return ret;
 }
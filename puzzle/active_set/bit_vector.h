@@ -149,6 +149,15 @@ class ActiveSetBitVector {
     return static_cast<double>(matches()) / total();
   }
 
+  // Releases storage reserved beyond what the set uses. The bit vector is
+  // allocated at its exact size, so there is nothing to release.
+  void ShrinkToFit() {}
+
+  // Number of heap bytes owned by this set (excluding sizeof(*this)).
+  int64_t StorageBytes() const {
+    return sizeof(BitVector) + matches_->num_words() * sizeof(BitVector::Word);
+  }
+
   ActiveSetBitVectorIterator GetIterator() const {
     return ActiveSetBitVectorIterator(matches_.get());
   }
@@ -0,0 +1,87 @@
+#include <random>
+
+#include "benchmark/benchmark.h"
+#include "puzzle/active_set/bit_vector.h"
+#include "puzzle/active_set/bit_vector_kernels.h"
+
+namespace puzzle {
+
+// 9!, the number of permutations of a sudoku row.
+static constexpr int kNumBits = 362880;
+
+static const bit_vector_internal::Kernels* KernelsForIndex(int index) {
+  switch (index) {
+    case 0:
+      return &bit_vector_internal::ScalarKernels();
+    case 1:
+      return bit_vector_internal::Avx2Kernels();
+    case 2:
+      return bit_vector_internal::Avx512Kernels();
+  }
+  return nullptr;
+}
+
+static std::vector<uint64_t> RandomWords(int num_words, int seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<uint64_t> ret(num_words);
+  for (uint64_t& w : ret) w = rng() | rng();
+  return ret;
+}
+
+static void BM_Intersect(benchmark::State& state) {
+  const bit_vector_internal::Kernels* kernels = KernelsForIndex(state.range(0));
+  if (kernels == nullptr) {
+    state.SkipWithError("Kernels not supported");
+    return;
+  }
+  state.SetLabel(kernels->name);
+  const int num_words = (kNumBits + 63) / 64;
+  std::vector<uint64_t> a = RandomWords(num_words, 1);
+  std::vector<uint64_t> b = RandomWords(num_words, 2);
+  for (auto _ : state) {
+    std::vector<uint64_t> dest = a;
+    benchmark::DoNotOptimize(
+        kernels->intersect(dest.data(), b.data(), num_words));
+  }
+  state.SetBytesProcessed(state.iterations() * num_words * sizeof(uint64_t));
+}
+
+BENCHMARK(BM_Intersect)->DenseRange(0, 2);
+
+static void BM_FindWordNotEqual(benchmark::State& state) {
+  const bit_vector_internal::Kernels* kernels = KernelsForIndex(state.range(0));
+  if (kernels == nullptr) {
+    state.SkipWithError("Kernels not supported");
+    return;
+  }
+  state.SetLabel(kernels->name);
+  const int num_words = (kNumBits + 63) / 64;
+  std::vector<uint64_t> buf(num_words, 0);
+  buf.back() = 1;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        kernels->find_word_not_equal(buf.data(), 0, num_words, 0));
+  }
+  state.SetBytesProcessed(state.iterations() * num_words * sizeof(uint64_t));
+}
+
+BENCHMARK(BM_FindWordNotEqual)->DenseRange(0, 2);
+
+// Walks every run of a sparse set, as ActiveSetBitVectorIterator does.
+static void BM_GetRangeSparse(benchmark::State& state) {
+  BitVector::UniquePtr bv = BitVector::Make(kNumBits);
+  bv->SetRange(false, 0, kNumBits);
+  for (int i = 0; i < kNumBits; i += state.range(0)) bv->SetBit(true, i);
+  for (auto _ : state) {
+    int runs = 0;
+    for (int offset = 0; offset < kNumBits; offset += bv->GetRange(offset)) {
+      ++runs;
+    }
+    benchmark::DoNotOptimize(runs);
+  }
+  state.SetLabel(bit_vector_internal::SelectedKernels().name);
+}
+
+BENCHMARK(BM_GetRangeSparse)->Arg(64)->Arg(4096)->Arg(65536);
+
+}  // namespace puzzle
@@ -0,0 +1,169 @@
+#include "puzzle/active_set/bit_vector_kernels.h"
+
+#include <bit>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PUZZLE_BIT_VECTOR_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace puzzle {
+namespace bit_vector_internal {
+
+namespace {
+
+int IntersectScalar(Word* a, const Word* b, int num_words) {
+  int ret = 0;
+  for (int i = 0; i < num_words; ++i) {
+    a[i] &= b[i];
+    ret += std::popcount(a[i]);
+  }
+  return ret;
+}
+
+int FindWordNotEqualScalar(const Word* buf, int begin, int end, Word skip) {
+  for (int i = begin; i < end; ++i) {
+    if (buf[i] != skip) return i;
+  }
+  return end;
+}
+
+#ifdef PUZZLE_BIT_VECTOR_X86_KERNELS
+
+// AVX2 has no vector popcount, so bytes are counted with a nibble lookup table
+// (vpshufb) and summed per 64-bit lane with vpsadbw.
+__attribute__((target("avx2,popcnt"))) int IntersectAvx2(Word* a,
+                                                         const Word* b,
+                                                         int num_words) {
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,  //
+                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+  __m256i counts = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 4 <= num_words; i += 4) {
+    __m256i* a_ptr = reinterpret_cast<__m256i*>(a + i);
+    const __m256i* b_ptr = reinterpret_cast<const __m256i*>(b + i);
+    __m256i v =
+        _mm256_and_si256(_mm256_loadu_si256(a_ptr), _mm256_loadu_si256(b_ptr));
+    _mm256_storeu_si256(a_ptr, v);
+    __m256i lo = _mm256_and_si256(v, low_nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+    __m256i byte_counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                          _mm256_shuffle_epi8(lookup, hi));
+    counts = _mm256_add_epi64(
+        counts, _mm256_sad_epu8(byte_counts, _mm256_setzero_si256()));
+  }
+  int ret = _mm256_extract_epi64(counts, 0) + _mm256_extract_epi64(counts, 1) +
+            _mm256_extract_epi64(counts, 2) + _mm256_extract_epi64(counts, 3);
+  for (; i < num_words; ++i) {
+    a[i] &= b[i];
+    ret += _mm_popcnt_u64(a[i]);
+  }
+  return ret;
+}
+
+__attribute__((target("avx2"))) int FindWordNotEqualAvx2(const Word* buf,
+                                                         int begin, int end,
+                                                         Word skip) {
+  const __m256i skip_v = _mm256_set1_epi64x(skip);
+  int i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i));
+    int equal_mask = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(v, skip_v)));
+    if (equal_mask != 0xf) {
+      return i + std::countr_zero(static_cast<unsigned>(~equal_mask));
+    }
+  }
+  for (; i < end; ++i) {
+    if (buf[i] != skip) return i;
+  }
+  return end;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) int IntersectAvx512(
+    Word* a, const Word* b, int num_words) {
+  __m512i counts = _mm512_setzero_si512();
+  int i = 0;
+  for (; i + 8 <= num_words; i += 8) {
+    __m512i v = _mm512_and_si512(_mm512_loadu_si512(a + i),
+                                 _mm512_loadu_si512(b + i));
+    _mm512_storeu_si512(a + i, v);
+    counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(v));
+  }
+  if (i < num_words) {
+    const __mmask8 tail = (1u << (num_words - i)) - 1;
+    __m512i v = _mm512_and_si512(_mm512_maskz_loadu_epi64(tail, a + i),
+                                 _mm512_maskz_loadu_epi64(tail, b + i));
+    _mm512_mask_storeu_epi64(a + i, tail, v);
+    counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(v));
+  }
+  return _mm512_reduce_add_epi64(counts);
+}
+
+__attribute__((target("avx512f"))) int FindWordNotEqualAvx512(const Word* buf,
+                                                              int begin,
+                                                              int end,
+                                                              Word skip) {
+  const __m512i skip_v = _mm512_set1_epi64(skip);
+  int i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __mmask8 not_equal =
+        _mm512_cmpneq_epu64_mask(_mm512_loadu_si512(buf + i), skip_v);
+    if (not_equal) return i + std::countr_zero(static_cast<unsigned>(not_equal));
+  }
+  if (i < end) {
+    const __mmask8 tail = (1u << (end - i)) - 1;
+    __mmask8 not_equal = _mm512_mask_cmpneq_epu64_mask(
+        tail, _mm512_maskz_loadu_epi64(tail, buf + i), skip_v);
+    if (not_equal) return i + std::countr_zero(static_cast<unsigned>(not_equal));
+  }
+  return end;
+}
+
+#endif  // PUZZLE_BIT_VECTOR_X86_KERNELS
+
+}  // namespace
+
+const Kernels& ScalarKernels() {
+  static const Kernels kScalar = {"scalar", &IntersectScalar,
+                                  &FindWordNotEqualScalar};
+  return kScalar;
+}
+
+const Kernels* Avx2Kernels() {
+#ifdef PUZZLE_BIT_VECTOR_X86_KERNELS
+  static const Kernels kAvx2 = {"avx2", &IntersectAvx2, &FindWordNotEqualAvx2};
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    return &kAvx2;
+  }
+#endif
+  return nullptr;
+}
+
+const Kernels* Avx512Kernels() {
+#ifdef PUZZLE_BIT_VECTOR_X86_KERNELS
+  static const Kernels kAvx512 = {"avx512", &IntersectAvx512,
+                                  &FindWordNotEqualAvx512};
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vpopcntdq") &&
+      __builtin_cpu_supports("popcnt")) {
+    return &kAvx512;
+  }
+#endif
+  return nullptr;
+}
+
+const Kernels& SelectedKernels() {
+  static const Kernels& selected = []() -> const Kernels& {
+    if (const Kernels* k = Avx512Kernels()) return *k;
+    if (const Kernels* k = Avx2Kernels()) return *k;
+    return ScalarKernels();
+  }();
+  return selected;
+}
+
+}  // namespace bit_vector_internal
+}  // namespace puzzle
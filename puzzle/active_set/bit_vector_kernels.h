@@ -0,0 +1,39 @@
+#ifndef PUZZLE_ACTIVE_SET_BIT_VECTOR_KERNELS_H
+#define PUZZLE_ACTIVE_SET_BIT_VECTOR_KERNELS_H
+
+#include <cstdint>
+
+namespace puzzle {
+namespace bit_vector_internal {
+
+using Word = uint64_t;
+
+// Word-array kernels used by BitVector, with SIMD implementations selected at
+// runtime based on the capabilities of the running CPU.
+struct Kernels {
+  const char* name;
+
+  // Performs `a[i] &= b[i]` for each i in [0, num_words) and returns the
+  // number of bits set in `a` afterwards.
+  int (*intersect)(Word* a, const Word* b, int num_words);
+
+  // Returns the index of the first word in [begin, end) of `buf` which is not
+  // equal to `skip`, or `end` if there is no such word.
+  int (*find_word_not_equal)(const Word* buf, int begin, int end, Word skip);
+};
+
+// Portable implementation, always available.
+const Kernels& ScalarKernels();
+
+// Returns nullptr if the compiler or the running CPU lacks support.
+const Kernels* Avx2Kernels();
+const Kernels* Avx512Kernels();
+
+// Returns the fastest kernels supported by the running CPU. The choice is made
+// on first call.
+const Kernels& SelectedKernels();
+
+}  // namespace bit_vector_internal
+}  // namespace puzzle
+
+#endif  // PUZZLE_ACTIVE_SET_BIT_VECTOR_KERNELS_H
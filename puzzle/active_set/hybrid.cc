@@ -0,0 +1,426 @@
+#include "puzzle/active_set/hybrid.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "puzzle/active_set/bit_vector_kernels.h"
+#include "vlog.h"
+
+namespace puzzle {
+
+namespace {
+
+constexpr uint64_t kAllBitsSet = 0xffffffffffffffffull;
+
+std::vector<int> SortFlatHashSet(const absl::flat_hash_set<int>& unsorted) {
+  std::vector<int> sorted;
+  sorted.reserve(unsorted.size());
+  std::copy(unsorted.begin(), unsorted.end(), std::back_inserter(sorted));
+  std::sort(sorted.begin(), sorted.end());
+  return sorted;
+}
+
+int BitmapWords(int size) { return (size + 63) / 64; }
+
+// Sets bits [begin, end) of `bitmap` to the corresponding bits of `src`.
+void CopyBitRange(const uint64_t* src, int begin, int end, uint64_t* bitmap) {
+  if (begin >= end) return;
+  int word = begin / 64;
+  const int end_word = (end - 1) / 64;
+  uint64_t mask = kAllBitsSet << (begin % 64);
+  for (; word < end_word; ++word) {
+    bitmap[word] |= src[word] & mask;
+    mask = kAllBitsSet;
+  }
+  mask &= kAllBitsSet >> (63 - (end - 1) % 64);
+  bitmap[word] |= src[word] & mask;
+}
+
+}  // namespace
+
+// static
+ActiveSetHybridContainer ActiveSetHybridContainer::FromRuns(
+    absl::Span<const std::pair<int, int>> runs, int size) {
+  ActiveSetHybridContainer ret;
+  ret.size_ = size;
+  for (const auto& [begin, end] : runs) ret.cardinality_ += end - begin;
+
+  // Pick the layout with the smallest storage.
+  const int array_bytes = ret.cardinality_ * sizeof(uint16_t);
+  const int run_bytes = runs.size() * 2 * sizeof(uint16_t);
+  const int bitmap_bytes = BitmapWords(size) * sizeof(uint64_t);
+  if (run_bytes <= array_bytes && run_bytes <= bitmap_bytes) {
+    ret.kind_ = Kind::kRun;
+    ret.data_.reserve(runs.size() * 2);
+    for (const auto& [begin, end] : runs) {
+      ret.data_.push_back(begin);
+      ret.data_.push_back(end - 1);
+    }
+  } else if (array_bytes <= bitmap_bytes) {
+    ret.kind_ = Kind::kArray;
+    ret.data_.reserve(ret.cardinality_);
+    for (const auto& [begin, end] : runs) {
+      for (int i = begin; i < end; ++i) ret.data_.push_back(i);
+    }
+  } else {
+    ret.kind_ = Kind::kBitmap;
+    ret.bitmap_.resize(BitmapWords(size), 0);
+    for (const auto& [begin, end] : runs) {
+      int word = begin / 64;
+      const int end_word = (end - 1) / 64;
+      uint64_t mask = kAllBitsSet << (begin % 64);
+      for (; word < end_word; ++word) {
+        ret.bitmap_[word] |= mask;
+        mask = kAllBitsSet;
+      }
+      ret.bitmap_[word] |= mask & (kAllBitsSet >> (63 - (end - 1) % 64));
+    }
+  }
+  return ret;
+}
+
+void ActiveSetHybridContainer::Optimize(int num_runs) {
+  const int array_bytes = cardinality_ * sizeof(uint16_t);
+  const int run_bytes = num_runs * 2 * sizeof(uint16_t);
+  const int bitmap_bytes = BitmapWords(size_) * sizeof(uint64_t);
+  Kind best = Kind::kBitmap;
+  if (run_bytes <= array_bytes && run_bytes <= bitmap_bytes) {
+    best = Kind::kRun;
+  } else if (array_bytes <= bitmap_bytes) {
+    best = Kind::kArray;
+  }
+  if (best == kind_) return;
+
+  std::vector<std::pair<int, int>> runs;
+  runs.reserve(num_runs);
+  ForEachRun([&](int begin, int end) { runs.emplace_back(begin, end); });
+  *this = FromRuns(runs, size_);
+}
+
+// static
+ActiveSetHybridContainer ActiveSetHybridContainer::Intersection(
+    const ActiveSetHybridContainer& a, const ActiveSetHybridContainer& b) {
+  DCHECK_EQ(a.size_, b.size_);
+  if (a.empty() || b.full()) return a;
+  if (b.empty() || a.full()) return b;
+
+  if (a.kind_ == Kind::kArray || b.kind_ == Kind::kArray) {
+    const ActiveSetHybridContainer& array = a.kind_ == Kind::kArray ? a : b;
+    const ActiveSetHybridContainer& other = a.kind_ == Kind::kArray ? b : a;
+    ActiveSetHybridContainer ret;
+    ret.kind_ = Kind::kArray;
+    ret.size_ = a.size_;
+    int hint = 0;
+    for (uint16_t v : array.data_) {
+      hint = other.Seek(v, hint);
+      if (other.Contains(v, hint)) ret.data_.push_back(v);
+    }
+    ret.cardinality_ = ret.data_.size();
+    // A subset of an array is never better stored as a bitmap, and rarely
+    // has few enough runs to be worth converting.
+    return ret;
+  }
+
+  if (a.kind_ == Kind::kRun && b.kind_ == Kind::kRun) {
+    std::vector<std::pair<int, int>> runs;
+    int i = 0;
+    int j = 0;
+    while (i < a.data_.size() && j < b.data_.size()) {
+      const int begin = std::max(a.data_[i], b.data_[j]);
+      const int last = std::min(a.data_[i + 1], b.data_[j + 1]);
+      if (begin <= last) runs.emplace_back(begin, last + 1);
+      if (a.data_[i + 1] < b.data_[j + 1]) {
+        i += 2;
+      } else {
+        j += 2;
+      }
+    }
+    return FromRuns(runs, a.size_);
+  }
+
+  ActiveSetHybridContainer ret;
+  ret.kind_ = Kind::kBitmap;
+  ret.size_ = a.size_;
+  if (a.kind_ == Kind::kBitmap && b.kind_ == Kind::kBitmap) {
+    ret.bitmap_ = a.bitmap_;
+    ret.cardinality_ = bit_vector_internal::SelectedKernels().intersect(
+        ret.bitmap_.data(), b.bitmap_.data(), ret.bitmap_.size());
+  } else {
+    // One bitmap, one run container: keep only the bits within the runs.
+    const ActiveSetHybridContainer& bitmap =
+        a.kind_ == Kind::kBitmap ? a : b;
+    const ActiveSetHybridContainer& runs = a.kind_ == Kind::kBitmap ? b : a;
+    ret.bitmap_.resize(bitmap.bitmap_.size(), 0);
+    for (int i = 0; i < runs.data_.size(); i += 2) {
+      CopyBitRange(bitmap.bitmap_.data(), runs.data_[i], runs.data_[i + 1] + 1,
+                   ret.bitmap_.data());
+    }
+    for (uint64_t w : ret.bitmap_) ret.cardinality_ += std::popcount(w);
+  }
+
+  int num_runs = 0;
+  uint64_t carry = 0;
+  for (uint64_t w : ret.bitmap_) {
+    num_runs += std::popcount(w & ~((w << 1) | carry));
+    carry = w >> 63;
+  }
+  ret.Optimize(num_runs);
+  return ret;
+}
+
+int ActiveSetHybridContainer::Seek(int offset, int hint) const {
+  switch (kind_) {
+    case Kind::kArray: {
+      if (hint >= data_.size() || data_[hint] >= offset) return hint;
+      return std::lower_bound(data_.begin() + hint, data_.end(), offset) -
+             data_.begin();
+    }
+    case Kind::kRun: {
+      // Find the first run whose last value is at least `offset`.
+      int lo = hint;
+      int hi = data_.size() / 2;
+      if (lo >= hi || data_[2 * lo + 1] >= offset) return lo;
+      while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (data_[2 * mid + 1] < offset) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      return lo;
+    }
+    case Kind::kBitmap:
+      return 0;
+  }
+  return 0;
+}
+
+bool ActiveSetHybridContainer::Contains(int offset, int hint) const {
+  DCHECK_LT(offset, size_);
+  switch (kind_) {
+    case Kind::kArray:
+      return hint < data_.size() && data_[hint] == offset;
+    case Kind::kRun:
+      return 2 * hint < data_.size() && data_[2 * hint] <= offset;
+    case Kind::kBitmap:
+      return bitmap_[offset / 64] & (1ull << (offset % 64));
+  }
+  return false;
+}
+
+int ActiveSetHybridContainer::RunEnd(int offset, int hint) const {
+  DCHECK_LT(offset, size_);
+  switch (kind_) {
+    case Kind::kArray: {
+      if (!Contains(offset, hint)) {
+        return hint < data_.size() ? data_[hint] : size_;
+      }
+      int end = offset + 1;
+      for (int i = hint + 1; i < data_.size() && data_[i] == end; ++i) ++end;
+      return end;
+    }
+    case Kind::kRun: {
+      if (!Contains(offset, hint)) {
+        return 2 * hint < data_.size() ? data_[2 * hint] : size_;
+      }
+      return data_[2 * hint + 1] + 1;
+    }
+    case Kind::kBitmap: {
+      const uint64_t flip = Contains(offset, hint) ? kAllBitsSet : 0;
+      int word = offset / 64;
+      uint64_t bits = (bitmap_[word] ^ flip) & (kAllBitsSet << (offset % 64));
+      if (!bits) {
+        word = bit_vector_internal::SelectedKernels().find_word_not_equal(
+            bitmap_.data(), word + 1, bitmap_.size(), flip);
+        if (word == bitmap_.size()) return size_;
+        bits = bitmap_[word] ^ flip;
+      }
+      return std::min(word * 64 + std::countr_zero(bits), size_);
+    }
+  }
+  return size_;
+}
+
+std::string ActiveSetHybridContainer::DebugString() const {
+  switch (kind_) {
+    case Kind::kArray:
+      return absl::StrCat("array{", absl::StrJoin(data_, ","), "}");
+    case Kind::kRun: {
+      std::string ret = "run{";
+      for (int i = 0; i < data_.size(); i += 2) {
+        absl::StrAppend(&ret, i == 0 ? "" : ",", data_[i], "-", data_[i + 1]);
+      }
+      return absl::StrCat(ret, "}");
+    }
+    case Kind::kBitmap:
+      return absl::StrCat("bitmap{cardinality:", cardinality_, "}");
+  }
+  return "";
+}
+
+int ActiveSetHybridIterator::RunSize() const {
+  if (container_ >= containers_.size()) return 0;
+  const ActiveSetHybridContainer& container = containers_[container_];
+  const int local = offset_ - container_ * ActiveSetHybridContainer::kSize;
+  const bool run_value = container.Contains(local, hint_);
+  const int end = container.RunEnd(local, hint_);
+  int ret = end - local;
+  if (end < container.size()) return ret;
+
+  // The run continues into subsequent containers.
+  for (int i = container_ + 1; i < containers_.size(); ++i) {
+    const ActiveSetHybridContainer& next = containers_[i];
+    if (run_value ? next.full() : next.empty()) {
+      ret += next.size();
+      continue;
+    }
+    if (next.Contains(0, /*hint=*/0) == run_value) {
+      ret += next.RunEnd(0, /*hint=*/0);
+    }
+    break;
+  }
+  return ret;
+}
+
+void ActiveSetHybridIterator::Advance(int n) {
+  offset_ += n;
+  if (offset_ >= total_) {
+    offset_ = total_;
+    container_ = containers_.size();
+    return;
+  }
+  const int container = offset_ / ActiveSetHybridContainer::kSize;
+  if (container != container_) {
+    container_ = container;
+    hint_ = 0;
+  }
+  hint_ = containers_[container_].Seek(
+      offset_ - container_ * ActiveSetHybridContainer::kSize, hint_);
+}
+
+std::string ActiveSetHybridIterator::DebugString() const {
+  return absl::StrCat("offset: ", offset_, "; ", "total: ", total_, "; ",
+                      "container: ", container_, "; ", "hint: ", hint_);
+}
+
+// static
+ActiveSetHybrid ActiveSetHybridBuilder::FromPositions(
+    const absl::flat_hash_set<int>& positions, int max_position) {
+  return FromPositions(SortFlatHashSet(positions), max_position);
+}
+
+// static
+ActiveSetHybrid ActiveSetHybridBuilder::FromPositions(
+    const std::initializer_list<int>& positions, int max_position) {
+  return FromPositions(absl::flat_hash_set<int>(positions), max_position);
+}
+
+// static
+ActiveSetHybrid ActiveSetHybridBuilder::FromPositions(
+    const std::vector<int>& positions, int max_position) {
+  ActiveSetHybridBuilder builder(max_position);
+  for (auto p : positions) {
+    if (p < 0) continue;
+    if (p >= max_position) break;
+    builder.AddBlockTo(false, p);
+    builder.Add(true);
+  }
+  builder.AddBlockTo(false, max_position);
+  return builder.DoneAdding();
+}
+
+void ActiveSetHybrid::Intersect(const ActiveSetHybrid& other) {
+  if (other.is_trivial()) return;
+  if (is_trivial()) {
+    *this = other;
+    return;
+  }
+  CHECK_EQ(total_, other.total_) << "Mismatched lengths not supported";
+  matches_count_ = 0;
+  for (int i = 0; i < containers_.size(); ++i) {
+    containers_[i] = ActiveSetHybridContainer::Intersection(
+        containers_[i], other.containers_[i]);
+    matches_count_ += containers_[i].cardinality();
+  }
+}
+
+void ActiveSetHybrid::ShrinkToFit() {
+  containers_.shrink_to_fit();
+  for (ActiveSetHybridContainer& container : containers_) {
+    container.ShrinkToFit();
+  }
+}
+
+int64_t ActiveSetHybrid::StorageBytes() const {
+  int64_t ret = containers_.capacity() * sizeof(ActiveSetHybridContainer);
+  for (const ActiveSetHybridContainer& container : containers_) {
+    ret += container.StorageBytes();
+  }
+  return ret;
+}
+
+std::string ActiveSetHybrid::DebugString() const {
+  return absl::StrCat(
+      "{total:", total_, "; containers: {",
+      absl::StrJoin(containers_, ", ",
+                    [](std::string* out, const ActiveSetHybridContainer& c) {
+                      absl::StrAppend(out, c.DebugString());
+                    }),
+      "}}");
+}
+
+std::vector<int> ActiveSetHybrid::EnabledValues() const {
+  std::vector<int> ret;
+  for (int i = 0; i < containers_.size(); ++i) {
+    const int base = i * ActiveSetHybridContainer::kSize;
+    containers_[i].ForEachRun([&](int begin, int end) {
+      for (int v = begin; v < end; ++v) ret.push_back(base + v);
+    });
+  }
+  return ret;
+}
+
+std::string ActiveSetHybrid::DebugValues() const {
+  return absl::StrCat("{", absl::StrJoin(EnabledValues(), ", "), "}");
+}
+
+void ActiveSetHybridBuilder::AddBlock(bool match, int size) {
+  while (size > 0) {
+    DCHECK_LT(offset_, set_.total_);
+    const int base = set_.containers_.size() * ActiveSetHybridContainer::kSize;
+    const int container_end =
+        std::min(base + ActiveSetHybridContainer::kSize, set_.total_);
+    const int n = std::min(size, container_end - offset_);
+    if (match) {
+      const int begin = offset_ - base;
+      if (!runs_.empty() && runs_.back().second == begin) {
+        runs_.back().second += n;
+      } else {
+        runs_.emplace_back(begin, begin + n);
+      }
+      set_.matches_count_ += n;
+    }
+    offset_ += n;
+    size -= n;
+    if (offset_ == container_end) FlushContainer();
+  }
+}
+
+void ActiveSetHybridBuilder::FlushContainer() {
+  const int base = set_.containers_.size() * ActiveSetHybridContainer::kSize;
+  set_.containers_.push_back(
+      ActiveSetHybridContainer::FromRuns(runs_, offset_ - base));
+  runs_.clear();
+}
+
+ActiveSetHybrid ActiveSetHybridBuilder::DoneAdding() {
+  CHECK_EQ(offset_, set_.total_);
+  return std::move(set_);
+}
+
+}  // namespace puzzle
@@ -0,0 +1,268 @@
+#ifndef PUZZLE_ACTIVE_SET_HYBRID_H
+#define PUZZLE_ACTIVE_SET_HYBRID_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/types/span.h"
+
+namespace puzzle {
+
+// Stores the true values of a single chunk of an ActiveSetHybrid in whichever
+// of three layouts is smallest for its content (as in Roaring bitmaps):
+//   * kArray: sorted offsets of the true values.
+//   * kRun: (first, last) offset pairs of the runs of true values.
+//   * kBitmap: one bit per offset.
+class ActiveSetHybridContainer {
+ public:
+  enum class Kind { kArray, kRun, kBitmap };
+
+  // Number of values covered by each container (except possibly the last
+  // container of a set).
+  static constexpr int kSize = 1 << 16;
+
+  // Constructs a container of `size` values where the values in the half-open
+  // ranges `runs` are true. `runs` must be sorted and non-adjacent.
+  static ActiveSetHybridContainer FromRuns(
+      absl::Span<const std::pair<int, int>> runs, int size);
+
+  static ActiveSetHybridContainer Intersection(
+      const ActiveSetHybridContainer& a, const ActiveSetHybridContainer& b);
+
+  Kind kind() const { return kind_; }
+  int size() const { return size_; }
+  int cardinality() const { return cardinality_; }
+  bool empty() const { return cardinality_ == 0; }
+  bool full() const { return cardinality_ == size_; }
+
+  // Returns a hint for Contains and RunEnd at `offset`. Hints are monotonic in
+  // `offset`, so a caller moving forward may pass its previous hint as `hint`
+  // to resume the search from there.
+  int Seek(int offset, int hint = 0) const;
+
+  bool Contains(int offset, int hint) const;
+
+  // Returns the end of the run of values equal to `Contains(offset, hint)`
+  // which includes `offset`, capped at size().
+  int RunEnd(int offset, int hint) const;
+
+  // Calls `fn(begin, end)` for each maximal half-open range of true values.
+  template <typename Fn>
+  void ForEachRun(Fn fn) const;
+
+  void ShrinkToFit() {
+    data_.shrink_to_fit();
+    bitmap_.shrink_to_fit();
+  }
+
+  // Number of bytes used by the container's storage.
+  int64_t StorageBytes() const {
+    return data_.capacity() * sizeof(uint16_t) +
+           bitmap_.capacity() * sizeof(uint64_t);
+  }
+
+  std::string DebugString() const;
+
+ private:
+  ActiveSetHybridContainer() = default;
+
+  // Re-encodes the container in the smallest layout for `num_runs` runs.
+  void Optimize(int num_runs);
+
+  Kind kind_ = Kind::kArray;
+  int size_ = 0;
+  int cardinality_ = 0;
+
+  // Values for kArray, or (first, last) pairs for kRun.
+  std::vector<uint16_t> data_;
+
+  // Bits for kBitmap. Bits at or beyond `size_` are zero.
+  std::vector<uint64_t> bitmap_;
+};
+
+class ActiveSetHybridIterator {
+ public:
+  ActiveSetHybridIterator(absl::Span<const ActiveSetHybridContainer> containers,
+                          int total)
+      : containers_(containers), total_(total) {}
+
+  int offset() const { return offset_; }
+  int total() const { return total_; }
+
+  bool value() const {
+    if (container_ >= containers_.size()) return true;
+    return containers_[container_].Contains(
+        offset_ - container_ * ActiveSetHybridContainer::kSize, hint_);
+  }
+
+  bool more() const { return offset() < total(); }
+
+  int RunSize() const;
+
+  // Moves the iterator the next 'block_size' values.
+  void Advance(int n);
+
+  std::string DebugString() const;
+
+ private:
+  absl::Span<const ActiveSetHybridContainer> containers_;
+  int container_ = 0;
+  int hint_ = 0;
+  int offset_ = 0;
+  int total_ = 0;
+};
+
+// Forward declare for using ActiveSetHybrid::Builder.
+class ActiveSetHybridBuilder;
+
+// ActiveSet implementation which splits the values into chunks of
+// ActiveSetHybridContainer::kSize and picks the layout of each chunk based on
+// its content, so that very selective sets stay small and dense sets stay
+// fast to intersect.
+class ActiveSetHybrid {
+ public:
+  using Iterator = ActiveSetHybridIterator;
+  using Builder = ActiveSetHybridBuilder;
+
+  static const ActiveSetHybrid& trivial() {
+    static ActiveSetHybrid trivial = []() { return ActiveSetHybrid(); }();
+    return trivial;
+  }
+
+  ActiveSetHybrid(const ActiveSetHybrid& other) = default;
+  ActiveSetHybrid& operator=(const ActiveSetHybrid& other) = default;
+  ActiveSetHybrid(ActiveSetHybrid&& other) = default;
+  ActiveSetHybrid& operator=(ActiveSetHybrid&& other) = default;
+
+  // Returns the intersections of the two active sets (that is, returns an
+  // ActiveSetHybrid which returns a true value for position if that value
+  // position corresponds to true values in both 'this' and 'other'). Unless
+  // one is trivial, 'this' and 'other' must have the same length.
+  ActiveSetHybrid Intersection(const ActiveSetHybrid& other) const {
+    ActiveSetHybrid ret = *this;
+    ret.Intersect(other);
+    return ret;
+  }
+  void Intersect(const ActiveSetHybrid& other);
+
+  std::vector<int> EnabledValues() const;
+
+  std::string DebugString() const;
+
+  std::string DebugValues() const;
+
+  bool is_trivial() const { return matches_count_ == total_; }
+  int matches() const { return matches_count_; }
+  int total() const { return total_; }
+  double Selectivity() const {
+    if (is_trivial()) return 1.0;
+    return static_cast<double>(matches()) / total();
+  }
+
+  // Releases storage reserved beyond what the set uses.
+  void ShrinkToFit();
+
+  // Number of heap bytes owned by this set (excluding sizeof(*this)).
+  int64_t StorageBytes() const;
+
+  ActiveSetHybridIterator GetIterator() const {
+    return ActiveSetHybridIterator(absl::MakeSpan(containers_), total_);
+  }
+
+ private:
+  ActiveSetHybrid() = default;
+
+  std::vector<ActiveSetHybridContainer> containers_;
+
+  // The total number of true values contained within this ActiveSetHybrid.
+  int matches_count_ = 0;
+
+  // The total number of boolean values contained within this ActiveSetHybrid.
+  int total_ = 0;
+
+  friend class ActiveSetHybridBuilder;
+};
+
+class ActiveSetHybridBuilder {
+ public:
+  explicit ActiveSetHybridBuilder(int total) { set_.total_ = total; }
+
+  // Constructs an ActiveSetHybrid such that each value contained in
+  // 'positions' returns 'true' and every other value in [0, 'max_position')
+  // returns false.
+  static ActiveSetHybrid FromPositions(
+      const absl::flat_hash_set<int>& positions, int max_position);
+  // Same as flat_hash_set form, except positions is required to be sorted.
+  static ActiveSetHybrid FromPositions(const std::vector<int>& positions,
+                                       int max_position);
+  static ActiveSetHybrid FromPositions(
+      const std::initializer_list<int>& positions, int max_position);
+
+  // Adds a new boolean value to the current ActiveSetHybrid. Must not be
+  // called after DoneAdding is called.
+  void Add(bool match) { AddBlock(match, 1); }
+
+  // Adds `size` enties of `value`. Equivalent to:
+  // for (int i = 0; i < size; ++i) Add(value);
+  void AddBlock(bool value, int size);
+
+  // Adds entites of `value` until `total()` is `position`. Note the fence-post
+  // here. The value at `position` is left unset.
+  void AddBlockTo(bool value, int position) {
+    AddBlock(value, position - offset_);
+  }
+
+  // Returns the ActiveSetHybrid constructed by calls to Add and AddBlock. It
+  // is undefined behavior to call more than once.
+  ActiveSetHybrid DoneAdding();
+
+  int total() { return set_.total(); }
+
+ private:
+  // Converts `runs_` into a container for the chunk ending at `offset_`.
+  void FlushContainer();
+
+  ActiveSetHybrid set_;
+
+  // Half-open ranges of true values within the current chunk.
+  std::vector<std::pair<int, int>> runs_;
+
+  // The total number of elements added to this builder.
+  int offset_ = 0;
+};
+
+template <typename Fn>
+void ActiveSetHybridContainer::ForEachRun(Fn fn) const {
+  switch (kind_) {
+    case Kind::kArray: {
+      for (int i = 0; i < data_.size();) {
+        int begin = data_[i];
+        int end = begin + 1;
+        for (++i; i < data_.size() && data_[i] == end; ++i) ++end;
+        fn(begin, end);
+      }
+      return;
+    }
+    case Kind::kRun: {
+      for (int i = 0; i < data_.size(); i += 2) {
+        fn(data_[i], data_[i + 1] + 1);
+      }
+      return;
+    }
+    case Kind::kBitmap: {
+      for (int offset = 0; offset < size_;) {
+        int end = RunEnd(offset, /*hint=*/0);
+        if (Contains(offset, /*hint=*/0)) fn(offset, end);
+        offset = end;
+      }
+      return;
+    }
+  }
+}
+
+}  // namespace puzzle
+
+#endif  // PUZZLE_ACTIVE_SET_HYBRID_H
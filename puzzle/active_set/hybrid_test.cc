@@ -0,0 +1,122 @@
+#include "puzzle/active_set/hybrid.h"
+
+#include <random>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace puzzle {
+
+// Returns `total` values made of runs whose lengths are drawn from
+// [1, `run_scale`] and which are true with probability `true_fraction`.
+std::vector<bool> RandomRuns(int total, int run_scale, double true_fraction,
+                             std::mt19937* rng) {
+  std::vector<bool> ret;
+  while (ret.size() < total) {
+    bool value = std::uniform_real_distribution<>()(*rng) < true_fraction;
+    int run = 1 + (*rng)() % run_scale;
+    for (int i = 0; i < run && ret.size() < total; ++i) ret.push_back(value);
+  }
+  return ret;
+}
+
+ActiveSetHybrid Build(const std::vector<bool>& bits) {
+  ActiveSetHybrid::Builder builder(bits.size());
+  for (bool b : bits) builder.Add(b);
+  return builder.DoneAdding();
+}
+
+void ExpectMatches(const ActiveSetHybrid& set, const std::vector<bool>& bits) {
+  std::vector<int> expected;
+  for (int i = 0; i < bits.size(); ++i) {
+    if (bits[i]) expected.push_back(i);
+  }
+  EXPECT_EQ(set.EnabledValues(), expected);
+  EXPECT_EQ(set.matches(), expected.size());
+
+  ActiveSetHybrid::Iterator it = set.GetIterator();
+  while (it.more()) {
+    int expected_run = 0;
+    while (it.offset() + expected_run < bits.size() &&
+           bits[it.offset() + expected_run] == bits[it.offset()]) {
+      ++expected_run;
+    }
+    ASSERT_EQ(it.value(), bits[it.offset()]) << it.offset();
+    ASSERT_EQ(it.RunSize(), expected_run) << it.offset();
+    // Alternate between stepping through the run and skipping it.
+    it.Advance(it.offset() % 2 ? 1 : expected_run);
+  }
+}
+
+TEST(ActiveSetHybridTest, PicksArrayForSparse) {
+  std::vector<int> positions;
+  for (int i = 0; i < 1000; ++i) positions.push_back(i * 37);
+  ActiveSetHybrid set = ActiveSetHybrid::Builder::FromPositions(
+      positions, ActiveSetHybridContainer::kSize);
+  EXPECT_THAT(set.DebugString(), testing::HasSubstr("array{"));
+  EXPECT_LT(set.StorageBytes(), 4000);
+}
+
+TEST(ActiveSetHybridTest, PicksRunForRuns) {
+  ActiveSetHybrid::Builder builder(3 * ActiveSetHybridContainer::kSize);
+  builder.AddBlock(false, 100);
+  builder.AddBlock(true, 2 * ActiveSetHybridContainer::kSize);
+  builder.AddBlockTo(false, builder.total());
+  ActiveSetHybrid set = builder.DoneAdding();
+  EXPECT_THAT(set.DebugString(), testing::HasSubstr("run{100-65535}"));
+  EXPECT_LT(set.StorageBytes(), 1000);
+
+  ActiveSetHybrid::Iterator it = set.GetIterator();
+  EXPECT_FALSE(it.value());
+  EXPECT_EQ(it.RunSize(), 100);
+  it.Advance(100);
+  EXPECT_TRUE(it.value());
+  EXPECT_EQ(it.RunSize(), 2 * ActiveSetHybridContainer::kSize);
+}
+
+TEST(ActiveSetHybridTest, PicksBitmapForDense) {
+  std::mt19937 rng(17);
+  std::vector<bool> bits;
+  for (int i = 0; i < ActiveSetHybridContainer::kSize; ++i) {
+    bits.push_back(rng() % 2);
+  }
+  ActiveSetHybrid set = Build(bits);
+  EXPECT_THAT(set.DebugString(), testing::HasSubstr("bitmap{"));
+  ExpectMatches(set, bits);
+}
+
+TEST(ActiveSetHybridTest, RandomRoundTrip) {
+  std::mt19937 rng(17);
+  for (int total : {1, 100, ActiveSetHybridContainer::kSize,
+                    ActiveSetHybridContainer::kSize + 1, 362880}) {
+    for (int run_scale : {1, 20, 5000}) {
+      for (double true_fraction : {0.05, 0.5, 0.95}) {
+        std::vector<bool> bits =
+            RandomRuns(total, run_scale, true_fraction, &rng);
+        ExpectMatches(Build(bits), bits);
+      }
+    }
+  }
+}
+
+TEST(ActiveSetHybridTest, RandomIntersection) {
+  std::mt19937 rng(17);
+  const int total = 362880;
+  for (int run_scale_a : {1, 20, 5000}) {
+    for (double true_fraction_a : {0.05, 0.5, 0.95}) {
+      std::vector<bool> a = RandomRuns(total, run_scale_a, true_fraction_a,
+                                       &rng);
+      for (int run_scale_b : {1, 20, 5000}) {
+        for (double true_fraction_b : {0.05, 0.5, 0.95}) {
+          std::vector<bool> b =
+              RandomRuns(total, run_scale_b, true_fraction_b, &rng);
+          std::vector<bool> expected(total);
+          for (int i = 0; i < total; ++i) expected[i] = a[i] && b[i];
+          ExpectMatches(Build(a).Intersection(Build(b)), expected);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace puzzle
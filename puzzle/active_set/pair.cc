@@ -1,3 +1,41 @@
 #include "puzzle/active_set/pair.h"
 
-namespace puzzle {}  // namespace puzzle
+namespace puzzle {
+
+void ActiveSetPair::Assign(int a_val, ActiveSet a_b_set) {
+  DCHECK(CanAssign(a_val)) << a_val << " after " << a_vals_.back();
+  if (a_b_set.is_trivial()) return;
+  a_b_set.ShrinkToFit();
+  set_storage_bytes_ += a_b_set.StorageBytes();
+  a_vals_.push_back(a_val);
+  sets_.push_back(std::move(a_b_set));
+  UpdateSlots();
+}
+
+void ActiveSetPair::UpdateSlots() {
+  const int64_t key_range = a_vals_.back() + 1;
+  const int64_t entries = a_vals_.size();
+  if (slots_.empty()) {
+    // Index densely once at least half of the key range is assigned.
+    if (2 * entries < key_range) return;
+    slots_.assign(key_range, -1);
+    for (int i = 0; i < a_vals_.size(); ++i) slots_[a_vals_[i]] = i;
+    return;
+  }
+  if (8 * entries < key_range) {
+    // Drop the index once under an eighth of the key range is assigned. The
+    // gap between the thresholds avoids rebuilding on alternate calls.
+    slots_ = std::vector<int32_t>();
+    return;
+  }
+  slots_.resize(key_range, -1);
+  slots_[a_vals_.back()] = sets_.size() - 1;
+}
+
+int64_t ActiveSetPair::StorageBytes() const {
+  return a_vals_.capacity() * sizeof(int32_t) +
+         slots_.capacity() * sizeof(int32_t) +
+         sets_.capacity() * sizeof(ActiveSet) + set_storage_bytes_;
+}
+
+}  // namespace puzzle
@@ -1,27 +1,77 @@
 #ifndef PUZZLE_ACTIVE_SET_PAIR_H
 #define PUZZLE_ACTIVE_SET_PAIR_H
 
-#include "absl/container/flat_hash_map.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/log/check.h"
 #include "puzzle/active_set/active_set.h"
 
 namespace puzzle {
 
+// Stores, for each position `a_val` of one class, the ActiveSet of another
+// class given `a_val`.
+// The sets are held contiguously in `sets_`, ordered by `a_val`, with the
+// matching keys in `a_vals_`. While the keys cover a large enough fraction of
+// [0, max key], `slots_` additionally indexes `sets_` densely by `a_val` so
+// Find is a single load; otherwise Find binary searches `a_vals_`. Either way
+// there is no per-entry hashing or load-factor slack as with a hash map.
+// Trivial sets are not stored, since Find returns ActiveSet::trivial() for any
+// unassigned `a_val`.
 class ActiveSetPair {
  public:
   ActiveSetPair() = default;
 
   const ActiveSet& Find(int a_val) const {
-    auto it = b_given_a_.find(a_val);
-    if (it == b_given_a_.end()) return ActiveSet::trivial();
-    return it->second;
+    if (!slots_.empty()) {
+      if (a_val >= slots_.size() || slots_[a_val] < 0) {
+        return ActiveSet::trivial();
+      }
+      return sets_[slots_[a_val]];
+    }
+    auto it = std::lower_bound(a_vals_.begin(), a_vals_.end(), a_val);
+    if (it == a_vals_.end() || *it != a_val) return ActiveSet::trivial();
+    return sets_[it - a_vals_.begin()];
   }
 
-  void Assign(int a_val, ActiveSet a_b_set) {
-    b_given_a_.emplace(a_val, std::move(a_b_set));
+  // Stores `a_b_set` for `a_val`, which must be greater than any `a_val`
+  // previously assigned (see CanAssign), so each call is amortized constant
+  // time. Invalidates references previously returned by Find.
+  void Assign(int a_val, ActiveSet a_b_set);
+
+  // Returns true if `a_val` is greater than any `a_val` previously assigned.
+  bool CanAssign(int a_val) const {
+    return a_vals_.empty() || a_vals_.back() < a_val;
+  }
+
+  // Number of non-trivial sets stored.
+  int size() const { return sets_.size(); }
+
+  // Calls `fn(a_val, set)` for each stored set in increasing `a_val` order.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (int i = 0; i < a_vals_.size(); ++i) fn(a_vals_[i], sets_[i]);
   }
 
+  // Number of heap bytes owned by this table, including the storage of the
+  // sets it holds. Constant time.
+  int64_t StorageBytes() const;
+
  private:
-  absl::flat_hash_map<int, ActiveSet> b_given_a_;
+  // Builds, extends or drops `slots_` based on the density of `a_vals_`.
+  void UpdateSlots();
+
+  // Sorted keys, parallel to `sets_`.
+  std::vector<int32_t> a_vals_;
+  std::vector<ActiveSet> sets_;
+
+  // If non-empty, slots_[a_val] is the index in `sets_` of the set for
+  // `a_val`, or -1.
+  std::vector<int32_t> slots_;
+
+  // Sum of StorageBytes() over `sets_`.
+  int64_t set_storage_bytes_ = 0;
 };
 
 }  // namespace puzzle
@@ -0,0 +1,96 @@
+#include <random>
+
+#include "absl/container/flat_hash_map.h"
+#include "benchmark/benchmark.h"
+#include "puzzle/active_set/pair.h"
+
+namespace puzzle {
+
+// 9!, the number of permutations of a sudoku row.
+static constexpr int kPermutationCount = 362880;
+
+// The layout ActiveSetPair replaced, kept here to compare against.
+class HashMapActiveSetPair {
+ public:
+  const ActiveSet& Find(int a_val) const {
+    auto it = b_given_a_.find(a_val);
+    if (it == b_given_a_.end()) return ActiveSet::trivial();
+    return it->second;
+  }
+
+  void Assign(int a_val, ActiveSet a_b_set) {
+    b_given_a_.emplace(a_val, std::move(a_b_set));
+  }
+
+  int64_t StorageBytes() const {
+    // One control byte per slot in addition to the slot itself.
+    int64_t ret = b_given_a_.capacity() *
+                  (sizeof(std::pair<const int, ActiveSet>) + 1);
+    for (const auto& [a_val, set] : b_given_a_) ret += set.StorageBytes();
+    return ret;
+  }
+
+ private:
+  absl::flat_hash_map<int, ActiveSet> b_given_a_;
+};
+
+// Returns a set over kPermutationCount values with `runs` true runs.
+static ActiveSet RandomSet(int runs, std::mt19937* rng) {
+  ActiveSet::Builder builder(kPermutationCount);
+  const int stride = kPermutationCount / runs;
+  for (int i = 0; i < runs; ++i) {
+    int begin = i * stride + (*rng)() % (stride / 2);
+    builder.AddBlockTo(false, begin);
+    builder.AddBlock(true, 1 + (*rng)() % (stride / 2));
+  }
+  builder.AddBlockTo(false, kPermutationCount);
+  return builder.DoneAdding();
+}
+
+// Builds a table with `state.range(0)` entries spread over the permutations
+// of class a, each with `state.range(1)` runs, and reports its footprint.
+template <typename Pair>
+static void BM_PairTable(benchmark::State& state) {
+  const int entries = state.range(0);
+  const int runs = state.range(1);
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    std::mt19937 rng(17);
+    Pair pair;
+    const int stride = kPermutationCount / entries;
+    for (int i = 0; i < entries; ++i) {
+      pair.Assign(i * stride, RandomSet(runs, &rng));
+    }
+    bytes = pair.StorageBytes();
+    benchmark::DoNotOptimize(pair);
+  }
+  state.counters["bytes"] = bytes;
+  state.counters["bytes_per_entry"] = static_cast<double>(bytes) / entries;
+}
+
+BENCHMARK_TEMPLATE(BM_PairTable, ActiveSetPair)
+    ->ArgsProduct({{100, 10000, kPermutationCount / 4}, {1, 16}});
+BENCHMARK_TEMPLATE(BM_PairTable, HashMapActiveSetPair)
+    ->ArgsProduct({{100, 10000, kPermutationCount / 4}, {1, 16}});
+
+template <typename Pair>
+static void BM_PairFind(benchmark::State& state) {
+  const int entries = state.range(0);
+  std::mt19937 rng(17);
+  Pair pair;
+  const int stride = kPermutationCount / entries;
+  for (int i = 0; i < entries; ++i) {
+    pair.Assign(i * stride, RandomSet(/*runs=*/1, &rng));
+  }
+  int a_val = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(pair.Find(a_val).matches());
+    a_val += stride;
+    if (a_val >= kPermutationCount) a_val = 0;
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_PairFind, ActiveSetPair)->Arg(100)->Arg(10000);
+BENCHMARK_TEMPLATE(BM_PairFind, HashMapActiveSetPair)->Arg(100)->Arg(10000);
+
+}  // namespace puzzle
@@ -3,13 +3,85 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
-using ::testing::AnyOf;
-using ::testing::Eq;
-using ::testing::UnorderedElementsAre;
-using ::testing::UnorderedElementsAreArray;
+using ::testing::ElementsAre;
 
 namespace puzzle {
 
-TEST(ActiveSetPair, Trivial) { EXPECT_TRUE(true); }
+TEST(ActiveSetPair, Trivial) {
+  ActiveSetPair pair;
+  EXPECT_TRUE(pair.Find(0).is_trivial());
+  EXPECT_TRUE(pair.Find(100).is_trivial());
+  EXPECT_EQ(pair.size(), 0);
+}
+
+TEST(ActiveSetPair, AssignAndFind) {
+  ActiveSetPair pair;
+  pair.Assign(1, ActiveSet::Builder::FromPositions({0}, 4));
+  pair.Assign(3, ActiveSet::Builder::FromPositions({1, 2}, 4));
+  EXPECT_THAT(pair.Find(1).EnabledValues(), ElementsAre(0));
+  EXPECT_THAT(pair.Find(3).EnabledValues(), ElementsAre(1, 2));
+  EXPECT_TRUE(pair.Find(0).is_trivial());
+  EXPECT_TRUE(pair.Find(2).is_trivial());
+  EXPECT_TRUE(pair.Find(4).is_trivial());
+  EXPECT_EQ(pair.size(), 2);
+}
+
+TEST(ActiveSetPair, CanAssign) {
+  ActiveSetPair pair;
+  EXPECT_TRUE(pair.CanAssign(0));
+  pair.Assign(2, ActiveSet::Builder::FromPositions({1}, 4));
+  EXPECT_FALSE(pair.CanAssign(1));
+  EXPECT_FALSE(pair.CanAssign(2));
+  EXPECT_TRUE(pair.CanAssign(3));
+}
+
+TEST(ActiveSetPair, ForEach) {
+  ActiveSetPair pair;
+  pair.Assign(1, ActiveSet::Builder::FromPositions({0}, 4));
+  pair.Assign(3, ActiveSet::Builder::FromPositions({1, 2}, 4));
+  std::vector<int> a_vals;
+  std::vector<std::vector<int>> values;
+  pair.ForEach([&](int a_val, const ActiveSet& set) {
+    a_vals.push_back(a_val);
+    values.push_back(set.EnabledValues());
+  });
+  EXPECT_THAT(a_vals, ElementsAre(1, 3));
+  EXPECT_THAT(values, ElementsAre(ElementsAre(0), ElementsAre(1, 2)));
+}
+
+TEST(ActiveSetPair, TrivialNotStored) {
+  ActiveSetPair pair;
+  pair.Assign(0, ActiveSet::Builder::FromPositions({0, 1, 2, 3}, 4));
+  EXPECT_TRUE(pair.Find(0).is_trivial());
+  EXPECT_EQ(pair.size(), 0);
+  EXPECT_EQ(pair.StorageBytes(), 0);
+}
+
+TEST(ActiveSetPair, SparseAndDense) {
+  // Sparse keys are searched, and indexed densely once filled in.
+  for (int step : {64, 1}) {
+    ActiveSetPair pair;
+    for (int a_val = 0; a_val < 1024; a_val += step) {
+      pair.Assign(a_val, ActiveSet::Builder::FromPositions({a_val}, 1024));
+    }
+    for (int a_val = 0; a_val < 1024; ++a_val) {
+      if (a_val % step == 0) {
+        EXPECT_THAT(pair.Find(a_val).EnabledValues(), ElementsAre(a_val));
+      } else {
+        EXPECT_TRUE(pair.Find(a_val).is_trivial()) << a_val;
+      }
+    }
+    EXPECT_EQ(pair.size(), 1024 / step);
+  }
+}
+
+TEST(ActiveSetPair, StorageBytes) {
+  ActiveSetPair pair;
+  ActiveSet set = ActiveSet::Builder::FromPositions({1}, 4);
+  const int64_t set_bytes = set.StorageBytes();
+  pair.Assign(9, std::move(set));
+  EXPECT_GE(pair.StorageBytes(), sizeof(int32_t) + sizeof(ActiveSet) +
+                                     set_bytes);
+}
 
 }  // namespace puzzle
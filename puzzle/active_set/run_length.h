@@ -89,6 +89,12 @@ class ActiveSetRunLength {
     return static_cast<double>(matches()) / total();
   }
 
+  // Releases storage reserved beyond what the set uses.
+  void ShrinkToFit() { matches_.shrink_to_fit(); }
+
+  // Number of heap bytes owned by this set (excluding sizeof(*this)).
+  int64_t StorageBytes() const { return matches_.capacity() * sizeof(int); }
+
   ActiveSetRunLengthIterator GetIterator() const {
     // ActiveSetRunLength may be constructed with an empty first record (it uses
     // this to indicate a false record to start), so skip that if present and
@@ -96,6 +96,12 @@ class ActiveSetRunPosition {
     return static_cast<double>(matches()) / total();
   }
 
+  // Releases storage reserved beyond what the set uses.
+  void ShrinkToFit() { matches_.shrink_to_fit(); }
+
+  // Number of heap bytes owned by this set (excluding sizeof(*this)).
+  int64_t StorageBytes() const { return matches_.capacity() * sizeof(int); }
+
   ActiveSetRunPositionIterator GetIterator() const {
     return ActiveSetRunPositionIterator(absl::MakeSpan(matches_), total_);
   }
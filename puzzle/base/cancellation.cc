@@ -0,0 +1,27 @@
+#include "puzzle/base/cancellation.h"
+
+namespace puzzle {
+
+bool Cancellation::CheckDeadline(bool rate_limit) const {
+  if (rate_limit) {
+    // Shared by every Cancellation on this thread, which is fine as it only
+    // rate limits reading the clock.
+    thread_local int calls_until_clock_check = 0;
+    if (--calls_until_clock_check > 0) return false;
+    calls_until_clock_check = kClockCheckInterval;
+  }
+
+  if (absl::Now() < deadline_) return false;
+  cancelled_.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+absl::Status Cancellation::status() const {
+  if (parent_ != nullptr && parent_->CancelledNow()) return parent_->status();
+  if (absl::Now() >= deadline_) {
+    return absl::DeadlineExceededError("Deadline exceeded");
+  }
+  return absl::CancelledError("Cancelled");
+}
+
+}  // namespace puzzle
@@ -0,0 +1,67 @@
+#ifndef PUZZLE_BASE_CANCELLATION_H
+#define PUZZLE_BASE_CANCELLATION_H
+
+#include <atomic>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+
+namespace puzzle {
+
+// Token for stopping a search early, either explicitly through Cancel or once
+// a deadline passes. A single Cancellation may be shared by any number of
+// threads, and Cancelled is cheap enough to call from the innermost loop of a
+// search.
+class Cancellation {
+ public:
+  Cancellation() = default;
+  explicit Cancellation(absl::Time deadline) : deadline_(deadline) {}
+
+  // Creates a token which is also cancelled whenever `parent` (if non-null)
+  // is. `parent` must outlive this token.
+  explicit Cancellation(const Cancellation* parent) : parent_(parent) {}
+
+  Cancellation(const Cancellation&) = delete;
+  Cancellation& operator=(const Cancellation&) = delete;
+
+  void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+
+  // Returns true once Cancel has been called or the deadline has passed. To
+  // keep this cheap, the clock is only read every kClockCheckInterval calls
+  // on each thread, so the deadline may be noticed a little late.
+  bool Cancelled() const {
+    if (cancelled_.load(std::memory_order_relaxed)) return true;
+    if (parent_ != nullptr && parent_->Cancelled()) return true;
+    if (deadline_ == absl::InfiniteFuture()) return false;
+    return CheckDeadline(/*rate_limit=*/true);
+  }
+
+  // As Cancelled, but always reads the clock if there is a deadline. For
+  // callers which check too rarely for Cancelled's rate limiting to work.
+  bool CancelledNow() const {
+    if (cancelled_.load(std::memory_order_relaxed)) return true;
+    if (parent_ != nullptr && parent_->CancelledNow()) return true;
+    if (deadline_ == absl::InfiniteFuture()) return false;
+    return CheckDeadline(/*rate_limit=*/false);
+  }
+
+  absl::Time deadline() const { return deadline_; }
+
+  // Returns the error for an operation stopped by this token. This is the
+  // parent's status if the parent was cancelled, DeadlineExceededError if the
+  // deadline has passed and CancelledError otherwise.
+  absl::Status status() const;
+
+ private:
+  static constexpr int kClockCheckInterval = 1024;
+
+  bool CheckDeadline(bool rate_limit) const;
+
+  mutable std::atomic<bool> cancelled_ = false;
+  absl::Time deadline_ = absl::InfiniteFuture();
+  const Cancellation* parent_ = nullptr;
+};
+
+}  // namespace puzzle
+
+#endif  // PUZZLE_BASE_CANCELLATION_H
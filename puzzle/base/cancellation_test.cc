@@ -0,0 +1,63 @@
+#include "puzzle/base/cancellation.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace puzzle {
+
+static bool CancelledWithin(const Cancellation& cancellation, int calls) {
+  for (int i = 0; i < calls; ++i) {
+    if (cancellation.Cancelled()) return true;
+  }
+  return false;
+}
+
+TEST(CancellationTest, Default) {
+  Cancellation cancellation;
+  EXPECT_FALSE(CancelledWithin(cancellation, 10000));
+  EXPECT_THAT(cancellation.deadline(), absl::InfiniteFuture());
+}
+
+TEST(CancellationTest, Cancel) {
+  Cancellation cancellation;
+  cancellation.Cancel();
+  EXPECT_TRUE(cancellation.Cancelled());
+  EXPECT_TRUE(absl::IsCancelled(cancellation.status()));
+}
+
+TEST(CancellationTest, FutureDeadline) {
+  Cancellation cancellation(absl::Now() + absl::Hours(1));
+  EXPECT_FALSE(CancelledWithin(cancellation, 10000));
+}
+
+TEST(CancellationTest, PastDeadline) {
+  Cancellation cancellation(absl::Now() - absl::Seconds(1));
+  EXPECT_TRUE(CancelledWithin(cancellation, 10000));
+  // Sticky once noticed.
+  EXPECT_TRUE(cancellation.Cancelled());
+  EXPECT_TRUE(absl::IsDeadlineExceeded(cancellation.status()));
+}
+
+TEST(CancellationTest, PastDeadlineNow) {
+  Cancellation cancellation(absl::Now() - absl::Seconds(1));
+  EXPECT_TRUE(cancellation.CancelledNow());
+}
+
+TEST(CancellationTest, Parent) {
+  Cancellation parent(absl::Now() - absl::Seconds(1));
+  Cancellation child(&parent);
+  Cancellation sibling(&parent);
+  EXPECT_TRUE(child.CancelledNow());
+  EXPECT_TRUE(absl::IsDeadlineExceeded(child.status()));
+  EXPECT_TRUE(sibling.CancelledNow());
+}
+
+TEST(CancellationTest, ChildDoesNotCancelParent) {
+  Cancellation parent;
+  Cancellation child(&parent);
+  child.Cancel();
+  EXPECT_TRUE(child.Cancelled());
+  EXPECT_FALSE(parent.Cancelled());
+}
+
+}  // namespace puzzle
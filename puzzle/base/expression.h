@@ -0,0 +1,404 @@
+#ifndef PUZZLE_BASE_EXPRESSION_H
+#define PUZZLE_BASE_EXPRESSION_H
+
+#include <concepts>
+#include <limits>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "puzzle/base/solution_filter.h"
+#include "puzzle/base/solution_view.h"
+
+namespace puzzle {
+
+// A small language for writing constraints which, unlike the predicates
+// passed to Solver::AddPredicate, can be inspected. For example:
+//
+//   using ::puzzle::expr::Id;
+//   using ::puzzle::expr::Sum;
+//   solver.AddConstraint("a > b", Id(0).Class(1) > Id(2).Class(1));
+//   solver.AddConstraint("cage", Sum(cells) == 10);
+//
+// Each operator returns a node whose type records the whole expression, so
+// a Constraint compiles to a single function with the expression inlined.
+// Forms which a permuter can apply without evaluating that function (see
+// Constraint::entry_value and the other accessors) are recognized as well,
+// and Solver::AddConstraint adds those through their dedicated entry points.
+// Comparisons and `&&`, `||` and `!` are evaluated without short circuiting,
+// which keeps the compiled function free of branches (other than the loops
+// of Sum and Product). The cells read are collected from the expression, so
+// they need not be listed by hand.
+namespace expr {
+
+using Cell = SolutionFilter::Cell;
+
+// Bases identifying integer and boolean valued nodes. Each node defines:
+//   Eval(const SolutionView&) const, returning int or bool.
+//   AppendCells(std::vector<Cell>*) const, appending each cell it reads.
+//   DebugString() const.
+struct IntNode {};
+struct BoolNode {};
+
+template <typename T>
+concept IntExpr = std::derived_from<T, IntNode>;
+
+template <typename T>
+concept BoolExpr = std::derived_from<T, BoolNode>;
+
+// Types usable as an integer operand. Integral and enum constants (such as
+// proto enum values) are converted to Constant.
+template <typename T>
+concept IntOperand =
+    IntExpr<T> || std::is_integral_v<T> || std::is_enum_v<T>;
+
+// The value of class `class_int` for entry `entry_id`.
+struct CellValue : IntNode {
+  explicit CellValue(Cell cell) : cell(cell) {}
+
+  int Eval(const SolutionView& s) const {
+    return s.Id(cell.entry_id).Class(cell.class_int);
+  }
+  void AppendCells(std::vector<Cell>* cells) const { cells->push_back(cell); }
+  std::string DebugString() const {
+    return absl::StrCat("Id(", cell.entry_id, ").Class(", cell.class_int, ")");
+  }
+
+  Cell cell;
+};
+
+struct Constant : IntNode {
+  explicit Constant(int value) : value(value) {}
+
+  int Eval(const SolutionView&) const { return value; }
+  void AppendCells(std::vector<Cell>*) const {}
+  std::string DebugString() const { return absl::StrCat(value); }
+
+  int value;
+};
+
+// Returned by Id to allow writing `Id(entry_id).Class(class_int)`.
+struct EntryRef {
+  CellValue Class(int class_int) const {
+    return CellValue(Cell{.entry_id = entry_id, .class_int = class_int});
+  }
+
+  int entry_id;
+};
+
+inline EntryRef Id(int entry_id) { return EntryRef{.entry_id = entry_id}; }
+
+// The sum of the values of `cells`.
+struct Sum : IntNode {
+  explicit Sum(std::vector<Cell> cells) : cells(std::move(cells)) {}
+
+  int Eval(const SolutionView& s) const {
+    int sum = 0;
+    for (const Cell& c : cells) sum += s.Id(c.entry_id).Class(c.class_int);
+    return sum;
+  }
+  void AppendCells(std::vector<Cell>* out) const {
+    out->insert(out->end(), cells.begin(), cells.end());
+  }
+  std::string DebugString() const {
+    return absl::StrCat("Sum(", CellsDebugString(cells), ")");
+  }
+
+  static std::string CellsDebugString(const std::vector<Cell>& cells) {
+    return absl::StrJoin(cells, ", ", [](std::string* out, const Cell& c) {
+      absl::StrAppend(out, "(", c.entry_id, ",", c.class_int, ")");
+    });
+  }
+
+  std::vector<Cell> cells;
+};
+
+// The product of the values of `cells`, each first offset by `offset`.
+// Class values are 0-indexed, so an offset of 1 gives the product of
+// 1-indexed values.
+struct Product : IntNode {
+  explicit Product(std::vector<Cell> cells, int offset = 0)
+      : cells(std::move(cells)), offset(offset) {}
+
+  int Eval(const SolutionView& s) const {
+    int product = 1;
+    for (const Cell& c : cells) {
+      product *= s.Id(c.entry_id).Class(c.class_int) + offset;
+    }
+    return product;
+  }
+  void AppendCells(std::vector<Cell>* out) const {
+    out->insert(out->end(), cells.begin(), cells.end());
+  }
+  std::string DebugString() const {
+    return absl::StrCat("Product(", Sum::CellsDebugString(cells), "; +",
+                        offset, ")");
+  }
+
+  std::vector<Cell> cells;
+  int offset;
+};
+
+// Binary operators. `kBool` selects whether the result is a BoolNode.
+#define PUZZLE_EXPR_OP(Name, kIsBool, Symbol, ArgType)                   \
+  struct Name {                                                          \
+    static constexpr bool kBool = kIsBool;                               \
+    static constexpr const char* kSymbol = #Symbol;                      \
+    static auto Apply(ArgType a, ArgType b) { return a Symbol b; }       \
+  };
+
+PUZZLE_EXPR_OP(Add, false, +, int)
+PUZZLE_EXPR_OP(Sub, false, -, int)
+PUZZLE_EXPR_OP(Mul, false, *, int)
+PUZZLE_EXPR_OP(Eq, true, ==, int)
+PUZZLE_EXPR_OP(Ne, true, !=, int)
+PUZZLE_EXPR_OP(Lt, true, <, int)
+PUZZLE_EXPR_OP(Le, true, <=, int)
+PUZZLE_EXPR_OP(Gt, true, >, int)
+PUZZLE_EXPR_OP(Ge, true, >=, int)
+// Bitwise rather than logical to avoid short circuiting.
+PUZZLE_EXPR_OP(And, true, &, bool)
+PUZZLE_EXPR_OP(Or, true, |, bool)
+
+#undef PUZZLE_EXPR_OP
+
+template <typename Op, typename L, typename R>
+struct Binary : std::conditional_t<Op::kBool, BoolNode, IntNode> {
+  Binary(L l, R r) : l(std::move(l)), r(std::move(r)) {}
+
+  auto Eval(const SolutionView& s) const {
+    return static_cast<std::conditional_t<Op::kBool, bool, int>>(
+        Op::Apply(l.Eval(s), r.Eval(s)));
+  }
+  void AppendCells(std::vector<Cell>* cells) const {
+    l.AppendCells(cells);
+    r.AppendCells(cells);
+  }
+  std::string DebugString() const {
+    return absl::StrCat("(", l.DebugString(), " ", Op::kSymbol, " ",
+                        r.DebugString(), ")");
+  }
+
+  L l;
+  R r;
+};
+
+template <BoolExpr E>
+struct Not : BoolNode {
+  explicit Not(E e) : e(std::move(e)) {}
+
+  bool Eval(const SolutionView& s) const { return !e.Eval(s); }
+  void AppendCells(std::vector<Cell>* cells) const { e.AppendCells(cells); }
+  std::string DebugString() const {
+    return absl::StrCat("!", e.DebugString());
+  }
+
+  E e;
+};
+
+template <IntOperand T>
+auto AsExpr(T t) {
+  if constexpr (IntExpr<T>) {
+    return t;
+  } else {
+    return Constant(static_cast<int>(t));
+  }
+}
+
+template <typename Op, IntOperand L, IntOperand R>
+  requires(IntExpr<L> || IntExpr<R>)
+auto MakeBinary(L l, R r) {
+  return Binary<Op, decltype(AsExpr(l)), decltype(AsExpr(r))>(AsExpr(l),
+                                                              AsExpr(r));
+}
+
+#define PUZZLE_EXPR_INT_OPERATOR(Symbol, Op)  \
+  template <IntOperand L, IntOperand R>       \
+    requires(IntExpr<L> || IntExpr<R>)        \
+  auto operator Symbol(L l, R r) {            \
+    return MakeBinary<Op>(l, r);              \
+  }
+
+PUZZLE_EXPR_INT_OPERATOR(+, Add)
+PUZZLE_EXPR_INT_OPERATOR(-, Sub)
+PUZZLE_EXPR_INT_OPERATOR(*, Mul)
+PUZZLE_EXPR_INT_OPERATOR(==, Eq)
+PUZZLE_EXPR_INT_OPERATOR(!=, Ne)
+PUZZLE_EXPR_INT_OPERATOR(<, Lt)
+PUZZLE_EXPR_INT_OPERATOR(<=, Le)
+PUZZLE_EXPR_INT_OPERATOR(>, Gt)
+PUZZLE_EXPR_INT_OPERATOR(>=, Ge)
+
+#undef PUZZLE_EXPR_INT_OPERATOR
+
+template <BoolExpr L, BoolExpr R>
+auto operator&&(L l, R r) {
+  return Binary<And, L, R>(std::move(l), std::move(r));
+}
+
+template <BoolExpr L, BoolExpr R>
+auto operator||(L l, R r) {
+  return Binary<Or, L, R>(std::move(l), std::move(r));
+}
+
+template <BoolExpr E>
+auto operator!(E e) {
+  return Not<E>(std::move(e));
+}
+
+}  // namespace expr
+
+// A boolean expression compiled for evaluation along with what is known
+// about it. Implicitly constructible from any boolean expression.
+class Constraint {
+ public:
+  using Cell = SolutionFilter::Cell;
+
+  // A constraint of the form `Id(e).Class(c) == value` (or `!=`).
+  struct EntryValue {
+    Cell cell;
+    int value;
+    bool equal;
+  };
+
+  // A constraint of the form `Id(e).Class(c) < value` (or `<=`, `>`, `>=`,
+  // with the constant on either side), as the inclusive range of values it
+  // allows the cell.
+  struct EntryRange {
+    Cell cell;
+    int min;
+    int max;
+  };
+
+  template <expr::BoolExpr E>
+  Constraint(E e)  // NOLINT: Implicit by design.
+      : predicate_([e](const SolutionView& s) { return e.Eval(s); }),
+        debug_string_(e.DebugString()) {
+    std::vector<Cell> cells;
+    e.AppendCells(&cells);
+    for (const Cell& cell : cells) {
+      bool seen = false;
+      for (const Cell& existing : cells_) {
+        if (existing.entry_id == cell.entry_id &&
+            existing.class_int == cell.class_int) {
+          seen = true;
+          break;
+        }
+      }
+      if (!seen) cells_.push_back(cell);
+    }
+    RecognizeForm(e);
+  }
+
+  const SolutionView::Predicate& predicate() const { return predicate_; }
+  bool operator()(const SolutionView& s) const { return predicate_(s); }
+
+  // Each cell read by the constraint, once, in the order first read.
+  const std::vector<Cell>& cells() const { return cells_; }
+
+  // Canonical text of the expression. Equal for equal expressions.
+  const std::string& DebugString() const { return debug_string_; }
+
+  // Set if the constraint restricts a single cell to (or away from) a
+  // constant.
+  const std::optional<EntryValue>& entry_value() const { return entry_value_; }
+
+  // Set if the constraint compares a single cell with a constant by `<`,
+  // `<=`, `>` or `>=`.
+  const std::optional<EntryRange>& entry_range() const { return entry_range_; }
+
+  // Set if the constraint is `a != b` for two distinct cells.
+  const std::optional<std::pair<Cell, Cell>>& different_cells() const {
+    return different_cells_;
+  }
+
+  // If the constraint is `a && b`, the constraints `a` and `b`, each split
+  // likewise. Otherwise empty. Adding each conjunct is equivalent to adding
+  // the constraint, and lets each be recognized (and pruned on) separately.
+  const std::vector<Constraint>& conjuncts() const { return conjuncts_; }
+
+ private:
+  template <typename Op>
+  void RecognizeForm(
+      const expr::Binary<Op, expr::CellValue, expr::Constant>& e) {
+    RecognizeCompareToConstant<Op>(e.l.cell, e.r.value);
+  }
+  template <typename Op>
+  void RecognizeForm(
+      const expr::Binary<Op, expr::Constant, expr::CellValue>& e) {
+    // `value op cell` is `cell op' value` with the comparison mirrored.
+    if constexpr (std::is_same_v<Op, expr::Lt>) {
+      RecognizeCompareToConstant<expr::Gt>(e.r.cell, e.l.value);
+    } else if constexpr (std::is_same_v<Op, expr::Le>) {
+      RecognizeCompareToConstant<expr::Ge>(e.r.cell, e.l.value);
+    } else if constexpr (std::is_same_v<Op, expr::Gt>) {
+      RecognizeCompareToConstant<expr::Lt>(e.r.cell, e.l.value);
+    } else if constexpr (std::is_same_v<Op, expr::Ge>) {
+      RecognizeCompareToConstant<expr::Le>(e.r.cell, e.l.value);
+    } else {
+      RecognizeCompareToConstant<Op>(e.r.cell, e.l.value);
+    }
+  }
+  template <typename Op>
+  void RecognizeCompareToConstant(Cell cell, int value) {
+    constexpr int kMin = std::numeric_limits<int>::min();
+    constexpr int kMax = std::numeric_limits<int>::max();
+    if constexpr (std::is_same_v<Op, expr::Eq> ||
+                  std::is_same_v<Op, expr::Ne>) {
+      entry_value_ = EntryValue{
+          .cell = cell, .value = value, .equal = std::is_same_v<Op, expr::Eq>};
+    } else if constexpr (std::is_same_v<Op, expr::Lt>) {
+      if (value == kMin) return;
+      entry_range_ = EntryRange{.cell = cell, .min = kMin, .max = value - 1};
+    } else if constexpr (std::is_same_v<Op, expr::Le>) {
+      entry_range_ = EntryRange{.cell = cell, .min = kMin, .max = value};
+    } else if constexpr (std::is_same_v<Op, expr::Gt>) {
+      if (value == kMax) return;
+      entry_range_ = EntryRange{.cell = cell, .min = value + 1, .max = kMax};
+    } else if constexpr (std::is_same_v<Op, expr::Ge>) {
+      entry_range_ = EntryRange{.cell = cell, .min = value, .max = kMax};
+    }
+  }
+  template <typename L, typename R>
+  void RecognizeForm(const expr::Binary<expr::And, L, R>& e) {
+    AddConjuncts(e.l);
+    AddConjuncts(e.r);
+  }
+  template <typename L, typename R>
+  void AddConjuncts(const expr::Binary<expr::And, L, R>& e) {
+    AddConjuncts(e.l);
+    AddConjuncts(e.r);
+  }
+  template <typename E>
+  void AddConjuncts(const E& e) {
+    conjuncts_.emplace_back(e);
+  }
+  void RecognizeForm(
+      const expr::Binary<expr::Ne, expr::CellValue, expr::CellValue>& e) {
+    // A cell compared with itself is never different, which only the
+    // predicate expresses.
+    if (e.l.cell.entry_id == e.r.cell.entry_id &&
+        e.l.cell.class_int == e.r.cell.class_int) {
+      return;
+    }
+    different_cells_ = {e.l.cell, e.r.cell};
+  }
+  template <typename E>
+  void RecognizeForm(const E&) {}
+
+  SolutionView::Predicate predicate_;
+  std::string debug_string_;
+  std::vector<Cell> cells_;
+  std::optional<EntryValue> entry_value_;
+  std::optional<EntryRange> entry_range_;
+  std::optional<std::pair<Cell, Cell>> different_cells_;
+  std::vector<Constraint> conjuncts_;
+};
+
+}  // namespace puzzle
+
+#endif  // PUZZLE_BASE_EXPRESSION_H
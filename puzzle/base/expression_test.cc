@@ -0,0 +1,157 @@
+#include "puzzle/base/expression.h"
+
+#include <limits>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace puzzle {
+
+using ::puzzle::expr::Id;
+using ::puzzle::expr::Product;
+using ::puzzle::expr::Sum;
+
+class ExpressionTest : public ::testing::Test {
+ protected:
+  ExpressionTest() {
+    entries_.emplace_back(0, std::vector<int>{0, 1, 2});
+    entries_.emplace_back(1, std::vector<int>{1, 2, 0});
+    entries_.emplace_back(2, std::vector<int>{2, 0, 1});
+  }
+
+  SolutionView view() const { return SolutionView(nullptr, &entries_); }
+
+  std::vector<Entry> entries_;
+};
+
+MATCHER_P2(IsCell, entry_id, class_int, "") {
+  return arg.entry_id == entry_id && arg.class_int == class_int;
+}
+
+TEST_F(ExpressionTest, Compare) {
+  EXPECT_TRUE(Constraint(Id(0).Class(2) == 2)(view()));
+  EXPECT_FALSE(Constraint(Id(0).Class(2) != 2)(view()));
+  EXPECT_TRUE(Constraint(Id(1).Class(0) < Id(2).Class(0))(view()));
+  EXPECT_TRUE(Constraint(Id(1).Class(0) <= 1)(view()));
+  EXPECT_FALSE(Constraint(1 > Id(1).Class(0))(view()));
+  EXPECT_TRUE(Constraint(2 >= Id(1).Class(0))(view()));
+}
+
+TEST_F(ExpressionTest, Arithmetic) {
+  EXPECT_TRUE(Constraint(Id(0).Class(1) + Id(0).Class(2) == 3)(view()));
+  EXPECT_TRUE(Constraint(Id(1).Class(1) - 1 == Id(0).Class(1))(view()));
+  EXPECT_TRUE(Constraint(2 * Id(2).Class(0) == 4)(view()));
+}
+
+TEST_F(ExpressionTest, SumAndProduct) {
+  std::vector<expr::Cell> cells = {{.entry_id = 0, .class_int = 2},
+                                   {.entry_id = 1, .class_int = 1},
+                                   {.entry_id = 2, .class_int = 0}};
+  EXPECT_TRUE(Constraint(Sum(cells) == 6)(view()));
+  EXPECT_TRUE(Constraint(Product(cells) == 8)(view()));
+  EXPECT_TRUE(Constraint(Product(cells, /*offset=*/1) == 27)(view()));
+}
+
+TEST_F(ExpressionTest, Logical) {
+  auto is_true = Id(0).Class(0) == 0;
+  auto is_false = Id(0).Class(0) == 1;
+  EXPECT_TRUE(Constraint(is_true && !is_false)(view()));
+  EXPECT_FALSE(Constraint(is_true && is_false)(view()));
+  EXPECT_TRUE(Constraint(is_false || is_true)(view()));
+  EXPECT_FALSE(Constraint(is_false || !is_true)(view()));
+}
+
+TEST_F(ExpressionTest, Cells) {
+  Constraint c = Id(0).Class(1) + Id(2).Class(1) == Id(0).Class(1) * 2;
+  EXPECT_THAT(c.cells(), ::testing::ElementsAre(IsCell(0, 1), IsCell(2, 1)));
+}
+
+TEST_F(ExpressionTest, DebugString) {
+  Constraint a = Id(0).Class(1) + 1 == Id(2).Class(1);
+  Constraint b = Id(0).Class(1) + 1 == Id(2).Class(1);
+  Constraint c = Id(0).Class(1) + 2 == Id(2).Class(1);
+  EXPECT_THAT(a.DebugString(), "((Id(0).Class(1) + 1) == Id(2).Class(1))");
+  EXPECT_THAT(a.DebugString(), b.DebugString());
+  EXPECT_THAT(a.DebugString(), ::testing::Ne(c.DebugString()));
+}
+
+TEST_F(ExpressionTest, EntryValueForm) {
+  Constraint eq = Id(1).Class(2) == 3;
+  ASSERT_TRUE(eq.entry_value().has_value());
+  EXPECT_THAT(eq.entry_value()->cell, IsCell(1, 2));
+  EXPECT_THAT(eq.entry_value()->value, 3);
+  EXPECT_TRUE(eq.entry_value()->equal);
+
+  Constraint ne = 3 != Id(1).Class(2);
+  ASSERT_TRUE(ne.entry_value().has_value());
+  EXPECT_FALSE(ne.entry_value()->equal);
+
+  EXPECT_FALSE(Constraint(Id(1).Class(2) < 3).entry_value().has_value());
+}
+
+TEST_F(ExpressionTest, EntryRangeForm) {
+  constexpr int kMin = std::numeric_limits<int>::min();
+  constexpr int kMax = std::numeric_limits<int>::max();
+  struct Case {
+    Constraint constraint;
+    int min;
+    int max;
+  };
+  for (const Case& c : {
+           Case{Id(1).Class(2) < 3, kMin, 2},
+           Case{Id(1).Class(2) <= 3, kMin, 3},
+           Case{Id(1).Class(2) > 3, 4, kMax},
+           Case{Id(1).Class(2) >= 3, 3, kMax},
+           Case{3 < Id(1).Class(2), 4, kMax},
+           Case{3 <= Id(1).Class(2), 3, kMax},
+           Case{3 > Id(1).Class(2), kMin, 2},
+           Case{3 >= Id(1).Class(2), kMin, 3},
+       }) {
+    SCOPED_TRACE(c.constraint.DebugString());
+    ASSERT_TRUE(c.constraint.entry_range().has_value());
+    EXPECT_THAT(c.constraint.entry_range()->cell, IsCell(1, 2));
+    EXPECT_THAT(c.constraint.entry_range()->min, c.min);
+    EXPECT_THAT(c.constraint.entry_range()->max, c.max);
+    EXPECT_FALSE(c.constraint.entry_value().has_value());
+  }
+
+  EXPECT_FALSE(Constraint(Id(1).Class(2) == 3).entry_range().has_value());
+  EXPECT_FALSE(
+      Constraint(Id(1).Class(2) < Id(0).Class(2)).entry_range().has_value());
+  EXPECT_FALSE(Constraint(Id(1).Class(2) + 1 < 3).entry_range().has_value());
+}
+
+TEST_F(ExpressionTest, Conjuncts) {
+  Constraint c = (Id(0).Class(0) != Id(1).Class(0) &&
+                  Id(2).Class(1) + Id(0).Class(1) == 2) &&
+                 Id(1).Class(1) >= 1;
+  ASSERT_THAT(c.conjuncts().size(), 3);
+  EXPECT_TRUE(c.conjuncts()[0].different_cells().has_value());
+  EXPECT_THAT(c.conjuncts()[1].DebugString(),
+              "((Id(2).Class(1) + Id(0).Class(1)) == 2)");
+  EXPECT_TRUE(c.conjuncts()[2].entry_range().has_value());
+  for (const Constraint& conjunct : c.conjuncts()) {
+    EXPECT_TRUE(conjunct.conjuncts().empty());
+  }
+
+  EXPECT_TRUE(Constraint(Id(0).Class(0) == 0 || Id(0).Class(1) == 0)
+                  .conjuncts()
+                  .empty());
+  EXPECT_TRUE(Constraint(!(Id(0).Class(0) == 0 && Id(0).Class(1) == 0))
+                  .conjuncts()
+                  .empty());
+}
+
+TEST_F(ExpressionTest, DifferentCellsForm) {
+  Constraint c = Id(0).Class(1) != Id(2).Class(0);
+  ASSERT_TRUE(c.different_cells().has_value());
+  EXPECT_THAT(c.different_cells()->first, IsCell(0, 1));
+  EXPECT_THAT(c.different_cells()->second, IsCell(2, 0));
+
+  EXPECT_FALSE(
+      Constraint(Id(0).Class(1) == Id(2).Class(0)).different_cells());
+  EXPECT_FALSE(
+      Constraint(Id(0).Class(1) != Id(0).Class(1)).different_cells());
+}
+
+}  // namespace puzzle
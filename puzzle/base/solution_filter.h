@@ -26,6 +26,12 @@ class EntryFilter {
 
 class SolutionFilter {
  public:
+  // Identifies the value of class `class_int` for entry `entry_id`.
+  struct Cell {
+    int entry_id;
+    int class_int;
+  };
+
   SolutionFilter() = default;
   SolutionFilter(std::string name, SolutionView::Predicate p,
                  std::vector<int> classes)
@@ -53,6 +59,22 @@ class SolutionFilter {
     }
   }
 
+  // Filter reading exactly the values of `cells`. Classes with a single cell
+  // in `cells` report its entry from `entry_id`.
+  SolutionFilter(std::string name, SolutionView::Predicate p,
+                 std::vector<Cell> cells)
+      : name_(std::move(name)), solution_p_(p), cells_(std::move(cells)) {
+    for (const Cell& cell : cells_) {
+      auto [it, inserted] =
+          class_to_entry_.emplace(cell.class_int, cell.entry_id);
+      if (inserted) {
+        classes_.push_back(cell.class_int);
+      } else if (it->second != cell.entry_id) {
+        it->second = Entry::kBadId;
+      }
+    }
+  }
+
   static std::function<bool(const SolutionFilter& a, const SolutionFilter& b)>
   LtByEntryId(int class_int = -1) {
     return [class_int](const SolutionFilter& a, const SolutionFilter& b) {
@@ -74,12 +96,25 @@ class SolutionFilter {
     return Entry::kBadId;
   }
 
+  // The cells read by this filter if constructed from them, and otherwise
+  // empty.
+  const std::vector<Cell>& cells() const { return cells_; }
+
+  // Text identifying what the predicate computes, including any values it
+  // captures (such as the expression of a Constraint), or empty if there is
+  // none. Filters with the same non-empty key and cells must have the same
+  // predicate, as --puzzle_active_set_cache_dir relies on it.
+  const std::string& key() const { return key_; }
+  void set_key(std::string key) { key_ = std::move(key); }
+
  private:
   std::string name_;
   SolutionView::Predicate solution_p_;
   std::vector<int> classes_;
   int entry_id_ = Entry::kBadId;
   absl::flat_hash_map<int, int> class_to_entry_;
+  std::vector<Cell> cells_;
+  std::string key_;
 };
 
 }  // namespace puzzle
@@ -44,7 +44,7 @@ bool ClassPermuter::AdvancerBase::WithActiveSet(const ActiveSet& other) {
   return true;
 }
 
-void ClassPermuter::AdvancerBase::AdvanceDeltaWithSkip(int delta) {
+int ClassPermuter::AdvancerBase::SkipDelta(int delta) {
   DCHECK(active_set_it_.value());
   active_set_it_.Advance(delta);
   if (!active_set_it_.value()) {
@@ -56,7 +56,7 @@ void ClassPermuter::AdvancerBase::AdvanceDeltaWithSkip(int delta) {
       << "Value returned false after advancing past false block: it("
       << active_set_it_.offset() << " of " << active_set_it_.total()
       << "): " << active_set_->DebugValues();
-  AdvanceDelta(delta);
+  return delta;
 }
 
 // static
@@ -27,7 +27,12 @@ class ClassPermuter {
     // Advances permutation until the the result should be allowed considering
     // 'active_set_'.
     void AdvanceWithSkip() { AdvanceDeltaWithSkip(/*delta=*/1); }
-    void AdvanceDeltaWithSkip(int delta);
+    void AdvanceDeltaWithSkip(int delta) { AdvanceDelta(SkipDelta(delta)); }
+
+    // Moves the iterator over 'active_set_' forward `delta` positions and then
+    // past any disabled positions. Returns the total distance moved, which the
+    // permutation must then be advanced by.
+    int SkipDelta(int delta);
 
     const absl::Span<const int>& current() const { return current_; }
     bool done() const { return current_.empty(); }
@@ -197,6 +202,15 @@ class ClassPermuter {
 
     double Selectivity() const { return advancer_->Selectivity(); }
 
+    // Returns the advancer of this iterator, which must be of the final type
+    // `AdvancerType`. Allows callers which know the concrete permuter to
+    // advance it without virtual dispatch (see StaticClassPermuter).
+    template <typename AdvancerType>
+    AdvancerType* advancer() const {
+      DCHECK(dynamic_cast<AdvancerType*>(advancer_.get()) != nullptr);
+      return static_cast<AdvancerType*>(advancer_.get());
+    }
+
    private:
     bool is_end() const { return advancer_ == nullptr || advancer_->done(); }
 
@@ -5,6 +5,7 @@
 #include "puzzle/class_permuter/class_permuter.h"
 #include "puzzle/class_permuter/factorial_radix.h"
 #include "puzzle/class_permuter/factorial_radix_delete_tracking.h"
+#include "puzzle/class_permuter/static_class_permuter.h"
 #include "puzzle/class_permuter/steinhaus_johnson_trotter.h"
 
 namespace puzzle {
@@ -154,4 +155,65 @@ BENCHMARK_TEMPLATE(BM_PermuterActiveSetSelectivity,
 BENCHMARK_TEMPLATE(BM_PermuterActiveSetSelectivity,
                    MakeClassPermuterFactorialRadixDeleteTracking, 9, 1000000);
 
+// Compares iteration through ClassPermuter::iterator (virtual dispatch per
+// advance) with StaticClassPermuter on the same permuter. With `every_n` > 1
+// the iterators skip through an ActiveSet enabling one in `every_n`
+// permutations, and with `skip_index` >= 0 every other advance is a ValueSkip
+// on that index, as FindNextValid does when a predicate fails.
+template <int depth, int every_n, int skip_index>
+static void BM_PermuterVirtual(benchmark::State& state) {
+  auto p = MakeClassPermuterFactorialRadixDeleteTracking()(depth);
+  ActiveSet::Builder builder(p->permutation_count());
+  for (int i = 0; i < p->permutation_count(); ++i) {
+    builder.Add(i % every_n == 0);
+  }
+  ActiveSet set = builder.DoneAdding();
+
+  for (auto _ : state) {
+    int sum = 0;
+    int step = 0;
+    for (auto it = p->begin().WithActiveSet(set); it != p->end();
+         it += ValueSkip{.value_index = skip_index >= 0 && ++step % 2 == 0
+                                            ? skip_index
+                                            : Entry::kBadId}) {
+      sum += (*it)[0];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+template <int depth, int every_n, int skip_index>
+static void BM_PermuterStatic(benchmark::State& state) {
+  auto p = MakeClassPermuterFactorialRadixDeleteTracking()(depth);
+  ActiveSet::Builder builder(p->permutation_count());
+  for (int i = 0; i < p->permutation_count(); ++i) {
+    builder.Add(i % every_n == 0);
+  }
+  ActiveSet set = builder.DoneAdding();
+
+  for (auto _ : state) {
+    int sum = 0;
+    int step = 0;
+    for (auto it = p->begin().WithActiveSet(set); it != p->end();
+         StaticClassPermuter<depth>::Advance(
+             it, ValueSkip{.value_index = skip_index >= 0 && ++step % 2 == 0
+                                              ? skip_index
+                                              : Entry::kBadId})) {
+      sum += (*it)[0];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_PermuterVirtual, 5, 1, -1);
+BENCHMARK_TEMPLATE(BM_PermuterStatic, 5, 1, -1);
+BENCHMARK_TEMPLATE(BM_PermuterVirtual, 9, 1, -1);
+BENCHMARK_TEMPLATE(BM_PermuterStatic, 9, 1, -1);
+BENCHMARK_TEMPLATE(BM_PermuterVirtual, 9, 7, -1);
+BENCHMARK_TEMPLATE(BM_PermuterStatic, 9, 7, -1);
+BENCHMARK_TEMPLATE(BM_PermuterVirtual, 9, 1, 6);
+BENCHMARK_TEMPLATE(BM_PermuterStatic, 9, 1, 6);
+BENCHMARK_TEMPLATE(BM_PermuterVirtual, 9, 7, 6);
+BENCHMARK_TEMPLATE(BM_PermuterStatic, 9, 7, 6);
+
 }  // namespace puzzle
@@ -1,10 +1,77 @@
 #ifndef PUZZLE_CLASS_PERMUTER_FACTORIAL_RADIX_DELETE_TRACKING_H
 #define PUZZLE_CLASS_PERMUTER_FACTORIAL_RADIX_DELETE_TRACKING_H
 
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "absl/log/check.h"
 #include "puzzle/class_permuter/class_permuter.h"
 
 namespace puzzle {
 
+namespace delete_tracking_internal {
+
+// Largest permutation size supported. Lookup tables hold N * 2^N entries.
+inline constexpr int kMaxStorageSize = 20;
+
+// Contains a map from a radix index position and a bit vector marked with
+// previously selected values from index_ in a permutation to the index for
+// the correspondingly selected value in index_.
+// This is a lookup-table for the function RadixIndexToRawIndex::ComputeValue
+// which is needed in the innermost loop of permutation calculation.
+template <int kMaxPos>
+class RadixIndexToRawIndex {
+ public:
+  static int Get(int position, int bit_vector) {
+    static RadixIndexToRawIndex<kMaxPos> singleton;
+    return singleton.data_[bit_vector * kMaxPos + position];
+  }
+
+ private:
+  RadixIndexToRawIndex() { Initialize(); }
+
+  void Initialize();
+  static int ComputeValue(int position, int delete_bit_vector);
+
+  void Set(int position, int bit_vector, int value) {
+    data_[bit_vector * kMaxPos + position] = value;
+  }
+
+  int data_[kMaxPos << kMaxPos];
+};
+
+// static
+template <int kMaxPos>
+int RadixIndexToRawIndex<kMaxPos>::ComputeValue(int position,
+                                                int delete_bit_vector) {
+  CHECK_LT(position, kMaxPos);
+  CHECK_EQ(delete_bit_vector & (0xffffffff << kMaxPos), 0);
+  for (int j = 0; j <= position; ++j) {
+    if (delete_bit_vector & (1 << j)) ++position;
+  }
+  return position;
+}
+
+template <int kMaxPos>
+void RadixIndexToRawIndex<kMaxPos>::Initialize() {
+  for (int position = 0; position < kMaxPos; ++position) {
+    for (int bv = 0; bv < (1 << kMaxPos); ++bv) {
+      Set(position, bv, ComputeValue(position, bv));
+    }
+  }
+}
+
+constexpr int64_t Factorial(int n) {
+  int64_t ret = 1;
+  for (int i = 2; i <= n; ++i) {
+    ret *= i;
+  }
+  return ret;
+}
+
+}  // namespace delete_tracking_internal
+
 // This implementation is O(class_size^2) turning a position into a
 // permutation but does allows a single position advance for
 // Advance(ValueSkip).
@@ -21,6 +88,15 @@ class ClassPermuterFactorialRadixDeleteTracking final : public ClassPermuter {
     void Advance() override;
     void AdvanceDelta(int dist) override;
     void AdvanceSkip(ValueSkip value_skip) override;
+
+   private:
+    // Sets `current_` from `position_`. Each digit of the factorial radix
+    // position has a compile time divisor, so no division instructions are
+    // needed.
+    template <size_t... kDigits>
+    void SetFromPosition(std::index_sequence<kDigits...>);
+    template <int kDigit>
+    void SetDigit(int& deleted);
   };
 
   explicit ClassPermuterFactorialRadixDeleteTracking(int permutation_size,
@@ -43,6 +119,98 @@ class MakeClassPermuterFactorialRadixDeleteTracking {
                                             int class_int = 0);
 };
 
+template <int kStorageSize>
+ClassPermuterFactorialRadixDeleteTracking<kStorageSize>::Advancer::Advancer(
+    const ClassPermuterFactorialRadixDeleteTracking* permuter)
+    : Base(permuter) {
+  static_assert(kStorageSize <= delete_tracking_internal::kMaxStorageSize,
+                "Permutation indexes use a memory buffer of size N * 2^N");
+}
+
+template <int kStorageSize>
+void ClassPermuterFactorialRadixDeleteTracking<
+    kStorageSize>::Advancer::AdvanceDelta(int dist) {
+  Base::position_ += dist;
+  if (Base::position_ >= Base::permutation_count()) {
+    Base::position_ = Base::permutation_count();
+    Base::set_current(absl::Span<const int>());
+  } else if (dist == 1) {
+    // Positions enumerate permutations in lexicographic order, so the next
+    // position does not need the full radix conversion.
+    std::next_permutation(Base::current_, Base::current_ + kStorageSize);
+  } else {
+    static_assert(kStorageSize <= delete_tracking_internal::kMaxStorageSize,
+                  "Permutation indexes must be useable as a bit vector");
+    SetFromPosition(std::make_index_sequence<kStorageSize - 1>());
+  }
+}
+
+template <int kStorageSize>
+template <size_t... kDigits>
+void ClassPermuterFactorialRadixDeleteTracking<kStorageSize>::Advancer::
+    SetFromPosition(std::index_sequence<kDigits...>) {
+  using delete_tracking_internal::RadixIndexToRawIndex;
+  int deleted = 0;
+  (SetDigit<kDigits>(deleted), ...);
+  const int next = RadixIndexToRawIndex<kStorageSize>::Get(0, deleted);
+  DCHECK_GE(next, 0);
+  Base::current_[kStorageSize - 1] = next;
+}
+
+template <int kStorageSize>
+template <int kDigit>
+void ClassPermuterFactorialRadixDeleteTracking<
+    kStorageSize>::Advancer::SetDigit(int& deleted) {
+  using delete_tracking_internal::RadixIndexToRawIndex;
+  constexpr int kRadix = kStorageSize - kDigit;
+  constexpr int64_t kDiv = delete_tracking_internal::Factorial(kRadix - 1);
+  const int next = RadixIndexToRawIndex<kStorageSize>::Get(
+      (Base::position_ / kDiv) % kRadix, deleted);
+  DCHECK_LT(next, kStorageSize);
+  Base::current_[kDigit] = next;
+  deleted |= (1 << next);
+}
+
+template <int kStorageSize>
+void ClassPermuterFactorialRadixDeleteTracking<
+    kStorageSize>::Advancer::Advance() {
+  AdvanceDelta(/*dist=*/1);
+}
+
+template <int kStorageSize>
+void ClassPermuterFactorialRadixDeleteTracking<
+    kStorageSize>::Advancer::AdvanceSkip(ValueSkip value_skip) {
+  int value = Base::current_[value_skip.value_index];
+  int div = delete_tracking_internal::Factorial(kStorageSize -
+                                               value_skip.value_index - 1);
+  auto still_on_value = [&]() {
+    return !Base::done() && Base::current_[value_skip.value_index] == value;
+  };
+  if (Base::active_set_->is_trivial()) {
+    int delta = div - (Base::position_ % div);
+    do {
+      AdvanceDelta(/*dist=*/delta);
+      delta = div;
+    } while (still_on_value());
+  } else {
+    do {
+      int delta = div - (Base::position_ % div);
+      Base::active_set_it_.Advance(delta);
+      if (!Base::active_set_it_.value()) {
+        int next_delta = Base::active_set_it_.RunSize();
+        delta += next_delta;
+        Base::active_set_it_.Advance(next_delta);
+        DCHECK(Base::active_set_it_.value())
+            << "Value returned false after advancing past false block: it("
+            << Base::active_set_it_.offset() << " of "
+            << Base::active_set_it_.total()
+            << "): " << Base::active_set_->DebugValues();
+      }
+      AdvanceDelta(/*dist=*/delta);
+    } while (still_on_value());
+  }
+}
+
 }  // namespace puzzle
 
 #endif  // PUZZLE_CLASS_PERMUTER_FACTORIAL_RADIX_DELETE_TRACKING_H
@@ -0,0 +1,52 @@
+#ifndef PUZZLE_CLASS_PERMUTER_SHARED_BY_ITERATION_ORDER_H
+#define PUZZLE_CLASS_PERMUTER_SHARED_BY_ITERATION_ORDER_H
+
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+
+#include "absl/base/call_once.h"
+#include "absl/base/const_init.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "puzzle/class_permuter/class_permuter.h"
+
+namespace puzzle {
+
+// Returns the `T(class_permuter)` shared by all permuters with the same type
+// and permutation size as `class_permuter` (and so the same iteration order).
+// The instance is built on first use and lives for the life of the process.
+//
+// Thread-safe. Each instance is built under its own once flag rather than the
+// lock guarding the table, so building one does not block callers wanting
+// another, and concurrent callers wanting the same one wait for a single
+// build.
+template <typename T>
+const T& SharedByIterationOrder(const ClassPermuter* class_permuter) {
+  using Key = std::pair<std::type_index, int>;
+  struct Entry {
+    absl::once_flag once;
+    std::unique_ptr<const T> value;
+  };
+  static absl::Mutex mu(absl::kConstInit);
+  static auto* shared =
+      new absl::flat_hash_map<Key, std::unique_ptr<Entry>>();
+
+  Key key(typeid(*class_permuter), class_permuter->permutation_size());
+  Entry* entry;
+  {
+    absl::MutexLock l(&mu);
+    std::unique_ptr<Entry>& slot = (*shared)[key];
+    if (slot == nullptr) slot = std::make_unique<Entry>();
+    entry = slot.get();
+  }
+  absl::call_once(entry->once, [&]() {
+    entry->value = std::make_unique<const T>(class_permuter);
+  });
+  return *entry->value;
+}
+
+}  // namespace puzzle
+
+#endif  // PUZZLE_CLASS_PERMUTER_SHARED_BY_ITERATION_ORDER_H
@@ -0,0 +1,86 @@
+#include "puzzle/class_permuter/shared_by_iteration_order.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/notification.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "puzzle/class_permuter/factorial_radix.h"
+#include "puzzle/class_permuter/steinhaus_johnson_trotter.h"
+
+namespace puzzle {
+
+// Counts its constructions. Each test uses its own `Tag` so that it starts
+// with nothing shared.
+template <int Tag>
+struct Counted {
+  explicit Counted(const ClassPermuter* class_permuter)
+      : permutation_size(class_permuter->permutation_size()) {
+    ++builds;
+  }
+
+  int permutation_size;
+  static std::atomic<int> builds;
+};
+
+template <int Tag>
+std::atomic<int> Counted<Tag>::builds = 0;
+
+TEST(SharedByIterationOrderTest, SameTypeAndSizeShared) {
+  using T = Counted<0>;
+  std::unique_ptr<ClassPermuter> a = MakeClassPermuterFactorialRadix()(
+      /*permutation_size=*/4, /*class_int=*/0);
+  std::unique_ptr<ClassPermuter> b = MakeClassPermuterFactorialRadix()(
+      /*permutation_size=*/4, /*class_int=*/1);
+
+  const T& from_a = SharedByIterationOrder<T>(a.get());
+  const T& from_b = SharedByIterationOrder<T>(b.get());
+  EXPECT_EQ(&from_a, &from_b);
+  EXPECT_EQ(from_a.permutation_size, 4);
+  EXPECT_EQ(T::builds, 1);
+}
+
+TEST(SharedByIterationOrderTest, DifferentTypeOrSizeNotShared) {
+  using T = Counted<1>;
+  std::unique_ptr<ClassPermuter> radix4 = MakeClassPermuterFactorialRadix()(
+      /*permutation_size=*/4, /*class_int=*/0);
+  std::unique_ptr<ClassPermuter> radix5 = MakeClassPermuterFactorialRadix()(
+      /*permutation_size=*/5, /*class_int=*/0);
+  std::unique_ptr<ClassPermuter> sjt4 =
+      MakeClassPermuterSteinhausJohnsonTrotter()(/*permutation_size=*/4,
+                                                 /*class_int=*/0);
+
+  const T& from_radix4 = SharedByIterationOrder<T>(radix4.get());
+  const T& from_radix5 = SharedByIterationOrder<T>(radix5.get());
+  const T& from_sjt4 = SharedByIterationOrder<T>(sjt4.get());
+  EXPECT_NE(&from_radix4, &from_radix5);
+  EXPECT_NE(&from_radix4, &from_sjt4);
+  EXPECT_EQ(from_radix5.permutation_size, 5);
+  EXPECT_EQ(T::builds, 3);
+}
+
+TEST(SharedByIterationOrderTest, ConcurrentCallersBuildOnce) {
+  using T = Counted<2>;
+  std::unique_ptr<ClassPermuter> permuter = MakeClassPermuterFactorialRadix()(
+      /*permutation_size=*/6, /*class_int=*/0);
+
+  absl::Notification start;
+  std::vector<const T*> got(8);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < got.size(); ++i) {
+    threads.emplace_back([&, i]() {
+      start.WaitForNotification();
+      got[i] = &SharedByIterationOrder<T>(permuter.get());
+    });
+  }
+  start.Notify();
+  for (std::thread& thread : threads) thread.join();
+
+  EXPECT_THAT(got, ::testing::Each(got[0]));
+  EXPECT_EQ(T::builds, 1);
+}
+
+}  // namespace puzzle
@@ -0,0 +1,68 @@
+#ifndef PUZZLE_CLASS_PERMUTER_STATIC_CLASS_PERMUTER_H
+#define PUZZLE_CLASS_PERMUTER_STATIC_CLASS_PERMUTER_H
+
+#include "puzzle/class_permuter/class_permuter.h"
+#include "puzzle/class_permuter/factorial_radix_delete_tracking.h"
+
+namespace puzzle {
+
+// Largest permutation size for which StaticClassPermuterSize will report a
+// match, and so the largest size callers dispatching on it instantiate.
+inline constexpr int kMaxStaticClassPermuterSize = 10;
+
+// Non-virtual equivalents of the ClassPermuter::iterator operations for
+// iterators of a ClassPermuterFactorialRadixDeleteTracking<kStorageSize> (the
+// default --puzzle_class_permuter_type). ClassPermuter::iterator dispatches
+// every advance through the virtual AdvancerBase, whereas these call the final
+// Advancer directly so that the advance can be inlined into the caller's loop.
+template <int kStorageSize>
+class StaticClassPermuter {
+ public:
+  using Permuter = ClassPermuterFactorialRadixDeleteTracking<kStorageSize>;
+  using Advancer = typename Permuter::Advancer;
+
+  // Returns true if iterators of `permuter` may be passed to the methods of
+  // this class.
+  static bool Matches(const ClassPermuter& permuter) {
+    return permuter.permutation_size() == kStorageSize &&
+           dynamic_cast<const Permuter*>(&permuter) != nullptr;
+  }
+
+  // Equivalent to `++it`.
+  static void Increment(ClassPermuter::iterator& it) {
+    Advancer* advancer = it.advancer<Advancer>();
+    if (advancer->active_set().is_trivial()) {
+      advancer->Advance();
+    } else {
+      advancer->AdvanceDelta(advancer->SkipDelta(/*delta=*/1));
+    }
+  }
+
+  // Equivalent to `it += value_skip`.
+  static void Advance(ClassPermuter::iterator& it, ValueSkip value_skip) {
+    if (value_skip.value_index == Entry::kBadId) {
+      Increment(it);
+      return;
+    }
+    it.advancer<Advancer>()->AdvanceSkip(value_skip);
+  }
+};
+
+// Returns `permuter.permutation_size()` if StaticClassPermuter of that size
+// matches `permuter` and the size is at most kMaxStaticClassPermuterSize.
+// Returns 0 otherwise.
+template <int kStorageSize = kMaxStaticClassPermuterSize>
+int StaticClassPermuterSize(const ClassPermuter& permuter) {
+  if constexpr (kStorageSize == 0) {
+    return 0;
+  } else {
+    if (StaticClassPermuter<kStorageSize>::Matches(permuter)) {
+      return kStorageSize;
+    }
+    return StaticClassPermuterSize<kStorageSize - 1>(permuter);
+  }
+}
+
+}  // namespace puzzle
+
+#endif  // PUZZLE_CLASS_PERMUTER_STATIC_CLASS_PERMUTER_H
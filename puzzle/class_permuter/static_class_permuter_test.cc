@@ -0,0 +1,55 @@
+#include "puzzle/class_permuter/static_class_permuter.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "puzzle/active_set/active_set.h"
+#include "puzzle/class_permuter/factorial_radix.h"
+#include "puzzle/class_permuter/factorial_radix_delete_tracking.h"
+
+namespace puzzle {
+
+TEST(StaticClassPermuterTest, Size) {
+  EXPECT_THAT(
+      StaticClassPermuterSize(*MakeClassPermuterFactorialRadixDeleteTracking()(
+          /*permutation_size=*/5)),
+      5);
+  EXPECT_THAT(
+      StaticClassPermuterSize(*MakeClassPermuterFactorialRadixDeleteTracking()(
+          /*permutation_size=*/kMaxStaticClassPermuterSize + 1)),
+      0);
+  EXPECT_THAT(StaticClassPermuterSize(
+                  *MakeClassPermuterFactorialRadix()(/*permutation_size=*/5)),
+              0);
+}
+
+TEST(StaticClassPermuterTest, MatchesIterator) {
+  constexpr int kPermuterSize = 5;
+  auto p = MakeClassPermuterFactorialRadixDeleteTracking()(kPermuterSize);
+
+  ActiveSet::Builder builder(p->permutation_count());
+  for (auto it = p->begin(); it != p->end(); ++it) {
+    builder.Add(it.position() % 3 != 0);
+  }
+  ActiveSet active_set = builder.DoneAdding();
+
+  for (const ActiveSet* set :
+       std::vector<const ActiveSet*>{&ActiveSet::trivial(), &active_set}) {
+    auto expected = p->begin().WithActiveSet(*set);
+    auto actual = p->begin().WithActiveSet(*set);
+    for (int step = 0; expected != p->end(); ++step) {
+      ASSERT_TRUE(actual != p->end());
+      EXPECT_THAT(actual.position(), expected.position());
+      EXPECT_THAT(*actual, ::testing::ElementsAreArray(*expected));
+      // Alternate plain advances with skips on each value index.
+      ValueSkip value_skip;
+      if (step % 2 == 1) value_skip.value_index = (step / 2) % kPermuterSize;
+      expected += value_skip;
+      StaticClassPermuter<kPermuterSize>::Advance(actual, value_skip);
+    }
+    EXPECT_TRUE(actual == p->end());
+  }
+}
+
+}  // namespace puzzle
@@ -1,5 +1,7 @@
 #include "puzzle/class_permuter/value_skip_to_active_set.h"
 
+#include "puzzle/class_permuter/shared_by_iteration_order.h"
+
 namespace puzzle {
 
 ValueSkipToActiveSet::ValueSkipToActiveSet(
@@ -39,4 +41,18 @@ ValueSkipToActiveSet::ValueSkipToActiveSet(
   }
 }
 
+const ValueSkipToActiveSet& ValueSkipToActiveSet::Shared(
+    const ClassPermuter* class_permuter) {
+  return SharedByIterationOrder<ValueSkipToActiveSet>(class_permuter);
+}
+
+int64_t ValueSkipToActiveSet::StorageBytes() const {
+  int64_t ret = active_set_.capacity() * sizeof(std::vector<ActiveSet>);
+  for (const std::vector<ActiveSet>& sets : active_set_) {
+    ret += sets.capacity() * sizeof(ActiveSet);
+    for (const ActiveSet& set : sets) ret += set.StorageBytes();
+  }
+  return ret;
+}
+
 }  // namespace puzzle
@@ -11,6 +11,13 @@ class ValueSkipToActiveSet {
  public:
   explicit ValueSkipToActiveSet(const ClassPermuter* class_permuter);
 
+  // Returns an instance shared by all permuters with the same type and
+  // permutation size as `class_permuter` (and so the same iteration order).
+  // The instance is built on first use and lives for the life of the process.
+  // Thread-safe.
+  static const ValueSkipToActiveSet& Shared(
+      const ClassPermuter* class_permuter);
+
   const ActiveSet& value_skip_set(int position, int value) const {
     if (position >= active_set_.size()) return ActiveSet::trivial();
     if (value >= active_set_[position].size()) return ActiveSet::trivial();
@@ -23,6 +30,10 @@ class ValueSkipToActiveSet {
                           /*value=*/(*it)[value_skip.value_index]);
   }
 
+  // Number of heap bytes owned by the table, including the storage of the
+  // sets it holds.
+  int64_t StorageBytes() const;
+
  private:
   // value_index => value => active_set.
   std::vector<std::vector<ActiveSet>> active_set_;
@@ -41,6 +41,23 @@ TEST(ValueSkipToActiveSet, FiveElements) {
   }
 }
 
+TEST(ValueSkipToActiveSet, SharedBySize) {
+  IntRangeDescriptor d4(4);
+  IntRangeDescriptor d5(5);
+  std::unique_ptr<ClassPermuter> a = MakeClassPermuter(&d5, /*class_int=*/0);
+  std::unique_ptr<ClassPermuter> b = MakeClassPermuter(&d5, /*class_int=*/1);
+  std::unique_ptr<ClassPermuter> c = MakeClassPermuter(&d4);
+
+  EXPECT_EQ(&ValueSkipToActiveSet::Shared(a.get()),
+            &ValueSkipToActiveSet::Shared(b.get()));
+  EXPECT_NE(&ValueSkipToActiveSet::Shared(a.get()),
+            &ValueSkipToActiveSet::Shared(c.get()));
+  EXPECT_EQ(ValueSkipToActiveSet::Shared(c.get())
+                .value_skip_set(/*position=*/3, /*value=*/1)
+                .matches(),
+            4 * 3 * 2 * 1 - 3 * 2 * 1);
+}
+
 template <typename MakePermuterType>
 static void BM_ValueSkipToActiveSet(benchmark::State& state) {
   int depth = state.range(0);
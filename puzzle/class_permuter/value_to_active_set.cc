@@ -0,0 +1,72 @@
+#include "puzzle/class_permuter/value_to_active_set.h"
+
+#include <bit>
+
+#include "puzzle/class_permuter/shared_by_iteration_order.h"
+
+namespace puzzle {
+
+static constexpr int kWordBits = 64;
+
+ValueToActiveSet::ValueToActiveSet(const ClassPermuter* class_permuter)
+    : permutation_count_(class_permuter->permutation_count()) {
+  const int size = class_permuter->permutation_size();
+  const int words = (permutation_count_ + kWordBits - 1) / kWordBits;
+
+  equal_.resize(size);
+  for (int i = 0; i < size; ++i) {
+    equal_[i].resize(size, std::vector<uint64_t>(words, 0));
+  }
+
+  for (auto it = class_permuter->begin(); it != class_permuter->end(); ++it) {
+    const int position = it.position();
+    for (int i = 0; i < size; ++i) {
+      const int value = (*it)[i];
+      CHECK_GE(value, 0);
+      CHECK_LT(value, size);
+      equal_[i][value][position / kWordBits] |= uint64_t{1}
+                                                << (position % kWordBits);
+    }
+  }
+}
+
+// static
+const ValueToActiveSet& ValueToActiveSet::Shared(
+    const ClassPermuter* class_permuter) {
+  return SharedByIterationOrder<ValueToActiveSet>(class_permuter);
+}
+
+ActiveSet ValueToActiveSet::Build(
+    absl::Span<const Predicate> predicates) const {
+  if (predicates.empty()) return ActiveSet::trivial();
+
+  const int words = (permutation_count_ + kWordBits - 1) / kWordBits;
+  std::vector<uint64_t> bits(words, ~uint64_t{0});
+  if (permutation_count_ % kWordBits != 0) {
+    // Only positions in [0, permutation_count_) may be set.
+    bits.back() = (uint64_t{1} << (permutation_count_ % kWordBits)) - 1;
+  }
+  for (const Predicate& p : predicates) {
+    DCHECK_LT(p.position, equal_.size());
+    DCHECK_LT(p.value, equal_[p.position].size());
+    const std::vector<uint64_t>& equal = equal_[p.position][p.value];
+    if (p.equal) {
+      for (int w = 0; w < words; ++w) bits[w] &= equal[w];
+    } else {
+      for (int w = 0; w < words; ++w) bits[w] &= ~equal[w];
+    }
+  }
+
+  ActiveSet::Builder builder(permutation_count_);
+  for (int w = 0; w < words; ++w) {
+    for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+      const int position = w * kWordBits + std::countr_zero(word);
+      builder.AddBlockTo(false, position);
+      builder.Add(true);
+    }
+  }
+  builder.AddBlockTo(false, permutation_count_);
+  return builder.DoneAdding();
+}
+
+}  // namespace puzzle
@@ -0,0 +1,49 @@
+#ifndef PUZZLE_CLASS_PERMUTER_VALUE_TO_ACTIVE_SET_H
+#define PUZZLE_CLASS_PERMUTER_VALUE_TO_ACTIVE_SET_H
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "puzzle/active_set/active_set.h"
+#include "puzzle/class_permuter/class_permuter.h"
+
+namespace puzzle {
+
+// Precomputes, for each (position, value) pair of a ClassPermuter, a bitmap of
+// the permutations which place `value` at `position`. Conjunctions of
+// predicates of the form "entry `position` has (or has not) `value` for this
+// class" can then be turned into an ActiveSet with a few word-wide ANDs per
+// predicate rather than by evaluating the predicates on every permutation.
+class ValueToActiveSet {
+ public:
+  struct Predicate {
+    int position;
+    int value;
+    // If false, the predicate is `!=` rather than `==`.
+    bool equal;
+  };
+
+  explicit ValueToActiveSet(const ClassPermuter* class_permuter);
+
+  // Returns an instance shared by all permuters with the same type and
+  // permutation size as `class_permuter` (and so the same iteration order).
+  // The instance is built on first use and lives for the life of the process.
+  // Thread-safe.
+  static const ValueToActiveSet& Shared(const ClassPermuter* class_permuter);
+
+  // Returns the ActiveSet of permutations which satisfy every element of
+  // `predicates`. The `position` and `value` of each must be in
+  // [0, permutation_size).
+  ActiveSet Build(absl::Span<const Predicate> predicates) const;
+
+ private:
+  int permutation_count_;
+
+  // position => value => bitmap of matching permutation positions.
+  std::vector<std::vector<std::vector<uint64_t>>> equal_;
+};
+
+}  // namespace puzzle
+
+#endif  //  PUZZLE_CLASS_PERMUTER_VALUE_TO_ACTIVE_SET_H
@@ -0,0 +1,79 @@
+#include "puzzle/class_permuter/value_to_active_set.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "puzzle/class_permuter/factory.h"
+
+namespace puzzle {
+
+TEST(ValueToActiveSet, FiveElements) {
+  IntRangeDescriptor d(5);
+  std::unique_ptr<ClassPermuter> permuter = MakeClassPermuter(&d);
+  ValueToActiveSet v2as(permuter.get());
+
+  for (int position : {0, 1, 2, 3, 4}) {
+    for (int value : {0, 1, 2, 3, 4}) {
+      int loops = 0;
+      ActiveSet equal = v2as.Build({{position, value, /*equal=*/true}});
+      for (auto it = permuter->begin().WithActiveSet(equal);
+           it != permuter->end(); ++it) {
+        EXPECT_EQ((*it)[position], value)
+            << "Position: " << position << "; iteration: " << it.position();
+        ++loops;
+      }
+      EXPECT_EQ(loops, 4 * 3 * 2 * 1) << "Value: " << value;
+
+      loops = 0;
+      ActiveSet not_equal = v2as.Build({{position, value, /*equal=*/false}});
+      for (auto it = permuter->begin().WithActiveSet(not_equal);
+           it != permuter->end(); ++it) {
+        EXPECT_NE((*it)[position], value)
+            << "Position: " << position << "; iteration: " << it.position();
+        ++loops;
+      }
+      EXPECT_EQ(loops, (5 - 1) * 4 * 3 * 2 * 1) << "Value: " << value;
+    }
+  }
+}
+
+TEST(ValueToActiveSet, Conjunction) {
+  IntRangeDescriptor d(5);
+  std::unique_ptr<ClassPermuter> permuter = MakeClassPermuter(&d);
+  ValueToActiveSet v2as(permuter.get());
+
+  ActiveSet as = v2as.Build({{/*position=*/0, /*value=*/3, /*equal=*/true},
+                             {/*position=*/1, /*value=*/0, /*equal=*/false},
+                             {/*position=*/2, /*value=*/4, /*equal=*/false}});
+  int loops = 0;
+  for (auto it = permuter->begin().WithActiveSet(as); it != permuter->end();
+       ++it) {
+    EXPECT_EQ((*it)[0], 3);
+    EXPECT_NE((*it)[1], 0);
+    EXPECT_NE((*it)[2], 4);
+    ++loops;
+  }
+  // 24 with (0)=3, less 6 with (1)=0 and 6 with (2)=4, plus the 2 with both.
+  EXPECT_EQ(loops, 24 - 6 - 6 + 2);
+  EXPECT_EQ(as.matches(), loops);
+
+  EXPECT_TRUE(v2as.Build({}).is_trivial());
+}
+
+TEST(ValueToActiveSet, SharedBySize) {
+  IntRangeDescriptor d4(4);
+  IntRangeDescriptor d5(5);
+  std::unique_ptr<ClassPermuter> a = MakeClassPermuter(&d5, /*class_int=*/0);
+  std::unique_ptr<ClassPermuter> b = MakeClassPermuter(&d5, /*class_int=*/1);
+  std::unique_ptr<ClassPermuter> c = MakeClassPermuter(&d4);
+
+  EXPECT_EQ(&ValueToActiveSet::Shared(a.get()),
+            &ValueToActiveSet::Shared(b.get()));
+  EXPECT_NE(&ValueToActiveSet::Shared(a.get()),
+            &ValueToActiveSet::Shared(c.get()));
+  EXPECT_EQ(ValueToActiveSet::Shared(c.get())
+                .Build({{/*position=*/3, /*value=*/1, /*equal=*/true}})
+                .matches(),
+            3 * 2 * 1);
+}
+
+}  // namespace puzzle
@@ -0,0 +1,102 @@
+#include "puzzle/solution_permuter/active_set_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "vlog.h"
+
+namespace puzzle {
+
+namespace {
+
+// Files start with kMagic, then kVersion and the fingerprint, each native
+// endian. kVersion changes with the format of FilterToActiveSet::Serialize.
+constexpr char kMagic[4] = {'P', 'Z', 'A', 'S'};
+constexpr uint32_t kVersion = 1;
+constexpr int kHeaderSize =
+    sizeof(kMagic) + sizeof(kVersion) + sizeof(uint64_t);
+
+std::string Header(uint64_t fingerprint) {
+  std::string header(kHeaderSize, '\0');
+  char* out = header.data();
+  std::memcpy(out, kMagic, sizeof(kMagic));
+  std::memcpy(out + sizeof(kMagic), &kVersion, sizeof(kVersion));
+  std::memcpy(out + sizeof(kMagic) + sizeof(kVersion), &fingerprint,
+              sizeof(fingerprint));
+  return header;
+}
+
+}  // namespace
+
+void Fingerprinter::Add(absl::string_view bytes) {
+  // Prefixed by the size so that adjacent strings cannot run together.
+  Add(static_cast<int64_t>(bytes.size()));
+  for (unsigned char c : bytes) {
+    fingerprint_ ^= c;
+    fingerprint_ *= 1099511628211ull;
+  }
+}
+
+void Fingerprinter::Add(int64_t value) {
+  for (int i = 0; i < sizeof(value); ++i) {
+    fingerprint_ ^= (static_cast<uint64_t>(value) >> (8 * i)) & 0xff;
+    fingerprint_ *= 1099511628211ull;
+  }
+}
+
+std::string ActiveSetCache::Path(uint64_t fingerprint) const {
+  return absl::StrFormat("%s/%016x.active_sets", dir_, fingerprint);
+}
+
+absl::StatusOr<bool> ActiveSetCache::Load(
+    uint64_t fingerprint,
+    absl::Span<const ClassPermuter* const> class_permuters,
+    FilterToActiveSet* filter_to_active_set) const {
+  std::ifstream in(Path(fingerprint), std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  // Read straight into a buffer of the file's size. Deserialize then copies
+  // the runs into ActiveSets, which own their storage, so loading is not
+  // zero-copy.
+  std::string data(static_cast<size_t>(in.tellg()), '\0');
+  in.seekg(0);
+  if (!in.read(data.data(), data.size())) {
+    return absl::DataLossError(
+        absl::StrCat("Could not read ", Path(fingerprint)));
+  }
+  if (absl::string_view(data).substr(0, kHeaderSize) != Header(fingerprint)) {
+    VLOG(1) << "Ignoring " << Path(fingerprint) << " with a different header";
+    return false;
+  }
+  RETURN_IF_ERROR(filter_to_active_set->Deserialize(
+      absl::string_view(data).substr(kHeaderSize), class_permuters));
+  return true;
+}
+
+absl::Status ActiveSetCache::Save(
+    uint64_t fingerprint, const FilterToActiveSet& filter_to_active_set) const {
+  const std::string path = Path(fingerprint);
+  absl::BitGen bitgen;
+  const std::string tmp_path =
+      absl::StrFormat("%s.%016x.tmp", path, absl::Uniform<uint64_t>(bitgen));
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out << Header(fingerprint) << filter_to_active_set.Serialize();
+    out.close();
+    if (!out) {
+      std::remove(tmp_path.c_str());
+      return absl::UnavailableError(absl::StrCat("Could not write ", tmp_path));
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    return absl::UnavailableError(absl::StrCat("Could not rename to ", path));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace puzzle
@@ -0,0 +1,59 @@
+#ifndef PUZZLE_SOLUTION_PERMUTER_ACTIVE_SET_CACHE_H
+#define PUZZLE_SOLUTION_PERMUTER_ACTIVE_SET_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "puzzle/class_permuter/class_permuter.h"
+#include "puzzle/solution_permuter/filter_to_active_set.h"
+
+namespace puzzle {
+
+// Accumulates a fingerprint of the inputs which determine a prepared
+// FilterToActiveSet. Unlike absl::Hash, the result is stable across
+// processes (FNV-1a).
+class Fingerprinter {
+ public:
+  void Add(absl::string_view bytes);
+  void Add(int64_t value);
+
+  uint64_t fingerprint() const { return fingerprint_; }
+
+ private:
+  uint64_t fingerprint_ = 14695981039346656037ull;
+};
+
+// Stores the state of prepared FilterToActiveSets in files under `dir`, one
+// per fingerprint, so that a later process preparing the same filters may
+// load them rather than build them again.
+class ActiveSetCache {
+ public:
+  explicit ActiveSetCache(std::string dir) : dir_(std::move(dir)) {}
+
+  // Replaces the state of `filter_to_active_set` with that stored for
+  // `fingerprint`. Returns false if nothing is stored for it. See
+  // FilterToActiveSet::Deserialize for `class_permuters`.
+  absl::StatusOr<bool> Load(
+      uint64_t fingerprint,
+      absl::Span<const ClassPermuter* const> class_permuters,
+      FilterToActiveSet* filter_to_active_set) const;
+
+  // Stores the state of `filter_to_active_set` for `fingerprint`, replacing
+  // anything stored. The file is written under a temporary name and renamed,
+  // so concurrent readers never see a partial file.
+  absl::Status Save(uint64_t fingerprint,
+                    const FilterToActiveSet& filter_to_active_set) const;
+
+ private:
+  std::string Path(uint64_t fingerprint) const;
+
+  std::string dir_;
+};
+
+}  // namespace puzzle
+
+#endif  // PUZZLE_SOLUTION_PERMUTER_ACTIVE_SET_CACHE_H
@@ -0,0 +1,197 @@
+#include "puzzle/solution_permuter/active_set_cache.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "puzzle/base/solution_filter.h"
+#include "puzzle/class_permuter/class_permuter.h"
+#include "puzzle/class_permuter/factory.h"
+#include "puzzle/solution_permuter/filter_to_active_set.h"
+
+using ::testing::ElementsAreArray;
+using ::testing::Ne;
+
+namespace puzzle {
+
+TEST(FingerprinterTest, Stable) {
+  Fingerprinter a;
+  a.Add("foo");
+  a.Add(int64_t{3});
+  Fingerprinter b;
+  b.Add("foo");
+  b.Add(int64_t{3});
+  EXPECT_THAT(a.fingerprint(), b.fingerprint());
+
+  Fingerprinter c;
+  c.Add("foo");
+  c.Add(int64_t{4});
+  EXPECT_THAT(a.fingerprint(), Ne(c.fingerprint()));
+}
+
+TEST(FingerprinterTest, StringsDoNotRunTogether) {
+  Fingerprinter a;
+  a.Add("ab");
+  a.Add("c");
+  Fingerprinter b;
+  b.Add("a");
+  b.Add("bc");
+  EXPECT_THAT(a.fingerprint(), Ne(b.fingerprint()));
+}
+
+class ActiveSetCacheTest : public ::testing::Test {
+ protected:
+  ActiveSetCacheTest() : entry_descriptor_(MakeEntryDescriptor()) {
+    permuter_a_ = MakeClassPermuter(entry_descriptor_.AllClassValues(0), 0);
+    permuter_b_ = MakeClassPermuter(entry_descriptor_.AllClassValues(1), 1);
+  }
+
+  static EntryDescriptor MakeEntryDescriptor() {
+    std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+    class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+    class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+    return EntryDescriptor(absl::make_unique<IntRangeDescriptor>(3),
+                           absl::make_unique<StringDescriptor>(
+                               std::vector<std::string>{"a", "b"}),
+                           std::move(class_descriptors));
+  }
+
+  // Builds active sets and pair tables for `builder`.
+  void Build(FilterToActiveSet* builder) {
+    SolutionFilter filter(
+        "a is 0 and b is 1 for id 0",
+        [](const SolutionView& s) {
+          return s.Id(0).Class(0) == 0 && s.Id(0).Class(1) == 1;
+        },
+        {0, 1});
+    ASSERT_TRUE(builder
+                    ->Build(permuter_a_.get(), permuter_b_.get(), {filter},
+                            FilterToActiveSet::PairClassMode::kMakePairs)
+                    .ok());
+  }
+
+  std::vector<const ClassPermuter*> class_permuters() const {
+    return {permuter_a_.get(), permuter_b_.get()};
+  }
+
+  EntryDescriptor entry_descriptor_;
+  std::unique_ptr<ClassPermuter> permuter_a_;
+  std::unique_ptr<ClassPermuter> permuter_b_;
+};
+
+TEST_F(ActiveSetCacheTest, RoundTrip) {
+  FilterToActiveSet built(&entry_descriptor_);
+  Build(&built);
+  ActiveSetCache cache(::testing::TempDir());
+  ASSERT_TRUE(cache.Save(/*fingerprint=*/1, built).ok());
+
+  FilterToActiveSet loaded(&entry_descriptor_);
+  absl::StatusOr<bool> found =
+      cache.Load(/*fingerprint=*/1, class_permuters(), &loaded);
+  ASSERT_TRUE(found.ok()) << found.status();
+  EXPECT_TRUE(*found);
+  for (int class_int : {0, 1}) {
+    EXPECT_THAT(loaded.active_set(class_int).EnabledValues(),
+                ElementsAreArray(built.active_set(class_int).EnabledValues()));
+  }
+  EXPECT_THAT(loaded.pair_entries(), built.pair_entries());
+  for (int a_val = 0; a_val < permuter_a_->permutation_count(); ++a_val) {
+    EXPECT_THAT(loaded.active_set_pair(0, a_val, 1).EnabledValues(),
+                ElementsAreArray(
+                    built.active_set_pair(0, a_val, 1).EnabledValues()));
+  }
+}
+
+TEST_F(ActiveSetCacheTest, Missing) {
+  ActiveSetCache cache(::testing::TempDir());
+  FilterToActiveSet loaded(&entry_descriptor_);
+  absl::StatusOr<bool> found =
+      cache.Load(/*fingerprint=*/2, class_permuters(), &loaded);
+  ASSERT_TRUE(found.ok()) << found.status();
+  EXPECT_FALSE(*found);
+}
+
+TEST_F(ActiveSetCacheTest, Truncated) {
+  FilterToActiveSet built(&entry_descriptor_);
+  Build(&built);
+  ActiveSetCache cache(::testing::TempDir());
+  ASSERT_TRUE(cache.Save(/*fingerprint=*/3, built).ok());
+  const std::string path =
+      absl::StrCat(::testing::TempDir(), "/0000000000000003.active_sets");
+  std::string contents;
+  {
+    std::ifstream in(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+  }
+  ASSERT_GT(contents.size(), 24);
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << contents.substr(0, contents.size() - 4);
+  }
+
+  FilterToActiveSet loaded(&entry_descriptor_);
+  EXPECT_FALSE(cache.Load(/*fingerprint=*/3, class_permuters(), &loaded).ok());
+  // Left as it was.
+  EXPECT_TRUE(loaded.active_set(0).is_trivial());
+}
+
+// Sets of two classes with 6 permutations each, and one pair table entry
+// from class 0 to class 1 at `a_val`.
+static std::string PairData(int a_val, int b_total) {
+  std::vector<int32_t> values = {/*classes=*/2,
+                                 /*class 0=*/6, -1,
+                                 /*class 1=*/6, -1,
+                                 /*pair tables=*/1, 0, 1,
+                                 /*entries=*/1, a_val, b_total, 1, 0, 1,
+                                 /*dropped pairs=*/0};
+  return std::string(reinterpret_cast<const char*>(values.data()),
+                     values.size() * sizeof(int32_t));
+}
+
+TEST_F(ActiveSetCacheTest, DeserializeChecksPermutations) {
+  FilterToActiveSet loaded(&entry_descriptor_);
+  ASSERT_TRUE(loaded.Deserialize(PairData(5, 6), class_permuters()).ok());
+  EXPECT_THAT(loaded.active_set_pair(0, 5, 1).EnabledValues(),
+              ElementsAreArray({0}));
+
+  // Keys past the permutations of class 0.
+  EXPECT_TRUE(absl::IsInvalidArgument(
+      loaded.Deserialize(PairData(6, 6), class_permuters())));
+  EXPECT_TRUE(absl::IsInvalidArgument(
+      loaded.Deserialize(PairData(-1, 6), class_permuters())));
+  // A set not sized for the permutations of class 1.
+  EXPECT_TRUE(absl::IsInvalidArgument(
+      loaded.Deserialize(PairData(5, 24), class_permuters())));
+  // Left as the last successful load.
+  EXPECT_THAT(loaded.active_set_pair(0, 5, 1).EnabledValues(),
+              ElementsAreArray({0}));
+}
+
+TEST_F(ActiveSetCacheTest, DeserializeChecksDroppedPairs) {
+  for (int class_b : {1, 2}) {
+    std::vector<int32_t> values = {/*classes=*/2,
+                                   /*class 0=*/6, -1,
+                                   /*class 1=*/6, -1,
+                                   /*pair tables=*/0,
+                                   /*dropped pairs=*/1, 0, class_b};
+    FilterToActiveSet loaded(&entry_descriptor_);
+    absl::Status st = loaded.Deserialize(
+        absl::string_view(reinterpret_cast<const char*>(values.data()),
+                          values.size() * sizeof(int32_t)),
+        class_permuters());
+    if (class_b == 1) {
+      ASSERT_TRUE(st.ok()) << st;
+      EXPECT_TRUE(loaded.pair_dropped(0, 1));
+    } else {
+      EXPECT_TRUE(absl::IsInvalidArgument(st)) << st;
+    }
+  }
+}
+
+}  // namespace puzzle
@@ -64,6 +64,8 @@ class ClassPairSelectivity {
   // cost of computing the pair-wise active sets (N^2 cost). But this is
   // neither the expected cost of the computation (early exit), nor is
   // that even the ideal metric which is the ROI on future compute reduction.
+  // --puzzle_pair_class_burn_down_roi orders by sampled estimates of both
+  // instead.
   bool operator<(const ClassPairSelectivity& other) const {
     if (computed() ^ other.computed()) {
       // Computed is "greater than" non-computed.
@@ -1,8 +1,20 @@
 #include "puzzle/solution_permuter/filter_to_active_set.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <tuple>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "puzzle/base/all_match.h"
+#include "vlog.h"
 
 ABSL_FLAG(bool, puzzle_value_skip_to_active_set, false,
           "If true, uses ValueSkipToActiveSet to restrict iterations through "
@@ -19,6 +31,80 @@ ABSL_FLAG(bool, puzzle_filter_pair_prune_skip_outer, false,
 
 namespace puzzle {
 
+namespace {
+
+std::vector<int> SortedKeys(
+    const absl::flat_hash_map<int, absl::flat_hash_set<int>>& map) {
+  std::vector<int> keys;
+  keys.reserve(map.size());
+  for (const auto& [key, unused] : map) keys.push_back(key);
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+// Appends `set` to `out` as its total, its number of runs of enabled
+// positions (-1 if trivial), and the start and size of each run.
+void SerializeActiveSet(const ActiveSet& set, std::vector<int32_t>* out) {
+  out->push_back(set.total());
+  if (set.is_trivial()) {
+    out->push_back(-1);
+    return;
+  }
+  const int count_index = out->size();
+  out->push_back(0);
+  int run_end = -1;
+  for (int position : set.EnabledValues()) {
+    if (position == run_end) {
+      ++out->back();
+    } else {
+      out->push_back(position);
+      out->push_back(1);
+      ++(*out)[count_index];
+    }
+    run_end = position + 1;
+  }
+}
+
+// Reads values written by SerializeActiveSet from the front of `data`.
+class ActiveSetReader {
+ public:
+  explicit ActiveSetReader(absl::Span<const int32_t> data) : data_(data) {}
+
+  bool done() const { return data_.empty(); }
+
+  absl::StatusOr<int32_t> Next() {
+    if (data_.empty()) return absl::DataLossError("Truncated active sets");
+    int32_t ret = data_.front();
+    data_.remove_prefix(1);
+    return ret;
+  }
+
+  absl::StatusOr<ActiveSet> NextSet() {
+    ASSIGN_OR_RETURN(int32_t total, Next());
+    ASSIGN_OR_RETURN(int32_t runs, Next());
+    if (runs < 0) return ActiveSet::trivial();
+    ActiveSet::Builder builder(total);
+    int offset = 0;
+    for (int i = 0; i < runs; ++i) {
+      ASSIGN_OR_RETURN(int32_t start, Next());
+      ASSIGN_OR_RETURN(int32_t size, Next());
+      if (start < offset || size <= 0 || start + size > total) {
+        return absl::DataLossError("Bad run in active set");
+      }
+      builder.AddBlockTo(false, start);
+      builder.AddBlock(true, size);
+      offset = start + size;
+    }
+    builder.AddBlockTo(false, total);
+    return builder.DoneAdding();
+  }
+
+ private:
+  absl::Span<const int32_t> data_;
+};
+
+}  // namespace
+
 std::ostream& operator<<(std::ostream& out,
                          FilterToActiveSet::SingleClassBuild val) {
   switch (val) {
@@ -74,18 +160,114 @@ FilterToActiveSet::FilterToActiveSet(const EntryDescriptor* entry_descriptor,
 FilterToActiveSet::FilterToActiveSet(const FilterToActiveSet& other)
     : active_sets_(other.active_sets_),
       active_set_pairs_(other.active_set_pairs_),
+      pair_bytes_(other.pair_bytes_.load()),
+      pair_memory_budget_(other.pair_memory_budget_),
       mutable_solution_(other.mutable_solution_.descriptor()),
       solution_(mutable_solution_.TestableSolution()),
-      profiler_(other.profiler_) {}
+      profiler_(other.profiler_) {
+  absl::MutexLock l(&other.dropped_mu_);
+  dropped_pairs_ = other.dropped_pairs_;
+}
+
+bool FilterToActiveSet::pair_dropped(int class_a, int class_b) const {
+  absl::MutexLock l(&dropped_mu_);
+  return dropped_pairs_.contains(
+      {std::min(class_a, class_b), std::max(class_a, class_b)});
+}
+
+int FilterToActiveSet::dropped_pair_count() const {
+  absl::MutexLock l(&dropped_mu_);
+  return dropped_pairs_.size();
+}
+
+int64_t FilterToActiveSet::active_set_bytes() const {
+  int64_t ret = active_sets_.capacity() * sizeof(ActiveSet);
+  for (const ActiveSet& set : active_sets_) ret += set.StorageBytes();
+  return ret;
+}
+
+int64_t FilterToActiveSet::value_skip_bytes() const {
+  // Descriptors of the same size share a table, which is counted once.
+  absl::flat_hash_set<const ValueSkipToActiveSet*> counted;
+  int64_t ret = 0;
+  for (const auto& [unused, vs2as] : value_skip_to_active_set_) {
+    if (vs2as != nullptr && counted.insert(vs2as).second) {
+      ret += vs2as->StorageBytes();
+    }
+  }
+  return ret;
+}
+
+int FilterToActiveSet::pair_entries() const {
+  int ret = 0;
+  for (const auto& pairs : active_set_pairs_) {
+    for (const ActiveSetPair& pair : pairs) ret += pair.size();
+  }
+  return ret;
+}
+
+std::string FilterToActiveSet::MemoryDebugString() const {
+  std::string ret = absl::StrCat(
+      "active sets: ", active_set_bytes(), "B; pair tables: ", pair_bytes(),
+      "B in ", pair_entries(), " sets");
+  if (int64_t bytes = value_skip_bytes(); bytes > 0) {
+    absl::StrAppend(&ret, "; value skip tables: ", bytes, "B");
+  }
+  if (int dropped = dropped_pair_count(); dropped > 0) {
+    absl::StrAppend(&ret, "; dropped pair tables: ", dropped);
+  }
+  return ret;
+}
+
+bool FilterToActiveSet::CanMakePair(int class_a, int class_b) const {
+  if (pair_dropped(class_a, class_b)) return false;
+  return pair_memory_budget_ == 0 || pair_bytes_.load() < pair_memory_budget_;
+}
+
+bool FilterToActiveSet::AssignPair(int class_a, int a_val, int class_b,
+                                   ActiveSet a_b_set) {
+  ActiveSetPair& pair = active_set_pairs_[class_a][class_b];
+  const int64_t before = pair.StorageBytes();
+  pair.Assign(a_val, std::move(a_b_set));
+  const int64_t delta = pair.StorageBytes() - before;
+  const int64_t bytes = pair_bytes_.fetch_add(delta) + delta;
+  if (pair_memory_budget_ == 0 || bytes <= pair_memory_budget_) return true;
+  VLOG(1) << "Dropping pair tables for (" << class_a << "," << class_b
+          << "): " << bytes << " > " << pair_memory_budget_;
+  DropPair(class_a, class_b);
+  return false;
+}
+
+void FilterToActiveSet::DropPair(int class_a, int class_b) {
+  for (auto [outer, inner] : {std::make_pair(class_a, class_b),
+                              std::make_pair(class_b, class_a)}) {
+    ActiveSetPair& pair = active_set_pairs_[outer][inner];
+    pair_bytes_.fetch_sub(pair.StorageBytes());
+    pair = ActiveSetPair();
+  }
+  absl::MutexLock l(&dropped_mu_);
+  dropped_pairs_.emplace(std::min(class_a, class_b),
+                         std::max(class_a, class_b));
+}
+
+std::pair<ActiveSetPair, ActiveSetPair> FilterToActiveSet::TakePairs(
+    int class_a, int class_b) {
+  std::pair<ActiveSetPair, ActiveSetPair> ret(
+      std::move(active_set_pairs_[class_a][class_b]),
+      std::move(active_set_pairs_[class_b][class_a]));
+  active_set_pairs_[class_a][class_b] = ActiveSetPair();
+  active_set_pairs_[class_b][class_a] = ActiveSetPair();
+  pair_bytes_.fetch_sub(ret.first.StorageBytes() +
+                        ret.second.StorageBytes());
+  return ret;
+}
 
 void FilterToActiveSet::SetupPermuter(const ClassPermuter* class_permuter) {
   if (!absl::GetFlag(FLAGS_puzzle_value_skip_to_active_set)) return;
 
-  const Descriptor* d = class_permuter->descriptor();
-  if (value_skip_to_active_set_[d] == nullptr) {
-    value_skip_to_active_set_[d] =
-        absl::make_unique<ValueSkipToActiveSet>(class_permuter);
-  }
+  const ValueSkipToActiveSet*& vs2as =
+      value_skip_to_active_set_[class_permuter->descriptor()];
+  if (vs2as == nullptr) vs2as = &ValueSkipToActiveSet::Shared(class_permuter);
 }
 
 absl::Status FilterToActiveSet::SetupBuild(
@@ -105,6 +287,144 @@ absl::Status FilterToActiveSet::SetupBuild(
   return absl::OkStatus();
 }
 
+std::string FilterToActiveSet::Serialize() const {
+  std::vector<int32_t> out;
+  out.push_back(active_sets_.size());
+  for (const ActiveSet& set : active_sets_) SerializeActiveSet(set, &out);
+
+  const int pair_count_index = out.size();
+  out.push_back(0);
+  for (int class_a = 0; class_a < active_set_pairs_.size(); ++class_a) {
+    for (int class_b = 0; class_b < active_set_pairs_[class_a].size();
+         ++class_b) {
+      const ActiveSetPair& pair = active_set_pairs_[class_a][class_b];
+      if (pair.size() == 0) continue;
+      ++out[pair_count_index];
+      out.push_back(class_a);
+      out.push_back(class_b);
+      out.push_back(pair.size());
+      pair.ForEach([&](int a_val, const ActiveSet& set) {
+        out.push_back(a_val);
+        SerializeActiveSet(set, &out);
+      });
+    }
+  }
+
+  {
+    absl::MutexLock l(&dropped_mu_);
+    out.push_back(dropped_pairs_.size());
+    for (const auto& [class_a, class_b] : dropped_pairs_) {
+      out.push_back(class_a);
+      out.push_back(class_b);
+    }
+  }
+  return std::string(reinterpret_cast<const char*>(out.data()),
+                     out.size() * sizeof(int32_t));
+}
+
+absl::Status FilterToActiveSet::Deserialize(
+    absl::string_view data,
+    absl::Span<const ClassPermuter* const> class_permuters) {
+  if (data.size() % sizeof(int32_t) != 0) {
+    return absl::DataLossError("Active sets not a whole number of values");
+  }
+  // Copied for alignment.
+  std::vector<int32_t> values(data.size() / sizeof(int32_t));
+  std::memcpy(values.data(), data.data(), data.size());
+  ActiveSetReader reader(values);
+
+  const int num_classes = active_sets_.size();
+  if (class_permuters.size() != num_classes) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        class_permuters.size(), " class permuters for ", num_classes,
+        " classes"));
+  }
+  for (int class_int = 0; class_int < num_classes; ++class_int) {
+    if (class_permuters[class_int]->class_int() != class_int) {
+      return absl::InvalidArgumentError("Class permuters not by class_int");
+    }
+  }
+  // Non-trivial sets must cover exactly the permutations of their class.
+  auto check_total = [&](const ActiveSet& set, int class_int) {
+    const int count = class_permuters[class_int]->permutation_count();
+    if (set.is_trivial() || set.total() == count) return absl::OkStatus();
+    return absl::InvalidArgumentError(
+        absl::StrCat("Active set of size ", set.total(), " for class ",
+                     class_int, " with ", count, " permutations"));
+  };
+  auto check_class = [&](int32_t class_int) {
+    if (class_int >= 0 && class_int < num_classes) return absl::OkStatus();
+    return absl::InvalidArgumentError(
+        absl::StrCat("Bad class_int in pair table: ", class_int));
+  };
+
+  ASSIGN_OR_RETURN(int32_t serialized_classes, reader.Next());
+  if (serialized_classes != num_classes) {
+    return absl::DataLossError(absl::StrCat(
+        "Active sets for ", serialized_classes, " classes, not ", num_classes));
+  }
+  std::vector<ActiveSet> active_sets;
+  for (int class_int = 0; class_int < num_classes; ++class_int) {
+    ASSIGN_OR_RETURN(ActiveSet set, reader.NextSet());
+    RETURN_IF_ERROR(check_total(set, class_int));
+    active_sets.push_back(std::move(set));
+  }
+
+  std::vector<std::vector<ActiveSetPair>> active_set_pairs(num_classes);
+  for (auto& pairs : active_set_pairs) pairs.resize(num_classes);
+  int64_t pair_bytes = 0;
+  ASSIGN_OR_RETURN(int32_t pair_count, reader.Next());
+  for (int i = 0; i < pair_count; ++i) {
+    ASSIGN_OR_RETURN(int32_t class_a, reader.Next());
+    ASSIGN_OR_RETURN(int32_t class_b, reader.Next());
+    ASSIGN_OR_RETURN(int32_t entries, reader.Next());
+    RETURN_IF_ERROR(check_class(class_a));
+    RETURN_IF_ERROR(check_class(class_b));
+    const int a_count = class_permuters[class_a]->permutation_count();
+    ActiveSetPair& pair = active_set_pairs[class_a][class_b];
+    for (int j = 0; j < entries; ++j) {
+      ASSIGN_OR_RETURN(int32_t a_val, reader.Next());
+      ASSIGN_OR_RETURN(ActiveSet set, reader.NextSet());
+      if (a_val < 0 || a_val >= a_count) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Pair table key ", a_val, " for class ", class_a, " with ",
+            a_count, " permutations"));
+      }
+      if (!pair.CanAssign(a_val)) {
+        return absl::InvalidArgumentError("Pair table keys out of order");
+      }
+      RETURN_IF_ERROR(check_total(set, class_b));
+      pair.Assign(a_val, std::move(set));
+    }
+    pair_bytes += pair.StorageBytes();
+  }
+
+  absl::flat_hash_set<std::pair<int, int>> dropped_pairs;
+  ASSIGN_OR_RETURN(int32_t dropped_count, reader.Next());
+  for (int i = 0; i < dropped_count; ++i) {
+    ASSIGN_OR_RETURN(int32_t class_a, reader.Next());
+    ASSIGN_OR_RETURN(int32_t class_b, reader.Next());
+    RETURN_IF_ERROR(check_class(class_a));
+    RETURN_IF_ERROR(check_class(class_b));
+    if (class_a >= class_b) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Dropped pair (", class_a, ",", class_b, ") not in class order"));
+    }
+    dropped_pairs.emplace(class_a, class_b);
+  }
+  if (!reader.done()) return absl::DataLossError("Trailing active set data");
+
+  for (const ClassPermuter* class_permuter : class_permuters) {
+    SetupPermuter(class_permuter);
+  }
+  active_sets_ = std::move(active_sets);
+  active_set_pairs_ = std::move(active_set_pairs);
+  pair_bytes_ = pair_bytes;
+  absl::MutexLock l(&dropped_mu_);
+  dropped_pairs_ = std::move(dropped_pairs);
+  return absl::OkStatus();
+}
+
 void FilterToActiveSet::Advance(const ValueSkipToActiveSet* vs2as,
                                 ValueSkip value_skip,
                                 ClassPermuter::iterator* it) const {
@@ -136,10 +456,10 @@ void FilterToActiveSet::SingleIterate(
                            ValueSkip& value_skip)>
         on_item) {
   const int class_int = permuter->class_int();
-  ValueSkipToActiveSet* vs2as = nullptr;
+  const ValueSkipToActiveSet* vs2as = nullptr;
   if (auto it = value_skip_to_active_set_.find(permuter->descriptor());
       it != value_skip_to_active_set_.end()) {
-    vs2as = it->second.get();
+    vs2as = it->second;
   }
 
   ValueSkip value_skip;
@@ -226,6 +546,7 @@ absl::Status FilterToActiveSet::SetupPairBuild(
 
 void FilterToActiveSet::DualIterate(
     const ClassPermuter* outer, const ClassPermuter* inner,
+    const ActiveSetPair& outer_inner_pair,
     absl::FunctionRef<void(void)> on_outer_before,
     absl::FunctionRef<bool(const ClassPermuter::iterator& it_outer,
                            const ClassPermuter::iterator& it_inner,
@@ -236,9 +557,8 @@ void FilterToActiveSet::DualIterate(
         on_outer_after) {
   const int class_outer = outer->class_int();
   const int class_inner = inner->class_int();
-  ActiveSetPair& outer_inner_pair = active_set_pairs_[class_outer][class_inner];
-  ValueSkipToActiveSet* vs2as_inner =
-      value_skip_to_active_set_[inner->descriptor()].get();
+  const ValueSkipToActiveSet* vs2as_inner =
+      value_skip_to_active_set_[inner->descriptor()];
 
   Position pos;
   pos.position = 0;
@@ -282,6 +602,16 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kBackAndForth>(
   RETURN_IF_ERROR(
       SetupPairBuild(permuter_a, permuter_b, predicates_by_a, predicates_by_b));
 
+  if (pair_class_mode == PairClassMode::kMakePairs &&
+      !CanMakePair(permuter_a->class_int(), permuter_b->class_int())) {
+    pair_class_mode = PairClassMode::kSingleton;
+  }
+  std::pair<ActiveSetPair, ActiveSetPair> previous_pairs;
+  if (pair_class_mode == PairClassMode::kMakePairs) {
+    previous_pairs =
+        TakePairs(permuter_a->class_int(), permuter_b->class_int());
+  }
+
   // Since we expect 'a' to be the smaller of the iterations, we use it as the
   // inner loop first, hoping to prune 'b' for its iteration.
   for (const auto& pair :
@@ -301,8 +631,6 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kBackAndForth>(
 
     int class_inner = inner->class_int();
     int class_outer = outer->class_int();
-    ActiveSetPair& outer_inner_pair =
-        active_set_pairs_[class_outer][class_inner];
 
     std::vector<SolutionFilter> outer_skip_preds;
     for (const auto& pred : predicates_by_outer) {
@@ -316,6 +644,10 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kBackAndForth>(
 
     DualIterate(
         outer, inner,
+        pair_class_mode == PairClassMode::kMakePairs
+            ? (outer == permuter_a ? previous_pairs.first
+                                   : previous_pairs.second)
+            : active_set_pairs_[class_outer][class_inner],
         // Outer, before inner.
         [&]() {
           inner_builder = ActiveSet::Builder(inner->permutation_count());
@@ -373,8 +705,10 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kBackAndForth>(
           }
           if (pair_class_mode == PairClassMode::kMakePairs) {
             inner_builder.AddBlockTo(false, inner->permutation_count());
-            outer_inner_pair.Assign(it_outer.position(),
-                                    inner_builder.DoneAdding());
+            if (!AssignPair(class_outer, it_outer.position(), class_inner,
+                            inner_builder.DoneAdding())) {
+              pair_class_mode = PairClassMode::kSingleton;
+            }
           }
         });
 
@@ -386,6 +720,67 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kBackAndForth>(
   return absl::OkStatus();
 }
 
+absl::StatusOr<FilterToActiveSet::PairBuildEstimate>
+FilterToActiveSet::EstimatePairBuild(
+    const ClassPermuter* permuter_a, const ClassPermuter* permuter_b,
+    const std::vector<SolutionFilter>& predicates_by_a,
+    const std::vector<SolutionFilter>& predicates_by_b, int samples) {
+  RETURN_IF_ERROR(
+      SetupPairBuild(permuter_a, permuter_b, predicates_by_a, predicates_by_b));
+
+  PairBuildEstimate estimate;
+  // The same directions as the kBackAndForth build.
+  for (const auto& pair :
+       std::vector<std::pair<const ClassPermuter*, const ClassPermuter*>>{
+           {permuter_b, permuter_a}, {permuter_a, permuter_b}}) {
+    const ClassPermuter* outer = pair.first;
+    const ClassPermuter* inner = pair.second;
+    const std::vector<SolutionFilter>& predicates_by_inner =
+        inner == permuter_a ? predicates_by_a : predicates_by_b;
+    const int class_inner = inner->class_int();
+    const double outer_count =
+        active_sets_[outer->class_int()].Selectivity() *
+        outer->permutation_count();
+    const int stride = std::max(1, static_cast<int>(outer_count / samples));
+
+    const ValueSkipToActiveSet* vs2as_inner =
+        value_skip_to_active_set_[inner->descriptor()];
+
+    // As DualIterate, but only starting the inner loop for sampled outers.
+    // Pair tables are not consulted, as the estimate is for kSingleton.
+    int outer_index = 0;
+    int sampled_count = 0;
+    int pruned_count = 0;
+    int64_t evaluations = 0;
+    SingleIterate(outer, [&](const ClassPermuter::iterator& it_outer,
+                             ValueSkip& outer_skip) {
+      if (outer_index++ % stride != 0) return false;
+      ++sampled_count;
+      ValueSkip inner_skip;
+      for (auto it_inner = inner->begin().WithActiveSet(
+               active_sets_[class_inner]);
+           it_inner != inner->end();
+           Advance(vs2as_inner, inner_skip, &it_inner)) {
+        mutable_solution_.SetClass(it_inner);
+        ++evaluations;
+        if (AllMatch(predicates_by_inner, solution_, class_inner,
+                     inner_skip)) {
+          return false;
+        }
+      }
+      ++pruned_count;
+      return false;
+    });
+
+    if (sampled_count == 0) continue;
+    estimate.evaluations += evaluations * outer_count / sampled_count;
+    double& pruned =
+        outer == permuter_a ? estimate.pruned_a : estimate.pruned_b;
+    pruned = static_cast<double>(pruned_count) / sampled_count;
+  }
+  return estimate;
+}
+
 template <>
 absl::Status
 FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPassThroughA>(
@@ -398,8 +793,14 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPassThroughA>(
 
   int class_a = permuter_a->class_int();
   int class_b = permuter_b->class_int();
-  ActiveSetPair& a_b_pair = active_set_pairs_[class_a][class_b];
-  ActiveSetPair& b_a_pair = active_set_pairs_[class_b][class_a];
+  if (pair_class_mode == PairClassMode::kMakePairs &&
+      !CanMakePair(class_a, class_b)) {
+    pair_class_mode = PairClassMode::kSingleton;
+  }
+  std::pair<ActiveSetPair, ActiveSetPair> previous_pairs;
+  if (pair_class_mode == PairClassMode::kMakePairs) {
+    previous_pairs = TakePairs(class_a, class_b);
+  }
   ActiveSet::Builder builder_a(permuter_a->permutation_count());
   absl::flat_hash_set<int> b_match_positions;
   absl::flat_hash_map<int, absl::flat_hash_set<int>> b_a_match_positions;
@@ -408,6 +809,9 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPassThroughA>(
   bool any_of_b;
   DualIterate(
       permuter_a, permuter_b,
+      pair_class_mode == PairClassMode::kMakePairs
+          ? previous_pairs.first
+          : active_set_pairs_[class_a][class_b],
       // Outer before inner.
       [&]() {
         any_of_b = false;
@@ -437,7 +841,10 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPassThroughA>(
       [&](const ClassPermuter::iterator& it_a, ValueSkip& a_skip) {
         if (pair_class_mode == PairClassMode::kMakePairs) {
           a_b_builder.AddBlockTo(false, permuter_b->permutation_count());
-          a_b_pair.Assign(it_a.position(), a_b_builder.DoneAdding());
+          if (!AssignPair(class_a, it_a.position(), class_b,
+                          a_b_builder.DoneAdding())) {
+            pair_class_mode = PairClassMode::kSingleton;
+          }
         }
         if (any_of_b) {
           builder_a.AddBlockTo(false, it_a.position());
@@ -450,11 +857,14 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPassThroughA>(
   active_sets_[class_b] = ActiveSet::Builder::FromPositions(
       b_match_positions, permuter_b->permutation_count());
   if (pair_class_mode == PairClassMode::kMakePairs) {
-    for (const auto& pair : b_a_match_positions) {
-      const int b_val = pair.first;
-      const absl::flat_hash_set<int>& a_set = pair.second;
-      b_a_pair.Assign(b_val, ActiveSet::Builder::FromPositions(
-                                 a_set, permuter_a->permutation_count()));
+    // ActiveSetPair::Assign requires increasing keys.
+    for (int b_val : SortedKeys(b_a_match_positions)) {
+      if (!AssignPair(class_b, b_val, class_a,
+                      ActiveSet::Builder::FromPositions(
+                          b_a_match_positions[b_val],
+                          permuter_a->permutation_count()))) {
+        break;
+      }
     }
   }
   return absl::OkStatus();
@@ -472,8 +882,14 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPairSet>(
 
   int class_a = permuter_a->class_int();
   int class_b = permuter_b->class_int();
-  ActiveSetPair& a_b_pair = active_set_pairs_[class_a][class_b];
-  ActiveSetPair& b_a_pair = active_set_pairs_[class_b][class_a];
+  if (pair_class_mode == PairClassMode::kMakePairs &&
+      !CanMakePair(class_a, class_b)) {
+    pair_class_mode = PairClassMode::kSingleton;
+  }
+  std::pair<ActiveSetPair, ActiveSetPair> previous_pairs;
+  if (pair_class_mode == PairClassMode::kMakePairs) {
+    previous_pairs = TakePairs(class_a, class_b);
+  }
   absl::flat_hash_set<int> a_match_positions;
   absl::flat_hash_set<int> b_match_positions;
   absl::flat_hash_map<int, absl::flat_hash_set<int>> a_b_match_positions;
@@ -481,6 +897,9 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPairSet>(
 
   DualIterate(
       permuter_a, permuter_b,
+      pair_class_mode == PairClassMode::kMakePairs
+          ? previous_pairs.first
+          : active_set_pairs_[class_a][class_b],
       // Outer before inner.
       [&]() {},
       // Inner.
@@ -510,17 +929,22 @@ FilterToActiveSet::Build<FilterToActiveSet::PairClassImpl::kPairSet>(
   active_sets_[class_b] = ActiveSet::Builder::FromPositions(
       b_match_positions, permuter_b->permutation_count());
   if (pair_class_mode == PairClassMode::kMakePairs) {
-    for (const auto& pair : a_b_match_positions) {
-      const int a_val = pair.first;
-      const absl::flat_hash_set<int>& b_set = pair.second;
-      a_b_pair.Assign(a_val, ActiveSet::Builder::FromPositions(
-                                 b_set, permuter_b->permutation_count()));
+    for (int a_val : SortedKeys(a_b_match_positions)) {
+      if (!AssignPair(class_a, a_val, class_b,
+                      ActiveSet::Builder::FromPositions(
+                          a_b_match_positions[a_val],
+                          permuter_b->permutation_count()))) {
+        return absl::OkStatus();
+      }
     }
-    for (const auto& pair : b_a_match_positions) {
-      const int b_val = pair.first;
-      const absl::flat_hash_set<int>& a_set = pair.second;
-      b_a_pair.Assign(b_val, ActiveSet::Builder::FromPositions(
-                                 a_set, permuter_a->permutation_count()));
+    // ActiveSetPair::Assign requires increasing keys.
+    for (int b_val : SortedKeys(b_a_match_positions)) {
+      if (!AssignPair(class_b, b_val, class_a,
+                      ActiveSet::Builder::FromPositions(
+                          b_a_match_positions[b_val],
+                          permuter_a->permutation_count()))) {
+        break;
+      }
     }
   }
   return absl::OkStatus();
@@ -565,4 +989,210 @@ absl::Status FilterToActiveSet::Build(
   }
 }
 
+int64_t FilterToActiveSet::ClassGroups::Key(const SolutionView& s) const {
+  int64_t key = 0;
+  for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+    key = key * base + (s.Id(*it).Class(class_int) - min_value);
+  }
+  return key;
+}
+
+std::unique_ptr<FilterToActiveSet::ClassGroups>
+FilterToActiveSet::GroupPermutations(
+    const ClassPermuter* permuter,
+    const std::vector<SolutionFilter>& predicates) const {
+  auto groups = absl::make_unique<ClassGroups>();
+  groups->class_int = permuter->class_int();
+  groups->min_value = 0;
+  groups->base = 1;
+
+  bool all_entries = false;
+  for (const auto& p : predicates) {
+    const int entry_id = p.entry_id(groups->class_int);
+    if (entry_id == Entry::kBadId) {
+      all_entries = true;
+    } else {
+      groups->entries.push_back(entry_id);
+    }
+  }
+
+  auto it = permuter->begin().WithActiveSet(active_sets_[groups->class_int]);
+  if (it == permuter->end()) return groups;
+
+  if (all_entries) {
+    groups->entries.resize(it->size());
+    absl::c_iota(groups->entries, 0);
+  } else {
+    absl::c_sort(groups->entries);
+    groups->entries.erase(
+        std::unique(groups->entries.begin(), groups->entries.end()),
+        groups->entries.end());
+  }
+  // Every permutation holds the same values, so the first gives the range.
+  const auto [min_it, max_it] = absl::c_minmax_element(*it);
+  groups->min_value = *min_it;
+  groups->base = *max_it - *min_it + 1;
+  if (groups->entries.size() * std::log2(groups->base) > 62) return nullptr;
+
+  for (; it != permuter->end(); ++it) {
+    int64_t key = 0;
+    for (auto e = groups->entries.rbegin(); e != groups->entries.rend(); ++e) {
+      key = key * groups->base + ((*it)[*e] - groups->min_value);
+    }
+    auto [found, inserted] =
+        groups->group_by_key.try_emplace(key, groups->representatives.size());
+    if (inserted) groups->representatives.emplace_back(it->begin(), it->end());
+    groups->positions.push_back(it.position());
+    groups->groups.push_back(found->second);
+  }
+  return groups;
+}
+
+void FilterToActiveSet::RestrictToGroups(const ClassPermuter* permuter,
+                                         const ClassGroups& groups,
+                                         const std::vector<bool>& supported) {
+  ActiveSet::Builder builder(permuter->permutation_count());
+  for (int i = 0; i < groups.positions.size(); ++i) {
+    if (supported[groups.groups[i]]) {
+      builder.AddBlockTo(false, groups.positions[i]);
+      builder.Add(true);
+    }
+  }
+  builder.AddBlockTo(false, permuter->permutation_count());
+  active_sets_[groups.class_int] = builder.DoneAdding();
+}
+
+absl::Status FilterToActiveSet::Build(
+    const ClassPermuter* permuter_a, const ClassPermuter* permuter_b,
+    const ClassPermuter* permuter_c,
+    const std::vector<SolutionFilter>& predicates, int64_t max_evaluations,
+    std::vector<SolutionFilter>* pair_predicates) {
+  if (predicates.empty()) return absl::OkStatus();
+
+  const std::array<const ClassPermuter*, 3> permuters = {permuter_a, permuter_b,
+                                                         permuter_c};
+  for (const auto& p : predicates) {
+    if (p.classes().size() != 3) {
+      return absl::InvalidArgumentError("Must have 3 classes in each filter");
+    }
+    for (int class_int : p.classes()) {
+      if (absl::c_none_of(permuters, [&](const ClassPermuter* permuter) {
+            return permuter->class_int() == class_int;
+          })) {
+        return absl::InvalidArgumentError("Filter must match class");
+      }
+    }
+  }
+
+  std::array<std::shared_ptr<ClassGroups>, 3> groups;
+  int64_t evaluations = 1;
+  for (int i = 0; i < 3; ++i) {
+    groups[i] = GroupPermutations(permuters[i], predicates);
+    if (groups[i] == nullptr) {
+      VLOG(2) << "Too many entries to group for " << predicates[0].name();
+      return absl::OkStatus();
+    }
+    evaluations *= groups[i]->representatives.size();
+    if (evaluations > max_evaluations) {
+      VLOG(2) << "Too many evaluations to project " << predicates[0].name();
+      return absl::OkStatus();
+    }
+  }
+
+  const int num_a = groups[0]->representatives.size();
+  const int num_b = groups[1]->representatives.size();
+  const int num_c = groups[2]->representatives.size();
+  std::vector<bool> supported_ab(num_a * num_b);
+  std::vector<bool> supported_ac(num_a * num_c);
+  std::vector<bool> supported_bc(num_b * num_c);
+  auto set_group = [&](const ClassGroups& class_groups, int group) {
+    const std::vector<int>& values = class_groups.representatives[group];
+    for (int entry_id = 0; entry_id < values.size(); ++entry_id) {
+      mutable_solution_.SetClass(entry_id, class_groups.class_int,
+                                 values[entry_id]);
+    }
+  };
+  for (int a = 0; a < num_a; ++a) {
+    set_group(*groups[0], a);
+    for (int b = 0; b < num_b; ++b) {
+      set_group(*groups[1], b);
+      for (int c = 0; c < num_c; ++c) {
+        // Nothing new is learned from a match.
+        if (supported_ab[a * num_b + b] && supported_ac[a * num_c + c] &&
+            supported_bc[b * num_c + c]) {
+          continue;
+        }
+        set_group(*groups[2], c);
+        if (absl::c_all_of(predicates, [&](const SolutionFilter& p) {
+              return p(solution_);
+            })) {
+          supported_ab[a * num_b + b] = true;
+          supported_ac[a * num_c + c] = true;
+          supported_bc[b * num_c + c] = true;
+        }
+      }
+    }
+  }
+
+  std::array<std::vector<bool>, 3> supported = {
+      std::vector<bool>(num_a), std::vector<bool>(num_b),
+      std::vector<bool>(num_c)};
+  for (int a = 0; a < num_a; ++a) {
+    for (int b = 0; b < num_b; ++b) {
+      if (supported_ab[a * num_b + b]) {
+        supported[0][a] = true;
+        supported[1][b] = true;
+      }
+    }
+    for (int c = 0; c < num_c; ++c) {
+      if (supported_ac[a * num_c + c]) supported[2][c] = true;
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (absl::c_all_of(supported[i], [](bool b) { return b; })) continue;
+    double old_selectivity = active_sets_[groups[i]->class_int].Selectivity();
+    RestrictToGroups(permuters[i], *groups[i], supported[i]);
+    VLOG(2) << "Selectivity (" << groups[i]->class_int
+            << "): " << old_selectivity << " => "
+            << active_sets_[groups[i]->class_int].Selectivity();
+  }
+  if (pair_predicates == nullptr) return absl::OkStatus();
+
+  for (const auto& class_groups : groups) {
+    class_groups->representatives.clear();
+    class_groups->positions.clear();
+    class_groups->groups.clear();
+  }
+  for (auto [x, y, supported_xy] : {std::make_tuple(0, 1, &supported_ab),
+                                    std::make_tuple(0, 2, &supported_ac),
+                                    std::make_tuple(1, 2, &supported_bc)}) {
+    if (absl::c_all_of(*supported_xy, [](bool b) { return b; })) continue;
+    std::vector<SolutionFilter::Cell> cells;
+    for (int i : {x, y}) {
+      for (int entry_id : groups[i]->entries) {
+        cells.push_back(
+            {.entry_id = entry_id, .class_int = groups[i]->class_int});
+      }
+    }
+    std::shared_ptr<const ClassGroups> groups_x = groups[x];
+    std::shared_ptr<const ClassGroups> groups_y = groups[y];
+    const int num_y = groups_y->group_by_key.size();
+    auto matches = std::make_shared<const std::vector<bool>>(
+        std::move(*supported_xy));
+    pair_predicates->push_back(SolutionFilter(
+        absl::StrCat(predicates[0].name(), " projected onto ",
+                     groups_x->class_int, ",", groups_y->class_int),
+        [groups_x, groups_y, num_y, matches](const SolutionView& s) {
+          // Permutations outside the ActiveSets match nothing.
+          auto it_x = groups_x->group_by_key.find(groups_x->Key(s));
+          if (it_x == groups_x->group_by_key.end()) return false;
+          auto it_y = groups_y->group_by_key.find(groups_y->Key(s));
+          if (it_y == groups_y->group_by_key.end()) return false;
+          return (*matches)[it_x->second * num_y + it_y->second];
+        },
+        std::move(cells)));
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace puzzle
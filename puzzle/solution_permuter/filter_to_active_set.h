@@ -1,10 +1,22 @@
 #ifndef PUZZLE_SOLUTION_PERMUTER_FILTER_TO_ACTIVE_SET_H_
 #define PUZZLE_SOLUTION_PERMUTER_FILTER_TO_ACTIVE_SET_H_
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "puzzle/active_set/pair.h"
 #include "puzzle/base/profiler.h"
 #include "puzzle/base/solution_filter.h"
@@ -47,6 +59,53 @@ class FilterToActiveSet {
     return active_set_pairs_[class_a][class_b].Find(a_val);
   }
 
+  // Caps the bytes held by the tables built with PairClassMode::kMakePairs at
+  // `bytes` (0 for no cap). A pair build which would exceed the cap drops the
+  // tables for its pair of classes (and skips building them in later builds)
+  // and otherwise behaves as kSingleton. See pair_dropped.
+  void set_pair_memory_budget(int64_t bytes) { pair_memory_budget_ = bytes; }
+
+  // Returns true if a kMakePairs build for `class_a` and `class_b` (in either
+  // order) dropped its tables due to the memory budget. active_set_pair
+  // returns trivial sets for such classes, so callers must evaluate the
+  // predicates between them some other way.
+  bool pair_dropped(int class_a, int class_b) const;
+  int dropped_pair_count() const;
+
+  // Number of heap bytes held by single class ActiveSets, by pair tables, and
+  // by ValueSkipToActiveSet tables respectively. The last are shared across
+  // the process rather than owned.
+  int64_t active_set_bytes() const;
+  int64_t pair_bytes() const { return pair_bytes_.load(); }
+  int64_t value_skip_bytes() const;
+
+  // Number of non-trivial sets held by pair tables.
+  int pair_entries() const;
+
+  // Summarizes the memory accounting above.
+  std::string MemoryDebugString() const;
+
+  // Returns the ActiveSets, the pair tables and the dropped pairs held, as
+  // native-endian int32 values. Each ActiveSet is stored as its runs of
+  // enabled positions.
+  std::string Serialize() const;
+
+  // Replaces the state held with that returned by Serialize for the same
+  // EntryDescriptor, and sets up `class_permuters` (indexed by class_int) as
+  // a build would. Returns InvalidArgumentError if a set or pair table does
+  // not fit the permutations of its classes. Nothing is modified if `data`
+  // is malformed.
+  absl::Status Deserialize(
+      absl::string_view data,
+      absl::Span<const ClassPermuter* const> class_permuters);
+
+  // Restricts the ActiveSet for `class_int` to permutations also contained
+  // in `active_set`. Subsequent builds for `class_int` honor the restriction.
+  void Intersect(int class_int, const ActiveSet& active_set) {
+    DCHECK_LT(static_cast<size_t>(class_int), active_sets_.size());
+    active_sets_[class_int].Intersect(active_set);
+  }
+
   // Given a class permuter and a set of predicates on that class (it is an
   // error to pass in predicates on other classes), returns the ActiveSet
   // representing and ANDing of those predicates on each permutation.
@@ -102,7 +161,74 @@ class FilterToActiveSet {
                      const std::vector<SolutionFilter>& predicates_by_b,
                      PairClassMode pair_class_mode = PairClassMode::kSingleton);
 
+  // A sampled estimate of a kSingleton pair build. See EstimatePairBuild.
+  struct PairBuildEstimate {
+    // Predicate evaluations the build would make.
+    double evaluations = 0;
+    // Fraction of the permutations of each class within its ActiveSet that
+    // the build would remove.
+    double pruned_a = 0;
+    double pruned_b = 0;
+  };
+
+  // Estimates a kSingleton pair build for `permuter_a` and `permuter_b`
+  // by running it for only `samples` evenly spaced permutations of the
+  // outer class in each direction. No ActiveSet is modified.
+  absl::StatusOr<PairBuildEstimate> EstimatePairBuild(
+      const ClassPermuter* permuter_a, const ClassPermuter* permuter_b,
+      const std::vector<SolutionFilter>& predicates_by_a,
+      const std::vector<SolutionFilter>& predicates_by_b, int samples);
+
+  // Given three class permuters and a set of predicates on exactly those
+  // classes, restricts the ActiveSet of each class to the permutations for
+  // which some permutations of the other two (within their ActiveSets) match
+  // every predicate. As with pair builds this is a good faith pruning, and
+  // the predicates must still be evaluated.
+  // If `pair_predicates` is non-null, then for each pair of the classes a
+  // filter matching exactly the values of the pair for which some value of
+  // the third class matches is appended to it (unless it would always
+  // match), so that pair builds may apply the projection too.
+  // Permutations are grouped by the values of the entries read by the
+  // predicates, and if more than `max_evaluations` combinations of groups
+  // would need evaluating, returns without restricting anything.
+  absl::Status Build(const ClassPermuter* permuter_a,
+                     const ClassPermuter* permuter_b,
+                     const ClassPermuter* permuter_c,
+                     const std::vector<SolutionFilter>& predicates,
+                     int64_t max_evaluations,
+                     std::vector<SolutionFilter>* pair_predicates = nullptr);
+
  private:
+  // The permutations of a class within its ActiveSet, grouped by the values
+  // at `entries`. Built by GroupPermutations.
+  struct ClassGroups {
+    // Returns the key of the group `s` is in, if `s` is within the ActiveSet.
+    int64_t Key(const SolutionView& s) const;
+
+    int class_int;
+    std::vector<int> entries;
+    // Keys are the values at `entries` as digits of base `base`.
+    int min_value;
+    int64_t base;
+    absl::flat_hash_map<int64_t, int> group_by_key;
+    // The values of a permutation of each group.
+    std::vector<std::vector<int>> representatives;
+    // The position and group of each permutation.
+    std::vector<int> positions;
+    std::vector<int> groups;
+  };
+
+  // Returns nullptr if the keys of the groups would overflow.
+  std::unique_ptr<ClassGroups> GroupPermutations(
+      const ClassPermuter* permuter,
+      const std::vector<SolutionFilter>& predicates) const;
+
+  // Restricts the ActiveSet for `groups.class_int` to the groups for which
+  // `supported` is true.
+  void RestrictToGroups(const ClassPermuter* permuter,
+                        const ClassGroups& groups,
+                        const std::vector<bool>& supported);
+
   // Advances `it` based on `value_skip`.
   void Advance(const ValueSkipToActiveSet* vs2as, ValueSkip value_skip,
                ClassPermuter::iterator* it) const;
@@ -117,14 +243,32 @@ class FilterToActiveSet {
 
   void SetupPermuter(const ClassPermuter* permuter);
 
+  // Returns true if tables for `class_a` and `class_b` may be built without
+  // exceeding the memory budget.
+  bool CanMakePair(int class_a, int class_b) const;
+
+  // Assigns `a_b_set` into the table for `class_a` and `class_b` at `a_val`.
+  // If this exceeds the memory budget, drops the tables for the pair instead
+  // and returns false.
+  bool AssignPair(int class_a, int a_val, int class_b, ActiveSet a_b_set);
+  void DropPair(int class_a, int class_b);
+
+  // Moves out the tables for `class_a` and `class_b` (in that order, then
+  // reversed) so a kMakePairs build can refill them in increasing key order
+  // while still restricting its iteration by the previous tables.
+  std::pair<ActiveSetPair, ActiveSetPair> TakePairs(int class_a, int class_b);
+
   inline void SingleIterate(
       const ClassPermuter* permuter,
       absl::FunctionRef<bool(const ClassPermuter::iterator& it,
                              ValueSkip& value_skip)>
           on_item);
 
+  // Iterates `inner` for each position of `outer`, restricted by the active
+  // sets and by `outer_inner_pair`.
   inline void DualIterate(
       const ClassPermuter* outer, const ClassPermuter* inner,
+      const ActiveSetPair& outer_inner_pair,
       absl::FunctionRef<void(void)> on_outer_before,
       absl::FunctionRef<bool(const ClassPermuter::iterator& it_outer,
                              const ClassPermuter::iterator& it_inner,
@@ -141,7 +285,19 @@ class FilterToActiveSet {
   // class_b given class_a is at position a_val.
   std::vector<std::vector<ActiveSetPair>> active_set_pairs_;
 
-  absl::flat_hash_map<const Descriptor*, std::unique_ptr<ValueSkipToActiveSet>>
+  // Sum of StorageBytes() over `active_set_pairs_`. Pair builds run
+  // concurrently, so this is shared between them.
+  std::atomic<int64_t> pair_bytes_ = 0;
+  int64_t pair_memory_budget_ = 0;
+
+  // Pairs of classes (ordered with the lower class first) whose tables were
+  // dropped.
+  mutable absl::Mutex dropped_mu_;
+  absl::flat_hash_set<std::pair<int, int>> dropped_pairs_
+      ABSL_GUARDED_BY(dropped_mu_);
+
+  // Points at ValueSkipToActiveSet::Shared tables.
+  absl::flat_hash_map<const Descriptor*, const ValueSkipToActiveSet*>
       value_skip_to_active_set_;
 
   MutableSolution mutable_solution_;
@@ -11,8 +11,11 @@
 #include "puzzle/class_permuter/factory.h"
 #include "puzzle/solution_permuter/mutable_solution.h"
 
+using ::testing::DoubleEq;
 using ::testing::ElementsAreArray;
 using ::testing::Eq;
+using ::testing::Gt;
+using ::testing::HasSubstr;
 using ::testing::IsEmpty;
 using ::testing::Le;
 using ::testing::UnorderedElementsAre;
@@ -498,6 +501,67 @@ TEST_P(PairPermuterTest, MakePairs) {
       ElementsAreArray(a0_is_0));
 }
 
+TEST_P(PairPermuterTest, MakePairsMemoryBudget) {
+  static constexpr int kClassIntA = 0;
+  static constexpr int kClassIntB = 1;
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+  EntryDescriptor entry_descriptor(
+      absl::make_unique<IntRangeDescriptor>(3),
+      absl::make_unique<StringDescriptor>(
+          std::vector<std::string>{"class a", "class b"}),
+      std::move(class_descriptors));
+
+  std::unique_ptr<ClassPermuter> permuter_a(MakeClassPermuter(
+      entry_descriptor.AllClassValues(kClassIntA), kClassIntA));
+  std::unique_ptr<ClassPermuter> permuter_b(MakeClassPermuter(
+      entry_descriptor.AllClassValues(kClassIntB), kClassIntB));
+
+  std::vector<int> a0_is_0;
+  int i = 0;
+  for (absl::Span<const int> a_vals : *permuter_a) {
+    if (a_vals[0] == 0) a0_is_0.push_back(i);
+    ++i;
+  }
+
+  SolutionFilter c("a is 0 and b is 1 for id 0",
+                   [](const SolutionView& s) {
+                     return s.Id(0).Class(kClassIntA) == 0 &&
+                            s.Id(0).Class(kClassIntB) == 1;
+                   },
+                   {kClassIntA, kClassIntB});
+
+  FilterToActiveSet unlimited(&entry_descriptor);
+  ASSERT_TRUE(unlimited
+                  .Build(pair_class_impl(), permuter_a.get(), permuter_b.get(),
+                         {c}, FilterToActiveSet::PairClassMode::kMakePairs)
+                  .ok());
+  EXPECT_FALSE(unlimited.pair_dropped(kClassIntA, kClassIntB));
+  EXPECT_GT(unlimited.pair_bytes(), 0);
+  EXPECT_GT(unlimited.pair_entries(), 0);
+
+  FilterToActiveSet budgeted(&entry_descriptor);
+  budgeted.set_pair_memory_budget(1);
+  ASSERT_TRUE(budgeted
+                  .Build(pair_class_impl(), permuter_a.get(), permuter_b.get(),
+                         {c}, FilterToActiveSet::PairClassMode::kMakePairs)
+                  .ok());
+  EXPECT_TRUE(budgeted.pair_dropped(kClassIntA, kClassIntB));
+  EXPECT_TRUE(budgeted.pair_dropped(kClassIntB, kClassIntA));
+  EXPECT_EQ(budgeted.dropped_pair_count(), 1);
+  EXPECT_EQ(budgeted.pair_bytes(), 0);
+  EXPECT_EQ(budgeted.pair_entries(), 0);
+  EXPECT_TRUE(
+      budgeted.active_set_pair(kClassIntA, a0_is_0[0], kClassIntB).is_trivial());
+  EXPECT_THAT(budgeted.MemoryDebugString(),
+              HasSubstr("dropped pair tables: 1"));
+
+  // Single class sets are still built.
+  EXPECT_THAT(budgeted.active_set(kClassIntA).EnabledValues(),
+              ElementsAreArray(a0_is_0));
+}
+
 TEST_P(PairPermuterTest, MakePairsEntryPredicate) {
   static constexpr int kClassIntA = 0;
   static constexpr int kClassIntB = 1;
@@ -743,4 +807,122 @@ TEST_P(PairPermuterTest, MakePairsCycle) {
   EXPECT_EQ(builder.active_set(kClassIntC).matches(), 1) << *permuter_c;
 }
 
+static EntryDescriptor MakeThreeByThree() {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  for (int i = 0; i < 3; ++i) {
+    class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+  }
+  return EntryDescriptor(absl::make_unique<IntRangeDescriptor>(3),
+                         absl::make_unique<StringDescriptor>(
+                             std::vector<std::string>{"a", "b", "c"}),
+                         std::move(class_descriptors));
+}
+
+static SolutionFilter AllTwoFilter() {
+  return SolutionFilter(
+      "id 0 sums to 6",
+      [](const SolutionView& s) {
+        return s.Id(0).Class(0) + s.Id(0).Class(1) + s.Id(0).Class(2) == 6;
+      },
+      std::vector<SolutionFilter::Cell>{{.entry_id = 0, .class_int = 0},
+                                        {.entry_id = 0, .class_int = 1},
+                                        {.entry_id = 0, .class_int = 2}});
+}
+
+TEST(TriplePermuterTest, Projects) {
+  EntryDescriptor entry_descriptor = MakeThreeByThree();
+  std::vector<std::unique_ptr<ClassPermuter>> permuters;
+  for (int class_int = 0; class_int < 3; ++class_int) {
+    permuters.push_back(MakeClassPermuter(
+        entry_descriptor.AllClassValues(class_int), class_int));
+  }
+
+  FilterToActiveSet builder(&entry_descriptor);
+  std::vector<SolutionFilter> pair_predicates;
+  ASSERT_TRUE(builder
+                  .Build(permuters[0].get(), permuters[1].get(),
+                         permuters[2].get(), {AllTwoFilter()},
+                         /*max_evaluations=*/27, &pair_predicates)
+                  .ok());
+
+  // Only values with 2 for id 0 remain.
+  for (int class_int = 0; class_int < 3; ++class_int) {
+    std::vector<int> id_0_is_2;
+    int position = 0;
+    for (absl::Span<const int> values : *permuters[class_int]) {
+      if (values[0] == 2) id_0_is_2.push_back(position);
+      ++position;
+    }
+    EXPECT_THAT(builder.active_set(class_int).EnabledValues(),
+                ElementsAreArray(id_0_is_2));
+  }
+
+  ASSERT_THAT(pair_predicates.size(), 3);
+  std::vector<Entry> entries;
+  entries.emplace_back(0, std::vector<int>{2, 2, 0});
+  entries.emplace_back(1, std::vector<int>{0, 0, 1});
+  entries.emplace_back(2, std::vector<int>{1, 1, 2});
+  SolutionView view(&entry_descriptor, &entries);
+  EXPECT_THAT(pair_predicates[0].classes(), UnorderedElementsAre(0, 1));
+  EXPECT_TRUE(pair_predicates[0](view));
+  EXPECT_THAT(pair_predicates[1].classes(), UnorderedElementsAre(0, 2));
+  EXPECT_FALSE(pair_predicates[1](view));
+}
+
+TEST(TriplePermuterTest, MaxEvaluations) {
+  EntryDescriptor entry_descriptor = MakeThreeByThree();
+  std::vector<std::unique_ptr<ClassPermuter>> permuters;
+  for (int class_int = 0; class_int < 3; ++class_int) {
+    permuters.push_back(MakeClassPermuter(
+        entry_descriptor.AllClassValues(class_int), class_int));
+  }
+
+  FilterToActiveSet builder(&entry_descriptor);
+  std::vector<SolutionFilter> pair_predicates;
+  ASSERT_TRUE(builder
+                  .Build(permuters[0].get(), permuters[1].get(),
+                         permuters[2].get(), {AllTwoFilter()},
+                         /*max_evaluations=*/26, &pair_predicates)
+                  .ok());
+  for (int class_int = 0; class_int < 3; ++class_int) {
+    EXPECT_TRUE(builder.active_set(class_int).is_trivial());
+  }
+  EXPECT_THAT(pair_predicates, IsEmpty());
+}
+
+TEST(PairEstimateTest, EveryPermutationSampled) {
+  EntryDescriptor entry_descriptor = MakeThreeByThree();
+  std::unique_ptr<ClassPermuter> permuter_a =
+      MakeClassPermuter(entry_descriptor.AllClassValues(0), 0);
+  std::unique_ptr<ClassPermuter> permuter_b =
+      MakeClassPermuter(entry_descriptor.AllClassValues(1), 1);
+  SolutionFilter filter(
+      "id 0 is 2 for a and b",
+      [](const SolutionView& s) {
+        return s.Id(0).Class(0) == 2 && s.Id(0).Class(1) == 2;
+      },
+      std::vector<SolutionFilter::Cell>{{.entry_id = 0, .class_int = 0},
+                                        {.entry_id = 0, .class_int = 1}});
+
+  FilterToActiveSet builder(&entry_descriptor);
+  absl::StatusOr<FilterToActiveSet::PairBuildEstimate> estimate =
+      builder.EstimatePairBuild(permuter_a.get(), permuter_b.get(), {filter},
+                                {filter}, /*samples=*/6);
+  ASSERT_TRUE(estimate.ok()) << estimate.status();
+  EXPECT_TRUE(builder.active_set(0).is_trivial());
+  EXPECT_TRUE(builder.active_set(1).is_trivial());
+
+  // Sampling every permutation matches what the build removes.
+  ASSERT_TRUE(
+      builder.Build(permuter_a.get(), permuter_b.get(), {filter}, {filter})
+          .ok());
+  EXPECT_THAT(estimate->pruned_a,
+              DoubleEq(1 - builder.active_set(0).Selectivity()));
+  EXPECT_THAT(estimate->pruned_b,
+              DoubleEq(1 - builder.active_set(1).Selectivity()));
+  EXPECT_THAT(estimate->pruned_a, DoubleEq(2.0 / 3));
+  EXPECT_THAT(estimate->evaluations, Gt(0));
+  EXPECT_THAT(estimate->evaluations, Le(2 * 6 * 6));
+}
+
 }  // namespace puzzle
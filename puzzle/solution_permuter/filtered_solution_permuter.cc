@@ -1,23 +1,45 @@
 #include "puzzle/solution_permuter/filtered_solution_permuter.h"
 
+#include <array>
+#include <cmath>
+#include <map>
+
+#include "absl/algorithm/container.h"
+#include "absl/flags/declare.h"
 #include "absl/flags/flag.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
 #include "puzzle/active_set/active_set.h"
 #include "puzzle/base/all_match.h"
 #include "puzzle/class_permuter/factory.h"
+#include "puzzle/class_permuter/static_class_permuter.h"
+#include "puzzle/solution_permuter/active_set_cache.h"
 #include "puzzle/solution_permuter/filter_to_active_set.h"
 #include "puzzle/solution_permuter/pair_filter_burn_down.h"
 #include "thread/future.h"
 #include "thread/inline_executor.h"
 #include "thread/pool.h"
+#include "thread/work_stealing_pool.h"
 #include "vlog.h"
 
+ABSL_DECLARE_FLAG(bool, puzzle_pair_class_burn_down_worklist);
+
 ABSL_FLAG(bool, puzzle_prune_class_iterator, true,
           "If specfied, class iterators will be pruned based on single "
           "class predicates that are present.");
 
+ABSL_FLAG(bool, puzzle_prune_entry_value_predicates, true,
+          "If true, predicates of the form \"this entry has exactly (or not) "
+          "this value\" added with AddEntryValuePredicate are applied by "
+          "intersecting process-wide precomputed active sets rather than "
+          "being evaluated as filters on every permutation.");
+
 ABSL_FLAG(bool, puzzle_prune_reorder_classes, true,
           "If true, class iteration will be re-ordered from the default "
           "based on effective scan rate.");
@@ -26,12 +48,75 @@ ABSL_FLAG(bool, puzzle_prune_pair_class_iterators, true,
           "If specfied, class iterators will be pruned based on pair "
           "class predicates that are present.");
 
+ABSL_FLAG(bool, puzzle_prune_triple_class_iterators, true,
+          "If specified, class iterators will be pruned based on predicates "
+          "on exactly three classes, and the pairwise restrictions they imply "
+          "are added to the pair class predicates.");
+
+ABSL_FLAG(int64_t, puzzle_prune_triple_class_max_evaluations, 1 << 16,
+          "If --puzzle_prune_triple_class_iterators is true, the most "
+          "evaluations of the predicates on a triple of classes made to prune "
+          "their iterators. Triples which would need more are left to be "
+          "evaluated during iteration.");
+
 ABSL_FLAG(bool, puzzle_prune_pair_class_iterators_mode_pair, false,
           "If specified pairwise iterators will be pruned with contextual "
           "pruning (that is, pairwise iterators will store, for each value "
           "of one iterator, the appropriate active sets for the other "
           "iterator).");
 
+ABSL_FLAG(int64_t, puzzle_active_set_memory_budget, 0,
+          "If positive, the maximum number of bytes held by the pairwise "
+          "active sets built for "
+          "--puzzle_prune_pair_class_iterators_mode_pair. Pairs of classes "
+          "whose active sets would exceed the budget are dropped and their "
+          "predicates are evaluated during iteration instead.");
+
+ABSL_FLAG(std::string, puzzle_active_set_cache_dir, "",
+          "If non-empty, a directory in which to store the prepared active "
+          "sets of each set of filters, keyed by a fingerprint of the "
+          "filters (their keys and cells), the entry descriptor and the "
+          "flags shaping the active sets. Later preparations with the same "
+          "fingerprint load them rather than building them. Only used if "
+          "every filter has a key (see SolutionFilter::key), as nothing else "
+          "identifies what a predicate computes.");
+
+ABSL_FLAG(bool, puzzle_static_class_permuter, true,
+          "If true and every class permuter is a \"delete_tracking\" "
+          "permuter of one size, iteration uses code specialized for that "
+          "size which advances the class iterators without virtual calls.");
+
+ABSL_FLAG(bool, puzzle_filter_statistics, false,
+          "If true, the calls, rejections and time spent in each filter "
+          "evaluated during iteration are counted and the most expensive "
+          "filters are reported in DebugStatistics.");
+
+ABSL_FLAG(bool, puzzle_filter_adaptive_order, false,
+          "If true, filters are counted as for --puzzle_filter_statistics "
+          "and the filters for each class are periodically reordered so "
+          "that those which reject the most per nanosecond are evaluated "
+          "first. Filters are only reordered among those with the same "
+          "entry, so that the ValueSkip on rejection is unchanged.");
+
+ABSL_FLAG(int64_t, puzzle_filter_adaptive_order_interval, 1 << 14,
+          "If --puzzle_filter_adaptive_order is true, the number of "
+          "evaluations of the filters of a class between reorderings.");
+
+ABSL_FLAG(bool, puzzle_backjump, true,
+          "If true, when every value of a class fails the search returns "
+          "directly to the latest earlier class read by a filter involved "
+          "in the failures, rather than to the class immediately before it. "
+          "Not used with --puzzle_prune_pair_class_iterators_mode_pair, or "
+          "with more than 64 classes.");
+
+ABSL_FLAG(bool, puzzle_dynamic_class_order, false,
+          "If true along with --puzzle_prune_pair_class_iterators_mode_pair, "
+          "the class iterated at each depth of the search is the unassigned "
+          "class with the fewest values remaining once the pairwise active "
+          "sets of the assigned classes are applied, rather than following "
+          "the fixed order chosen before the search. Not used for parallel "
+          "search or with more than 64 classes.");
+
 ABSL_FLAG(bool, puzzle_thread_pool_executor, false,
           "If true Solver::Prepare will try to use a thread pool to speed "
           "up the work by using more CPU cores.");
@@ -40,13 +125,63 @@ ABSL_FLAG(int, puzzle_thread_pool_executor_threads, 4,
           "If --puzzle_thread_pool_executor is true, this specifies the size "
           "of the threadpool used (number of concurrent threads)");
 
+ABSL_FLAG(bool, puzzle_thread_pool_executor_work_stealing, false,
+          "If --puzzle_thread_pool_executor is true, this selects a "
+          "work-stealing pool (per-thread queues) rather than a pool with a "
+          "single shared queue.");
+
+ABSL_FLAG(bool, puzzle_parallel_search, false,
+          "If true, iteration over solutions is performed by concurrently "
+          "searching disjoint chunks of the outermost class permuter. The "
+          "order of returned solutions is no longer deterministic.");
+
+ABSL_FLAG(int, puzzle_parallel_search_threads, 4,
+          "If --puzzle_parallel_search is true, this specifies the number of "
+          "threads used to search for solutions.");
+
+ABSL_FLAG(int, puzzle_parallel_search_chunks_per_thread, 16,
+          "If --puzzle_parallel_search is true, the outermost class permuter "
+          "is split into this many chunks per search thread. More chunks "
+          "balance uneven subtrees better at the cost of more contention.");
+
 namespace puzzle {
 
+FilteredSolutionPermuter::RootPartition::RootPartition(int permutation_count,
+                                                       int num_chunks)
+    : permutation_count_(permutation_count),
+      chunk_size_(std::max(1, (permutation_count + num_chunks - 1) /
+                                  std::max(1, num_chunks))) {}
+
+bool FilteredSolutionPermuter::RootPartition::Claim(int* begin, int* end) {
+  if (cancelled()) return false;
+  int chunk = next_chunk_.fetch_add(1, std::memory_order_relaxed);
+  if (chunk >= (permutation_count_ + chunk_size_ - 1) / chunk_size_) {
+    return false;
+  }
+  *begin = chunk * chunk_size_;
+  *end = std::min(*begin + chunk_size_, permutation_count_);
+  return true;
+}
+
+FilteredSolutionPermuter::Advancer::Advancer(
+    const FilteredSolutionPermuter* permuter, RootPartition* partition)
+    : Advancer(permuter, partition, /*find_first=*/true) {}
+
+// static
+std::unique_ptr<FilteredSolutionPermuter::Advancer>
+FilteredSolutionPermuter::Advancer::ForSampling(
+    const FilteredSolutionPermuter* permuter) {
+  return absl::WrapUnique(
+      new Advancer(permuter, /*partition=*/nullptr, /*find_first=*/false));
+}
+
 FilteredSolutionPermuter::Advancer::Advancer(
-    const FilteredSolutionPermuter* permuter)
+    const FilteredSolutionPermuter* permuter, RootPartition* partition,
+    bool find_first)
     : AdvancerBase(permuter == nullptr ? nullptr
                                        : permuter->entry_descriptor()),
-      permuter_(permuter) {
+      permuter_(permuter),
+      partition_(partition) {
   if (permuter_ == nullptr) {
     set_done();
     return;
@@ -57,8 +192,38 @@ FilteredSolutionPermuter::Advancer::Advancer(
   for (const auto& class_permuter : permuter_->class_permuters_) {
     iterators_[class_permuter->class_int()] = class_permuter->end();
   }
+  if (absl::GetFlag(FLAGS_puzzle_filter_statistics) ||
+      absl::GetFlag(FLAGS_puzzle_filter_adaptive_order)) {
+    filter_stats_.resize(iterators_.size());
+    filter_order_.resize(iterators_.size());
+    evaluations_until_reorder_.resize(
+        iterators_.size(),
+        absl::GetFlag(FLAGS_puzzle_filter_adaptive_order)
+            ? absl::GetFlag(FLAGS_puzzle_filter_adaptive_order_interval)
+            : -1);
+    for (int class_int = 0; class_int < iterators_.size(); ++class_int) {
+      const int num_filters = permuter_->class_predicates_[class_int].size();
+      filter_stats_[class_int].resize(num_filters);
+      filter_order_[class_int].resize(num_filters);
+      absl::c_iota(filter_order_[class_int], 0);
+    }
+  }
+  dynamic_order_ = permuter_->dynamic_order_ && partition_ == nullptr;
+  if (dynamic_order_) {
+    const int num_classes = iterators_.size();
+    dynamic_order_classes_.resize(num_classes);
+    dynamic_active_sets_.resize(
+        num_classes + 1,
+        std::vector<ActiveSet>(num_classes, ActiveSet::trivial()));
+    for (int class_int = 0; class_int < num_classes; ++class_int) {
+      dynamic_active_sets_[0][class_int] =
+          permuter_->filter_to_active_set_->active_set(class_int);
+    }
+  }
+  if (!find_first) return;
 
-  if (FindNextValid(/*class_position=*/0)) {
+  if (dynamic_order_ ? FindNextValidDynamic(/*depth=*/0, /*resume=*/false)
+                     : FindNextValidFromStart()) {
     set_position(position());
   } else {
     set_done();
@@ -69,6 +234,94 @@ FilteredSolutionPermuter::Advancer::Advancer(
   }
 }
 
+FilteredSolutionPermuter::Advancer::~Advancer() {
+  if (!filter_stats_.empty()) permuter_->AddFilterStats(filter_stats_);
+}
+
+bool FilteredSolutionPermuter::Advancer::MatchPredicates(
+    int class_int, ValueSkip& value_skip, uint64_t* conflicts) {
+  if (!filter_stats_.empty()) {
+    return MatchPredicatesWithStats(class_int, value_skip, conflicts);
+  }
+  if (conflicts == nullptr) {
+    return AllMatch(permuter_->class_predicates_[class_int], current(),
+                    class_int, value_skip);
+  }
+
+  const std::vector<SolutionFilter>& predicates =
+      permuter_->class_predicates_[class_int];
+  const SolutionView solution = current();
+  for (int i = 0; i < predicates.size(); ++i) {
+    if (!predicates[i](solution)) {
+      value_skip.value_index = predicates[i].entry_id(class_int);
+      *conflicts |= permuter_->class_predicate_conflicts_[class_int][i];
+      return false;
+    }
+  }
+  value_skip.value_index = Entry::kBadId;
+  return true;
+}
+
+bool FilteredSolutionPermuter::Advancer::MatchPredicatesWithStats(
+    int class_int, ValueSkip& value_skip, uint64_t* conflicts) {
+  const std::vector<SolutionFilter>& predicates =
+      permuter_->class_predicates_[class_int];
+  std::vector<FilterStats>& stats = filter_stats_[class_int];
+  if (evaluations_until_reorder_[class_int] > 0 &&
+      --evaluations_until_reorder_[class_int] == 0) {
+    ReorderFilters(class_int);
+    evaluations_until_reorder_[class_int] =
+        absl::GetFlag(FLAGS_puzzle_filter_adaptive_order_interval);
+  }
+
+  const SolutionView solution = current();
+  for (int i : filter_order_[class_int]) {
+    FilterStats& filter_stats = stats[i];
+    bool match;
+    if (filter_stats.calls++ % kFilterTimingInterval == 0) {
+      const int64_t start = absl::GetCurrentTimeNanos();
+      match = predicates[i](solution);
+      filter_stats.timed_nanos += absl::GetCurrentTimeNanos() - start;
+      ++filter_stats.timed_calls;
+    } else {
+      match = predicates[i](solution);
+    }
+    if (!match) {
+      ++filter_stats.rejections;
+      value_skip.value_index = predicates[i].entry_id(class_int);
+      if (conflicts != nullptr) {
+        *conflicts |= permuter_->class_predicate_conflicts_[class_int][i];
+      }
+      return false;
+    }
+  }
+  value_skip.value_index = Entry::kBadId;
+  return true;
+}
+
+void FilteredSolutionPermuter::Advancer::ReorderFilters(int class_int) {
+  const std::vector<SolutionFilter>& predicates =
+      permuter_->class_predicates_[class_int];
+  const std::vector<FilterStats>& stats = filter_stats_[class_int];
+  auto score = [&](int i) {
+    if (stats[i].calls == 0) return 0.0;
+    double rejection_rate =
+        static_cast<double>(stats[i].rejections) / stats[i].calls;
+    // Untimed filters (or ones too quick to measure) are treated as costing
+    // a nanosecond.
+    return rejection_rate / std::max(1.0, stats[i].NanosPerCall());
+  };
+  // The first filter to reject determines the ValueSkip, and filters on
+  // earlier entries skip further, so only filters skipping on the same entry
+  // are reordered.
+  absl::c_stable_sort(filter_order_[class_int], [&](int a, int b) {
+    const int entry_a = predicates[a].entry_id(class_int);
+    const int entry_b = predicates[b].entry_id(class_int);
+    if (entry_a != entry_b) return entry_a < entry_b;
+    return score(a) > score(b);
+  });
+}
+
 void FilteredSolutionPermuter::Advancer::InitializeIterator(
     const ClassPermuter* class_permuter, int class_position) {
   const int class_int = class_permuter->class_int();
@@ -91,6 +344,19 @@ void FilteredSolutionPermuter::Advancer::InitializeIterator(
   }
 }
 
+template <int kStaticSize>
+bool FilteredSolutionPermuter::Advancer::FindNextValidFromStart() {
+  if constexpr (kStaticSize == 0) {
+    return FindNextValid<0>(/*class_position=*/0);
+  } else {
+    if (permuter_->static_class_size_ == kStaticSize) {
+      return FindNextValid<kStaticSize>(/*class_position=*/0);
+    }
+    return FindNextValidFromStart<kStaticSize - 1>();
+  }
+}
+
+template <int kStaticSize>
 bool FilteredSolutionPermuter::Advancer::FindNextValid(int class_position) {
   if (static_cast<unsigned int>(class_position) >=
       permuter_->class_permuters_.size()) {
@@ -101,24 +367,189 @@ bool FilteredSolutionPermuter::Advancer::FindNextValid(int class_position) {
       permuter_->class_permuters_[class_position].get();
   const int class_int = class_permuter->class_int();
 
+  // Bit i is set if the class at position i was read by a filter which
+  // rejected a value of this class (or of a later class, in a failed search
+  // below a value of this class). Only tracked if `permuter_->backjump_`.
+  uint64_t conflicts = 0;
   if (iterators_[class_int] == class_permuter->end()) {
     InitializeIterator(class_permuter, class_position);
+  } else {
+    // Resuming after an earlier match, so the values already passed over
+    // were not all rejected and might match given other earlier classes.
+    conflicts = ~uint64_t{0};
   }
+  uint64_t* const track_conflicts = permuter_->backjump_ ? &conflicts : nullptr;
+  const uint64_t position_bit = uint64_t{1} << (class_position & 63);
 
-  const std::vector<SolutionFilter>& solution_predicates =
-      permuter_->class_predicates_[class_int];
   ValueSkip value_skip;
-  for (; iterators_[class_int] != class_permuter->end();
-       iterators_[class_int] += value_skip) {
-    mutable_solution().SetClass(iterators_[class_int]);
-    if (NotePositionForProfiler(class_position)) return false;
-    if (AllMatch(solution_predicates, current(), class_int, value_skip) &&
-        FindNextValid(class_position + 1)) {
-      return true;
+  ClassPermuter::iterator& it = iterators_[class_int];
+  for (; it != class_permuter->end(); Next<kStaticSize>(it, value_skip)) {
+    if (partition_ != nullptr && class_position == 0 && !AdvanceIntoChunk()) {
+      failed_conflicts_ = ~uint64_t{0};
+      return false;
     }
+    if constexpr (kStaticSize == 0) {
+      mutable_solution().SetClass(it);
+    } else {
+      mutable_solution().SetClass<kStaticSize>(it);
+    }
+    if (NotePositionForProfiler(class_position)) {
+      failed_conflicts_ = ~uint64_t{0};
+      return false;
+    }
+    if (!MatchPredicates(class_int, value_skip, track_conflicts)) continue;
+    if (FindNextValid<kStaticSize>(class_position + 1)) return true;
+    if (track_conflicts == nullptr) continue;
+    if ((failed_conflicts_ & position_bit) == 0) {
+      // No value of this class was involved in the failure below, so none
+      // can resolve it. Leave `failed_conflicts_` for the earlier classes
+      // and return to the latest one which was involved. Later classes are
+      // left at end() and so are re-initialized when next reached.
+      it = class_permuter->end();
+      return false;
+    }
+    conflicts |= failed_conflicts_;
   }
 
   // Didn't find an entry in iteration. Return "no match".
+  failed_conflicts_ = conflicts & (position_bit - 1);
+  return false;
+}
+
+bool FilteredSolutionPermuter::Advancer::FindNextValidDynamic(int depth,
+                                                             bool resume) {
+  const int num_classes = iterators_.size();
+  if (depth == num_classes) return !resume;
+
+  if (!resume) {
+    const int chosen = ChooseDynamicClass(depth);
+    if (chosen < 0) return false;
+    dynamic_order_classes_[depth] = chosen;
+    dynamic_assigned_ |= uint64_t{1} << chosen;
+    iterators_[chosen] =
+        permuter_->class_permuters_by_int_[chosen]->begin().WithActiveSet(
+            dynamic_active_sets_[depth][chosen]);
+  }
+
+  const int class_int = dynamic_order_classes_[depth];
+  const ClassPermuter* class_permuter =
+      permuter_->class_permuters_by_int_[class_int];
+  ClassPermuter::iterator& it = iterators_[class_int];
+  if (resume) {
+    // `it` is at the value of the last match, which has already passed the
+    // checks below.
+    if (FindNextValidDynamic(depth + 1, /*resume=*/true)) return true;
+    ++it;
+  }
+
+  ValueSkip value_skip;
+  for (; it != class_permuter->end(); it += value_skip) {
+    mutable_solution().SetClass(it);
+    if (NotePositionForProfiler(depth)) return false;
+    if (!MatchDynamicPredicates(class_int, value_skip)) continue;
+    if (!ForwardCheck(depth, class_int, it.position())) continue;
+    if (FindNextValidDynamic(depth + 1, /*resume=*/false)) return true;
+  }
+
+  dynamic_assigned_ &= ~(uint64_t{1} << class_int);
+  return false;
+}
+
+int FilteredSolutionPermuter::Advancer::ChooseDynamicClass(int depth) const {
+  int chosen = -1;
+  int chosen_count = 0;
+  // Ties are broken by the order chosen by ReorderEvaluation.
+  for (const auto& class_permuter : permuter_->class_permuters_) {
+    const int class_int = class_permuter->class_int();
+    if (dynamic_assigned_ & (uint64_t{1} << class_int)) continue;
+    const ActiveSet& active_set = dynamic_active_sets_[depth][class_int];
+    const int count = active_set.is_trivial()
+                          ? class_permuter->permutation_count()
+                          : active_set.matches();
+    if (count == 0) return -1;
+    if (chosen < 0 || count < chosen_count) {
+      chosen = class_int;
+      chosen_count = count;
+    }
+  }
+  return chosen;
+}
+
+bool FilteredSolutionPermuter::Advancer::MatchDynamicPredicates(
+    int class_int, ValueSkip& value_skip) {
+  const SolutionView solution = current();
+  for (const DynamicFilter& dynamic_filter :
+       permuter_->dynamic_class_predicates_[class_int]) {
+    if (dynamic_filter.classes & ~dynamic_assigned_) continue;
+    if (!dynamic_filter.filter(solution)) {
+      value_skip.value_index = dynamic_filter.filter.entry_id(class_int);
+      return false;
+    }
+  }
+  value_skip.value_index = Entry::kBadId;
+  return true;
+}
+
+bool FilteredSolutionPermuter::Advancer::ForwardCheck(int depth, int class_int,
+                                                      int position) {
+  const FilterToActiveSet* builder = permuter_->filter_to_active_set_.get();
+  for (int other = 0; other < iterators_.size(); ++other) {
+    if (dynamic_assigned_ & (uint64_t{1} << other)) continue;
+    ActiveSet& active_set = dynamic_active_sets_[depth + 1][other];
+    active_set = dynamic_active_sets_[depth][other];
+    active_set.Intersect(builder->active_set_pair(class_int, position, other));
+    if (!active_set.is_trivial() && active_set.matches() == 0) return false;
+  }
+  return true;
+}
+
+double FilteredSolutionPermuter::Advancer::SampleLeaf(
+    absl::BitGenRef gen, absl::FunctionRef<bool(const SolutionView&)> accept) {
+  double weight = 1;
+  for (int class_position = 0;
+       class_position < permuter_->class_permuters_.size(); ++class_position) {
+    const ClassPermuter* class_permuter =
+        permuter_->class_permuters_[class_position].get();
+    const int class_int = class_permuter->class_int();
+    const std::vector<SolutionFilter>& solution_predicates =
+        permuter_->class_predicates_[class_int];
+
+    // Reservoir sample a single matching position in one pass.
+    int matches = 0;
+    int chosen = 0;
+    ValueSkip value_skip;
+    InitializeIterator(class_permuter, class_position);
+    ClassPermuter::iterator& it = iterators_[class_int];
+    for (; it != class_permuter->end(); it += value_skip) {
+      mutable_solution().SetClass(it);
+      if (AllMatch(solution_predicates, current(), class_int, value_skip)) {
+        ++matches;
+        if (absl::Uniform(gen, 0, matches) == 0) chosen = it.position();
+      }
+    }
+    if (matches == 0) return 0;
+    weight *= matches;
+
+    InitializeIterator(class_permuter, class_position);
+    while (it.position() < chosen) it += chosen - it.position();
+    mutable_solution().SetClass(it);
+  }
+  return accept(current()) ? weight : 0;
+}
+
+bool FilteredSolutionPermuter::Advancer::AdvanceIntoChunk() {
+  const ClassPermuter* class_permuter = permuter_->class_permuters_[0].get();
+  ClassPermuter::iterator& it = iterators_[class_permuter->class_int()];
+  while (it != class_permuter->end()) {
+    const int position = it.position();
+    if (position >= chunk_end_) {
+      if (!partition_->Claim(&chunk_begin_, &chunk_end_)) return false;
+    } else if (position < chunk_begin_) {
+      it += chunk_begin_ - position;
+    } else {
+      return true;
+    }
+  }
   return false;
 }
 
@@ -148,6 +579,12 @@ bool FilteredSolutionPermuter::Advancer::NotePositionForProfiler(
   VLOG(3) << "FindNextValid(" << class_position << ") ("
           << IterationDebugString() << ")";
 
+  if (const Cancellation* cancellation = permuter_->cancellation();
+      cancellation != nullptr && cancellation->Cancelled()) {
+    if (partition_ != nullptr) partition_->Cancel();
+    return true;
+  }
+  if (partition_ != nullptr) return partition_->cancelled();
   if (permuter_->profiler_ == nullptr) return false;
 
   if (permuter_->profiler_->NotePermutation(this->position())) {
@@ -160,25 +597,30 @@ bool FilteredSolutionPermuter::Advancer::NotePositionForProfiler(
 
 void FilteredSolutionPermuter::Advancer::Advance() {
   bool found_value = false;
-  for (int class_position = permuter_->class_permuters_.size() - 1;
-       class_position >= 0; --class_position) {
-    const ClassPermuter* class_permuter =
-        permuter_->class_permuters_[class_position].get();
-    int class_int = class_permuter->class_int();
+  if (dynamic_order_) {
+    found_value = FindNextValidDynamic(/*depth=*/0, /*resume=*/true);
+  } else {
+    for (int class_position = permuter_->class_permuters_.size() - 1;
+         class_position >= 0; --class_position) {
+      const ClassPermuter* class_permuter =
+          permuter_->class_permuters_[class_position].get();
+      int class_int = class_permuter->class_int();
 
-    if (iterators_[class_int] == class_permuter->end()) {
-      InitializeIterator(class_permuter, class_position);
-    } else {
-      ++iterators_[class_int];
-    }
-    mutable_solution().SetClass(iterators_[class_int]);
+      if (iterators_[class_int] == class_permuter->end()) {
+        InitializeIterator(class_permuter, class_position);
+      } else {
+        ++iterators_[class_int];
+      }
+      mutable_solution().SetClass(iterators_[class_int]);
 
-    if (iterators_[class_int] != class_permuter->end()) {
-      found_value = true;
-      break;
+      if (iterators_[class_int] != class_permuter->end()) {
+        found_value = true;
+        break;
+      }
     }
+    found_value = found_value && FindNextValidFromStart();
   }
-  if (found_value && FindNextValid(0)) {
+  if (found_value) {
     set_position(position());
   } else {
     set_done();
@@ -205,16 +647,178 @@ Position FilteredSolutionPermuter::Advancer::position() const {
   };
 }
 
+FilteredSolutionPermuter::ParallelAdvancer::ParallelAdvancer(
+    const FilteredSolutionPermuter* permuter, int num_threads)
+    : AdvancerBase(permuter->entry_descriptor()),
+      permuter_(permuter),
+      partition_(
+          permuter->class_permuters_.empty()
+              ? 0
+              : permuter->class_permuters_[0]->permutation_count(),
+          num_threads *
+              absl::GetFlag(FLAGS_puzzle_parallel_search_chunks_per_thread)),
+      running_workers_(num_threads),
+      pool_(absl::make_unique<::thread::Pool>(num_threads)) {
+  for (int i = 0; i < num_threads; ++i) {
+    pool_->Schedule([this]() { RunWorker(); });
+  }
+  Advance();
+}
+
+FilteredSolutionPermuter::ParallelAdvancer::~ParallelAdvancer() {
+  partition_.Cancel();
+  absl::MutexLock l(&mu_);
+  mu_.Await(absl::Condition(this, &ParallelAdvancer::NoRunningWorkers));
+}
+
+void FilteredSolutionPermuter::ParallelAdvancer::RunWorker() {
+  for (Advancer advancer(permuter_, &partition_); !advancer.done();
+       advancer.Advance()) {
+    absl::MutexLock l(&mu_);
+    mu_.Await(absl::Condition(this, &ParallelAdvancer::HasRoomOrCancelled));
+    if (partition_.cancelled()) break;
+    solutions_.emplace_back(advancer.current());
+  }
+  absl::MutexLock l(&mu_);
+  --running_workers_;
+}
+
+void FilteredSolutionPermuter::ParallelAdvancer::Advance() {
+  if (permuter_->profiler_ != nullptr && permuter_->profiler_->Done()) {
+    partition_.Cancel();
+  }
+  if (const Cancellation* cancellation = permuter_->cancellation();
+      cancellation != nullptr && cancellation->CancelledNow()) {
+    partition_.Cancel();
+  }
+  absl::MutexLock l(&mu_);
+  mu_.Await(absl::Condition(this, &ParallelAdvancer::HasSolutionOrDone));
+  if (solutions_.empty()) {
+    set_done();
+    set_position({
+        .position = permuter_->permutation_count(),
+        .count = permuter_->permutation_count(),
+    });
+    return;
+  }
+  mutable_solution().SetFrom(solutions_.front().view());
+  set_position(solutions_.front().position());
+  solutions_.pop_front();
+}
+
 FilteredSolutionPermuter::FilteredSolutionPermuter(const EntryDescriptor* e,
                                                    Profiler* profiler)
-    : SolutionPermuter(e),
-      profiler_(profiler),
-      executor_(
-          absl::GetFlag(FLAGS_puzzle_thread_pool_executor)
-              ? static_cast<::thread::Executor*>(new ::thread::Pool(
-                    absl::GetFlag(FLAGS_puzzle_thread_pool_executor_threads)))
-              : static_cast<::thread::Executor*>(
-                    new ::thread::InlineExecutor())) {}
+    : SolutionPermuter(e), profiler_(profiler), executor_(MakeExecutor()) {}
+
+// static
+std::unique_ptr<::thread::Executor> FilteredSolutionPermuter::MakeExecutor() {
+  if (!absl::GetFlag(FLAGS_puzzle_thread_pool_executor)) {
+    return absl::make_unique<::thread::InlineExecutor>();
+  }
+  const int num_threads =
+      absl::GetFlag(FLAGS_puzzle_thread_pool_executor_threads);
+  if (absl::GetFlag(FLAGS_puzzle_thread_pool_executor_work_stealing)) {
+    return absl::make_unique<::thread::WorkStealingPool>(num_threads);
+  }
+  return absl::make_unique<::thread::Pool>(num_threads);
+}
+
+SolutionPermuter::iterator FilteredSolutionPermuter::begin() const {
+  if (absl::GetFlag(FLAGS_puzzle_parallel_search) &&
+      prepare_state_ == PrepareState::kFull && !class_permuters_.empty()) {
+    return iterator(absl::make_unique<ParallelAdvancer>(
+        this, absl::GetFlag(FLAGS_puzzle_parallel_search_threads)));
+  }
+  return iterator(absl::make_unique<Advancer>(this));
+}
+
+absl::StatusOr<int64_t> FilteredSolutionPermuter::Count(
+    absl::FunctionRef<bool(const SolutionView&)> accept,
+    int num_threads) const {
+  if (prepare_state_ != PrepareState::kFull || class_permuters_.empty() ||
+      num_threads <= 1) {
+    return SolutionPermuter::Count(accept, num_threads);
+  }
+
+  RootPartition partition(
+      class_permuters_[0]->permutation_count(),
+      num_threads *
+          absl::GetFlag(FLAGS_puzzle_parallel_search_chunks_per_thread));
+  std::atomic<int64_t> count = 0;
+  {
+    ::thread::Pool pool(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      pool.Schedule([this, &partition, &count, accept]() {
+        int64_t worker_count = 0;
+        for (Advancer advancer(this, &partition); !advancer.done();
+             advancer.Advance()) {
+          if (accept(advancer.current())) ++worker_count;
+        }
+        count.fetch_add(worker_count, std::memory_order_relaxed);
+      });
+    }
+    // Destroying `pool` waits for the workers.
+  }
+  return count.load();
+}
+
+absl::StatusOr<SolutionPermuter::CountEstimate>
+FilteredSolutionPermuter::EstimateCount(
+    absl::FunctionRef<bool(const SolutionView&)> accept, int num_samples,
+    int num_threads) const {
+  if (prepare_state_ != PrepareState::kFull) {
+    return absl::FailedPreconditionError("Not prepared");
+  }
+  if (num_samples <= 0) {
+    return absl::InvalidArgumentError("num_samples must be positive");
+  }
+  num_threads = std::max(1, std::min(num_threads, num_samples));
+
+  struct Sums {
+    double sum = 0;
+    double sum_of_squares = 0;
+    int samples = 0;
+  };
+  std::vector<Sums> worker_sums(num_threads);
+  std::atomic<int> next_sample = 0;
+  {
+    ::thread::Pool pool(num_threads);
+    for (Sums& sums : worker_sums) {
+      pool.Schedule([this, &sums, &next_sample, num_samples, accept]() {
+        absl::BitGen gen;
+        std::unique_ptr<Advancer> sampler = Advancer::ForSampling(this);
+        while (next_sample.fetch_add(1, std::memory_order_relaxed) <
+               num_samples) {
+          if (cancellation() != nullptr && cancellation()->Cancelled()) break;
+          double weight = sampler->SampleLeaf(gen, accept);
+          sums.sum += weight;
+          sums.sum_of_squares += weight * weight;
+          ++sums.samples;
+        }
+      });
+    }
+    // Destroying `pool` waits for the workers.
+  }
+
+  Sums total;
+  for (const Sums& sums : worker_sums) {
+    total.sum += sums.sum;
+    total.sum_of_squares += sums.sum_of_squares;
+    total.samples += sums.samples;
+  }
+  CountEstimate ret;
+  ret.samples = total.samples;
+  if (total.samples == 0) return ret;
+  ret.count = total.sum / total.samples;
+  if (total.samples > 1) {
+    double variance =
+        std::max(0.0, (total.sum_of_squares / total.samples -
+                       ret.count * ret.count) *
+                          total.samples / (total.samples - 1));
+    ret.standard_error = std::sqrt(variance / total.samples);
+  }
+  return ret;
+}
 
 absl::StatusOr<bool> FilteredSolutionPermuter::AddFilter(
     SolutionFilter solution_filter) {
@@ -233,6 +837,30 @@ absl::StatusOr<bool> FilteredSolutionPermuter::AddFilter(
   return true;
 }
 
+absl::StatusOr<bool> FilteredSolutionPermuter::AddEntryValuePredicate(
+    int entry_id, int class_int, int value, bool equal) {
+  if (prepare_state_ != PrepareState::kUnprepared) {
+    return absl::FailedPreconditionError("Permuter already prepared");
+  }
+  if (!absl::GetFlag(FLAGS_puzzle_prune_entry_value_predicates)) {
+    return false;
+  }
+  if (class_int < 0 || class_int >= entry_descriptor()->num_classes()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Bad class_int: ", class_int));
+  }
+  const int num_values = entry_descriptor()->AllClassValues(class_int)->size();
+  if (entry_id < 0 || entry_id >= num_values || value < 0 ||
+      value >= num_values) {
+    // Out of the range of the precomputed tables. Leave it to a filter.
+    return false;
+  }
+  entry_value_predicates_.resize(entry_descriptor()->num_classes());
+  entry_value_predicates_[class_int].push_back(
+      ValueToActiveSet::Predicate{entry_id, value, equal});
+  return true;
+}
+
 double FilteredSolutionPermuter::Selectivity() const {
   double selectivity = 1.0;
   for (const auto& permuter : class_permuters_) {
@@ -249,6 +877,8 @@ absl::Status FilteredSolutionPermuter::PrepareCheap() {
   prepare_state_ = PrepareState::kCheap;
   filter_to_active_set_ =
       absl::make_unique<FilterToActiveSet>(entry_descriptor(), profiler_);
+  filter_to_active_set_->set_pair_memory_budget(
+      absl::GetFlag(FLAGS_puzzle_active_set_memory_budget));
 
   for (int class_int = 0; class_int < entry_descriptor()->AllClasses()->size();
        ++class_int) {
@@ -258,10 +888,42 @@ absl::Status FilteredSolutionPermuter::PrepareCheap() {
         MakeClassPermuter(class_descriptor, class_int));
   }
 
+  ApplyEntryValuePredicates();
+  if (const std::string cache_dir =
+          absl::GetFlag(FLAGS_puzzle_active_set_cache_dir);
+      !cache_dir.empty()) {
+    if (std::optional<uint64_t> fingerprint = ActiveSetFingerprint();
+        fingerprint.has_value()) {
+      std::vector<const ClassPermuter*> class_permuters;
+      for (const auto& class_permuter : class_permuters_) {
+        class_permuters.push_back(class_permuter.get());
+      }
+      absl::StatusOr<bool> loaded = ActiveSetCache(cache_dir).Load(
+          *fingerprint, class_permuters, filter_to_active_set_.get());
+      if (loaded.ok()) {
+        active_sets_from_cache_ = *loaded;
+      } else {
+        LOG(WARNING) << "Ignoring active set cache: " << loaded.status();
+      }
+    }
+  }
   RETURN_IF_ERROR(BuildActiveSetsCheap(&prepare_cheap_state_.residual));
+  NoteSelectivityBound();
   return absl::OkStatus();
 }
 
+void FilteredSolutionPermuter::ApplyEntryValuePredicates() {
+  // `class_permuters_` has not been reordered yet, so is indexed by class_int.
+  for (int class_int = 0; class_int < entry_value_predicates_.size();
+       ++class_int) {
+    if (entry_value_predicates_[class_int].empty()) continue;
+    const ClassPermuter* class_permuter = class_permuters_[class_int].get();
+    filter_to_active_set_->Intersect(
+        class_int, ValueToActiveSet::Shared(class_permuter)
+                       .Build(entry_value_predicates_[class_int]));
+  }
+}
+
 absl::Status FilteredSolutionPermuter::PrepareFull() {
   if (prepare_state_ != PrepareState::kCheap) {
     return absl::FailedPreconditionError("Already prepared");
@@ -269,6 +931,18 @@ absl::Status FilteredSolutionPermuter::PrepareFull() {
   prepare_state_ = PrepareState::kFull;
 
   RETURN_IF_ERROR(BuildActiveSetsFull());
+  NoteSelectivityBound();
+  if (const std::string cache_dir =
+          absl::GetFlag(FLAGS_puzzle_active_set_cache_dir);
+      !cache_dir.empty() && !active_sets_from_cache_) {
+    if (std::optional<uint64_t> fingerprint = ActiveSetFingerprint();
+        fingerprint.has_value()) {
+      absl::Status st =
+          ActiveSetCache(cache_dir).Save(*fingerprint, *filter_to_active_set_);
+      if (!st.ok()) LOG(WARNING) << "Not caching active sets: " << st;
+    }
+  }
+  RestoreDroppedPairPredicates(&prepare_cheap_state_.residual);
   ReorderEvaluation();
 
   class_predicates_.clear();
@@ -300,6 +974,69 @@ absl::Status FilteredSolutionPermuter::PrepareFull() {
               SolutionFilter::LtByEntryId());
   }
 
+  // Pairwise active sets in iteration depend on every earlier class, so a
+  // failure can never be attributed to fewer than all of them.
+  backjump_ =
+      absl::GetFlag(FLAGS_puzzle_backjump) &&
+      !absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators_mode_pair) &&
+      class_permuters_.size() <= 64;
+  class_predicate_conflicts_.clear();
+  if (backjump_) {
+    std::vector<int> class_position(class_permuters_.size());
+    for (int i = 0; i < class_permuters_.size(); ++i) {
+      class_position[class_permuters_[i]->class_int()] = i;
+    }
+    class_predicate_conflicts_.resize(class_predicates_.size());
+    for (int class_int = 0; class_int < class_predicates_.size();
+         ++class_int) {
+      for (const SolutionFilter& filter : class_predicates_[class_int]) {
+        uint64_t mask = 0;
+        for (int c : filter.classes()) {
+          mask |= uint64_t{1} << class_position[c];
+        }
+        class_predicate_conflicts_[class_int].push_back(mask);
+      }
+    }
+  }
+
+  // Every filter is listed under each class it reads, and evaluated once the
+  // last of them is assigned.
+  dynamic_order_ =
+      absl::GetFlag(FLAGS_puzzle_dynamic_class_order) &&
+      absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators_mode_pair) &&
+      class_permuters_.size() <= 64;
+  dynamic_class_predicates_.clear();
+  class_permuters_by_int_.clear();
+  if (dynamic_order_) {
+    dynamic_class_predicates_.resize(class_permuters_.size());
+    class_permuters_by_int_.resize(class_permuters_.size());
+    for (const auto& class_permuter : class_permuters_) {
+      class_permuters_by_int_[class_permuter->class_int()] =
+          class_permuter.get();
+    }
+    for (const SolutionFilter& filter : prepare_cheap_state_.residual) {
+      uint64_t classes = 0;
+      for (int c : filter.classes()) classes |= uint64_t{1} << c;
+      for (int c : filter.classes()) {
+        dynamic_class_predicates_[c].push_back(
+            {.filter = filter, .classes = classes});
+      }
+    }
+  }
+
+  static_class_size_ = 0;
+  if (absl::GetFlag(FLAGS_puzzle_static_class_permuter) &&
+      !class_permuters_.empty()) {
+    static_class_size_ = StaticClassPermuterSize(*class_permuters_[0]);
+    for (const auto& permuter : class_permuters_) {
+      if (StaticClassPermuterSize(*permuter) != static_class_size_) {
+        static_class_size_ = 0;
+        break;
+      }
+    }
+  }
+  VLOG(1) << "Static class permuter size: " << static_class_size_;
+
   if (VLOG_IS_ON(2)) {
     for (const auto& permuter : class_permuters_) {
       double selectivity =
@@ -334,6 +1071,10 @@ absl::Status FilteredSolutionPermuter::BuildActiveSetsCheap(
 
   std::vector<std::vector<SolutionFilter>> single_class_predicates;
   single_class_predicates.resize(class_permuters_.size());
+  // Ordered so that the builds, which each depend on those before, are
+  // deterministic.
+  std::map<std::array<int, 3>, std::vector<SolutionFilter>>
+      triple_class_predicates;
   for (const auto& filter : predicates_) {
     if (filter.classes().size() == 1) {
       int class_int = filter.classes()[0];
@@ -350,10 +1091,21 @@ absl::Status FilteredSolutionPermuter::BuildActiveSetsCheap(
         residual->push_back(filter);
       }
     } else {
+      if (filter.classes().size() == 3) {
+        std::array<int, 3> key = {filter.classes()[0], filter.classes()[1],
+                                  filter.classes()[2]};
+        absl::c_sort(key);
+        triple_class_predicates[key].push_back(filter);
+      }
       residual->push_back(filter);
     }
   }
 
+  if (active_sets_from_cache_) {
+    VLOG(1) << "Active sets loaded from cache";
+    return absl::OkStatus();
+  }
+
   VLOG(1) << "Generating singleton selectivities";
 
   for (auto& single_class_predicate_list : single_class_predicates) {
@@ -380,6 +1132,32 @@ absl::Status FilteredSolutionPermuter::BuildActiveSetsCheap(
   while (::thread::Future<absl::Status>* st = work_set.WaitForAny()) {
     if (!(*st)->ok()) return **st;
   }
+
+  if (!absl::GetFlag(FLAGS_puzzle_prune_triple_class_iterators)) {
+    return absl::OkStatus();
+  }
+  VLOG(1) << "Generating triple selectivities";
+  const int64_t max_evaluations =
+      absl::GetFlag(FLAGS_puzzle_prune_triple_class_max_evaluations);
+  for (const auto& [classes, predicates] : triple_class_predicates) {
+    std::vector<SolutionFilter> pair_predicates;
+    RETURN_IF_ERROR(filter_to_active_set_->Build(
+        class_permuters_[classes[0]].get(), class_permuters_[classes[1]].get(),
+        class_permuters_[classes[2]].get(), predicates, max_evaluations,
+        absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators)
+            ? &pair_predicates
+            : nullptr));
+    // The pair predicates are implied by `predicates`, which remain in the
+    // residual, so they are only used to build active sets.
+    for (SolutionFilter& filter : pair_predicates) {
+      const int class_a = filter.classes()[0];
+      const int class_b = filter.classes()[1];
+      prepare_cheap_state_.pair_class_predicates[{class_a, class_b}].push_back(
+          filter);
+      prepare_cheap_state_.pair_class_predicates[{class_b, class_a}].push_back(
+          std::move(filter));
+    }
+  }
   return absl::OkStatus();
 }
 
@@ -387,18 +1165,165 @@ absl::Status FilteredSolutionPermuter::BuildActiveSetsFull() {
   if (!absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators)) {
     return absl::OkStatus();
   }
+  if (active_sets_from_cache_) return absl::OkStatus();
 
   VLOG(1) << "Generating pair selectivities";
 
   PairFilterBurnDown burn_down(
       class_permuters_, std::move(prepare_cheap_state_.pair_class_predicates),
-      filter_to_active_set_.get(), executor_.get());
+      filter_to_active_set_.get(), executor_.get(), cancellation());
+  burn_down.set_on_progress([this]() { NoteSelectivityBound(); });
 
   RETURN_IF_ERROR(burn_down.BurnDown());
+  if (absl::GetFlag(FLAGS_puzzle_pair_class_burn_down_worklist)) {
+    fixpoint_stats_ = burn_down.fixpoint_stats();
+  }
 
   return absl::OkStatus();
 }
 
+std::optional<uint64_t> FilteredSolutionPermuter::ActiveSetFingerprint()
+    const {
+  for (const SolutionFilter& filter : predicates_) {
+    if (filter.key().empty()) {
+      VLOG(1) << "Not using the active set cache: \"" << filter.name()
+              << "\" has no key";
+      return std::nullopt;
+    }
+  }
+
+  Fingerprinter fingerprinter;
+  for (bool flag :
+       {absl::GetFlag(FLAGS_puzzle_prune_class_iterator),
+        absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators),
+        absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators_mode_pair),
+        absl::GetFlag(FLAGS_puzzle_prune_triple_class_iterators)}) {
+    fingerprinter.Add(int64_t{flag});
+  }
+  fingerprinter.Add(absl::GetFlag(FLAGS_puzzle_active_set_memory_budget));
+
+  fingerprinter.Add(entry_descriptor()->AllIds()->size());
+  fingerprinter.Add(entry_descriptor()->num_classes());
+  for (int class_int = 0; class_int < entry_descriptor()->num_classes();
+       ++class_int) {
+    fingerprinter.Add(entry_descriptor()->AllClassValues(class_int)->size());
+  }
+
+  fingerprinter.Add(predicates_.size());
+  for (const SolutionFilter& filter : predicates_) {
+    fingerprinter.Add(filter.key());
+    fingerprinter.Add(filter.classes().size());
+    for (int class_int : filter.classes()) {
+      fingerprinter.Add(class_int);
+      fingerprinter.Add(filter.entry_id(class_int));
+    }
+    fingerprinter.Add(filter.cells().size());
+    for (const SolutionFilter::Cell& cell : filter.cells()) {
+      fingerprinter.Add(cell.entry_id);
+      fingerprinter.Add(cell.class_int);
+    }
+  }
+
+  fingerprinter.Add(entry_value_predicates_.size());
+  for (const auto& predicates : entry_value_predicates_) {
+    fingerprinter.Add(predicates.size());
+    for (const ValueToActiveSet::Predicate& p : predicates) {
+      fingerprinter.Add(p.position);
+      fingerprinter.Add(p.value);
+      fingerprinter.Add(int64_t{p.equal});
+    }
+  }
+  return fingerprinter.fingerprint();
+}
+
+void FilteredSolutionPermuter::RestoreDroppedPairPredicates(
+    std::vector<SolutionFilter>* residual) {
+  if (!absl::GetFlag(FLAGS_puzzle_prune_class_iterator) ||
+      !absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators) ||
+      !absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators_mode_pair)) {
+    // Pair predicates were never left to the pair active sets.
+    return;
+  }
+  if (filter_to_active_set_->dropped_pair_count() == 0) return;
+
+  for (const auto& filter : predicates_) {
+    if (filter.classes().size() != 2) continue;
+    if (filter_to_active_set_->pair_dropped(filter.classes()[0],
+                                            filter.classes()[1])) {
+      residual->push_back(filter);
+    }
+  }
+  VLOG(1) << filter_to_active_set_->dropped_pair_count()
+          << " pair active sets dropped; " << residual->size()
+          << " residual predicates";
+}
+
+std::string FilteredSolutionPermuter::DebugStatistics() const {
+  if (filter_to_active_set_ == nullptr) return "";
+  std::vector<std::string> parts = {filter_to_active_set_->MemoryDebugString()};
+  if (active_sets_from_cache_) parts.push_back("active sets from cache");
+  if (fixpoint_stats_.has_value()) {
+    parts.push_back(absl::StrCat(
+        "pair fixpoint ", fixpoint_stats_->fixpoint ? "reached" : "not reached",
+        ": ", fixpoint_stats_->builds, " builds, ", fixpoint_stats_->requeued,
+        " requeued, ", absl::FormatDuration(fixpoint_stats_->elapsed)));
+  }
+  std::string filter_stats = FilterStatsDebugString();
+  if (!filter_stats.empty()) parts.push_back(std::move(filter_stats));
+  return absl::StrJoin(parts, "] [");
+}
+
+void FilteredSolutionPermuter::AddFilterStats(
+    const std::vector<std::vector<FilterStats>>& stats) const {
+  absl::MutexLock l(&filter_stats_mu_);
+  if (filter_stats_.empty()) {
+    filter_stats_ = stats;
+    return;
+  }
+  for (int class_int = 0; class_int < stats.size(); ++class_int) {
+    for (int i = 0; i < stats[class_int].size(); ++i) {
+      FilterStats& sum = filter_stats_[class_int][i];
+      sum.calls += stats[class_int][i].calls;
+      sum.rejections += stats[class_int][i].rejections;
+      sum.timed_calls += stats[class_int][i].timed_calls;
+      sum.timed_nanos += stats[class_int][i].timed_nanos;
+    }
+  }
+}
+
+std::string FilteredSolutionPermuter::FilterStatsDebugString() const {
+  static constexpr int kMaxReported = 5;
+
+  struct Reported {
+    const SolutionFilter* filter;
+    const FilterStats* stats;
+    double nanos;
+  };
+  std::vector<Reported> reported;
+  absl::MutexLock l(&filter_stats_mu_);
+  for (int class_int = 0; class_int < filter_stats_.size(); ++class_int) {
+    for (int i = 0; i < filter_stats_[class_int].size(); ++i) {
+      const FilterStats& stats = filter_stats_[class_int][i];
+      if (stats.calls == 0) continue;
+      reported.push_back({.filter = &class_predicates_[class_int][i],
+                          .stats = &stats,
+                          .nanos = stats.NanosPerCall() * stats.calls});
+    }
+  }
+  absl::c_sort(reported, [](const Reported& a, const Reported& b) {
+    return a.nanos > b.nanos;
+  });
+  if (reported.size() > kMaxReported) reported.resize(kMaxReported);
+  return absl::StrJoin(
+      reported, "; ", [](std::string* out, const Reported& r) {
+        absl::StrAppend(
+            out, r.filter->name(), ": ", r.stats->calls, " calls, ",
+            static_cast<int>(100.0 * r.stats->rejections / r.stats->calls),
+            "% rejected, ",
+            static_cast<int64_t>(r.nanos / 1000000), "ms");
+      });
+}
+
 void FilteredSolutionPermuter::ReorderEvaluation() {
   if (!absl::GetFlag(FLAGS_puzzle_prune_reorder_classes)) {
     return;
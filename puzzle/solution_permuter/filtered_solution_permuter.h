@@ -1,36 +1,179 @@
 #ifndef PUZZLE_SOLUTION_PERMUTER_FILTERED_SOLUTION_PERMUTER_H
 #define PUZZLE_SOLUTION_PERMUTER_FILTERED_SOLUTION_PERMUTER_H
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
 #include "absl/memory/memory.h"
+#include "absl/random/bit_gen_ref.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "puzzle/base/owned_solution.h"
 #include "puzzle/base/profiler.h"
 #include "puzzle/base/solution_filter.h"
 #include "puzzle/class_permuter/class_permuter.h"
+#include "puzzle/class_permuter/static_class_permuter.h"
+#include "puzzle/class_permuter/value_to_active_set.h"
 #include "puzzle/solution_permuter/filter_to_active_set.h"
 #include "puzzle/solution_permuter/mutable_solution.h"
+#include "puzzle/solution_permuter/pair_filter_burn_down.h"
 #include "puzzle/solution_permuter/solution_permuter.h"
 #include "thread/executor.h"
+#include "thread/pool.h"
 
 namespace puzzle {
 
 class FilteredSolutionPermuter final : public SolutionPermuter {
  public:
+  class ParallelAdvancer;
+
+  // Counts of the evaluations of a single SolutionFilter during iteration.
+  // Only one in kFilterTimingInterval evaluations is timed.
+  struct FilterStats {
+    int64_t calls = 0;
+    int64_t rejections = 0;
+    int64_t timed_calls = 0;
+    int64_t timed_nanos = 0;
+
+    double NanosPerCall() const {
+      return timed_calls == 0 ? 0 : static_cast<double>(timed_nanos) / timed_calls;
+    }
+  };
+  static constexpr int kFilterTimingInterval = 64;
+
+  // Hands out disjoint chunks of positions of the outermost class permuter
+  // (`class_permuters_[0]`) to concurrent Advancers.
+  class RootPartition {
+   public:
+    RootPartition(int permutation_count, int num_chunks);
+
+    // Claims the next unsearched chunk, returning its half-open position range
+    // in [`begin`, `end`). Returns false if all chunks have been claimed or
+    // the search was cancelled. Successive claims from a single thread are
+    // strictly increasing.
+    bool Claim(int* begin, int* end);
+
+    void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    bool cancelled() const {
+      return cancelled_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    const int permutation_count_;
+    const int chunk_size_;
+    std::atomic<int> next_chunk_ = 0;
+    std::atomic<bool> cancelled_ = false;
+  };
+
   class Advancer final : public SolutionPermuter::AdvancerBase {
    public:
-    explicit Advancer(const FilteredSolutionPermuter* permuter);
+    explicit Advancer(const FilteredSolutionPermuter* permuter)
+        : Advancer(permuter, /*partition=*/nullptr) {}
+
+    // If `partition` is non-null, only positions of the outermost class
+    // permuter from chunks claimed from `partition` are iterated and the
+    // profiler is not consulted (the profiler is not thread-safe).
+    Advancer(const FilteredSolutionPermuter* permuter,
+             RootPartition* partition);
+
+    // Adds any filter statistics gathered to the permuter's.
+    ~Advancer() override;
 
     Advancer(const Advancer&) = delete;
     Advancer& operator=(const Advancer&) = delete;
 
+    // Returns an Advancer for SampleLeaf, which unlike the constructors does
+    // not search for a first matching position.
+    static std::unique_ptr<Advancer> ForSampling(
+        const FilteredSolutionPermuter* permuter);
+
     Position position() const;
 
+    // Sets each class in turn to a value chosen uniformly from those matching
+    // its predicates given the earlier classes, and returns the product of the
+    // number of such values if `accept` is true of the result, or zero
+    // otherwise (including if some class has no matching value). This is
+    // Knuth's estimator of the number of matching positions.
+    double SampleLeaf(absl::BitGenRef gen,
+                      absl::FunctionRef<bool(const SolutionView&)> accept);
+
    private:
+    Advancer(const FilteredSolutionPermuter* permuter, RootPartition* partition,
+             bool find_first);
+
     void Advance() override;
 
     void PruneClass(int class_int,
                     const std::vector<SolutionFilter>& predicates);
+
+    // Returns AllMatch of `permuter_->class_predicates_[class_int]` against
+    // the current solution, gathering statistics on each filter and
+    // adapting the order in which they are evaluated if enabled. If
+    // `conflicts` is non-null and a filter rejects, the positions of the
+    // classes it reads are added to `*conflicts`.
+    bool MatchPredicates(int class_int, ValueSkip& value_skip,
+                         uint64_t* conflicts = nullptr);
+    bool MatchPredicatesWithStats(int class_int, ValueSkip& value_skip,
+                                  uint64_t* conflicts);
+
+    // Sorts `filter_order_[class_int]` by decreasing rejections per
+    // nanosecond spent evaluating the filter, among filters with the same
+    // entry_id.
+    void ReorderFilters(int class_int);
+
+    // Advances the iterators of `class_permuters_[class_position]` and later
+    // to the next position matching all predicates. If `kStaticSize` is
+    // non-zero, every class permuter must match StaticClassPermuter of that
+    // size, and iterators are advanced without virtual calls.
+    template <int kStaticSize>
     bool FindNextValid(int class_position);
 
+    // As FindNextValid, but for --puzzle_dynamic_class_order. The class at
+    // `depth` is chosen by ChooseDynamicClass when first reached, and
+    // recorded in `dynamic_order_classes_`. If `resume` is true, the
+    // iterators at `depth` and deeper are at the last match, and the search
+    // continues from the next position.
+    bool FindNextValidDynamic(int depth, bool resume);
+
+    // Returns the unassigned class with the fewest values in
+    // `dynamic_active_sets_[depth]`, or -1 if any unassigned class has none.
+    int ChooseDynamicClass(int depth) const;
+
+    // Returns AllMatch of the filters in
+    // `permuter_->dynamic_class_predicates_[class_int]` whose classes are
+    // all assigned.
+    bool MatchDynamicPredicates(int class_int, ValueSkip& value_skip);
+
+    // Sets `dynamic_active_sets_[depth + 1]` for each unassigned class from
+    // `dynamic_active_sets_[depth]` and the pairwise active sets given
+    // `class_int` is at `position`. Returns false if any becomes empty.
+    bool ForwardCheck(int depth, int class_int, int position);
+
+    // Calls FindNextValid for the first class permuter with `kStaticSize` set
+    // to `permuter_->static_class_size_`, or zero if that is larger than
+    // `kStaticSize`.
+    template <int kStaticSize = kMaxStaticClassPermuterSize>
+    bool FindNextValidFromStart();
+
+    // Equivalent to `it += value_skip`.
+    template <int kStaticSize>
+    static void Next(ClassPermuter::iterator& it, ValueSkip value_skip) {
+      if constexpr (kStaticSize == 0) {
+        it += value_skip;
+      } else {
+        StaticClassPermuter<kStaticSize>::Advance(it, value_skip);
+      }
+    }
+
+    // Moves the outermost iterator forward to the first position within a
+    // chunk claimed from `partition_`, claiming new chunks as needed. Returns
+    // false if no claimable positions remain.
+    bool AdvanceIntoChunk();
+
     std::string IterationDebugString() const;
 
     // Initializes the iterator corresponding to `class_permuter` to begin
@@ -43,36 +186,130 @@ class FilteredSolutionPermuter final : public SolutionPermuter {
 
     // If permuter_->profiler is not null, calls NotePosition and flushes a
     // status prompt to std::out. Returns true if the profiler signals an
-    // early abort is indicated.
+    // early abort is indicated, or if the permuter's cancellation token (when
+    // set) has been cancelled, in which case `partition_` is also cancelled.
     bool NotePositionForProfiler(int class_position);
 
     const FilteredSolutionPermuter* permuter_ = nullptr;
+    RootPartition* partition_ = nullptr;
+    int chunk_begin_ = 0;
+    int chunk_end_ = 0;
     std::vector<int> class_types_;
     std::vector<ClassPermuter::iterator> iterators_;
     std::vector<double> pair_selectivity_reduction_;
+
+    // Indexed by class_int and then by index in
+    // `permuter_->class_predicates_[class_int]`. Empty unless
+    // --puzzle_filter_statistics or --puzzle_filter_adaptive_order is set.
+    std::vector<std::vector<FilterStats>> filter_stats_;
+    // Indexed by class_int. The order in which to evaluate
+    // `permuter_->class_predicates_[class_int]`, by index.
+    std::vector<std::vector<int>> filter_order_;
+    // Indexed by class_int. Evaluations remaining before ReorderFilters if
+    // --puzzle_filter_adaptive_order is set.
+    std::vector<int64_t> evaluations_until_reorder_;
+
+    // Set when FindNextValid fails, as a bitmask of the class positions
+    // involved in the failure. Cleared bits mark classes whose values may
+    // be changed without effect on the failure, so are skipped on the way
+    // back to the latest set bit.
+    uint64_t failed_conflicts_ = 0;
+
+    // True if searching with FindNextValidDynamic.
+    bool dynamic_order_ = false;
+    // The class_int assigned at each depth of FindNextValidDynamic.
+    std::vector<int> dynamic_order_classes_;
+    // Bitmask of the class_ints assigned by FindNextValidDynamic.
+    uint64_t dynamic_assigned_ = 0;
+    // Indexed by depth and then class_int. The values remaining for each
+    // class not yet assigned at that depth.
+    std::vector<std::vector<ActiveSet>> dynamic_active_sets_;
+
+    friend FilteredSolutionPermuter;
+    friend ParallelAdvancer;
+  };
+
+  // Searches the permutations of the outermost class permuter in parallel by
+  // running one partitioned Advancer per thread of a private thread::Pool.
+  // Each worker owns its own MutableSolution and iterator stack, and passes
+  // matches back through a bounded queue. Solutions are returned in an order
+  // which depends on thread scheduling.
+  class ParallelAdvancer final : public SolutionPermuter::AdvancerBase {
+   public:
+    ParallelAdvancer(const FilteredSolutionPermuter* permuter,
+                     int num_threads);
+    ~ParallelAdvancer() override;
+
+    ParallelAdvancer(const ParallelAdvancer&) = delete;
+    ParallelAdvancer& operator=(const ParallelAdvancer&) = delete;
+
+   private:
+    void Advance() override;
+
+    void RunWorker() ABSL_LOCKS_EXCLUDED(mu_);
+
+    bool HasSolutionOrDone() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return !solutions_.empty() || running_workers_ == 0;
+    }
+    bool HasRoomOrCancelled() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return solutions_.size() < kMaxQueuedSolutions ||
+             partition_.cancelled();
+    }
+    bool NoRunningWorkers() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return running_workers_ == 0;
+    }
+
+    static constexpr int kMaxQueuedSolutions = 64;
+
+    const FilteredSolutionPermuter* permuter_;
+    RootPartition partition_;
+    absl::Mutex mu_;
+    std::deque<OwnedSolution> solutions_ ABSL_GUARDED_BY(mu_);
+    int running_workers_ ABSL_GUARDED_BY(mu_);
+
+    // Declared last so worker threads are joined before other members are
+    // destroyed.
+    std::unique_ptr<::thread::Pool> pool_;
   };
 
   FilteredSolutionPermuter(const EntryDescriptor* e, Profiler* profiler);
   ~FilteredSolutionPermuter() = default;
 
-  // Movable, but not copyable.
+  // Neither copyable nor movable: `selectivity_bound_` is atomic, as other
+  // threads read it while this permuter is prepared, and `filter_stats_mu_`
+  // is a Mutex.
   FilteredSolutionPermuter(const FilteredSolutionPermuter&) = delete;
   FilteredSolutionPermuter& operator=(const FilteredSolutionPermuter&) = delete;
-  FilteredSolutionPermuter(FilteredSolutionPermuter&&) = default;
-  FilteredSolutionPermuter& operator=(FilteredSolutionPermuter&&) = default;
+  FilteredSolutionPermuter(FilteredSolutionPermuter&&) = delete;
+  FilteredSolutionPermuter& operator=(FilteredSolutionPermuter&&) = delete;
 
-  iterator begin() const override {
-    return iterator(absl::make_unique<Advancer>(this));
-  }
+  iterator begin() const override;
 
   double Selectivity() const override;
+  double SelectivityBound() const override {
+    return selectivity_bound_.load(std::memory_order_relaxed);
+  }
   double permutation_count() const;
 
   absl::StatusOr<bool> AddFilter(SolutionFilter solution_filter) override;
+  absl::StatusOr<bool> AddEntryValuePredicate(int entry_id, int class_int,
+                                              int value, bool equal) override;
 
   absl::Status PrepareCheap() override;
   absl::Status PrepareFull() override;
 
+  // Searches disjoint chunks of the outermost class permuter on separate
+  // threads as for --puzzle_parallel_search, but only counts matches.
+  absl::StatusOr<int64_t> Count(
+      absl::FunctionRef<bool(const SolutionView&)> accept,
+      int num_threads) const override;
+
+  absl::StatusOr<CountEstimate> EstimateCount(
+      absl::FunctionRef<bool(const SolutionView&)> accept, int num_samples,
+      int num_threads) const override;
+
+  std::string DebugStatistics() const override;
+
  private:
   // Builds ActiveSet for each element in 'class_permuters_' (if flag enabled).
   // Elements in 'filters' that are not completely evaluated by these active
@@ -80,6 +317,40 @@ class FilteredSolutionPermuter final : public SolutionPermuter {
   absl::Status BuildActiveSetsCheap(std::vector<SolutionFilter>* residual);
   absl::Status BuildActiveSetsFull();
 
+  // Adds to `residual` the pair class predicates that were left to pair
+  // ActiveSets which were then dropped for exceeding
+  // --puzzle_active_set_memory_budget.
+  void RestoreDroppedPairPredicates(std::vector<SolutionFilter>* residual);
+
+  // Restricts the ActiveSet of each class to the permutations satisfying its
+  // `entry_value_predicates_`.
+  void ApplyEntryValuePredicates();
+
+  // Returns a fingerprint of the predicates, the EntryDescriptor and the
+  // flags which determine `filter_to_active_set_` once prepared, or nullopt
+  // if any predicate has no key. Filters are identified by key and cells;
+  // names (and the values captured by a predicate) are not seen.
+  std::optional<uint64_t> ActiveSetFingerprint() const;
+
+  // Returns the executor used for PrepareCheap and PrepareFull as selected by
+  // --puzzle_thread_pool_executor and related flags.
+  static std::unique_ptr<::thread::Executor> MakeExecutor();
+
+  // Publishes Selectivity as `selectivity_bound_`. Must not be called while
+  // active sets are being built.
+  void NoteSelectivityBound() {
+    selectivity_bound_.store(Selectivity(), std::memory_order_relaxed);
+    NotifySelectivityBound();
+  }
+
+  // Adds `stats` from a finished Advancer to `filter_stats_`.
+  void AddFilterStats(const std::vector<std::vector<FilterStats>>& stats) const
+      ABSL_LOCKS_EXCLUDED(filter_stats_mu_);
+
+  // Returns a summary of `filter_stats_` for DebugStatistics.
+  std::string FilterStatsDebugString() const
+      ABSL_LOCKS_EXCLUDED(filter_stats_mu_);
+
   // Reorders 'class_permuters_' by increasing selectivity. The effect of this
   // is to mean that any filter evaluated on a partial set of 'class_permuters_'
   // maximally prunes unnecessary iteration.
@@ -87,6 +358,12 @@ class FilteredSolutionPermuter final : public SolutionPermuter {
 
   std::vector<SolutionFilter> predicates_;
 
+  // entry_value_predicates_[class_int] holds the predicates added by
+  // AddEntryValuePredicate for `class_int`. These are applied to
+  // `filter_to_active_set_` from precomputed ValueToActiveSet tables rather
+  // than by evaluating a filter per permutation.
+  std::vector<std::vector<ValueToActiveSet::Predicate>> entry_value_predicates_;
+
   Profiler* profiler_;
 
   enum class PrepareState {
@@ -95,6 +372,9 @@ class FilteredSolutionPermuter final : public SolutionPermuter {
     kFull = 2,
   };
   PrepareState prepare_state_ = PrepareState::kUnprepared;
+  // Selectivity as of the last completed step of preparation. Active sets
+  // only ever narrow, so this is an upper bound on the prepared Selectivity.
+  std::atomic<double> selectivity_bound_ = 1.0;
   struct PrepareCheapState {
     std::vector<SolutionFilter> residual;
     absl::flat_hash_map<std::pair<int, int>, std::vector<SolutionFilter>>
@@ -113,9 +393,46 @@ class FilteredSolutionPermuter final : public SolutionPermuter {
 
   std::unique_ptr<FilterToActiveSet> filter_to_active_set_;
 
+  // Set by BuildActiveSetsFull with --puzzle_pair_class_burn_down_worklist.
+  std::optional<PairFilterBurnDown::FixpointStats> fixpoint_stats_;
+
+  // True if `filter_to_active_set_` was loaded by PrepareCheap from
+  // --puzzle_active_set_cache_dir, in which case no active sets are built.
+  bool active_sets_from_cache_ = false;
+
+  // If non-zero, every element of `class_permuters_` matches
+  // StaticClassPermuter<static_class_size_>. Set by PrepareFull.
+  int static_class_size_ = 0;
+
+  // If true, Advancer::FindNextValid backjumps. Set by PrepareFull.
+  bool backjump_ = false;
+
+  // A filter along with the bitmask of class_ints it reads.
+  struct DynamicFilter {
+    SolutionFilter filter;
+    uint64_t classes;
+  };
+  // If true, Advancer searches with FindNextValidDynamic, which uses
+  // `dynamic_class_predicates_` and `class_permuters_by_int_` (indexed by
+  // class_int) in place of `class_predicates_`. Set by PrepareFull.
+  bool dynamic_order_ = false;
+  std::vector<std::vector<DynamicFilter>> dynamic_class_predicates_;
+  std::vector<const ClassPermuter*> class_permuters_by_int_;
+  // Parallel to `class_predicates_`. The positions within `class_permuters_`
+  // of the classes read by each filter, as a bitmask. Set by PrepareFull if
+  // `backjump_` is true.
+  std::vector<std::vector<uint64_t>> class_predicate_conflicts_;
+
   std::unique_ptr<::thread::Executor> executor_;
 
+  // Filter statistics summed over every Advancer which has finished, indexed
+  // as Advancer::filter_stats_.
+  mutable absl::Mutex filter_stats_mu_;
+  mutable std::vector<std::vector<FilterStats>> filter_stats_
+      ABSL_GUARDED_BY(filter_stats_mu_);
+
   friend Advancer;
+  friend ParallelAdvancer;
 };
 
 }  // namespace puzzle
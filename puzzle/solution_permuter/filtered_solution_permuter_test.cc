@@ -1,19 +1,46 @@
 #include "puzzle/solution_permuter/filtered_solution_permuter.h"
 
+#include <filesystem>
 #include <iostream>
 #include <string>
+#include <type_traits>
 #include <unordered_set>
 #include <vector>
 
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "puzzle/base/owned_solution.h"
 #include "puzzle/base/solution_filter.h"
 
+ABSL_DECLARE_FLAG(bool, puzzle_parallel_search);
+ABSL_DECLARE_FLAG(int, puzzle_parallel_search_threads);
+ABSL_DECLARE_FLAG(bool, puzzle_prune_pair_class_iterators_mode_pair);
+ABSL_DECLARE_FLAG(int64_t, puzzle_active_set_memory_budget);
+ABSL_DECLARE_FLAG(bool, puzzle_filter_statistics);
+ABSL_DECLARE_FLAG(bool, puzzle_filter_adaptive_order);
+ABSL_DECLARE_FLAG(int64_t, puzzle_filter_adaptive_order_interval);
+ABSL_DECLARE_FLAG(bool, puzzle_backjump);
+ABSL_DECLARE_FLAG(bool, puzzle_dynamic_class_order);
+ABSL_DECLARE_FLAG(bool, puzzle_pair_class_burn_down_worklist);
+ABSL_DECLARE_FLAG(bool, puzzle_pair_class_burn_down_roi);
+ABSL_DECLARE_FLAG(std::string, puzzle_active_set_cache_dir);
+ABSL_DECLARE_FLAG(bool, puzzle_pair_class_mode_make_pairs);
+ABSL_DECLARE_FLAG(bool, puzzle_value_skip_to_active_set);
+
+using ::testing::DoubleEq;
 using ::testing::Ge;
+using ::testing::HasSubstr;
+using ::testing::Lt;
+using ::testing::UnorderedElementsAreArray;
 
 namespace puzzle {
 
+static_assert(!std::is_move_constructible_v<FilteredSolutionPermuter>,
+              "selectivity_bound_ and filter_stats_mu_ are not movable");
+
 TEST(FilteredSolutionPermuterTest, Simple) {
   std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
   class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
@@ -163,4 +190,515 @@ TEST(FilteredSolutionPermuterTest, CropBothClasses) {
   }
 }
 
+TEST(FilteredSolutionPermuterTest, EntryValuePredicates) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+  EntryDescriptor ed(absl::make_unique<IntRangeDescriptor>(3),
+                     absl::make_unique<StringDescriptor>(
+                         std::vector<std::string>{"foo", "bar"}),
+                     std::move(class_descriptors));
+
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  absl::StatusOr<bool> added = p.AddEntryValuePredicate(
+      /*entry_id=*/0, /*class_int=*/0, /*value=*/1, /*equal=*/true);
+  ASSERT_TRUE(added.ok()) << added.status();
+  EXPECT_TRUE(*added);
+  added = p.AddEntryValuePredicate(/*entry_id=*/1, /*class_int=*/1,
+                                   /*value=*/2, /*equal=*/false);
+  ASSERT_TRUE(added.ok()) << added.status();
+  EXPECT_TRUE(*added);
+  // Out of range values are left to the caller to evaluate as a filter.
+  added = p.AddEntryValuePredicate(/*entry_id=*/1, /*class_int=*/1,
+                                   /*value=*/3, /*equal=*/false);
+  ASSERT_TRUE(added.ok()) << added.status();
+  EXPECT_FALSE(*added);
+  ASSERT_TRUE(p.Prepare().ok());
+
+  std::vector<OwnedSolution> solutions;
+  for (auto it = p.begin(); it != p.end(); ++it) {
+    EXPECT_THAT(it->Id(0).Class(0), 1);
+    EXPECT_THAT(it->Id(1).Class(1), ::testing::Ne(2));
+    solutions.push_back(OwnedSolution(*it));
+  }
+  EXPECT_THAT(solutions.size(), 2 * 4);
+}
+
+static void AddPairAndTripleFilters(FilteredSolutionPermuter& p) {
+  SolutionFilter pair(
+      "pair",
+      [](const SolutionView& s) {
+        return s.Id(0).Class(0) != s.Id(0).Class(1);
+      },
+      std::vector<int>{0, 1});
+  pair.set_key("Id(0).Class(0) != Id(0).Class(1)");
+  EXPECT_TRUE(p.AddFilter(std::move(pair)).ok());
+  SolutionFilter triple(
+      "triple",
+      [](const SolutionView& s) {
+        return s.Id(1).Class(0) + s.Id(1).Class(1) == s.Id(1).Class(2);
+      },
+      std::vector<int>{0, 1, 2});
+  triple.set_key("Id(1).Class(0) + Id(1).Class(1) == Id(1).Class(2)");
+  EXPECT_TRUE(p.AddFilter(std::move(triple)).ok());
+}
+
+static std::vector<std::string> AllSolutionStrings(
+    const EntryDescriptor* ed) {
+  FilteredSolutionPermuter p(ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(p);
+  EXPECT_TRUE(p.Prepare().ok());
+
+  std::vector<std::string> solutions;
+  for (auto it = p.begin(); it != p.end(); ++it) {
+    solutions.push_back(absl::StrCat(*it));
+  }
+  return solutions;
+}
+
+TEST(FilteredSolutionPermuterTest, ParallelSearchMatchesSerial) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  EntryDescriptor ed(absl::make_unique<IntRangeDescriptor>(4),
+                     absl::make_unique<StringDescriptor>(
+                         std::vector<std::string>{"foo", "bar", "baz"}),
+                     std::move(class_descriptors));
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_parallel_search, false);
+  std::vector<std::string> serial = AllSolutionStrings(&ed);
+  ASSERT_FALSE(serial.empty());
+
+  absl::SetFlag(&FLAGS_puzzle_parallel_search, true);
+  for (int threads : {1, 2, 7}) {
+    absl::SetFlag(&FLAGS_puzzle_parallel_search_threads, threads);
+    EXPECT_THAT(AllSolutionStrings(&ed), UnorderedElementsAreArray(serial))
+        << threads << " threads";
+  }
+}
+
+TEST(FilteredSolutionPermuterTest, ParallelSearchEarlyExit) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(5));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(5));
+  EntryDescriptor ed(absl::make_unique<IntRangeDescriptor>(5),
+                     absl::make_unique<StringDescriptor>(
+                         std::vector<std::string>{"foo", "bar"}),
+                     std::move(class_descriptors));
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_parallel_search, true);
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  ASSERT_TRUE(p.Prepare().ok());
+
+  // Abandoning iteration with workers still blocked on a full queue must not
+  // hang or leak.
+  int seen = 0;
+  for (auto it = p.begin(); it != p.end() && seen < 3; ++it) {
+    ++seen;
+  }
+  EXPECT_THAT(seen, 3);
+}
+
+static EntryDescriptor MakeFourByThree() {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  return EntryDescriptor(absl::make_unique<IntRangeDescriptor>(4),
+                         absl::make_unique<StringDescriptor>(
+                             std::vector<std::string>{"foo", "bar", "baz"}),
+                         std::move(class_descriptors));
+}
+
+TEST(FilteredSolutionPermuterTest, ParallelCountMatchesSerial) {
+  EntryDescriptor ed = MakeFourByThree();
+  const int serial = AllSolutionStrings(&ed).size();
+  ASSERT_THAT(serial, ::testing::Gt(0));
+
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(p);
+  ASSERT_TRUE(p.Prepare().ok());
+  // Reject solutions with an odd first value as a stand-in for residual
+  // filters.
+  auto accept = [](const SolutionView& s) { return s.Id(0).Class(0) % 2 == 0; };
+  absl::StatusOr<int64_t> serial_accepted = p.Count(accept, /*num_threads=*/1);
+  ASSERT_TRUE(serial_accepted.ok());
+  EXPECT_THAT(*serial_accepted, ::testing::Lt(serial));
+  for (int threads : {2, 7}) {
+    EXPECT_THAT(p.Count(accept, threads), absl::StatusOr<int64_t>(
+                                               *serial_accepted))
+        << threads << " threads";
+  }
+}
+
+TEST(FilteredSolutionPermuterTest, EstimateCountWithoutFilters) {
+  EntryDescriptor ed = MakeFourByThree();
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  ASSERT_TRUE(p.Prepare().ok());
+
+  // Every walk sees all 24 permutations of each class, so every sample is
+  // exact.
+  absl::StatusOr<SolutionPermuter::CountEstimate> estimate = p.EstimateCount(
+      [](const SolutionView&) { return true; }, /*num_samples=*/10,
+      /*num_threads=*/2);
+  ASSERT_TRUE(estimate.ok()) << estimate.status();
+  EXPECT_THAT(estimate->count, 24 * 24 * 24);
+  EXPECT_THAT(estimate->standard_error, 0);
+  EXPECT_THAT(estimate->samples, 10);
+}
+
+TEST(FilteredSolutionPermuterTest, EstimateCountWithFilters) {
+  EntryDescriptor ed = MakeFourByThree();
+  const int exact = AllSolutionStrings(&ed).size();
+
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(p);
+  ASSERT_TRUE(p.Prepare().ok());
+  absl::StatusOr<SolutionPermuter::CountEstimate> estimate = p.EstimateCount(
+      [](const SolutionView&) { return true; }, /*num_samples=*/20000,
+      /*num_threads=*/4);
+  ASSERT_TRUE(estimate.ok()) << estimate.status();
+  EXPECT_THAT(estimate->samples, 20000);
+  EXPECT_THAT(estimate->standard_error, ::testing::Gt(0));
+  // The estimator is unbiased; allow for a generous number of standard errors
+  // to keep the test from flaking.
+  EXPECT_THAT(estimate->count,
+              ::testing::DoubleNear(exact, 6 * estimate->standard_error));
+}
+
+TEST(FilteredSolutionPermuterTest, FilterStatistics) {
+  EntryDescriptor ed = MakeFourByThree();
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_filter_statistics, true);
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(p);
+  ASSERT_TRUE(p.Prepare().ok());
+  EXPECT_THAT(p.DebugStatistics(), ::testing::Not(HasSubstr("triple")));
+
+  for (auto it = p.begin(); it != p.end(); ++it) {
+  }
+  // The pair filter is handled by active sets, so only the triple is
+  // evaluated during iteration.
+  EXPECT_THAT(p.DebugStatistics(), HasSubstr("triple: "));
+  EXPECT_THAT(p.DebugStatistics(), HasSubstr("% rejected"));
+}
+
+TEST(FilteredSolutionPermuterTest, AdaptiveOrderMatchesSerial) {
+  EntryDescriptor ed = MakeFourByThree();
+  std::vector<std::string> serial = AllSolutionStrings(&ed);
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_filter_adaptive_order, true);
+  absl::SetFlag(&FLAGS_puzzle_filter_adaptive_order_interval, 3);
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(p);
+  // Several filters on the last class, one of which never rejects.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(p.AddFilter(SolutionFilter(
+                                absl::StrCat("noop ", i),
+                                [](const SolutionView&) { return true; },
+                                std::vector<int>{0, 1, 2}))
+                    .ok());
+  }
+  ASSERT_TRUE(p.Prepare().ok());
+  std::vector<std::string> adaptive;
+  for (auto it = p.begin(); it != p.end(); ++it) {
+    adaptive.push_back(absl::StrCat(*it));
+  }
+  EXPECT_THAT(adaptive, UnorderedElementsAreArray(serial));
+}
+
+// Searches four classes of three entries where whether the last class
+// matches depends only on the first two, so that backjumping can skip the
+// third. Returns the solutions found and sets `*evaluations` to the number
+// of filter evaluations.
+static std::vector<std::string> BackjumpSolutionStrings(int* evaluations) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  for (int i = 0; i < 4; ++i) {
+    class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+  }
+  EntryDescriptor ed(absl::make_unique<IntRangeDescriptor>(3),
+                     absl::make_unique<StringDescriptor>(
+                         std::vector<std::string>{"a", "b", "c", "d"}),
+                     std::move(class_descriptors));
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  *evaluations = 0;
+  EXPECT_TRUE(p.AddFilter(SolutionFilter(
+                              "first three",
+                              [evaluations](const SolutionView& s) {
+                                ++*evaluations;
+                                return s.Id(0).Class(0) + s.Id(0).Class(1) !=
+                                       s.Id(0).Class(2);
+                              },
+                              std::vector<int>{0, 1, 2}))
+                  .ok());
+  EXPECT_TRUE(p.AddFilter(SolutionFilter(
+                              "skips third",
+                              [evaluations](const SolutionView& s) {
+                                ++*evaluations;
+                                return s.Id(1).Class(3) ==
+                                       s.Id(1).Class(0) + s.Id(1).Class(1);
+                              },
+                              std::vector<int>{0, 1, 3}))
+                  .ok());
+  EXPECT_TRUE(p.Prepare().ok());
+
+  std::vector<std::string> solutions;
+  for (auto it = p.begin(); it != p.end(); ++it) {
+    solutions.push_back(absl::StrCat(*it));
+  }
+  return solutions;
+}
+
+TEST(FilteredSolutionPermuterTest, BackjumpMatchesSerial) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_backjump, false);
+  int serial_evaluations;
+  std::vector<std::string> serial =
+      BackjumpSolutionStrings(&serial_evaluations);
+  ASSERT_FALSE(serial.empty());
+
+  absl::SetFlag(&FLAGS_puzzle_backjump, true);
+  int backjump_evaluations;
+  EXPECT_THAT(BackjumpSolutionStrings(&backjump_evaluations),
+              UnorderedElementsAreArray(serial));
+  EXPECT_THAT(backjump_evaluations, Lt(serial_evaluations));
+}
+
+TEST(FilteredSolutionPermuterTest, DynamicClassOrderMatchesSerial) {
+  EntryDescriptor ed = MakeFourByThree();
+  std::vector<std::string> serial = AllSolutionStrings(&ed);
+  ASSERT_FALSE(serial.empty());
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators_mode_pair, true);
+  absl::SetFlag(&FLAGS_puzzle_dynamic_class_order, true);
+  EXPECT_THAT(AllSolutionStrings(&ed), UnorderedElementsAreArray(serial));
+}
+
+TEST(FilteredSolutionPermuterTest, WorklistBurnDownMatchesHeap) {
+  EntryDescriptor ed = MakeFourByThree();
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators_mode_pair, true);
+  std::vector<std::string> heap = AllSolutionStrings(&ed);
+  ASSERT_FALSE(heap.empty());
+  FilteredSolutionPermuter heap_permuter(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(heap_permuter);
+  ASSERT_TRUE(heap_permuter.Prepare().ok());
+
+  absl::SetFlag(&FLAGS_puzzle_pair_class_burn_down_worklist, true);
+  EXPECT_THAT(AllSolutionStrings(&ed), UnorderedElementsAreArray(heap));
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(p);
+  ASSERT_TRUE(p.Prepare().ok());
+  // Both run to the same fixpoint.
+  EXPECT_THAT(p.Selectivity(), DoubleEq(heap_permuter.Selectivity()));
+  EXPECT_THAT(p.DebugStatistics(), HasSubstr("pair fixpoint reached"));
+}
+
+TEST(FilteredSolutionPermuterTest, RoiBurnDownMatchesSerial) {
+  EntryDescriptor ed = MakeFourByThree();
+  std::vector<std::string> serial = AllSolutionStrings(&ed);
+  ASSERT_FALSE(serial.empty());
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_pair_class_burn_down_roi, true);
+  EXPECT_THAT(AllSolutionStrings(&ed), UnorderedElementsAreArray(serial));
+  // Skipped pairs still get tables.
+  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators_mode_pair, true);
+  EXPECT_THAT(AllSolutionStrings(&ed), UnorderedElementsAreArray(serial));
+}
+
+TEST(FilteredSolutionPermuterTest, ActiveSetCache) {
+  EntryDescriptor ed = MakeFourByThree();
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators_mode_pair, true);
+  std::vector<std::string> uncached = AllSolutionStrings(&ed);
+  ASSERT_FALSE(uncached.empty());
+
+  const std::string cache_dir =
+      absl::StrCat(::testing::TempDir(), "/active_set_cache_test");
+  std::filesystem::remove_all(cache_dir);
+  ASSERT_TRUE(std::filesystem::create_directories(cache_dir));
+  absl::SetFlag(&FLAGS_puzzle_active_set_cache_dir, cache_dir);
+
+  FilteredSolutionPermuter built(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(built);
+  ASSERT_TRUE(built.Prepare().ok());
+  EXPECT_THAT(built.DebugStatistics(),
+              ::testing::Not(HasSubstr("active sets from cache")));
+
+  FilteredSolutionPermuter loaded(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(loaded);
+  ASSERT_TRUE(loaded.Prepare().ok());
+  EXPECT_THAT(loaded.DebugStatistics(), HasSubstr("active sets from cache"));
+  EXPECT_THAT(loaded.Selectivity(), built.Selectivity());
+  std::vector<std::string> solutions;
+  for (auto it = loaded.begin(); it != loaded.end(); ++it) {
+    solutions.push_back(absl::StrCat(*it));
+  }
+  EXPECT_THAT(solutions, UnorderedElementsAreArray(uncached));
+
+  // A different set of filters is not found.
+  FilteredSolutionPermuter other(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(other);
+  ASSERT_TRUE(other
+                  .AddFilter(SolutionFilter(
+                      "extra", [](const SolutionView&) { return true; }, {0}))
+                  .ok());
+  ASSERT_TRUE(other.Prepare().ok());
+  EXPECT_THAT(other.DebugStatistics(),
+              ::testing::Not(HasSubstr("active sets from cache")));
+}
+
+// Adds a filter named "cage" whose predicate captures `sum`. If `keyed`, the
+// filter's key includes `sum`.
+static void AddCageFilter(FilteredSolutionPermuter& p, int sum, bool keyed) {
+  SolutionFilter cage(
+      "cage",
+      [sum](const SolutionView& s) {
+        return s.Id(1).Class(0) + s.Id(1).Class(1) == sum;
+      },
+      std::vector<int>{0, 1});
+  if (keyed) {
+    cage.set_key(absl::StrCat("Id(1).Class(0) + Id(1).Class(1) == ", sum));
+  }
+  EXPECT_TRUE(p.AddFilter(std::move(cage)).ok());
+}
+
+static std::vector<std::string> Prepared(FilteredSolutionPermuter& p) {
+  EXPECT_TRUE(p.Prepare().ok());
+  std::vector<std::string> solutions;
+  for (auto it = p.begin(); it != p.end(); ++it) {
+    solutions.push_back(absl::StrCat(*it));
+  }
+  return solutions;
+}
+
+TEST(FilteredSolutionPermuterTest, ActiveSetCacheMissesCapturedConstant) {
+  EntryDescriptor ed = MakeFourByThree();
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators_mode_pair, true);
+  // uncached[i] holds the solutions with a cage sum of 2 + i.
+  std::vector<std::string> uncached[2];
+  for (int i : {0, 1}) {
+    FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+    AddCageFilter(p, 2 + i, /*keyed=*/false);
+    uncached[i] = Prepared(p);
+    ASSERT_FALSE(uncached[i].empty());
+  }
+  ASSERT_THAT(uncached[0], ::testing::Ne(uncached[1]));
+
+  const std::string cache_dir =
+      absl::StrCat(::testing::TempDir(), "/active_set_cache_captured_test");
+  std::filesystem::remove_all(cache_dir);
+  ASSERT_TRUE(std::filesystem::create_directories(cache_dir));
+  absl::SetFlag(&FLAGS_puzzle_active_set_cache_dir, cache_dir);
+
+  for (bool keyed : {false, true}) {
+    // The two puzzles differ only in the value captured by "cage".
+    for (int i : {0, 1}) {
+      FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+      AddCageFilter(p, 2 + i, keyed);
+      EXPECT_THAT(Prepared(p), UnorderedElementsAreArray(uncached[i]))
+          << keyed << ", " << i;
+      EXPECT_THAT(p.DebugStatistics(),
+                  ::testing::Not(HasSubstr("active sets from cache")))
+          << keyed << ", " << i;
+    }
+  }
+  // Nothing was saved for the unkeyed filters. The keyed ones are found.
+  FilteredSolutionPermuter again(&ed, /*profiler=*/nullptr);
+  AddCageFilter(again, 3, /*keyed=*/true);
+  EXPECT_THAT(Prepared(again), UnorderedElementsAreArray(uncached[1]));
+  EXPECT_THAT(again.DebugStatistics(), HasSubstr("active sets from cache"));
+}
+
+TEST(FilteredSolutionPermuterTest, ActiveSetCachePairIterators) {
+  EntryDescriptor ed = MakeFourByThree();
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators_mode_pair, true);
+  absl::SetFlag(&FLAGS_puzzle_pair_class_mode_make_pairs, true);
+  absl::SetFlag(&FLAGS_puzzle_value_skip_to_active_set, true);
+  std::vector<std::string> uncached = AllSolutionStrings(&ed);
+  ASSERT_FALSE(uncached.empty());
+
+  const std::string cache_dir =
+      absl::StrCat(::testing::TempDir(), "/active_set_cache_pair_test");
+  std::filesystem::remove_all(cache_dir);
+  ASSERT_TRUE(std::filesystem::create_directories(cache_dir));
+  absl::SetFlag(&FLAGS_puzzle_active_set_cache_dir, cache_dir);
+
+  FilteredSolutionPermuter built(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(built);
+  ASSERT_TRUE(built.Prepare().ok());
+  ASSERT_THAT(built.DebugStatistics(), HasSubstr("value skip tables"));
+
+  FilteredSolutionPermuter loaded(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(loaded);
+  ASSERT_TRUE(loaded.Prepare().ok());
+  EXPECT_THAT(loaded.DebugStatistics(), HasSubstr("active sets from cache"));
+  // Set up as a build would have, though nothing was built.
+  EXPECT_THAT(loaded.DebugStatistics(), HasSubstr("value skip tables"));
+  std::vector<std::string> solutions;
+  for (auto it = loaded.begin(); it != loaded.end(); ++it) {
+    solutions.push_back(absl::StrCat(*it));
+  }
+  EXPECT_THAT(solutions, UnorderedElementsAreArray(uncached));
+}
+
+TEST(FilteredSolutionPermuterTest, SelectivityBound) {
+  EntryDescriptor ed = MakeFourByThree();
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  AddPairAndTripleFilters(p);
+  int notified = 0;
+  p.set_on_selectivity_bound([&]() { ++notified; });
+  EXPECT_THAT(p.SelectivityBound(), 1.0);
+
+  ASSERT_TRUE(p.PrepareCheap().ok());
+  const double cheap_bound = p.SelectivityBound();
+  EXPECT_THAT(cheap_bound, p.Selectivity());
+  EXPECT_THAT(notified, Ge(1));
+  const int cheap_notified = notified;
+
+  ASSERT_TRUE(p.PrepareFull().ok());
+  EXPECT_THAT(p.SelectivityBound(), p.Selectivity());
+  EXPECT_THAT(p.SelectivityBound(), ::testing::Le(cheap_bound));
+  EXPECT_THAT(notified, ::testing::Gt(cheap_notified));
+}
+
+TEST(FilteredSolutionPermuterTest, MemoryBudgetDropsPairs) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  EntryDescriptor ed(absl::make_unique<IntRangeDescriptor>(4),
+                     absl::make_unique<StringDescriptor>(
+                         std::vector<std::string>{"foo", "bar", "baz"}),
+                     std::move(class_descriptors));
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators_mode_pair, true);
+  std::vector<std::string> unlimited = AllSolutionStrings(&ed);
+  ASSERT_FALSE(unlimited.empty());
+
+  absl::SetFlag(&FLAGS_puzzle_active_set_memory_budget, 1);
+  // Pair predicates whose tables are dropped must still be honored.
+  EXPECT_THAT(AllSolutionStrings(&ed), UnorderedElementsAreArray(unlimited));
+
+  FilteredSolutionPermuter p(&ed, /*profiler=*/nullptr);
+  ASSERT_TRUE(p.AddFilter(SolutionFilter(
+                              "pair",
+                              [](const SolutionView& s) {
+                                return s.Id(0).Class(0) != s.Id(0).Class(1);
+                              },
+                              std::vector<int>{0, 1}))
+                  .ok());
+  ASSERT_TRUE(p.Prepare().ok());
+  EXPECT_THAT(p.DebugStatistics(), HasSubstr("dropped pair tables: 1"));
+}
+
 }  // namespace puzzle
@@ -0,0 +1,393 @@
+#include "puzzle/solution_permuter/grid_solution_permuter.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
+
+namespace puzzle {
+
+class GridSolutionPermuter::Advancer final
+    : public SolutionPermuter::AdvancerBase {
+ public:
+  explicit Advancer(const GridSolutionPermuter* permuter);
+
+  void Advance() override;
+
+ private:
+  struct Frame {
+    State state;
+    // The cell being branched on, its number of candidates, and those not
+    // yet tried.
+    int cell;
+    int num_candidates;
+    Mask untried;
+  };
+
+  // Finds the next solution below `stack_`, leaving it in
+  // `mutable_solution()`. Returns false if there are no more.
+  bool Search();
+
+  void SetPosition();
+
+  const GridSolutionPermuter* permuter_;
+  std::vector<Frame> stack_;
+  std::vector<int> dirty_;
+};
+
+GridSolutionPermuter::Advancer::Advancer(const GridSolutionPermuter* permuter)
+    : AdvancerBase(permuter->entry_descriptor()), permuter_(permuter) {
+  if (!permuter_->root_consistent_) {
+    set_done();
+    SetPosition();
+    return;
+  }
+  const State& root = permuter_->root_;
+  for (int cell = 0; cell < root.candidates.size(); ++cell) {
+    if (root.assigned[cell]) {
+      mutable_solution().SetClass(permuter_->EntryId(cell),
+                                  permuter_->ClassInt(cell),
+                                  std::countr_zero(root.candidates[cell]));
+    }
+  }
+  if (root.unassigned == 0) {
+    // Propagation alone found the only solution.
+    SetPosition();
+    return;
+  }
+  const int cell = permuter_->ChooseCell(root);
+  stack_.push_back({.state = root,
+                    .cell = cell,
+                    .num_candidates = std::popcount(root.candidates[cell]),
+                    .untried = root.candidates[cell]});
+  Advance();
+}
+
+bool GridSolutionPermuter::Advancer::Search() {
+  const Cancellation* cancellation = permuter_->cancellation();
+  while (!stack_.empty()) {
+    if (cancellation != nullptr && cancellation->Cancelled()) return false;
+    Frame& top = stack_.back();
+    if (top.untried == 0) {
+      stack_.pop_back();
+      continue;
+    }
+    const Mask value_bit = top.untried & -top.untried;
+    top.untried ^= value_bit;
+
+    State next = top.state;
+    next.candidates[top.cell] = value_bit;
+    dirty_.assign(1, top.cell);
+    if (!permuter_->Propagate(next, dirty_, mutable_solution())) continue;
+    if (next.unassigned == 0) return true;
+
+    const int cell = permuter_->ChooseCell(next);
+    const Mask candidates = next.candidates[cell];
+    stack_.push_back({.state = std::move(next),
+                      .cell = cell,
+                      .num_candidates = std::popcount(candidates),
+                      .untried = candidates});
+  }
+  return false;
+}
+
+void GridSolutionPermuter::Advancer::Advance() {
+  if (!Search()) set_done();
+  SetPosition();
+}
+
+void GridSolutionPermuter::Advancer::SetPosition() {
+  const double count = permuter_->permutation_count();
+  if (done()) {
+    set_position({.position = count, .count = count});
+    return;
+  }
+  // The fraction of the search tree already explored, scaled to `count`, so
+  // that positions increase as solutions are returned. Each frame is
+  // exploring the value it last took from `untried`; the values before it are
+  // done. Subtrees are weighted as if they were equally large, so this is an
+  // estimate of progress rather than of the solution's index.
+  double completion = 0;
+  double scale = 1;
+  for (const Frame& frame : stack_) {
+    const int done_before =
+        frame.num_candidates - std::popcount(frame.untried) - 1;
+    completion += scale * done_before / frame.num_candidates;
+    scale /= frame.num_candidates;
+  }
+  set_position({.position = completion * count, .count = count});
+}
+
+GridSolutionPermuter::GridSolutionPermuter(const EntryDescriptor* e)
+    : SolutionPermuter(e),
+      num_entries_(e->AllIds()->size()),
+      num_classes_(e->num_classes()) {
+  all_values_ = num_entries_ >= 32 ? ~Mask{0} : (Mask{1} << num_entries_) - 1;
+  initial_candidates_.resize(num_entries_ * num_classes_, all_values_);
+}
+
+absl::StatusOr<bool> GridSolutionPermuter::AddFilter(
+    SolutionFilter solution_filter) {
+  if (solution_filter.classes().empty()) {
+    // No reason to store the predicate here as we require a full solution to
+    // evaluate the predicate.
+    return false;
+  }
+  Filter filter{.filter = std::move(solution_filter), .cells = {}};
+  if (!filter.filter.cells().empty()) {
+    for (const Cell& cell : filter.filter.cells()) {
+      if (cell.entry_id < 0 || cell.entry_id >= num_entries_ ||
+          cell.class_int < 0 || cell.class_int >= num_classes_) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Bad cell: ", cell.entry_id, ",", cell.class_int));
+      }
+      filter.cells.push_back(CellIndex(cell.entry_id, cell.class_int));
+    }
+    filters_.push_back(std::move(filter));
+    return true;
+  }
+  for (int class_int : filter.filter.classes()) {
+    if (class_int < 0 || class_int >= num_classes_) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad class_int: ", class_int));
+    }
+    const int entry_id = filter.filter.entry_id(class_int);
+    if (entry_id != Entry::kBadId) {
+      filter.cells.push_back(CellIndex(entry_id, class_int));
+      continue;
+    }
+    // The filter may read any entry of the class.
+    for (int entry_id = 0; entry_id < num_entries_; ++entry_id) {
+      filter.cells.push_back(CellIndex(entry_id, class_int));
+    }
+  }
+  filters_.push_back(std::move(filter));
+  return true;
+}
+
+absl::StatusOr<bool> GridSolutionPermuter::AddEntryValuePredicate(
+    int entry_id, int class_int, int value, bool equal) {
+  if (entry_id < 0 || entry_id >= num_entries_ || class_int < 0 ||
+      class_int >= num_classes_ || value < 0 || value >= num_entries_) {
+    return false;
+  }
+  Mask& candidates = initial_candidates_[CellIndex(entry_id, class_int)];
+  if (equal) {
+    candidates &= Mask{1} << value;
+  } else {
+    candidates &= ~(Mask{1} << value);
+  }
+  return true;
+}
+
+absl::StatusOr<bool> GridSolutionPermuter::AddAllDifferentPredicate(
+    absl::Span<const Cell> cells) {
+  std::vector<int> group;
+  for (const Cell& cell : cells) {
+    if (cell.entry_id < 0 || cell.entry_id >= num_entries_ ||
+        cell.class_int < 0 || cell.class_int >= num_classes_) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad cell: ", cell.entry_id, ",", cell.class_int));
+    }
+    group.push_back(CellIndex(cell.entry_id, cell.class_int));
+  }
+  std::sort(group.begin(), group.end());
+  if (std::adjacent_find(group.begin(), group.end()) != group.end()) {
+    return absl::InvalidArgumentError("Repeated cell in group");
+  }
+  groups_.push_back(std::move(group));
+  return true;
+}
+
+absl::Status GridSolutionPermuter::PrepareCheap() {
+  if (num_entries_ > 32) {
+    return absl::UnimplementedError(
+        absl::StrCat("Too many entries for GridSolutionPermuter: ",
+                     num_entries_));
+  }
+  for (int class_int = 0; class_int < num_classes_; ++class_int) {
+    if (entry_descriptor()->AllClassValues(class_int)->size() !=
+        num_entries_) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Class ", class_int, " is not a permutation of ",
+                       num_entries_, " values"));
+    }
+    std::vector<int> group;
+    for (int entry_id = 0; entry_id < num_entries_; ++entry_id) {
+      group.push_back(CellIndex(entry_id, class_int));
+    }
+    groups_.push_back(std::move(group));
+  }
+
+  const int num_cells = num_entries_ * num_classes_;
+  std::vector<std::vector<bool>> is_peer(num_cells,
+                                         std::vector<bool>(num_cells));
+  peers_.assign(num_cells, {});
+  for (const std::vector<int>& group : groups_) {
+    for (int a : group) {
+      for (int b : group) {
+        if (a == b || is_peer[a][b]) continue;
+        is_peer[a][b] = true;
+        peers_[a].push_back(b);
+      }
+    }
+  }
+
+  cell_filters_.assign(num_cells, {});
+  for (int i = 0; i < filters_.size(); ++i) {
+    for (int cell : filters_[i].cells) {
+      cell_filters_[cell].push_back(i);
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status GridSolutionPermuter::PrepareFull() {
+  root_.candidates = initial_candidates_;
+  root_.assigned.assign(root_.candidates.size(), false);
+  root_.unassigned = root_.candidates.size();
+
+  MutableSolution solution(entry_descriptor());
+  std::vector<int> dirty;
+  root_consistent_ = true;
+  for (int cell = 0; cell < root_.candidates.size(); ++cell) {
+    if (root_.candidates[cell] == 0) root_consistent_ = false;
+    if (std::has_single_bit(root_.candidates[cell])) dirty.push_back(cell);
+  }
+  // Filters on a single cell prune candidates before any cell is assigned.
+  for (const Filter& filter : filters_) {
+    if (!root_consistent_) break;
+    root_consistent_ = CheckFilter(filter, root_, dirty, solution);
+  }
+  if (root_consistent_) {
+    root_consistent_ = Propagate(root_, dirty, solution);
+  }
+  return absl::OkStatus();
+}
+
+bool GridSolutionPermuter::Propagate(State& state, std::vector<int>& dirty,
+                                     MutableSolution& solution) const {
+  while (true) {
+    while (!dirty.empty()) {
+      const int cell = dirty.back();
+      dirty.pop_back();
+      if (state.assigned[cell]) continue;
+
+      const Mask value_bit = state.candidates[cell];
+      DCHECK(std::has_single_bit(value_bit));
+      state.assigned[cell] = true;
+      --state.unassigned;
+      solution.SetClass(EntryId(cell), ClassInt(cell),
+                        std::countr_zero(value_bit));
+
+      for (int peer : peers_[cell]) {
+        Mask& candidates = state.candidates[peer];
+        if ((candidates & value_bit) == 0) continue;
+        candidates &= ~value_bit;
+        if (candidates == 0) return false;
+        if (std::has_single_bit(candidates)) dirty.push_back(peer);
+      }
+      for (int filter : cell_filters_[cell]) {
+        if (!CheckFilter(filters_[filter], state, dirty, solution)) {
+          return false;
+        }
+      }
+    }
+    if (!HiddenSingles(state, dirty)) return false;
+    if (dirty.empty()) return true;
+  }
+}
+
+bool GridSolutionPermuter::CheckFilter(const Filter& filter, State& state,
+                                       std::vector<int>& dirty,
+                                       MutableSolution& solution) const {
+  int unassigned = -1;
+  for (int cell : filter.cells) {
+    if (state.assigned[cell]) continue;
+    if (unassigned != -1) return true;
+    unassigned = cell;
+  }
+
+  SolutionView view = solution.TestableSolution();
+  if (unassigned == -1) return filter.filter(view);
+
+  const Mask candidates = state.candidates[unassigned];
+  Mask allowed = 0;
+  for (Mask rest = candidates; rest != 0; rest &= rest - 1) {
+    const int value = std::countr_zero(rest);
+    solution.SetClass(EntryId(unassigned), ClassInt(unassigned), value);
+    if (filter.filter(view)) allowed |= Mask{1} << value;
+  }
+  if (allowed == candidates) return true;
+  if (allowed == 0) return false;
+  state.candidates[unassigned] = allowed;
+  if (std::has_single_bit(allowed)) dirty.push_back(unassigned);
+  return true;
+}
+
+bool GridSolutionPermuter::HiddenSingles(State& state,
+                                         std::vector<int>& dirty) const {
+  for (const std::vector<int>& group : groups_) {
+    // Only a group with a cell per value must contain every value.
+    if (group.size() != num_entries_) continue;
+
+    Mask once = 0;
+    Mask twice = 0;
+    for (int cell : group) {
+      twice |= once & state.candidates[cell];
+      once |= state.candidates[cell];
+    }
+    if (once != all_values_) return false;
+
+    for (Mask hidden = once & ~twice; hidden != 0; hidden &= hidden - 1) {
+      const Mask value_bit = hidden & -hidden;
+      for (int cell : group) {
+        if ((state.candidates[cell] & value_bit) == 0) continue;
+        if (state.candidates[cell] != value_bit) {
+          state.candidates[cell] = value_bit;
+          dirty.push_back(cell);
+        }
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+int GridSolutionPermuter::ChooseCell(const State& state) const {
+  int best = -1;
+  int best_count = 0;
+  for (int cell = 0; cell < state.candidates.size(); ++cell) {
+    if (state.assigned[cell]) continue;
+    const int count = std::popcount(state.candidates[cell]);
+    if (best == -1 || count < best_count) {
+      best = cell;
+      best_count = count;
+      if (count == 2) break;
+    }
+  }
+  return best;
+}
+
+double GridSolutionPermuter::Selectivity() const {
+  if (!root_consistent_) return 0;
+  double selectivity = 1;
+  for (Mask candidates : root_.candidates) {
+    selectivity *= static_cast<double>(std::popcount(candidates)) /
+                   std::max(1, num_entries_);
+  }
+  return selectivity;
+}
+
+double GridSolutionPermuter::permutation_count() const {
+  return std::pow(static_cast<double>(num_entries_),
+                  num_entries_ * num_classes_);
+}
+
+SolutionPermuter::iterator GridSolutionPermuter::begin() const {
+  return iterator(absl::make_unique<Advancer>(this));
+}
+
+}  // namespace puzzle
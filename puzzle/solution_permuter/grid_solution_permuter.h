@@ -0,0 +1,127 @@
+#ifndef PUZZLE_SOLUTION_PERMUTER_GRID_SOLUTION_PERMUTER_H
+#define PUZZLE_SOLUTION_PERMUTER_GRID_SOLUTION_PERMUTER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "puzzle/base/solution_filter.h"
+#include "puzzle/solution_permuter/mutable_solution.h"
+#include "puzzle/solution_permuter/solution_permuter.h"
+
+namespace puzzle {
+
+// SolutionPermuter which treats each value of each entry as a cell holding a
+// bit mask of its candidate values, and searches by assigning single cells
+// and propagating constraints with mask operations rather than by permuting
+// whole classes.
+//
+// Each class is a permutation, so the cells of a class form an all-different
+// group, as do the groups added with AddAllDifferentPredicate (for example the
+// rows and boxes of a sudoku). Groups are propagated natively: an assigned
+// value is removed from the rest of its groups (naked singles) and a value
+// with a single candidate cell in a group covering every value is assigned
+// there (hidden singles). Entry value predicates restrict candidate masks
+// directly. Any other filter is evaluated once all of its cells are assigned,
+// and prunes the candidates of its last unassigned cell. The cells of a filter
+// are those it was constructed from, or else those of its entry in each of its
+// classes (every entry if unspecified). Search branches on the unassigned cell
+// with the fewest candidates.
+class GridSolutionPermuter final : public SolutionPermuter {
+ public:
+  explicit GridSolutionPermuter(const EntryDescriptor* e);
+  ~GridSolutionPermuter() = default;
+
+  // Movable, but not copyable.
+  GridSolutionPermuter(const GridSolutionPermuter&) = delete;
+  GridSolutionPermuter& operator=(const GridSolutionPermuter&) = delete;
+  GridSolutionPermuter(GridSolutionPermuter&&) = default;
+  GridSolutionPermuter& operator=(GridSolutionPermuter&&) = default;
+
+  absl::StatusOr<bool> AddFilter(SolutionFilter solution_filter) override;
+  absl::StatusOr<bool> AddEntryValuePredicate(int entry_id, int class_int,
+                                              int value, bool equal) override;
+  absl::StatusOr<bool> AddAllDifferentPredicate(
+      absl::Span<const Cell> cells) override;
+
+  absl::Status PrepareCheap() override;
+  absl::Status PrepareFull() override;
+
+  // Product over cells of the fraction of values still candidates after
+  // propagating the constraints before any search.
+  double Selectivity() const override;
+
+  iterator begin() const override;
+
+  double permutation_count() const;
+
+ private:
+  class Advancer;
+
+  using Mask = uint32_t;
+
+  // Search state at a node.
+  struct State {
+    // Candidate values of each cell, indexed by CellIndex.
+    std::vector<Mask> candidates;
+    // True once a cell with a single candidate has been propagated.
+    std::vector<bool> assigned;
+    int unassigned = 0;
+  };
+
+  struct Filter {
+    SolutionFilter filter;
+    std::vector<int> cells;
+  };
+
+  int CellIndex(int entry_id, int class_int) const {
+    return entry_id * num_classes_ + class_int;
+  }
+  int EntryId(int cell) const { return cell / num_classes_; }
+  int ClassInt(int cell) const { return cell % num_classes_; }
+
+  // Propagates constraints from the cells in `dirty` (which must have single
+  // candidates) until no more candidates are removed. Values of cells
+  // assigned along the way are set in `solution`. Returns false if some
+  // constraint cannot be satisfied.
+  bool Propagate(State& state, std::vector<int>& dirty,
+                 MutableSolution& solution) const;
+
+  // Checks `filter` if at most one of its cells is unassigned, removing the
+  // candidates of that cell which fail `filter`.
+  bool CheckFilter(const Filter& filter, State& state, std::vector<int>& dirty,
+                   MutableSolution& solution) const;
+
+  // Assigns each value which has a single candidate cell in a group with a
+  // cell per value. Returns false if such a group is missing a value.
+  bool HiddenSingles(State& state, std::vector<int>& dirty) const;
+
+  // Returns the unassigned cell of `state` with the fewest candidates.
+  int ChooseCell(const State& state) const;
+
+  int num_entries_ = 0;
+  int num_classes_ = 0;
+  Mask all_values_ = 0;
+
+  // Candidates of each cell from entry value predicates.
+  std::vector<Mask> initial_candidates_;
+
+  // Cells of each all-different group, including one per class.
+  std::vector<std::vector<int>> groups_;
+
+  // peers_[cell] is the set of other cells sharing a group with `cell`.
+  std::vector<std::vector<int>> peers_;
+
+  std::vector<Filter> filters_;
+
+  // cell_filters_[cell] indexes the filters in `filters_` on `cell`.
+  std::vector<std::vector<int>> cell_filters_;
+
+  // State after propagating from `initial_candidates_`, and whether that was
+  // consistent. Set by PrepareFull.
+  State root_;
+  bool root_consistent_ = false;
+};
+
+}  // namespace puzzle
+
+#endif  // PUZZLE_SOLUTION_PERMUTER_GRID_SOLUTION_PERMUTER_H
@@ -0,0 +1,171 @@
+#include "puzzle/solution_permuter/grid_solution_permuter.h"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "puzzle/base/owned_solution.h"
+#include "puzzle/base/solution_filter.h"
+
+using ::testing::Ge;
+using ::testing::Lt;
+using ::testing::Ne;
+
+namespace puzzle {
+
+static EntryDescriptor MakeGrid(int size) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  for (int i = 0; i < size; ++i) {
+    class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(size));
+  }
+  std::vector<std::string> class_names;
+  for (int i = 0; i < size; ++i) class_names.push_back(absl::StrCat("c", i));
+  return EntryDescriptor(absl::make_unique<IntRangeDescriptor>(size),
+                         absl::make_unique<StringDescriptor>(class_names),
+                         std::move(class_descriptors));
+}
+
+static std::vector<OwnedSolution> AllSolutions(const GridSolutionPermuter& p) {
+  std::unordered_set<std::string> history;
+  std::vector<OwnedSolution> solutions;
+  double last_position = 0;
+  for (auto it = p.begin(); it != p.end(); ++it) {
+    EXPECT_THAT(it->position().position, Ge(last_position));
+    EXPECT_THAT(it->position().position, Lt(it->position().count));
+    last_position = it->position().position;
+    EXPECT_THAT(history.insert(absl::StrCat(*it)).second, true) << *it;
+    solutions.push_back(OwnedSolution(*it));
+  }
+  return solutions;
+}
+
+TEST(GridSolutionPermuterTest, Simple) {
+  EntryDescriptor ed = MakeGrid(3);
+  GridSolutionPermuter p(&ed);
+  ASSERT_TRUE(p.Prepare().ok());
+
+  EXPECT_THAT(p.permutation_count(), 3 * 3 * 3 * 3 * 3 * 3 * 3 * 3 * 3);
+  EXPECT_THAT(AllSolutions(p).size(), 6 * 6 * 6);
+}
+
+TEST(GridSolutionPermuterTest, LatinSquare) {
+  EntryDescriptor ed = MakeGrid(3);
+  GridSolutionPermuter p(&ed);
+  for (int entry_id = 0; entry_id < 3; ++entry_id) {
+    std::vector<SolutionPermuter::Cell> row;
+    for (int class_int = 0; class_int < 3; ++class_int) {
+      row.push_back({.entry_id = entry_id, .class_int = class_int});
+    }
+    ASSERT_THAT(p.AddAllDifferentPredicate(row), true);
+  }
+  ASSERT_TRUE(p.Prepare().ok());
+
+  std::vector<OwnedSolution> solutions = AllSolutions(p);
+  EXPECT_THAT(solutions.size(), 12);
+  for (const OwnedSolution& solution : solutions) {
+    for (int entry_id = 0; entry_id < 3; ++entry_id) {
+      std::unordered_set<int> values;
+      for (int class_int = 0; class_int < 3; ++class_int) {
+        values.insert(solution.view().Id(entry_id).Class(class_int));
+      }
+      EXPECT_THAT(values.size(), 3) << solution;
+    }
+  }
+}
+
+TEST(GridSolutionPermuterTest, RepeatedCell) {
+  EntryDescriptor ed = MakeGrid(3);
+  GridSolutionPermuter p(&ed);
+  EXPECT_FALSE(p.AddAllDifferentPredicate({{.entry_id = 0, .class_int = 0},
+                                           {.entry_id = 0, .class_int = 0}})
+                   .ok());
+}
+
+TEST(GridSolutionPermuterTest, EntryValueAndFilter) {
+  EntryDescriptor ed = MakeGrid(3);
+  GridSolutionPermuter p(&ed);
+  ASSERT_THAT(p.AddEntryValuePredicate(/*entry_id=*/0, /*class_int=*/0,
+                                       /*value=*/2, /*equal=*/true),
+              true);
+  ASSERT_THAT(p.AddEntryValuePredicate(/*entry_id=*/1, /*class_int=*/1,
+                                       /*value=*/0, /*equal=*/false),
+              true);
+  ASSERT_THAT(p.AddFilter(SolutionFilter(
+                  "sum",
+                  [](const SolutionView& s) {
+                    return s.Id(1).Class(1) + s.Id(2).Class(2) == 3;
+                  },
+                  absl::flat_hash_map<int, int>{{1, 1}, {2, 2}})),
+              true);
+  ASSERT_TRUE(p.Prepare().ok());
+
+  std::vector<OwnedSolution> solutions = AllSolutions(p);
+  // Class 0 has 2 permutations with entry 0 fixed, class 1 has 4 with entry 1
+  // not 0, and class 2 has 2 with entry 2 fixed by the sum.
+  EXPECT_THAT(solutions.size(), 2 * 4 * 2);
+  for (const OwnedSolution& solution : solutions) {
+    EXPECT_THAT(solution.view().Id(0).Class(0), 2) << solution;
+    EXPECT_THAT(solution.view().Id(1).Class(1), Ne(0)) << solution;
+    EXPECT_THAT(solution.view().Id(1).Class(1) + solution.view().Id(2).Class(2), 3)
+        << solution;
+  }
+}
+
+TEST(GridSolutionPermuterTest, Sudoku4x4) {
+  EntryDescriptor ed = MakeGrid(4);
+  GridSolutionPermuter p(&ed);
+  for (int row = 0; row < 4; ++row) {
+    std::vector<SolutionPermuter::Cell> cells;
+    for (int col = 0; col < 4; ++col) {
+      cells.push_back({.entry_id = row, .class_int = col});
+    }
+    ASSERT_THAT(p.AddAllDifferentPredicate(cells), true);
+  }
+  for (int box = 0; box < 4; ++box) {
+    std::vector<SolutionPermuter::Cell> cells;
+    for (int i = 0; i < 4; ++i) {
+      cells.push_back({.entry_id = 2 * (box / 2) + i / 2,
+                       .class_int = 2 * (box % 2) + i % 2});
+    }
+    ASSERT_THAT(p.AddAllDifferentPredicate(cells), true);
+  }
+  // 0 . | . .
+  // . . | 1 .
+  // ----+----
+  // . 2 | . .
+  // . . | . 3
+  const std::vector<std::vector<int>> clues = {
+      {0, 0, 0}, {1, 2, 1}, {2, 1, 2}, {3, 3, 3}};
+  for (const auto& clue : clues) {
+    ASSERT_THAT(p.AddEntryValuePredicate(clue[0], clue[1], clue[2],
+                                         /*equal=*/true),
+                true);
+  }
+  ASSERT_TRUE(p.Prepare().ok());
+
+  std::vector<OwnedSolution> solutions = AllSolutions(p);
+  ASSERT_THAT(solutions.size(), 1);
+  const std::vector<std::vector<int>> expected = {
+      {0, 1, 3, 2}, {2, 3, 1, 0}, {3, 2, 0, 1}, {1, 0, 2, 3}};
+  for (int row = 0; row < 4; ++row) {
+    for (int col = 0; col < 4; ++col) {
+      EXPECT_THAT(solutions[0].view().Id(row).Class(col), expected[row][col])
+          << solutions[0];
+    }
+  }
+}
+
+TEST(GridSolutionPermuterTest, NotAPermutation) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(4));
+  EntryDescriptor ed(absl::make_unique<IntRangeDescriptor>(3),
+                     absl::make_unique<StringDescriptor>(
+                         std::vector<std::string>{"foo"}),
+                     std::move(class_descriptors));
+  GridSolutionPermuter p(&ed);
+  EXPECT_FALSE(p.Prepare().ok());
+}
+
+}  // namespace puzzle
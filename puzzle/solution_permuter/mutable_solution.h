@@ -39,10 +39,25 @@ class MutableSolution {
     }
   }
 
+  // As above for an iterator known to hold `kWidth` values, so the copy can be
+  // unrolled.
+  template <int kWidth>
+  void SetClass(const ClassPermuter::iterator& it) {
+    DCHECK_EQ(it->size(), kWidth);
+    const int* values = it->data();
+    const int class_int = it.class_int();
+    for (int j = 0; j < kWidth; ++j) {
+      entries_[j].SetClass(class_int, values[j]);
+    }
+  }
+
   void SetClass(int entry_id, int class_id, int value) {
     entries_[entry_id].SetClass(class_id, value);
   }
 
+  // Copies all values from `view`, which must share `descriptor()`.
+  void SetFrom(const SolutionView& view) { entries_ = view.entries(); }
+
  private:
   const EntryDescriptor* descriptor_;
   std::vector<Entry> entries_;
@@ -1,9 +1,13 @@
 #include "puzzle/solution_permuter/pair_filter_burn_down.h"
 
+#include <deque>
+
+#include "absl/algorithm/container.h"
 #include "absl/flags/flag.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
 #include "puzzle/base/solution_filter.h"
 #include "thread/future.h"
 #include "vlog.h"
@@ -16,6 +20,29 @@ ABSL_FLAG(bool, puzzle_pair_class_burn_down_class, false,
           "True for threading optimized model for pair pruning. False for a "
           "more iterative friendly model.");
 
+ABSL_FLAG(bool, puzzle_pair_class_burn_down_worklist, false,
+          "If true, pair pruning runs builds of pairs with no class in common "
+          "concurrently from a worklist, and adds the pairs sharing a class "
+          "back to the worklist whenever a build shrinks that class, until "
+          "no build shrinks any class.");
+
+ABSL_FLAG(absl::Duration, puzzle_pair_class_burn_down_worklist_budget,
+          absl::InfiniteDuration(),
+          "If --puzzle_pair_class_burn_down_worklist is true, no further "
+          "builds are started after this long, even if a fixpoint has not "
+          "been reached.");
+
+ABSL_FLAG(bool, puzzle_pair_class_burn_down_roi, false,
+          "If true, pair pruning estimates the cost and the pruning of each "
+          "pair build by sampling, runs builds in order of pruning per unit "
+          "of cost, and skips builds not expected to remove more pairs of "
+          "permutations than they evaluate.");
+
+ABSL_FLAG(int, puzzle_pair_class_burn_down_roi_samples, 16,
+          "Number of permutations of the outer class to sample in each "
+          "direction when estimating a pair build for "
+          "--puzzle_pair_class_burn_down_roi.");
+
 extern absl::Flag<bool> FLAGS_puzzle_prune_pair_class_iterators_mode_pair;
 
 namespace puzzle {
@@ -93,7 +120,11 @@ absl::Status PairFilterBurnDown::BurnDown() {
   if (!pairs.ok()) return pairs.status();
   if (pairs->empty()) return absl::OkStatus();
 
-  if (absl::GetFlag(FLAGS_puzzle_pair_class_burn_down_class)) {
+  if (absl::GetFlag(FLAGS_puzzle_pair_class_burn_down_worklist)) {
+    RETURN_IF_ERROR(WorklistBurnDown(std::move(*pairs)));
+  } else if (absl::GetFlag(FLAGS_puzzle_pair_class_burn_down_roi)) {
+    RETURN_IF_ERROR(RoiBurnDown(std::move(*pairs)));
+  } else if (absl::GetFlag(FLAGS_puzzle_pair_class_burn_down_class)) {
     RETURN_IF_ERROR(ClassBurnDown(std::move(*pairs)));
   } else {
     RETURN_IF_ERROR(HeapBurnDown(std::move(*pairs)));
@@ -115,6 +146,8 @@ absl::Status PairFilterBurnDown::ClassBurnDown(
   std::vector<bool> active(class_permuters_.size(), false);
   bool more_work = true;
   while (more_work) {
+    // Builds already scheduled are waited for as `work` is destroyed.
+    if (Cancelled()) return cancellation_->status();
     more_work = false;
     ClassPairSelectivity* work_pair = nullptr;
     for (ClassPairSelectivity& pair : pairs) {
@@ -144,6 +177,7 @@ absl::Status PairFilterBurnDown::ClassBurnDown(
           &work,
           [this, work_pair, &active, &active_lock, &active_count,
            pair_class_mode]() -> absl::StatusOr<ClassPairSelectivity*> {
+            if (Cancelled()) return cancellation_->status();
             double old_pair_selectivity = work_pair->pair_selectivity();
             absl::Status build_st = filter_to_active_set_->Build(
                 work_pair->a(), work_pair->b(), *work_pair->filters_by_a(),
@@ -234,6 +268,7 @@ absl::Status PairFilterBurnDown::HeapBurnDown(
   std::make_heap(pairs.begin(), pairs.end(), ClassPairSelectivityGreaterThan());
   ::thread::FutureSet<absl::Status> work;
   while (!pairs.begin()->computed()) {
+    if (Cancelled()) return cancellation_->status();
     std::pop_heap(pairs.begin(), pairs.end(),
                   ClassPairSelectivityGreaterThan());
     ClassPairSelectivity& pair = pairs.back();
@@ -274,6 +309,7 @@ absl::Status PairFilterBurnDown::HeapBurnDown(
       }
       std::make_heap(pairs.begin(), pairs.end(),
                      ClassPairSelectivityGreaterThan());
+      if (on_progress_) on_progress_();
     } else {
       if (old_pair_selectivity != pair.pair_selectivity()) {
         return absl::InternalError("Selectivity shouldn't increase");
@@ -283,12 +319,236 @@ absl::Status PairFilterBurnDown::HeapBurnDown(
     }
   }
 
+  return MakePairs(pairs, pair_class_mode);
+}
+
+absl::Status PairFilterBurnDown::WorklistBurnDown(
+    std::vector<ClassPairSelectivity> pairs) {
+  VLOG(1) << "Pruning pairs to a fixpoint: " << pairs.size();
+
+  FilterToActiveSet::PairClassMode pair_class_mode =
+      absl::GetFlag(FLAGS_puzzle_pair_class_mode_make_pairs)
+          ? FilterToActiveSet::PairClassMode::kMakePairs
+          : FilterToActiveSet::PairClassMode::kSingleton;
+  const absl::Time start = absl::Now();
+  const absl::Time deadline =
+      start + absl::GetFlag(FLAGS_puzzle_pair_class_burn_down_worklist_budget);
+
+  // Most selective first, as for HeapBurnDown.
+  std::sort(pairs.begin(), pairs.end(),
+            [](const ClassPairSelectivity& a, const ClassPairSelectivity& b) {
+              return a.pair_selectivity() < b.pair_selectivity();
+            });
+  std::vector<std::vector<int>> pairs_by_class(class_permuters_.size());
+  std::deque<int> worklist;
+  std::vector<bool> queued(pairs.size(), true);
+  for (int i = 0; i < pairs.size(); ++i) {
+    pairs_by_class[pairs[i].a()->class_int()].push_back(i);
+    pairs_by_class[pairs[i].b()->class_int()].push_back(i);
+    worklist.push_back(i);
+  }
+
+  // Builds update the ActiveSets of both their classes, so only builds with
+  // no class in common may run together. `busy` and `selectivity` are only
+  // touched from this thread, while the classes concerned are not building.
+  std::vector<bool> busy(class_permuters_.size(), false);
+  std::vector<double> selectivity(class_permuters_.size());
+  for (const auto& permuter : class_permuters_) {
+    selectivity[permuter->class_int()] =
+        filter_to_active_set_->active_set(permuter->class_int()).Selectivity();
+  }
+  fixpoint_stats_ = FixpointStats();
+  int running = 0;
+  bool shrank_since_progress = false;
+  ::thread::FutureSet<absl::StatusOr<int>> work;
+  while (true) {
+    if (Cancelled()) return cancellation_->status();
+    if (absl::Now() < deadline) {
+      for (auto it = worklist.begin(); it != worklist.end();) {
+        const int i = *it;
+        const int class_a = pairs[i].a()->class_int();
+        const int class_b = pairs[i].b()->class_int();
+        if (busy[class_a] || busy[class_b]) {
+          ++it;
+          continue;
+        }
+        it = worklist.erase(it);
+        queued[i] = false;
+        busy[class_a] = busy[class_b] = true;
+        ++running;
+        ++fixpoint_stats_.builds;
+        ClassPairSelectivity* pair = &pairs[i];
+        executor_->ScheduleFuture(
+            &work,
+            [this, i, pair, pair_class_mode]() -> absl::StatusOr<int> {
+              RETURN_IF_ERROR(filter_to_active_set_->Build(
+                  pair->a(), pair->b(), *pair->filters_by_a(),
+                  *pair->filters_by_b(), pair_class_mode));
+              return i;
+            });
+      }
+    }
+    if (running == 0) break;
+
+    ::thread::Future<absl::StatusOr<int>>* next = work.WaitForAny();
+    if (next == nullptr) {
+      return absl::InternalError("Work expected but not found");
+    }
+    if (!(*next)->ok()) return (*next)->status();
+    --running;
+    const int done = ***next;
+    for (const ClassPermuter* permuter : {pairs[done].a(), pairs[done].b()}) {
+      const int class_int = permuter->class_int();
+      busy[class_int] = false;
+      const double new_selectivity =
+          filter_to_active_set_->active_set(class_int).Selectivity();
+      if (new_selectivity > selectivity[class_int]) {
+        return absl::InternalError("Selectivity shouldn't increase");
+      }
+      if (new_selectivity == selectivity[class_int]) continue;
+      VLOG(2) << "Selectivity (" << class_int
+              << "): " << selectivity[class_int] << " => " << new_selectivity;
+      selectivity[class_int] = new_selectivity;
+      shrank_since_progress = true;
+      for (int i : pairs_by_class[class_int]) {
+        if (i == done || queued[i]) continue;
+        queued[i] = true;
+        worklist.push_back(i);
+        ++fixpoint_stats_.requeued;
+      }
+    }
+    if (running == 0 && shrank_since_progress) {
+      shrank_since_progress = false;
+      if (on_progress_) on_progress_();
+    }
+  }
+
+  fixpoint_stats_.fixpoint = worklist.empty();
+  fixpoint_stats_.elapsed = absl::Now() - start;
+  VLOG(1) << "Pair pruning "
+          << (fixpoint_stats_.fixpoint ? "reached" : "stopped before")
+          << " a fixpoint after " << fixpoint_stats_.builds << " builds ("
+          << fixpoint_stats_.requeued << " requeued) in "
+          << fixpoint_stats_.elapsed;
+
+  return MakePairs(pairs, pair_class_mode);
+}
+
+absl::StatusOr<double> PairFilterBurnDown::EstimateReturn(
+    const ClassPairSelectivity& pair, int samples) const {
+  ASSIGN_OR_RETURN(FilterToActiveSet::PairBuildEstimate estimate,
+                   filter_to_active_set_->EstimatePairBuild(
+                       pair.a(), pair.b(), *pair.filters_by_a(),
+                       *pair.filters_by_b(), samples));
+  const double count_a =
+      filter_to_active_set_->active_set(pair.a()->class_int()).Selectivity() *
+      pair.a()->permutation_count();
+  const double count_b =
+      filter_to_active_set_->active_set(pair.b()->class_int()).Selectivity() *
+      pair.b()->permutation_count();
+  // The fraction of the pairs of permutations of the two classes the build
+  // removes, which a search over them would no longer visit.
+  const double pruned = 1 - (1 - estimate.pruned_a) * (1 - estimate.pruned_b);
+  const double cost = std::max(1.0, estimate.evaluations);
+  VLOG(2) << "Estimate (" << pair.a()->class_int() << ", "
+          << pair.b()->class_int() << "): " << pruned << " pruned for " << cost
+          << " evaluations";
+  // Not worth building if it removes fewer pairs than it evaluates.
+  if (pruned * count_a * count_b < cost) return -1;
+  return pruned / cost;
+}
+
+absl::Status PairFilterBurnDown::RoiBurnDown(
+    std::vector<ClassPairSelectivity> pairs) {
+  VLOG(1) << "Pruning pairs by estimated return: " << pairs.size();
+
+  const int samples =
+      absl::GetFlag(FLAGS_puzzle_pair_class_burn_down_roi_samples);
+  // Pairs to build (again), with their estimated returns. Shrinking the
+  // ActiveSet of a class makes the estimates for its pairs stale, but they
+  // are only estimated again once they would be chosen.
+  std::vector<bool> pending(pairs.size(), true);
+  std::vector<double> returns(pairs.size());
+  std::vector<bool> fresh(pairs.size(), true);
+  for (int i = 0; i < pairs.size(); ++i) {
+    ASSIGN_OR_RETURN(returns[i], EstimateReturn(pairs[i], samples));
+  }
+  int builds = 0;
+  while (true) {
+    if (Cancelled()) return cancellation_->status();
+    int best = -1;
+    for (int i = 0; i < pairs.size(); ++i) {
+      if (!pending[i]) continue;
+      if (best == -1 || returns[i] > returns[best]) best = i;
+    }
+    if (best == -1) break;
+    if (!fresh[best]) {
+      ASSIGN_OR_RETURN(returns[best], EstimateReturn(pairs[best], samples));
+      fresh[best] = true;
+      continue;
+    }
+    if (returns[best] < 0) {
+      // Stale estimates below this one may no longer be negative.
+      bool any_stale = false;
+      for (int i = 0; i < pairs.size(); ++i) {
+        if (!pending[i] || fresh[i]) continue;
+        ASSIGN_OR_RETURN(returns[i], EstimateReturn(pairs[i], samples));
+        fresh[i] = true;
+        any_stale = true;
+      }
+      if (!any_stale) break;
+      continue;
+    }
+
+    ClassPairSelectivity& pair = pairs[best];
+    const double old_a =
+        filter_to_active_set_->active_set(pair.a()->class_int()).Selectivity();
+    const double old_b =
+        filter_to_active_set_->active_set(pair.b()->class_int()).Selectivity();
+    // Pair tables are left to MakePairs, as skipped pairs need them too.
+    RETURN_IF_ERROR(filter_to_active_set_->Build(
+        pair.a(), pair.b(), *pair.filters_by_a(), *pair.filters_by_b(),
+        FilterToActiveSet::PairClassMode::kSingleton));
+    ++builds;
+    pending[best] = false;
+
+    bool shrank = false;
+    for (const auto& [permuter, old_selectivity] :
+         {std::make_pair(pair.a(), old_a), std::make_pair(pair.b(), old_b)}) {
+      const double new_selectivity =
+          filter_to_active_set_->active_set(permuter->class_int())
+              .Selectivity();
+      if (new_selectivity > old_selectivity) {
+        return absl::InternalError("Selectivity shouldn't increase");
+      }
+      if (new_selectivity == old_selectivity) continue;
+      shrank = true;
+      for (int i = 0; i < pairs.size(); ++i) {
+        if (i == best) continue;
+        if (pairs[i].a() != permuter && pairs[i].b() != permuter) continue;
+        pending[i] = true;
+        fresh[i] = false;
+      }
+    }
+    if (shrank && on_progress_) on_progress_();
+  }
+
+  VLOG(1) << "Ran " << builds << " pair builds; skipped "
+          << absl::c_count(pending, true);
+
+  return MakePairs(pairs, FilterToActiveSet::PairClassMode::kSingleton);
+}
+
+absl::Status PairFilterBurnDown::MakePairs(
+    std::vector<ClassPairSelectivity>& pairs,
+    FilterToActiveSet::PairClassMode pair_class_mode) {
   if (absl::GetFlag(FLAGS_puzzle_prune_pair_class_iterators_mode_pair) &&
       pair_class_mode != FilterToActiveSet::PairClassMode::kMakePairs) {
     VLOG(1) << "Running one more pass to generate pairs";
     ::thread::FutureSet<absl::Status> make_pairs_work;
     for (ClassPairSelectivity& pair : pairs) {
       executor_->ScheduleFuture(&make_pairs_work, [this, &pair]() {
+        if (Cancelled()) return cancellation_->status();
         return filter_to_active_set_->Build(
             pair.a(), pair.b(), *pair.filters_by_a(), *pair.filters_by_b(),
             FilterToActiveSet::PairClassMode::kMakePairs);
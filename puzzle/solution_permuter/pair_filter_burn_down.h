@@ -1,8 +1,12 @@
 #ifndef PUZZLE_SOLUTION_PERMUTER_PAIR_FILTER_BURN_DOWN_H
 #define PUZZLE_SOLUTION_PERMUTER_PAIR_FILTER_BURN_DOWN_H
 
+#include <functional>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "puzzle/base/cancellation.h"
 #include "puzzle/class_permuter/class_permuter.h"
 #include "puzzle/solution_permuter/class_pair_selectivity.h"
 #include "puzzle/solution_permuter/filter_to_active_set.h"
@@ -12,30 +16,87 @@ namespace puzzle {
 
 class PairFilterBurnDown {
  public:
+  // Counts from BurnDown with --puzzle_pair_class_burn_down_worklist.
+  struct FixpointStats {
+    // Pair builds run.
+    int builds = 0;
+    // Pairs put back on the worklist after one of their classes shrank.
+    int requeued = 0;
+    // False if the time budget ran out first.
+    bool fixpoint = false;
+    absl::Duration elapsed;
+  };
+
+  // If `cancellation` is non-null, BurnDown returns its status rather than
+  // scheduling further pair builds once it is cancelled.
   PairFilterBurnDown(
       const std::vector<std::unique_ptr<ClassPermuter>>& class_permuters,
       absl::flat_hash_map<std::pair<int, int>, std::vector<SolutionFilter>>
           pair_class_predicates,
-      FilterToActiveSet* filter_to_active_set, ::thread::Executor* executor)
+      FilterToActiveSet* filter_to_active_set, ::thread::Executor* executor,
+      const Cancellation* cancellation = nullptr)
       : class_permuters_(class_permuters),
         pair_class_predicates_(std::move(pair_class_predicates)),
         filter_to_active_set_(filter_to_active_set),
-        executor_(executor) {}
+        executor_(executor),
+        cancellation_(cancellation) {}
+
+  // Sets a function to call each time a pair build has been applied while no
+  // other builds are running, such that the active sets may be read. Never
+  // called with --puzzle_pair_class_burn_down_class, where builds overlap.
+  // With --puzzle_pair_class_burn_down_worklist, only called once the
+  // builds running together have all finished.
+  void set_on_progress(std::function<void()> on_progress) {
+    on_progress_ = std::move(on_progress);
+  }
 
   absl::Status BurnDown();
 
+  const FixpointStats& fixpoint_stats() const { return fixpoint_stats_; }
+
  private:
+  bool Cancelled() const {
+    return cancellation_ != nullptr && cancellation_->CancelledNow();
+  }
+
   absl::StatusOr<std::vector<ClassPairSelectivity>> BuildSelectivityPairs();
 
   absl::Status HeapBurnDown(std::vector<ClassPairSelectivity> pairs);
 
   absl::Status ClassBurnDown(std::vector<ClassPairSelectivity> pairs);
 
+  // Runs builds of pairs with no class in common concurrently from a
+  // worklist holding every pair. Whenever a build shrinks the ActiveSet of
+  // a class, the other pairs with that class are added back to the
+  // worklist, until it is empty (a fixpoint) or the time budget is spent.
+  absl::Status WorklistBurnDown(std::vector<ClassPairSelectivity> pairs);
+
+  // Runs builds in order of the return estimated by EstimateReturn, skipping
+  // those with a negative return. Whenever a build shrinks the ActiveSet of
+  // a class, the other pairs with that class are estimated again before
+  // they are chosen.
+  absl::Status RoiBurnDown(std::vector<ClassPairSelectivity> pairs);
+
+  // Returns the fraction of the pairs of permutations of the classes of
+  // `pair` a build is expected to remove per predicate evaluation, from a
+  // sample of `samples` permutations in each direction. Negative if the
+  // build is expected to evaluate more than it removes.
+  absl::StatusOr<double> EstimateReturn(const ClassPairSelectivity& pair,
+                                        int samples) const;
+
+  // With --puzzle_prune_pair_class_iterators_mode_pair, builds the pair
+  // tables for `pairs` if the burn down did not.
+  absl::Status MakePairs(std::vector<ClassPairSelectivity>& pairs,
+                         FilterToActiveSet::PairClassMode pair_class_mode);
+
   const std::vector<std::unique_ptr<ClassPermuter>>& class_permuters_;
   absl::flat_hash_map<std::pair<int, int>, std::vector<SolutionFilter>>
       pair_class_predicates_;
   FilterToActiveSet* filter_to_active_set_;
   ::thread::Executor* executor_;
+  const Cancellation* cancellation_;
+  std::function<void()> on_progress_;
+  FixpointStats fixpoint_stats_;
 };
 
 };  // namespace puzzle
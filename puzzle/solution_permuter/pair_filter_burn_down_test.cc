@@ -0,0 +1,140 @@
+#include "puzzle/solution_permuter/pair_filter_burn_down.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "puzzle/active_set/active_set.h"
+#include "puzzle/base/solution_filter.h"
+#include "puzzle/class_permuter/factory.h"
+#include "thread/inline_executor.h"
+
+ABSL_DECLARE_FLAG(bool, puzzle_pair_class_burn_down_worklist);
+
+namespace puzzle {
+
+class PairFilterBurnDownTest : public ::testing::Test {
+ protected:
+  PairFilterBurnDownTest() : entry_descriptor_(MakeEntryDescriptor()) {
+    for (int class_int = 0; class_int < 3; ++class_int) {
+      class_permuters_.push_back(MakeClassPermuter(
+          entry_descriptor_.AllClassValues(class_int), class_int));
+    }
+  }
+
+  static EntryDescriptor MakeEntryDescriptor() {
+    std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+    for (int i = 0; i < 3; ++i) {
+      class_descriptors.push_back(absl::make_unique<IntRangeDescriptor>(3));
+    }
+    return EntryDescriptor(absl::make_unique<IntRangeDescriptor>(3),
+                           absl::make_unique<StringDescriptor>(
+                               std::vector<std::string>{"a", "b", "c"}),
+                           std::move(class_descriptors));
+  }
+
+  void AddFilter(
+      absl::flat_hash_map<std::pair<int, int>, std::vector<SolutionFilter>>&
+          pair_class_predicates,
+      SolutionFilter filter) {
+    const int class_a = filter.classes()[0];
+    const int class_b = filter.classes()[1];
+    pair_class_predicates[{class_a, class_b}].push_back(filter);
+    pair_class_predicates[{class_b, class_a}].push_back(std::move(filter));
+  }
+
+  EntryDescriptor entry_descriptor_;
+  std::vector<std::unique_ptr<ClassPermuter>> class_permuters_;
+};
+
+TEST_F(PairFilterBurnDownTest, WorklistRequeuesChangedNeighbors) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_pair_class_burn_down_worklist, true);
+
+  absl::flat_hash_map<std::pair<int, int>, std::vector<SolutionFilter>>
+      pair_class_predicates;
+  // Only removes permutations of class 0.
+  AddFilter(pair_class_predicates,
+            SolutionFilter(
+                "0 shrinks",
+                [](const SolutionView& s) {
+                  return s.Id(0).Class(0) == 0 || s.Id(0).Class(1) == 3;
+                },
+                {0, 1}));
+  // Never remove a permutation.
+  AddFilter(pair_class_predicates,
+            SolutionFilter(
+                "0 and 2 differ",
+                [](const SolutionView& s) {
+                  return s.Id(1).Class(0) != s.Id(1).Class(2);
+                },
+                {0, 2}));
+  AddFilter(pair_class_predicates,
+            SolutionFilter(
+                "1 and 2 differ",
+                [](const SolutionView& s) {
+                  return s.Id(1).Class(1) != s.Id(1).Class(2);
+                },
+                {1, 2}));
+
+  FilterToActiveSet filter_to_active_set(&entry_descriptor_);
+  // Makes the pairs with class 2 the more selective, so (0, 2) is built
+  // before (0, 1) shrinks class 0, and must be built again after.
+  filter_to_active_set.Intersect(
+      2, ActiveSet::Builder::FromPositions(
+             {0, 1, 2}, class_permuters_[2]->permutation_count()));
+
+  ::thread::InlineExecutor executor;
+  PairFilterBurnDown burn_down(class_permuters_,
+                               std::move(pair_class_predicates),
+                               &filter_to_active_set, &executor);
+  ASSERT_TRUE(burn_down.BurnDown().ok());
+
+  EXPECT_THAT(filter_to_active_set.active_set(0).matches(), 2);
+  EXPECT_TRUE(filter_to_active_set.active_set(1).is_trivial());
+  EXPECT_THAT(filter_to_active_set.active_set(2).matches(), 3);
+
+  // (0, 2) is requeued as class 0 changed. (1, 2) shares no changed class,
+  // and the build of (0, 1) which changed class 0 is not requeued for it.
+  const PairFilterBurnDown::FixpointStats& stats = burn_down.fixpoint_stats();
+  EXPECT_TRUE(stats.fixpoint);
+  EXPECT_THAT(stats.requeued, 1);
+  EXPECT_THAT(stats.builds, 3 + 1);
+}
+
+TEST_F(PairFilterBurnDownTest, WorklistWithoutChangesRequeuesNothing) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_pair_class_burn_down_worklist, true);
+
+  absl::flat_hash_map<std::pair<int, int>, std::vector<SolutionFilter>>
+      pair_class_predicates;
+  for (auto [class_a, class_b] : {std::make_pair(0, 1), std::make_pair(0, 2),
+                                  std::make_pair(1, 2)}) {
+    AddFilter(pair_class_predicates,
+              SolutionFilter(
+                  "differ",
+                  [class_a, class_b](const SolutionView& s) {
+                    return s.Id(1).Class(class_a) != s.Id(1).Class(class_b);
+                  },
+                  {class_a, class_b}));
+  }
+
+  FilterToActiveSet filter_to_active_set(&entry_descriptor_);
+  ::thread::InlineExecutor executor;
+  PairFilterBurnDown burn_down(class_permuters_,
+                               std::move(pair_class_predicates),
+                               &filter_to_active_set, &executor);
+  ASSERT_TRUE(burn_down.BurnDown().ok());
+
+  const PairFilterBurnDown::FixpointStats& stats = burn_down.fixpoint_stats();
+  EXPECT_TRUE(stats.fixpoint);
+  EXPECT_THAT(stats.requeued, 0);
+  EXPECT_THAT(stats.builds, 3);
+}
+
+}  // namespace puzzle
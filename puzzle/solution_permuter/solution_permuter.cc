@@ -8,6 +8,23 @@ absl::Status SolutionPermuter::Prepare() {
   return absl::OkStatus();
 }
 
+absl::StatusOr<int64_t> SolutionPermuter::Count(
+    absl::FunctionRef<bool(const SolutionView&)> accept,
+    int num_threads) const {
+  int64_t count = 0;
+  for (const SolutionView& solution : *this) {
+    if (accept(solution)) ++count;
+  }
+  return count;
+}
+
+absl::StatusOr<SolutionPermuter::CountEstimate> SolutionPermuter::EstimateCount(
+    absl::FunctionRef<bool(const SolutionView&)> accept, int num_samples,
+    int num_threads) const {
+  return absl::UnimplementedError(
+      "EstimateCount is not supported by this permuter");
+}
+
 SolutionPermuter::AdvancerBase::AdvancerBase(
     const EntryDescriptor* entry_descriptor)
     : mutable_solution_(entry_descriptor) {
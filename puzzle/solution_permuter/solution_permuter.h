@@ -1,9 +1,15 @@
 #ifndef PUZZLE_SOLUTION_PERMUTER_SOLUTION_PERMUTER_H_
 #define PUZZLE_SOLUTION_PERMUTER_SOLUTION_PERMUTER_H_
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
 
+#include "absl/functional/function_ref.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "puzzle/base/cancellation.h"
 #include "puzzle/base/solution_filter.h"
 #include "puzzle/base/solution_view.h"
 #include "puzzle/solution_permuter/mutable_solution.h"
@@ -75,26 +81,112 @@ class SolutionPermuter {
     std::unique_ptr<AdvancerBase> advancer_;
   };
 
+  using Cell = SolutionFilter::Cell;
+
+  // Result of EstimateCount.
+  struct CountEstimate {
+    double count = 0;
+    // Standard error of `count`, estimated from the spread of the samples.
+    double standard_error = 0;
+    int samples = 0;
+  };
+
   explicit SolutionPermuter(const EntryDescriptor* entry_descriptor)
       : entry_descriptor_(entry_descriptor) {}
   virtual ~SolutionPermuter() = default;
 
   virtual absl::StatusOr<bool> AddFilter(SolutionFilter solution_filter) = 0;
 
+  // Adds the predicate `s.Id(entry_id).Class(class_int) == value` (or `!=` if
+  // `equal` is false). Returns true if the predicate will be honored, and
+  // false if the caller must instead add an equivalent filter. The default
+  // implementation always returns false.
+  virtual absl::StatusOr<bool> AddEntryValuePredicate(int entry_id,
+                                                      int class_int, int value,
+                                                      bool equal) {
+    return false;
+  }
+
+  // Adds the predicate that the values of `cells` are pairwise different.
+  // Returns true if the predicate will be honored, and false if the caller
+  // must instead add equivalent filters. The default implementation always
+  // returns false.
+  virtual absl::StatusOr<bool> AddAllDifferentPredicate(
+      absl::Span<const Cell> cells) {
+    return false;
+  }
+
   absl::Status Prepare();
 
   virtual double Selectivity() const = 0;
   virtual absl::Status PrepareCheap() = 0;
   virtual absl::Status PrepareFull() = 0;
 
+  // Returns an upper bound on what Selectivity will be once prepared. Unlike
+  // Selectivity, this may be called from any thread while PrepareCheap or
+  // PrepareFull is running on another, so it can be used to judge a
+  // preparation before it finishes.
+  virtual double SelectivityBound() const { return 1.0; }
+
+  // Sets a function called, possibly on another thread, each time
+  // SelectivityBound may have decreased, so a caller judging a preparation
+  // can wait for progress rather than poll. Must outlive its use here; an
+  // empty function (the default) disables the calls.
+  void set_on_selectivity_bound(std::function<void()> on_selectivity_bound) {
+    on_selectivity_bound_ = std::move(on_selectivity_bound);
+  }
+
+  // Returns a human readable summary of the resources used by the permuter
+  // (e.g. bytes held by precomputed tables), or "" if there is nothing to
+  // report.
+  virtual std::string DebugStatistics() const { return ""; }
+
   virtual iterator begin() const = 0;
   iterator end() const { return iterator(absl::make_unique<NullAdvancer>()); }
 
+  // Returns the number of permutations for which `accept` is true. Permuters
+  // may split the search across up to `num_threads` threads, in which case
+  // `accept` is called concurrently. The default implementation iterates on
+  // the calling thread.
+  virtual absl::StatusOr<int64_t> Count(
+      absl::FunctionRef<bool(const SolutionView&)> accept,
+      int num_threads) const;
+
+  // Estimates the number of permutations for which `accept` is true from
+  // `num_samples` random walks from the root of the search to a leaf, spread
+  // across up to `num_threads` threads (`accept` is called concurrently).
+  // Each walk picks uniformly among the values consistent with the filters
+  // at each step, and contributes the product of the number of such values
+  // along the way if `accept` is true of the leaf, or zero otherwise
+  // (Knuth's estimator). The default implementation returns
+  // UnimplementedError.
+  virtual absl::StatusOr<CountEstimate> EstimateCount(
+      absl::FunctionRef<bool(const SolutionView&)> accept, int num_samples,
+      int num_threads) const;
+
+  // Sets the token which permuters may check during PrepareFull and
+  // iteration. Once it is cancelled, preparation may return its status and
+  // iteration may end early, so callers must check it to distinguish an
+  // early end from exhausting the permutations. Must outlive its use here;
+  // nullptr (the default) disables the checks.
+  void set_cancellation(const Cancellation* cancellation) {
+    cancellation_ = cancellation;
+  }
+
  protected:
   const EntryDescriptor* entry_descriptor() const { return entry_descriptor_; }
 
+  const Cancellation* cancellation() const { return cancellation_; }
+
+  // To be called by implementations whenever SelectivityBound decreases.
+  void NotifySelectivityBound() const {
+    if (on_selectivity_bound_) on_selectivity_bound_();
+  }
+
  private:
   const EntryDescriptor* entry_descriptor_;
+  const Cancellation* cancellation_ = nullptr;
+  std::function<void()> on_selectivity_bound_;
 };
 
 }  // namespace puzzle
@@ -4,10 +4,11 @@
 #include "puzzle/solution_permuter/allowed_value_solution_permuter.h"
 #include "puzzle/solution_permuter/brute_solution_permuter.h"
 #include "puzzle/solution_permuter/filtered_solution_permuter.h"
+#include "puzzle/solution_permuter/grid_solution_permuter.h"
 
 ABSL_FLAG(std::string, puzzle_solution_permuter, "filtered",
           "Selects the method of solution opermutation. Allowed values are: "
-          "brute, filtered, and allowonly.");
+          "brute, filtered, allowonly, and grid.");
 
 namespace puzzle {
 
@@ -20,6 +21,8 @@ std::unique_ptr<SolutionPermuter> CreateSolutionPermuter(
                                                        profiler);
   } else if (absl::GetFlag(FLAGS_puzzle_solution_permuter) == "allowonly") {
     return absl::make_unique<AllowedValueSolutionPermuter>(entry_descriptor);
+  } else if (absl::GetFlag(FLAGS_puzzle_solution_permuter) == "grid") {
+    return absl::make_unique<GridSolutionPermuter>(entry_descriptor);
   } else {
     LOG(FATAL) << "Bad value for flag puzzle_solution_permuter: "
                << absl::GetFlag(FLAGS_puzzle_solution_permuter);
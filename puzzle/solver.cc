@@ -1,11 +1,33 @@
 #include "puzzle/solver.h"
 
+#include <optional>
+
+#include "absl/algorithm/container.h"
 #include "absl/flags/flag.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
 #include "puzzle/base/all_match.h"
 #include "puzzle/solution_permuter/solution_permuter_factory.h"
 
 ABSL_FLAG(bool, puzzle_alternate_full_selectivity_check, true, "...");
 ABSL_FLAG(bool, puzzle_alternate_disable, false, "...");
+ABSL_FLAG(bool, puzzle_alternate_portfolio, false,
+          "If true and there is more than one alternate, every alternate is "
+          "prepared and searched concurrently on its own thread instead of "
+          "choosing one by selectivity. The first alternate to find a "
+          "solution (or to finish without one) is used and the others are "
+          "cancelled. Ignored if the profiler is enabled.");
+ABSL_FLAG(bool, puzzle_alternate_prepare_concurrently, false,
+          "If true and there is more than one alternate, every alternate is "
+          "fully prepared concurrently on its own thread before choosing the "
+          "most selective. Ignored if the profiler is enabled.");
+ABSL_FLAG(double, puzzle_alternate_prepare_abandon_ratio, 1.0,
+          "If --puzzle_alternate_prepare_concurrently is true, preparation of "
+          "an alternate is abandoned once its selectivity so far is more than "
+          "this multiple of the selectivity of an alternate which has "
+          "finished preparing. Since preparing only lowers selectivity, "
+          "values of 1 or less may abandon an alternate which would have "
+          "been chosen. Non-positive values disable abandonment.");
 
 namespace puzzle {
 
@@ -15,6 +37,8 @@ Solver::Solver(EntryDescriptor entry_descriptor)
   alternates_.push_back(
       CreateSolutionPermuter(&entry_descriptor_, profiler_.get()));
   residual_.push_back({});
+  all_different_pairs_.push_back({});
+  constraints_.push_back({});
 }
 
 absl::Status Solver::AddFilter(SolutionFilter solution_filter) {
@@ -23,12 +47,165 @@ absl::Status Solver::AddFilter(SolutionFilter solution_filter) {
     if (current_alternate_ && i != current_alternate_->id_) {
       continue;
     }
-    ASSIGN_OR_RETURN(bool fully_used,
-                     alternates_[i]->AddFilter(solution_filter));
-    if (!fully_used) {
-      // Permuter indicated that it can't fully evaluate the filter.
-      residual_[i].push_back(solution_filter);
+    RETURN_IF_ERROR(AddFilter(i, solution_filter));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Solver::AddFilter(int alternate_id,
+                               SolutionFilter solution_filter) {
+  ASSIGN_OR_RETURN(bool fully_used,
+                   alternates_[alternate_id]->AddFilter(solution_filter));
+  if (!fully_used) {
+    // Permuter indicated that it can't fully evaluate the filter.
+    residual_[alternate_id].push_back(std::move(solution_filter));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Solver::AddEntryValuePredicate(std::string name, int entry_id,
+                                            int class_int, int value,
+                                            bool equal) {
+  filter_added_ = true;
+  std::optional<SolutionFilter> fallback;
+  for (int i = 0; i < alternates_.size(); ++i) {
+    if (current_alternate_ && i != current_alternate_->id_) {
+      continue;
+    }
+    ASSIGN_OR_RETURN(
+        bool used,
+        alternates_[i]->AddEntryValuePredicate(entry_id, class_int, value,
+                                               equal));
+    if (used) continue;
+
+    // Permuter doesn't handle the form directly, so add the equivalent filter.
+    if (!fallback) {
+      fallback = SolutionFilter(
+          name,
+          [class_int, value, equal](const Entry& e) {
+            return (e.Class(class_int) == value) == equal;
+          },
+          {class_int}, entry_id);
+      const expr::CellValue cell = expr::Id(entry_id).Class(class_int);
+      fallback->set_key(equal ? (cell == value).DebugString()
+                              : (cell != value).DebugString());
     }
+    RETURN_IF_ERROR(AddFilter(i, *fallback));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Solver::AddAllDifferentPredicate(std::string name,
+                                              std::vector<Cell> cells) {
+  filter_added_ = true;
+  const int num_classes = entry_descriptor_.num_classes();
+  for (int i = 0; i < alternates_.size(); ++i) {
+    if (current_alternate_ && i != current_alternate_->id_) {
+      continue;
+    }
+    ASSIGN_OR_RETURN(bool used,
+                     alternates_[i]->AddAllDifferentPredicate(cells));
+
+    for (int a = 0; a < cells.size(); ++a) {
+      for (int b = a + 1; b < cells.size(); ++b) {
+        const Cell cell_a = cells[a];
+        const Cell cell_b = cells[b];
+        // Each class is a permutation, so its values already differ.
+        if (cell_a.class_int == cell_b.class_int) continue;
+        const int index_a = cell_a.entry_id * num_classes + cell_a.class_int;
+        const int index_b = cell_b.entry_id * num_classes + cell_b.class_int;
+        if (!all_different_pairs_[i]
+                 .insert({std::min(index_a, index_b),
+                          std::max(index_a, index_b)})
+                 .second) {
+          continue;
+        }
+        if (used) continue;
+
+        // Permuter doesn't handle the form directly, so add the equivalent
+        // filter.
+        std::string pair_name =
+            absl::StrCat(name, " (", cell_a.entry_id + 1, ",",
+                         cell_a.class_int + 1, ") vs (", cell_b.entry_id + 1,
+                         ",", cell_b.class_int + 1, ")");
+        SolutionFilter filter =
+            cell_a.entry_id == cell_b.entry_id
+                ? SolutionFilter(
+                      std::move(pair_name),
+                      [class_a = cell_a.class_int,
+                       class_b = cell_b.class_int](const Entry& e) {
+                        return e.Class(class_a) != e.Class(class_b);
+                      },
+                      {cell_a.class_int, cell_b.class_int}, cell_a.entry_id)
+                : SolutionFilter(
+                      std::move(pair_name),
+                      [cell_a, cell_b](const SolutionView& s) {
+                        return s.Id(cell_a.entry_id).Class(cell_a.class_int) !=
+                               s.Id(cell_b.entry_id).Class(cell_b.class_int);
+                      },
+                      absl::flat_hash_map<int, int>{
+                          {cell_a.class_int, cell_a.entry_id},
+                          {cell_b.class_int, cell_b.entry_id}});
+        // Keyed as the equivalent Constraint would be.
+        filter.set_key((expr::Id(cell_a.entry_id).Class(cell_a.class_int) !=
+                        expr::Id(cell_b.entry_id).Class(cell_b.class_int))
+                           .DebugString());
+        RETURN_IF_ERROR(AddFilter(i, std::move(filter)));
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Solver::AddConstraint(std::string name,
+                                   const Constraint& constraint) {
+  if (!constraint.conjuncts().empty()) {
+    for (const Constraint& conjunct : constraint.conjuncts()) {
+      RETURN_IF_ERROR(AddConstraint(name, conjunct));
+    }
+    return absl::OkStatus();
+  }
+  if (const auto& entry_range = constraint.entry_range()) {
+    const Cell cell = entry_range->cell;
+    if (cell.class_int < 0 ||
+        cell.class_int >= entry_descriptor_.num_classes()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad class in ", constraint.DebugString()));
+    }
+    // Class values are 0-indexed, so exclude each index outside the range.
+    const int num_values =
+        entry_descriptor_.AllClassValues(cell.class_int)->size();
+    for (int value = 0; value < num_values; ++value) {
+      if (value >= entry_range->min && value <= entry_range->max) continue;
+      RETURN_IF_ERROR(AddEntryValuePredicate(name, cell.entry_id,
+                                             cell.class_int, value,
+                                             /*equal=*/false));
+    }
+    return absl::OkStatus();
+  }
+  if (const auto& entry_value = constraint.entry_value()) {
+    return AddEntryValuePredicate(std::move(name), entry_value->cell.entry_id,
+                                  entry_value->cell.class_int,
+                                  entry_value->value, entry_value->equal);
+  }
+  if (const auto& different_cells = constraint.different_cells()) {
+    return AddAllDifferentPredicate(
+        std::move(name), {different_cells->first, different_cells->second});
+  }
+
+  filter_added_ = true;
+  SolutionFilter filter(std::move(name), constraint.predicate(),
+                        constraint.cells());
+  filter.set_key(constraint.DebugString());
+  for (int i = 0; i < alternates_.size(); ++i) {
+    if (current_alternate_ && i != current_alternate_->id_) {
+      continue;
+    }
+    if (!constraints_[i].insert(constraint.DebugString()).second) {
+      VLOG(2) << "Skipping duplicate constraint " << filter.name();
+      continue;
+    }
+    RETURN_IF_ERROR(AddFilter(i, filter));
   }
   return absl::OkStatus();
 }
@@ -39,19 +216,54 @@ absl::StatusOr<OwnedSolution> Solver::Solve() {
   return std::move(ret[0]);
 }
 
+std::unique_ptr<::thread::Future<absl::StatusOr<OwnedSolution>>>
+Solver::SolveAsync(::thread::Executor* executor) {
+  return executor->ScheduleFuture([this]() { return Solve(); });
+}
+
+void Solver::set_cancellation(const Cancellation* cancellation) {
+  cancellation_ = cancellation;
+  for (const auto& alternate : alternates_) {
+    alternate->set_cancellation(cancellation);
+  }
+}
+
+::thread::Executor* Solver::AlternatePool() {
+  if (alternate_pool_ == nullptr) {
+    alternate_pool_ = std::make_unique<::thread::Pool>(alternates_.size());
+  }
+  return alternate_pool_.get();
+}
+
+absl::Status Solver::CheckCancelled() const {
+  if (cancellation_ != nullptr && cancellation_->CancelledNow()) {
+    return cancellation_->status();
+  }
+  return absl::OkStatus();
+}
+
 absl::StatusOr<Solver::AlternateId> Solver::PrepareAndChooseAlternate() {
   AlternateId ret;
   if (absl::GetFlag(FLAGS_puzzle_alternate_disable)) {
     ret.id_ = 0;
     RETURN_IF_ERROR(alternates_[0]->PrepareCheap());
+    RETURN_IF_ERROR(CheckCancelled());
     RETURN_IF_ERROR(alternates_[0]->PrepareFull());
+    RETURN_IF_ERROR(CheckCancelled());
     return ret;
   }
 
+  if (absl::GetFlag(FLAGS_puzzle_alternate_prepare_concurrently) &&
+      alternates_.size() > 1 && profiler_ == nullptr) {
+    return PrepareAlternatesConcurrently();
+  }
+
   double best_selectivity = 1.1;
   for (int i = 0; i < alternates_.size(); ++i) {
+    RETURN_IF_ERROR(CheckCancelled());
     RETURN_IF_ERROR(alternates_[i]->PrepareCheap());
     if (absl::GetFlag(FLAGS_puzzle_alternate_full_selectivity_check)) {
+      RETURN_IF_ERROR(CheckCancelled());
       RETURN_IF_ERROR(alternates_[i]->PrepareFull());
     }
     double alternate_selectivity = alternates_[i]->Selectivity();
@@ -62,15 +274,192 @@ absl::StatusOr<Solver::AlternateId> Solver::PrepareAndChooseAlternate() {
   }
 
   if (!absl::GetFlag(FLAGS_puzzle_alternate_full_selectivity_check)) {
+    RETURN_IF_ERROR(CheckCancelled());
     RETURN_IF_ERROR(alternates_[ret.id_]->PrepareFull());
   }
+  RETURN_IF_ERROR(CheckCancelled());
 
   VLOG_IF(1, alternates_.size() > 1) << "Chose alternate: " << ret.id_;
 
   return ret;
 }
 
+absl::StatusOr<Solver::AlternateId> Solver::PrepareAlternatesConcurrently() {
+  // Each alternate gets its own token so it can be abandoned without
+  // affecting the others, while still honoring `cancellation_`.
+  std::vector<std::unique_ptr<Cancellation>> preparer_cancellations;
+  for (const auto& alternate : alternates_) {
+    preparer_cancellations.push_back(
+        absl::make_unique<Cancellation>(cancellation_));
+    alternate->set_cancellation(preparer_cancellations.back().get());
+  }
+
+  const double abandon_ratio =
+      absl::GetFlag(FLAGS_puzzle_alternate_prepare_abandon_ratio);
+  absl::Mutex mu;
+  // Set when an alternate finishes or lowers its SelectivityBound.
+  bool changed = false;
+  std::vector<std::optional<absl::Status>> statuses(alternates_.size());
+  std::vector<double> selectivities(alternates_.size());
+  std::vector<bool> abandoned(alternates_.size(), false);
+  if (abandon_ratio > 0) {
+    for (const auto& alternate : alternates_) {
+      alternate->set_on_selectivity_bound([&]() {
+        absl::MutexLock l(&mu);
+        changed = true;
+      });
+    }
+  }
+  absl::BlockingCounter running(alternates_.size());
+  for (int i = 0; i < alternates_.size(); ++i) {
+    AlternatePool()->Schedule([&, i]() {
+      absl::Status st = alternates_[i]->PrepareCheap();
+      if (st.ok()) st = alternates_[i]->PrepareFull();
+      {
+        absl::MutexLock l(&mu);
+        if (st.ok()) selectivities[i] = alternates_[i]->Selectivity();
+        statuses[i] = std::move(st);
+        changed = true;
+      }
+      running.DecrementCount();
+    });
+  }
+
+  {
+    absl::MutexLock l(&mu);
+    while (absl::c_any_of(statuses, [](const auto& st) { return !st; })) {
+      mu.Await(absl::Condition(&changed));
+      changed = false;
+      if (abandon_ratio <= 0) continue;
+
+      std::optional<double> best_finished;
+      for (int i = 0; i < alternates_.size(); ++i) {
+        if (!statuses[i] || !statuses[i]->ok()) continue;
+        if (!best_finished || selectivities[i] < *best_finished) {
+          best_finished = selectivities[i];
+        }
+      }
+      if (!best_finished) continue;
+      for (int i = 0; i < alternates_.size(); ++i) {
+        if (statuses[i] || abandoned[i]) continue;
+        if (alternates_[i]->SelectivityBound() >
+            *best_finished * abandon_ratio) {
+          VLOG(1) << "Abandoning preparation of alternate " << i;
+          abandoned[i] = true;
+          preparer_cancellations[i]->Cancel();
+        }
+      }
+    }
+  }
+  // The tasks may still be leaving `mu`.
+  running.Wait();
+
+  for (const auto& alternate : alternates_) {
+    alternate->set_cancellation(cancellation_);
+    alternate->set_on_selectivity_bound(nullptr);
+  }
+  RETURN_IF_ERROR(CheckCancelled());
+
+  AlternateId ret;
+  std::optional<double> best_selectivity;
+  for (int i = 0; i < alternates_.size(); ++i) {
+    if (!statuses[i]->ok()) {
+      if (abandoned[i]) continue;
+      return *statuses[i];
+    }
+    if (!best_selectivity || selectivities[i] < *best_selectivity) {
+      ret.id_ = i;
+      best_selectivity = selectivities[i];
+    }
+  }
+  if (!best_selectivity) {
+    return absl::InternalError("Every alternate was abandoned");
+  }
+
+  VLOG(1) << "Chose alternate: " << ret.id_;
+
+  return ret;
+}
+
 absl::StatusOr<std::vector<OwnedSolution>> Solver::AllSolutions(int limit) {
+  std::vector<OwnedSolution> ret;
+  if (limit == 0) return ret;
+  RETURN_IF_ERROR(ForEachSolution([&](const SolutionView& solution) {
+    ret.push_back(OwnedSolution(solution));
+    return limit < 0 || ret.size() < static_cast<size_t>(limit);
+  }));
+  return ret;
+}
+
+absl::Status Solver::ForEachSolution(
+    absl::FunctionRef<bool(const SolutionView&)> fn) {
+  absl::Status transform_status;
+  RETURN_IF_ERROR(VisitMatches([&](const SolutionView& solution) {
+    if (chosen_alternate_.id_ == 0) return fn(solution);
+    absl::StatusOr<OwnedSolution> transformed =
+        TransformAlternate(solution, chosen_alternate_);
+    if (!transformed.ok()) {
+      transform_status = transformed.status();
+      return false;
+    }
+    return fn(transformed->view());
+  }));
+  return transform_status;
+}
+
+absl::StatusOr<int64_t> Solver::CountSolutions(int64_t limit,
+                                               int num_threads) {
+  int64_t count = 0;
+  if (limit == 0) return count;
+  if (num_threads > 1) {
+    if (limit > 0) {
+      return absl::InvalidArgumentError(
+          "Cannot count solutions concurrently with a limit");
+    }
+    ASSIGN_OR_RETURN(chosen_alternate_, PrepareAndChooseAlternate());
+    absl::Span<const SolutionFilter> on_solution =
+        residual_[chosen_alternate_.id_];
+    ASSIGN_OR_RETURN(count,
+                     alternates_[chosen_alternate_.id_]->Count(
+                         [on_solution](const SolutionView& solution) {
+                           return AllMatch(on_solution, solution);
+                         },
+                         num_threads));
+    RETURN_IF_ERROR(CheckCancelled());
+    return count;
+  }
+  // Alternates are equivalent representations of the problem, so solutions
+  // are counted without transforming them back.
+  RETURN_IF_ERROR(VisitMatches([&](const SolutionView&) {
+    ++count;
+    return limit < 0 || count < limit;
+  }));
+  return count;
+}
+
+absl::StatusOr<Solver::CountEstimate> Solver::EstimateSolutionCount(
+    int num_samples, int num_threads) {
+  ASSIGN_OR_RETURN(chosen_alternate_, PrepareAndChooseAlternate());
+  absl::Span<const SolutionFilter> on_solution =
+      residual_[chosen_alternate_.id_];
+  ASSIGN_OR_RETURN(CountEstimate estimate,
+                   alternates_[chosen_alternate_.id_]->EstimateCount(
+                       [on_solution](const SolutionView& solution) {
+                         return AllMatch(on_solution, solution);
+                       },
+                       num_samples, num_threads));
+  RETURN_IF_ERROR(CheckCancelled());
+  return estimate;
+}
+
+absl::Status Solver::VisitMatches(
+    absl::FunctionRef<bool(const SolutionView&)> on_match) {
+  if (absl::GetFlag(FLAGS_puzzle_alternate_portfolio) &&
+      !absl::GetFlag(FLAGS_puzzle_alternate_disable) &&
+      alternates_.size() > 1 && profiler_ == nullptr) {
+    return RaceAlternates(on_match);
+  }
+
   absl::Time start = absl::Now();
   ASSIGN_OR_RETURN(chosen_alternate_, PrepareAndChooseAlternate());
 
@@ -79,8 +468,11 @@ absl::StatusOr<std::vector<OwnedSolution>> Solver::AllSolutions(int limit) {
   absl::Span<const SolutionFilter> on_solution =
       residual_[chosen_alternate_.id_];
 
-  std::vector<OwnedSolution> ret;
+  bool stopped = false;
   for (auto& solution : *solution_permuter) {
+    // Permuters which check `cancellation_` themselves simply end iteration,
+    // this catches the rest.
+    if (cancellation_ != nullptr && cancellation_->Cancelled()) break;
     VLOG(2) << "Solution to test @" << solution.position();
     if (profiler_ != nullptr) {
       profiler_->NotePermutation(solution.position());
@@ -88,31 +480,121 @@ absl::StatusOr<std::vector<OwnedSolution>> Solver::AllSolutions(int limit) {
     ++test_calls_;
     if (AllMatch(on_solution, solution)) {
       VLOG(1) << "Solution found @" << solution.position();
-      if (chosen_alternate_.id_ == 0) {
-        ret.push_back(puzzle::OwnedSolution(solution));
-      } else {
-        ASSIGN_OR_RETURN(puzzle::OwnedSolution transformed,
-                         TransformAlternate(solution, chosen_alternate_));
-        ret.push_back(std::move(transformed));
-      }
-      if (limit >= 0 && ret.size() >= static_cast<size_t>(limit)) {
+      if (!on_match(solution)) {
+        stopped = true;
         break;
       }
     }
   }
 
-  absl::Time end = absl::Now();
   if (profiler_) {
     profiler_->NoteFinish();
   }
+  NoteSearchFinished(start);
+
+  if (!stopped) {
+    // Iteration may have ended early rather than exhausting the permuter.
+    RETURN_IF_ERROR(CheckCancelled());
+  }
+
+  return absl::OkStatus();
+}
+
+absl::Status Solver::RaceAlternates(
+    absl::FunctionRef<bool(const SolutionView&)> on_match) {
+  absl::Time start = absl::Now();
+
+  // Each alternate gets its own token so the losers can be cancelled without
+  // affecting the winner, while still honoring `cancellation_`.
+  std::vector<std::unique_ptr<Cancellation>> racer_cancellations;
+  for (const auto& alternate : alternates_) {
+    racer_cancellations.push_back(
+        absl::make_unique<Cancellation>(cancellation_));
+    alternate->set_cancellation(racer_cancellations.back().get());
+  }
+
+  absl::Mutex mu;
+  std::optional<int> winner;
+  // Returns true if alternate `i` is (or now becomes) the winner.
+  auto claim = [&](int i) {
+    absl::MutexLock l(&mu);
+    if (winner) return *winner == i;
+    winner = i;
+    chosen_alternate_.id_ = i;
+    for (int j = 0; j < racer_cancellations.size(); ++j) {
+      if (j != i) racer_cancellations[j]->Cancel();
+    }
+    VLOG(1) << "Alternate " << i << " won";
+    return true;
+  };
+
+  std::vector<absl::Status> statuses(alternates_.size());
+  std::vector<int> test_calls(alternates_.size(), 0);
+  auto race = [&](int i) -> absl::Status {
+    SolutionPermuter* solution_permuter = alternates_[i].get();
+    const Cancellation* racer_cancellation = racer_cancellations[i].get();
+    RETURN_IF_ERROR(solution_permuter->PrepareCheap());
+    RETURN_IF_ERROR(solution_permuter->PrepareFull());
+
+    absl::Span<const SolutionFilter> on_solution = residual_[i];
+    bool claimed = false;
+    bool stopped = false;
+    for (auto& solution : *solution_permuter) {
+      if (racer_cancellation->Cancelled()) break;
+      ++test_calls[i];
+      if (AllMatch(on_solution, solution)) {
+        if (!claimed && !(claimed = claim(i))) break;
+        // Only the winner gets here, so `on_match` is never called
+        // concurrently.
+        if (!on_match(solution)) {
+          stopped = true;
+          break;
+        }
+      }
+    }
+    if (!stopped && racer_cancellation->CancelledNow()) {
+      return racer_cancellation->status();
+    }
+    // Exhausting the search without a match also wins.
+    if (!claimed && !claim(i)) return absl::CancelledError("Lost race");
+    return absl::OkStatus();
+  };
+  absl::BlockingCounter running(alternates_.size());
+  for (int i = 0; i < alternates_.size(); ++i) {
+    AlternatePool()->Schedule([&, i]() {
+      statuses[i] = race(i);
+      running.DecrementCount();
+    });
+  }
+  // Waits for every alternate to finish or notice that it was cancelled.
+  running.Wait();
 
+  for (const auto& alternate : alternates_) {
+    alternate->set_cancellation(cancellation_);
+  }
+  test_calls_ += absl::c_accumulate(test_calls, 0);
+
+  if (!winner) {
+    // Every alternate failed before finding a solution.
+    RETURN_IF_ERROR(CheckCancelled());
+    return statuses[0];
+  }
+  NoteSearchFinished(start);
+  return statuses[*winner];
+}
+
+void Solver::NoteSearchFinished(absl::Time start) {
+  absl::Time end = absl::Now();
   last_debug_statistics_ =
       absl::StrFormat("[%d solutions tested in %dms]", test_calls_,
                       (end - start) / absl::Milliseconds(1));
+  if (std::string permuter_statistics =
+          alternates_[chosen_alternate_.id_]->DebugStatistics();
+      !permuter_statistics.empty()) {
+    absl::StrAppend(&last_debug_statistics_, " [", permuter_statistics, "]");
+  }
 
   VLOG(1) << last_debug_statistics_;
-
-  return ret;
 }
 
 std::string Solver::DebugStatistics() const { return last_debug_statistics_; }
@@ -132,7 +614,10 @@ absl::StatusOr<Solver::AlternateId> Solver::CreateAlternate() {
   ret.id_ = alternates_.size();
   alternates_.push_back(
       CreateSolutionPermuter(&entry_descriptor_, profiler_.get()));
+  alternates_.back()->set_cancellation(cancellation_);
   residual_.push_back({});
+  all_different_pairs_.push_back({});
+  constraints_.push_back({});
   return ret;
 }
 
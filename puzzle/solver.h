@@ -1,25 +1,71 @@
 #ifndef PUZZLE_SOLVER_H
 #define PUZZLE_SOLVER_H
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "puzzle/base/cancellation.h"
+#include "puzzle/base/expression.h"
 #include "puzzle/base/owned_solution.h"
 #include "puzzle/base/profiler.h"
 #include "puzzle/base/solution_view.h"
 #include "puzzle/solution_permuter/solution_permuter.h"
+#include "thread/executor.h"
+#include "thread/future.h"
+#include "thread/pool.h"
 
 namespace puzzle {
 
 class Solver {
  public:
+  using Cell = SolutionPermuter::Cell;
+
   explicit Solver(EntryDescriptor entry_descriptor);
   ~Solver() = default;
 
   absl::StatusOr<OwnedSolution> Solve();
   absl::StatusOr<std::vector<OwnedSolution>> AllSolutions(int limit = -1);
 
+  // Calls `fn` with each solution until it returns false or there are no
+  // more. The SolutionView is only valid for the duration of the call; no
+  // copy is made unless a non-default alternate was chosen (see
+  // TransformAlternate).
+  absl::Status ForEachSolution(
+      absl::FunctionRef<bool(const SolutionView&)> fn);
+
+  // Returns the number of solutions, stopping once `limit` are found if it is
+  // non-negative. Solutions are never copied. If `num_threads` is greater
+  // than 1, permuters which support it count disjoint parts of the search
+  // concurrently; `limit` must be negative in that case.
+  absl::StatusOr<int64_t> CountSolutions(int64_t limit = -1,
+                                         int num_threads = 1);
+
+  using CountEstimate = SolutionPermuter::CountEstimate;
+
+  // Estimates the number of solutions from `num_samples` random walks down
+  // the search, as described for SolutionPermuter::EstimateCount, using
+  // `num_threads` threads. Returns UnimplementedError if the permuter does
+  // not support sampling.
+  absl::StatusOr<CountEstimate> EstimateSolutionCount(int num_samples,
+                                                      int num_threads = 1);
+
+  // Runs Solve on `executor` and returns a Future for its result. The Solver
+  // must not otherwise be used, or destroyed, until the Future has a value.
+  // Use set_cancellation to bound the time spent.
+  std::unique_ptr<::thread::Future<absl::StatusOr<OwnedSolution>>> SolveAsync(
+      ::thread::Executor* executor);
+
+  // Sets the token checked while preparing and searching. Once it is
+  // cancelled, or its deadline passes, Solve and AllSolutions stop promptly
+  // (releasing any threads they use) and return its status(). `cancellation`
+  // must outlive any such call. nullptr (the default) disables the checks.
+  void set_cancellation(const Cancellation* cancellation);
+
   // TODO(@monkeynova): Check class_int_restrict_list with a dummy
   // Solution that looks for class requests on other values.
 
@@ -69,6 +115,42 @@ class Solver {
         SolutionFilter(std::move(name), predicate, std::move(class_to_entry)));
   }
 
+  // Add predicate with the constraint that only the values of `cells` are
+  // used by this filter. Classes with a single cell allow skipping as with
+  // `class_to_entry` above, and permuters which work per cell may check the
+  // predicate as soon as those cells are known.
+  absl::Status AddPredicate(std::string name, SolutionView::Predicate predicate,
+                            std::vector<Cell> cells) {
+    return AddFilter(
+        SolutionFilter(std::move(name), predicate, std::move(cells)));
+  }
+
+  // Adds the predicate `s.Id(entry_id).Class(class_int) == value` (or `!=` if
+  // `equal` is false). Equivalent to the corresponding
+  // AddSpecificEntryPredicate call, but permuters which recognize the form
+  // may apply it without evaluating a predicate per permutation.
+  absl::Status AddEntryValuePredicate(std::string name, int entry_id,
+                                      int class_int, int value, bool equal);
+
+  // Adds the predicate that the values of `cells` are pairwise different.
+  // Equivalent to adding a `!=` predicate for each pair of `cells`, but
+  // permuters which recognize the form may propagate it directly. Pairs which
+  // are different by construction (cells of the same class) or which were
+  // covered by an earlier call do not get another predicate.
+  absl::Status AddAllDifferentPredicate(std::string name,
+                                        std::vector<Cell> cells);
+
+  // Adds `constraint`, an expression such as
+  // `expr::Id(0).Class(1) != expr::Id(2).Class(1)` (see expression.h). A
+  // conjunction is added as each of its conjuncts. Forms with a dedicated
+  // entry point are added through it: a cell compared with a constant
+  // becomes AddEntryValuePredicate calls (one `!=` per value excluded by
+  // `<`, `<=`, `>` or `>=`), and `!=` between cells becomes
+  // AddAllDifferentPredicate. Otherwise the constraint is added as a
+  // predicate on the cells it reads. A constraint identical to one added
+  // before is skipped.
+  absl::Status AddConstraint(std::string name, const Constraint& constraint);
+
   int test_calls() const { return test_calls_; }
 
   std::string DebugStatistics() const;
@@ -124,7 +206,34 @@ class Solver {
 
  private:
   absl::Status AddFilter(SolutionFilter solution_filter);
+  absl::Status AddFilter(int alternate_id, SolutionFilter solution_filter);
   absl::StatusOr<AlternateId> PrepareAndChooseAlternate();
+  // Implements PrepareAndChooseAlternate for
+  // --puzzle_alternate_prepare_concurrently.
+  absl::StatusOr<AlternateId> PrepareAlternatesConcurrently();
+
+  // Prepares, chooses an alternate and calls `on_match` with each solution of
+  // it (untransformed) until `on_match` returns false.
+  absl::Status VisitMatches(
+      absl::FunctionRef<bool(const SolutionView&)> on_match);
+
+  // Implements VisitMatches for --puzzle_alternate_portfolio by preparing and
+  // searching every alternate concurrently. The first alternate to find a
+  // match (or exhaust its search) becomes `chosen_alternate_` and the rest
+  // are cancelled. `on_match` is only called for the chosen alternate, but
+  // on a thread other than the caller's.
+  absl::Status RaceAlternates(
+      absl::FunctionRef<bool(const SolutionView&)> on_match);
+
+  // Records statistics for a search of `chosen_alternate_` begun at `start`.
+  void NoteSearchFinished(absl::Time start);
+
+  // Returns the status of `cancellation_` if it has been cancelled.
+  absl::Status CheckCancelled() const;
+
+  // Returns the pool with a thread per alternate on which alternates are
+  // prepared or raced concurrently, creating it on first use.
+  ::thread::Executor* AlternatePool();
 
   const EntryDescriptor entry_descriptor_;
 
@@ -135,9 +244,20 @@ class Solver {
 
   std::unique_ptr<Profiler> profiler_;
 
+  const Cancellation* cancellation_ = nullptr;
+
   std::optional<AlternateId> current_alternate_;
   std::vector<std::unique_ptr<SolutionPermuter>> alternates_;
+  // See AlternatePool. Declared after `alternates_` so it is destroyed
+  // before them.
+  std::unique_ptr<::thread::Pool> alternate_pool_;
   std::vector<std::vector<SolutionFilter>> residual_;
+  // Pairs of cells (by index entry_id * num_classes + class_int) covered by
+  // AddAllDifferentPredicate for each alternate.
+  std::vector<absl::flat_hash_set<std::pair<int, int>>> all_different_pairs_;
+  // Indexed by alternate. The DebugStrings of constraints added by
+  // AddConstraint.
+  std::vector<absl::flat_hash_set<std::string>> constraints_;
   AlternateId chosen_alternate_;
 
   std::vector<std::unique_ptr<puzzle::Descriptor>> descriptors_;
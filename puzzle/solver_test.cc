@@ -0,0 +1,390 @@
+#include "puzzle/solver.h"
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
+#include "absl/log/check.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "thread/pool.h"
+
+ABSL_DECLARE_FLAG(bool, puzzle_alternate_portfolio);
+ABSL_DECLARE_FLAG(bool, puzzle_alternate_prepare_concurrently);
+
+namespace puzzle {
+
+static EntryDescriptor MakeDescriptor(int num_entries, int num_classes) {
+  std::vector<std::unique_ptr<const Descriptor>> class_descriptors;
+  std::vector<std::string> class_names;
+  for (int i = 0; i < num_classes; ++i) {
+    class_descriptors.push_back(
+        absl::make_unique<IntRangeDescriptor>(num_entries));
+    class_names.push_back(absl::StrCat("c", i));
+  }
+  return EntryDescriptor(absl::make_unique<IntRangeDescriptor>(num_entries),
+                         absl::make_unique<StringDescriptor>(class_names),
+                         std::move(class_descriptors));
+}
+
+// Adds a predicate on every class which no solution satisfies, so that
+// searching for one visits every permutation.
+static void AddUnsatisfiable(Solver& solver, int num_classes) {
+  std::vector<int> classes;
+  for (int i = 0; i < num_classes; ++i) classes.push_back(i);
+  ASSERT_TRUE(solver
+                  .AddPredicate(
+                      "unsatisfiable",
+                      [](const SolutionView& s) {
+                        return s.Id(0).Class(0) == s.Id(1).Class(0);
+                      },
+                      classes)
+                  .ok());
+}
+
+// Adds a predicate satisfied by 24 of the 36 solutions of
+// MakeDescriptor(3, 2).
+static void AddEntryZeroDiffers(Solver& solver) {
+  ASSERT_TRUE(solver
+                  .AddPredicate(
+                      "differs",
+                      [](const SolutionView& s) {
+                        return s.Id(0).Class(0) != s.Id(0).Class(1);
+                      },
+                      {0, 1})
+                  .ok());
+}
+
+// Solver with a second alternate which records which alternate produced each
+// solution.
+class TwoAlternateSolver : public Solver {
+ public:
+  explicit TwoAlternateSolver(EntryDescriptor entry_descriptor)
+      : Solver(std::move(entry_descriptor)) {
+    absl::StatusOr<AlternateId> alternate = CreateAlternate();
+    CHECK(alternate.ok()) << alternate.status();
+    other_ = *alternate;
+  }
+
+  void SetOther() { SetAlternate(other_); }
+  void SetDefault() { SetAlternate(DefaultAlternate()); }
+  void SetAll() { SetAlternate(std::nullopt); }
+
+  std::optional<bool> transformed() const { return transformed_; }
+
+ private:
+  absl::StatusOr<OwnedSolution> TransformAlternate(
+      SolutionView in, AlternateId alternate) const override {
+    transformed_ = alternate == other_;
+    return OwnedSolution(in);
+  }
+
+  AlternateId other_;
+  mutable std::optional<bool> transformed_;
+};
+
+TEST(SolverTest, ForEachSolution) {
+  Solver solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(solver);
+  int visited = 0;
+  ASSERT_TRUE(solver
+                  .ForEachSolution([&](const SolutionView& s) {
+                    EXPECT_THAT(s.Id(0).Class(0),
+                                ::testing::Ne(s.Id(0).Class(1)));
+                    ++visited;
+                    return true;
+                  })
+                  .ok());
+  EXPECT_THAT(visited, 24);
+}
+
+TEST(SolverTest, ForEachSolutionStop) {
+  Solver solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(solver);
+  int visited = 0;
+  ASSERT_TRUE(solver
+                  .ForEachSolution([&](const SolutionView&) {
+                    return ++visited < 5;
+                  })
+                  .ok());
+  EXPECT_THAT(visited, 5);
+}
+
+TEST(SolverTest, CountSolutions) {
+  Solver solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(solver);
+  EXPECT_THAT(solver.CountSolutions(), absl::StatusOr<int64_t>(24));
+}
+
+TEST(SolverTest, CountSolutionsLimit) {
+  Solver solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(solver);
+  EXPECT_THAT(solver.CountSolutions(/*limit=*/10),
+              absl::StatusOr<int64_t>(10));
+}
+
+TEST(SolverTest, CountSolutionsThreads) {
+  Solver solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(solver);
+  EXPECT_THAT(solver.CountSolutions(/*limit=*/-1, /*num_threads=*/3),
+              absl::StatusOr<int64_t>(24));
+}
+
+TEST(SolverTest, CountSolutionsThreadsWithLimit) {
+  Solver solver(MakeDescriptor(3, 2));
+  EXPECT_FALSE(solver.CountSolutions(/*limit=*/10, /*num_threads=*/3).ok());
+}
+
+TEST(SolverTest, EstimateSolutionCount) {
+  Solver solver(MakeDescriptor(3, 2));
+  absl::StatusOr<Solver::CountEstimate> estimate =
+      solver.EstimateSolutionCount(/*num_samples=*/100, /*num_threads=*/2);
+  if (absl::IsUnimplemented(estimate.status())) {
+    GTEST_SKIP() << "Permuter does not support sampling";
+  }
+  ASSERT_TRUE(estimate.ok()) << estimate.status();
+  // Without filters every walk is exact.
+  EXPECT_THAT(estimate->count, 36);
+}
+
+TEST(SolverTest, AddConstraint) {
+  using ::puzzle::expr::Id;
+  Solver solver(MakeDescriptor(3, 2));
+  ASSERT_TRUE(
+      solver.AddConstraint("differs", Id(0).Class(0) != Id(0).Class(1)).ok());
+  EXPECT_THAT(solver.CountSolutions(), absl::StatusOr<int64_t>(24));
+}
+
+TEST(SolverTest, AddConstraintSameCell) {
+  using ::puzzle::expr::Id;
+  Solver solver(MakeDescriptor(3, 2));
+  ASSERT_TRUE(
+      solver.AddConstraint("never", Id(0).Class(0) != Id(0).Class(0)).ok());
+  EXPECT_THAT(solver.CountSolutions(), absl::StatusOr<int64_t>(0));
+}
+
+TEST(SolverTest, AddConstraintEntryValue) {
+  using ::puzzle::expr::Id;
+  Solver solver(MakeDescriptor(3, 2));
+  ASSERT_TRUE(solver.AddConstraint("value", Id(0).Class(0) == 1).ok());
+  EXPECT_THAT(solver.CountSolutions(), absl::StatusOr<int64_t>(12));
+}
+
+TEST(SolverTest, AddConstraintEntryRange) {
+  using ::puzzle::expr::Id;
+  Solver solver(MakeDescriptor(3, 2));
+  // Values 1 and 2 of 0..2.
+  ASSERT_TRUE(solver.AddConstraint("range", Id(0).Class(0) > 0).ok());
+  EXPECT_THAT(solver.CountSolutions(), absl::StatusOr<int64_t>(2 * 2 * 6));
+
+  Solver none(MakeDescriptor(3, 2));
+  ASSERT_TRUE(none.AddConstraint("none", 3 <= Id(0).Class(0)).ok());
+  EXPECT_THAT(none.CountSolutions(), absl::StatusOr<int64_t>(0));
+}
+
+TEST(SolverTest, AddConstraintConjuncts) {
+  using ::puzzle::expr::Id;
+  auto constraint = Id(0).Class(0) != Id(1).Class(1) &&
+                    Id(0).Class(1) + Id(1).Class(0) >= 2 && Id(2).Class(0) < 2;
+  Solver expected(MakeDescriptor(3, 2));
+  ASSERT_TRUE(expected
+                  .AddPredicate(
+                      "lambda",
+                      [](const SolutionView& s) {
+                        return s.Id(0).Class(0) != s.Id(1).Class(1) &&
+                               s.Id(0).Class(1) + s.Id(1).Class(0) >= 2 &&
+                               s.Id(2).Class(0) < 2;
+                      },
+                      {0, 1})
+                  .ok());
+  absl::StatusOr<int64_t> expected_count = expected.CountSolutions();
+  ASSERT_TRUE(expected_count.ok());
+  ASSERT_GT(*expected_count, 0);
+
+  Solver solver(MakeDescriptor(3, 2));
+  ASSERT_TRUE(solver.AddConstraint("expr", constraint).ok());
+  EXPECT_THAT(solver.CountSolutions(), expected_count);
+}
+
+TEST(SolverTest, AddConstraintMatchesPredicate) {
+  using ::puzzle::expr::Id;
+  auto constraint = Id(0).Class(0) + Id(1).Class(1) < Id(2).Class(0) ||
+                    Id(1).Class(0) == Id(2).Class(1);
+  Solver expected(MakeDescriptor(3, 2));
+  ASSERT_TRUE(expected
+                  .AddPredicate(
+                      "lambda",
+                      [](const SolutionView& s) {
+                        return s.Id(0).Class(0) + s.Id(1).Class(1) <
+                                   s.Id(2).Class(0) ||
+                               s.Id(1).Class(0) == s.Id(2).Class(1);
+                      },
+                      {0, 1})
+                  .ok());
+  absl::StatusOr<int64_t> expected_count = expected.CountSolutions();
+  ASSERT_TRUE(expected_count.ok());
+
+  Solver solver(MakeDescriptor(3, 2));
+  ASSERT_TRUE(solver.AddConstraint("expr", constraint).ok());
+  // Duplicates are skipped, which is only visible in the result if it were
+  // broken.
+  ASSERT_TRUE(solver.AddConstraint("expr again", constraint).ok());
+  EXPECT_THAT(solver.CountSolutions(), expected_count);
+}
+
+TEST(SolverTest, SolveAsync) {
+  Solver solver(MakeDescriptor(3, 2));
+  ASSERT_TRUE(solver
+                  .AddPredicate(
+                      "ordered",
+                      [](const SolutionView& s) {
+                        return s.Id(0).Class(0) == 2 && s.Id(1).Class(0) == 1 &&
+                               s.Id(0).Class(1) == 0 && s.Id(1).Class(1) == 2;
+                      },
+                      {0, 1})
+                  .ok());
+
+  ::thread::Pool pool(1);
+  std::unique_ptr<::thread::Future<absl::StatusOr<OwnedSolution>>> result =
+      solver.SolveAsync(&pool);
+  ASSERT_TRUE((*result)->ok()) << (*result)->status();
+  const SolutionView solution = (*result)->value().view();
+  EXPECT_THAT(solution.Id(2).Class(0), 0);
+  EXPECT_THAT(solution.Id(2).Class(1), 1);
+}
+
+TEST(SolverTest, CancelledBeforeSolve) {
+  Solver solver(MakeDescriptor(3, 2));
+  Cancellation cancellation;
+  cancellation.Cancel();
+  solver.set_cancellation(&cancellation);
+  EXPECT_TRUE(absl::IsCancelled(solver.Solve().status()));
+}
+
+TEST(SolverTest, Deadline) {
+  // 8!^5 permutations, which would take far longer than the test timeout to
+  // exhaust.
+  Solver solver(MakeDescriptor(8, 5));
+  AddUnsatisfiable(solver, 5);
+  Cancellation cancellation(absl::Now() + absl::Milliseconds(200));
+  solver.set_cancellation(&cancellation);
+
+  ::thread::Pool pool(1);
+  absl::Time start = absl::Now();
+  std::unique_ptr<::thread::Future<absl::StatusOr<OwnedSolution>>> result =
+      solver.SolveAsync(&pool);
+  EXPECT_TRUE(absl::IsDeadlineExceeded((*result)->status()))
+      << (*result)->status();
+  EXPECT_THAT(absl::Now() - start, ::testing::Lt(absl::Seconds(30)));
+}
+
+TEST(SolverTest, CancelWhileSearching) {
+  Solver solver(MakeDescriptor(8, 5));
+  AddUnsatisfiable(solver, 5);
+  Cancellation cancellation;
+  solver.set_cancellation(&cancellation);
+
+  ::thread::Pool pool(1);
+  std::unique_ptr<::thread::Future<absl::StatusOr<OwnedSolution>>> result =
+      solver.SolveAsync(&pool);
+  absl::SleepFor(absl::Milliseconds(100));
+  EXPECT_FALSE(result->has_value());
+  cancellation.Cancel();
+  EXPECT_TRUE(absl::IsCancelled((*result)->status())) << (*result)->status();
+}
+
+TEST(SolverTest, PortfolioCountSolutions) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_alternate_portfolio, true);
+  TwoAlternateSolver count_solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(count_solver);
+  EXPECT_THAT(count_solver.CountSolutions(), absl::StatusOr<int64_t>(24));
+
+  TwoAlternateSolver solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(solver);
+  int visited = 0;
+  ASSERT_TRUE(solver
+                  .ForEachSolution([&](const SolutionView& s) {
+                    EXPECT_THAT(s.Id(0).Class(0),
+                                ::testing::Ne(s.Id(0).Class(1)));
+                    ++visited;
+                    return true;
+                  })
+                  .ok());
+  EXPECT_THAT(visited, 24);
+}
+
+TEST(SolverTest, PortfolioCancelsLoser) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_alternate_portfolio, true);
+  // Only the default alternate is slow, so the other must win and cancel it.
+  TwoAlternateSolver solver(MakeDescriptor(8, 5));
+  solver.SetDefault();
+  AddUnsatisfiable(solver, 5);
+  solver.SetAll();
+
+  absl::Time start = absl::Now();
+  absl::StatusOr<OwnedSolution> solution = solver.Solve();
+  ASSERT_TRUE(solution.ok()) << solution.status();
+  EXPECT_THAT(solver.transformed(), ::testing::Optional(true));
+  EXPECT_THAT(absl::Now() - start, ::testing::Lt(absl::Seconds(30)));
+}
+
+TEST(SolverTest, PortfolioDeadline) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_alternate_portfolio, true);
+  TwoAlternateSolver solver(MakeDescriptor(8, 5));
+  AddUnsatisfiable(solver, 5);
+  Cancellation cancellation(absl::Now() + absl::Milliseconds(200));
+  solver.set_cancellation(&cancellation);
+
+  absl::Time start = absl::Now();
+  EXPECT_TRUE(absl::IsDeadlineExceeded(solver.Solve().status()));
+  EXPECT_THAT(absl::Now() - start, ::testing::Lt(absl::Seconds(30)));
+}
+
+TEST(SolverTest, ConcurrentPrepareCountSolutions) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_alternate_prepare_concurrently, true);
+  TwoAlternateSolver solver(MakeDescriptor(3, 2));
+  AddEntryZeroDiffers(solver);
+  EXPECT_THAT(solver.CountSolutions(), absl::StatusOr<int64_t>(24));
+}
+
+TEST(SolverTest, ConcurrentPrepareChoosesMostSelective) {
+  for (bool concurrently : {false, true}) {
+    absl::FlagSaver flag_saver;
+    absl::SetFlag(&FLAGS_puzzle_alternate_prepare_concurrently, concurrently);
+    TwoAlternateSolver solver(MakeDescriptor(3, 2));
+    AddEntryZeroDiffers(solver);
+    solver.SetOther();
+    ASSERT_TRUE(solver
+                    .AddPredicate(
+                        "first", [](const SolutionView& s) {
+                          return s.Id(0).Class(0) == 0;
+                        },
+                        {0})
+                    .ok());
+    solver.SetAll();
+    int visited = 0;
+    ASSERT_TRUE(solver
+                    .ForEachSolution([&](const SolutionView&) {
+                      ++visited;
+                      return true;
+                    })
+                    .ok());
+    EXPECT_THAT(visited, 8) << concurrently;
+    EXPECT_THAT(solver.transformed(), ::testing::Optional(true))
+        << concurrently;
+  }
+}
+
+TEST(SolverTest, ConcurrentPrepareDeadline) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_alternate_prepare_concurrently, true);
+  TwoAlternateSolver solver(MakeDescriptor(3, 2));
+  Cancellation cancellation(absl::Now() - absl::Seconds(1));
+  solver.set_cancellation(&cancellation);
+  EXPECT_TRUE(absl::IsDeadlineExceeded(solver.Solve().status()));
+}
+
+}  // namespace puzzle
@@ -4,55 +4,118 @@
 #include "absl/flags/flag.h"
 #include "absl/flags/usage.h"
 #include "absl/strings/str_cat.h"
+#include "ken_ken/grid.h"
 #include "main_lib.h"
-#include "sudoku/sudoku.h"
 
-ABSL_FLAG(int, solutions, 1000,
-          "The number of sudoku solutions to compute to estimate the "
-          "percentage of soution boards.");
+ABSL_FLAG(int, width, 9,
+          "Width of the sudoku boards to count. Valid values are 4 (2x2 "
+          "boxes), 6 (2x3 boxes) and 9 (3x3 boxes).");
+
+ABSL_FLAG(std::string, mode, "auto",
+          "How to count the boards. 'exact' enumerates every board, 'sample' "
+          "estimates the count from random walks down the search tree, and "
+          "'auto' is 'exact' for widths below 9 and 'sample' otherwise.");
+
+ABSL_FLAG(int, samples, 1000,
+          "The number of random walks used to estimate the count in 'sample' "
+          "mode.");
+
+ABSL_FLAG(int, threads, 4,
+          "The number of threads used to count or sample boards.");
 
 extern absl::Flag<bool> FLAGS_puzzle_prune_pair_class_iterators;
 
-class EmptySudoku : public sudoku::Sudoku {
- public:
-  absl::StatusOr<Board> GetInstanceBoard() const override {
-    return EmptyBoard();
+// Sudoku board of width `kWidth` with boxes `kBoxHeight` rows high and no
+// givens.
+template <int64_t kWidth, int kBoxHeight>
+class EmptySudoku : public ken_ken::Grid<kWidth> {
+ private:
+  using Base = ken_ken::Grid<kWidth>;
+  using typename Base::Board;
+  using typename Base::Box;
+  using typename Base::Orientation;
+
+  static constexpr int kBoxWidth = kWidth / kBoxHeight;
+  static_assert(kBoxWidth * kBoxHeight == kWidth, "Boxes must tile a row");
+
+  absl::Status AddGridPredicates(Orientation o) override {
+    const int boxes_per_row = kWidth / kBoxWidth;
+    for (int box = 0; box < kWidth; ++box) {
+      std::vector<Box> boxes;
+      for (int i = 0; i < kWidth; ++i) {
+        Box b = {
+            .entry_id = kBoxHeight * (box / boxes_per_row) + i / kBoxWidth,
+            .class_id = kBoxWidth * (box % boxes_per_row) + i % kBoxWidth};
+        if (o == Orientation::kTranspose) b.Transpose();
+        boxes.push_back(b);
+      }
+      RETURN_IF_ERROR(this->AddAllDifferentPredicate(
+          absl::StrCat("No box dupes ", box + 1), Base::ToCells(boxes)));
+    }
+    return absl::OkStatus();
   }
+
   absl::StatusOr<Board> GetSolutionBoard() const override {
-    return EmptyBoard();
+    return absl::UnimplementedError("Empty boards have no single solution");
   }
 };
 
+template <int64_t kWidth, int kBoxHeight>
+static void Count() {
+  std::string mode = absl::GetFlag(FLAGS_mode);
+  if (mode == "auto") mode = kWidth < 9 ? "exact" : "sample";
+  QCHECK(mode == "exact" || mode == "sample") << "Bad --mode: " << mode;
+
+  if (mode == "sample") {
+    // Pruning pair class iterators with an empty board involves basically
+    // solving all sudoku problems before being able to return any. For
+    // estimation purposes we disable this pessimization.
+    absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators, false);
+  }
+
+  EmptySudoku<kWidth, kBoxHeight> empty_sudoku;
+  absl::Status setup_status = empty_sudoku.Setup();
+  QCHECK(setup_status.ok()) << setup_status;
+
+  const int num_threads = absl::GetFlag(FLAGS_threads);
+  if (mode == "exact") {
+    absl::StatusOr<int64_t> count =
+        empty_sudoku.CountSolutions(/*limit=*/-1, num_threads);
+    QCHECK(count.ok()) << count.status();
+    std::cout << *count << std::endl;
+    return;
+  }
+
+  absl::StatusOr<puzzle::Solver::CountEstimate> estimate =
+      empty_sudoku.EstimateSolutionCount(absl::GetFlag(FLAGS_samples),
+                                         num_threads);
+  QCHECK(estimate.ok()) << estimate.status();
+  std::cout << estimate->count << " +/- " << estimate->standard_error << " ("
+            << estimate->samples << " samples)" << std::endl;
+}
+
 int main(int argc, char** argv) {
   std::vector<char*> args = InitMain(
       argc, argv,
-      absl::StrCat("Estimates the number of total sudoku solution boards. No "
-                   "arguments are allowed. Usage:\n",
+      absl::StrCat("Counts or estimates the number of total sudoku solution "
+                   "boards. No arguments are allowed. Usage:\n",
                    argv[0]));
   QCHECK_EQ(args.size(), 1) << "Extra argument!" << std::endl
                             << absl::ProgramUsageMessage();
 
-  // Pruning pair class iterators with an empty board involves basically
-  // solving all sudoku problems before being able to return any. For
-  // estimation purposes we disable this pessimization.
-  absl::SetFlag(&FLAGS_puzzle_prune_pair_class_iterators, false);
-
-  auto empty_sudoku = absl::WrapUnique<puzzle::Problem>(new EmptySudoku());
-  absl::Status setup_status = empty_sudoku->Setup();
-  QCHECK(setup_status.ok()) << setup_status;
-
-  const int num_solutions = absl::GetFlag(FLAGS_solutions);
-  absl::StatusOr<std::vector<puzzle::OwnedSolution>> solutions =
-      empty_sudoku->AllSolutions(num_solutions);
-  QCHECK(solutions.ok()) << solutions.status();
-  QCHECK_EQ(solutions->size(), num_solutions);
-
-  int i = num_solutions;
-  const auto& solution = solutions->at(i - 1);
-  QCHECK(solution.IsValid());
-  puzzle::Position position = solution.position();
-  std::cout << position.position << " of " << position.count << " => "
-            << (position.count * i / (position.position + 1)) << std::endl;
+  switch (absl::GetFlag(FLAGS_width)) {
+    case 4:
+      Count<4, 2>();
+      break;
+    case 6:
+      Count<6, 2>();
+      break;
+    case 9:
+      Count<9, 3>();
+      break;
+    default:
+      LOG(QFATAL) << "Unsupported --width: " << absl::GetFlag(FLAGS_width);
+  }
 
   return 0;
 }
@@ -24,25 +24,10 @@ absl::Status GreaterThanSudoku::AddComparison(const std::pair<Box, Box>& cmp) {
     return absl::InvalidArgumentError(
         "Comparisons must be with in a box (class)");
   }
-  if (cmp.first.entry_id == cmp.second.entry_id) {
-    return AddSpecificEntryPredicate(
-        absl::StrCat(cmp.first, " > ", cmp.second),
-        [cmp](const puzzle::Entry& e) {
-          return e.Class(cmp.first.class_id) > e.Class(cmp.second.class_id);
-        },
-        {cmp.first.class_id, cmp.second.class_id}, cmp.first.entry_id);
-  }
-  if (cmp.first.class_id != cmp.second.class_id) {
-    return absl::InvalidArgumentError(
-        "Comparison must be on neighboring boxes");
-  }
-  return AddPredicate(
-      absl::StrCat(cmp.first, " > ", cmp.second),
-      [cmp](const puzzle::SolutionView& s) {
-        return s.Id(cmp.first.entry_id).Class(cmp.first.class_id) >
-               s.Id(cmp.second.entry_id).Class(cmp.second.class_id);
-      },
-      {cmp.first.class_id});
+  using ::puzzle::expr::Id;
+  return AddConstraint(absl::StrCat(cmp.first, " > ", cmp.second),
+                       Id(cmp.first.entry_id).Class(cmp.first.class_id) >
+                           Id(cmp.second.entry_id).Class(cmp.second.class_id));
 }
 
 absl::Status GreaterThanSudoku::InstanceSetup(
@@ -121,15 +106,13 @@ absl::Status GreaterThanSudoku::AddRangePredicates(
 
     int prev_size = prev.size();
     int next_size = next.size();
-    RETURN_IF_ERROR(AddSpecificEntryPredicate(
+    // Class is 0-indexed.
+    const ::puzzle::expr::CellValue cell =
+        ::puzzle::expr::Id(b.entry_id).Class(b.class_id);
+    RETURN_IF_ERROR(AddConstraint(
         absl::StrCat("(", b.entry_id, ",", b.class_id, ") chain; ",
                      "prev=", prev_size, "; next=", next_size),
-        [b, prev_size, next_size](const puzzle::Entry& e) {
-          // Class is 0-indexed.
-          return e.Class(b.class_id) >= prev_size &&
-                 e.Class(b.class_id) <= 8 - next_size;
-        },
-        {b.class_id}, b.entry_id));
+        cell >= prev_size && cell <= 8 - next_size));
   }
 
   return absl::OkStatus();
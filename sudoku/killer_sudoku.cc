@@ -15,18 +15,6 @@ absl::Status KillerSudoku::AddCage(const Cage& cage) {
   if (cage.boxes.empty()) {
     return absl::InvalidArgumentError("cage cannot be empty");
   }
-  absl::flat_hash_map<int, int> class_to_entry;
-  for (const Box& box : cage.boxes) {
-    auto it = class_to_entry.find(box.class_id);
-    if (it == class_to_entry.end()) {
-      class_to_entry.emplace(box.class_id, box.entry_id);
-    } else {
-      // If a predicate uses multiple entries for a class, there isn't a skip
-      // model that captures that.
-      it->second = puzzle::Entry::kBadId;
-    }
-  }
-
   if (absl::GetFlag(FLAGS_sudoku_killer_composition)) {
     std::vector<int> count_by_entry(9, 0);
     std::vector<int> count_by_class(9, 0);
@@ -54,25 +42,21 @@ absl::Status KillerSudoku::AddCage(const Cage& cage) {
           std::max(count_by_entry[box.entry_id], count_by_class[box.class_id]);
       int max_cage_val = cage.expected_sum - (min_cage - biggest_remove);
       if (max_cage_val < 9) {
-        RETURN_IF_ERROR(AddSpecificEntryPredicate(
+        // Value is 0 indexed.
+        RETURN_IF_ERROR(AddConstraint(
             absl::StrCat("Cage max for ", box, " = ", max_cage_val),
-            [box, max_cage_val](const puzzle::Entry& e) {
-              // Value is 0 indexed.
-              return e.Class(box.class_id) <= max_cage_val - 1;
-            },
-            {box.class_id}, box.entry_id));
+            puzzle::expr::Id(box.entry_id).Class(box.class_id) <=
+                max_cage_val - 1));
       }
 
       int smallest_remove = 9 + 1 - biggest_remove;
       int min_cage_val = cage.expected_sum - (max_cage - smallest_remove);
       if (min_cage_val > 1) {
-        RETURN_IF_ERROR(AddSpecificEntryPredicate(
+        // Value is 0 indexed.
+        RETURN_IF_ERROR(AddConstraint(
             absl::StrCat("Cage min for ", box, " = ", min_cage_val),
-            [box, min_cage_val](const puzzle::Entry& e) {
-              // Value is 0 indexed.
-              return e.Class(box.class_id) >= min_cage_val - 1;
-            },
-            {box.class_id}, box.entry_id));
+            puzzle::expr::Id(box.entry_id).Class(box.class_id) >=
+                min_cage_val - 1));
       }
     }
 
@@ -81,17 +65,12 @@ absl::Status KillerSudoku::AddCage(const Cage& cage) {
     // constraints.
   }
 
-  return AddPredicate(
+  // Solution values are 0-indexed, rather than 1-indexed like the sum.
+  return AddConstraint(
       absl::StrCat("Sum around ", cage.boxes[0], " = ", cage.expected_sum),
-      [cage](const puzzle::SolutionView& s) {
-        // Solution values are 0-indexed, rather than 1-indexed like the sum.
-        int sum = cage.boxes.size();
-        for (const Box& box : cage.boxes) {
-          sum += s.Id(box.entry_id).Class(box.class_id);
-        }
-        return sum == cage.expected_sum;
-      },
-      std::move(class_to_entry));
+      puzzle::expr::Sum(ToCells(cage.boxes)) +
+              static_cast<int>(cage.boxes.size()) ==
+          cage.expected_sum);
 }
 
 absl::Status KillerSudoku::InstanceSetup(
@@ -1,37 +1,92 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <vector>
 
+#include "absl/flags/flag.h"
 #include "absl/flags/usage.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "absl/time/time.h"
 #include "main_lib.h"
 #include "sudoku/line_board.h"
+#include "sudoku/multi_line_solver.h"
 
-class Stats {
+ABSL_FLAG(int, threads, 1,
+          "Number of boards to solve concurrently. Results are still "
+          "written in input order.");
+
+ABSL_FLAG(int, max_in_flight, 0,
+          "If --threads is greater than 1, the maximum number of boards which "
+          "have been read but whose results have not yet been written. If "
+          "not positive, 4 per thread is used.");
+
+// Tracks per-board solve times to report throughput and latency percentiles.
+// Solve times are counted in logarithmic buckets, so memory and the cost of
+// ToString are fixed however many boards are added.
+class ThroughputStats {
  public:
-  Stats() = default;
+  explicit ThroughputStats(absl::Time start) : start_(start) {}
 
-  void Add(int point) {
-    max_ = std::max(point, max_);
-    min_ = std::min(point, min_);
+  void Add(absl::Duration solve_time) {
     ++count_;
-    sum_ += point;
+    ++buckets_[Bucket(solve_time)];
+  }
+
+  int64_t count() const { return count_; }
+
+  // Boards completed per second of wall time since `start`.
+  double BoardsPerSecond(absl::Time now) const {
+    double seconds = absl::ToDoubleSeconds(now - start_);
+    return seconds > 0 ? count() / seconds : 0;
   }
 
-  int min() const { return min_; }
-  int max() const { return max_; }
-  int avg() const { return sum_ / count_; }
+  // Returns the solve time at `percentile` (in [0, 100]), rounded up to the
+  // upper bound of its bucket (within 1/kBucketsPerDoubling of a doubling).
+  absl::Duration Percentile(double percentile) const {
+    if (count_ == 0) return absl::ZeroDuration();
+    const int64_t rank = static_cast<int64_t>((count_ - 1) * percentile / 100);
+    int64_t seen = 0;
+    for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+      seen += buckets_[bucket];
+      if (seen > rank) return UpperBound(bucket);
+    }
+    return UpperBound(kNumBuckets - 1);
+  }
 
-  template <typename Sink>
-  friend void AbslStringify(Sink& s, const Stats& st) {
-    absl::Format(&s, "%d/%d/%d (%d)", st.min(), st.avg(), st.max(), st.count_);
+  std::string ToString(absl::Time now) const {
+    return absl::StrFormat(
+        "%d boards; %.1f boards/s; p50 %.1fms; p99 %.1fms", count(),
+        BoardsPerSecond(now), absl::ToDoubleMilliseconds(Percentile(50)),
+        absl::ToDoubleMilliseconds(Percentile(99)));
   }
 
  private:
-  int min_ = std::numeric_limits<int>::max();
-  int max_ = std::numeric_limits<int>::min();
-  int count_ = 0;
-  int sum_ = 0;
+  // Bucket 0 holds times up to kMinTime, and each bucket after covers a
+  // factor of 2^(1 / kBucketsPerDoubling), so the last ends at a little over
+  // an hour.
+  static constexpr int kBucketsPerDoubling = 8;
+  static constexpr int kNumBuckets = 32 * kBucketsPerDoubling + 1;
+  static constexpr absl::Duration kMinTime = absl::Microseconds(1);
+
+  static int Bucket(absl::Duration solve_time) {
+    if (solve_time <= kMinTime) return 0;
+    const int bucket = static_cast<int>(std::ceil(
+        std::log2(solve_time / kMinTime) * kBucketsPerDoubling));
+    return std::clamp(bucket, 0, kNumBuckets - 1);
+  }
+
+  static absl::Duration UpperBound(int bucket) {
+    return kMinTime *
+           std::exp2(static_cast<double>(bucket) / kBucketsPerDoubling);
+  }
+
+  absl::Time start_;
+  int64_t count_ = 0;
+  std::array<int64_t, kNumBuckets> buckets_ = {};
 };
 
 int main(int argc, char** argv) {
@@ -42,38 +97,41 @@ int main(int argc, char** argv) {
                             << absl::ProgramUsageMessage();
 
   int exit_code = 0;
-  Stats time_stats;
+  ThroughputStats stats(absl::Now());
 
   absl::Time last_flush = absl::Now();
 
-  for (std::string buf; std::getline(std::cin, buf);) {
-    LOG(INFO) << "In:  " << buf;
-    absl::Time start = absl::Now();
-    ::sudoku::LineBoard line_board(buf);
-
-    absl::Status setup_status = line_board.Setup();
-    QCHECK(setup_status.ok()) << setup_status;
-
-    absl::StatusOr<::puzzle::OwnedSolution> answer = line_board.Solve();
-    QCHECK(answer.ok()) << answer.status();
-    if (answer->IsValid()) {
-      absl::Time done = absl::Now();
-      int solve_ms = (done - start) / absl::Milliseconds(1);
-      time_stats.Add(solve_ms);
-      if (done - last_flush > absl::Milliseconds(250)) {
-        std::cout << absl::StreamFormat("\033[1K\r%v", time_stats)
-                  << std::flush;
-        last_flush = done;
-      }
-
-      LOG(INFO) << "Out: " << ::sudoku::LineBoard::ToString(answer->view())
-                << " (" << solve_ms << "ms)";
-    } else {
-      LOG(ERROR) << "No answer found";
-      exit_code = 1;
-    }
-  }
-  std::cout << std::endl;
+  ::sudoku::MultiLineSolver solver(absl::GetFlag(FLAGS_threads),
+                                   absl::GetFlag(FLAGS_max_in_flight));
+  absl::Status st = solver.SolveStream(
+      [](std::string* line) {
+        if (!std::getline(std::cin, *line)) return false;
+        LOG(INFO) << "In:  " << *line;
+        return true;
+      },
+      [&](int index, absl::string_view line,
+          ::sudoku::MultiLineSolver::Result result) {
+        if (!result.solution.ok()) return result.solution.status();
+        if (!result.solution->IsValid()) {
+          LOG(ERROR) << "No answer found: " << line;
+          exit_code = 1;
+          return absl::OkStatus();
+        }
+        stats.Add(result.solve_time);
+        absl::Time now = absl::Now();
+        if (now - last_flush > absl::Milliseconds(250)) {
+          std::cout << "\033[1K\r" << stats.ToString(now) << std::flush;
+          last_flush = now;
+        }
+
+        LOG(INFO) << "Out: "
+                  << ::sudoku::LineBoard::ToString(result.solution->view())
+                  << " (" << result.solve_time / absl::Milliseconds(1)
+                  << "ms)";
+        return absl::OkStatus();
+      });
+  QCHECK(st.ok()) << st;
+  std::cout << "\033[1K\r" << stats.ToString(absl::Now()) << std::endl;
 
   return exit_code;
 }
@@ -0,0 +1,103 @@
+#include "sudoku/multi_line_solver.h"
+
+#include <deque>
+
+#include "sudoku/line_board.h"
+#include "thread/future.h"
+
+namespace sudoku {
+
+MultiLineSolver::MultiLineSolver(int num_threads, int max_in_flight)
+    : max_in_flight_(max_in_flight > 0 ? max_in_flight : 4 * num_threads) {
+  if (num_threads > 1) {
+    pool_ = std::make_unique<::thread::Pool>(num_threads);
+  }
+}
+
+absl::StatusOr<puzzle::OwnedSolution> MultiLineSolver::Solve(
+    absl::string_view line) const {
+  LineBoard board(line);
+  RETURN_IF_ERROR(board.Setup());
+  return board.Solve();
+}
+
+MultiLineSolver::Result MultiLineSolver::TimedSolve(
+    absl::string_view line) const {
+  absl::Time start = absl::Now();
+  Result ret;
+  ret.solution = Solve(line);
+  ret.solve_time = absl::Now() - start;
+  return ret;
+}
+
+absl::Status MultiLineSolver::SolveAll(
+    absl::Span<const std::string> lines,
+    absl::FunctionRef<absl::Status(
+        int index, absl::StatusOr<puzzle::OwnedSolution> result)>
+        on_result) const {
+  int next = 0;
+  return SolveStream(
+      [&](std::string* line) {
+        if (next >= lines.size()) return false;
+        *line = lines[next++];
+        return true;
+      },
+      [&](int index, absl::string_view line, Result result) {
+        return on_result(index, std::move(result.solution));
+      });
+}
+
+absl::Status MultiLineSolver::SolveStream(
+    absl::FunctionRef<bool(std::string* line)> next_line,
+    absl::FunctionRef<absl::Status(int index, absl::string_view line,
+                                   Result result)>
+        on_result) const {
+  if (pool_ == nullptr) {
+    std::string line;
+    for (int index = 0; next_line(&line); ++index) {
+      RETURN_IF_ERROR(on_result(index, line, TimedSolve(line)));
+    }
+    return absl::OkStatus();
+  }
+
+  struct InFlight {
+    int index;
+    std::string line;
+    std::unique_ptr<::thread::Future<Result>> result;
+  };
+  // Ordered by index. Only the front is ever reported, which keeps results
+  // in input order regardless of which board finishes first.
+  std::deque<InFlight> in_flight;
+  absl::Status status;
+  auto report_front = [&]() {
+    InFlight front = std::move(in_flight.front());
+    in_flight.pop_front();
+    Result result = std::move(*front.result).WaitForAndConsumeValue();
+    if (status.ok()) {
+      status = on_result(front.index, front.line, std::move(result));
+    }
+  };
+
+  std::string line;
+  for (int index = 0; status.ok() && next_line(&line); ++index) {
+    in_flight.push_back(InFlight{
+        index, line,
+        pool_->ScheduleFuture([this, line]() { return TimedSolve(line); })});
+    while (in_flight.size() >= max_in_flight_) {
+      report_front();
+    }
+    // Stream out anything already finished without waiting for the window to
+    // fill.
+    while (status.ok() && !in_flight.empty() &&
+           in_flight.front().result->has_value()) {
+      report_front();
+    }
+  }
+  // Wait for (and, unless `on_result` failed, report) the remaining boards.
+  while (!in_flight.empty()) {
+    report_front();
+  }
+  return status;
+}
+
+}  // namespace sudoku
@@ -0,0 +1,81 @@
+#ifndef SUDOKU_MULTI_LINE_SOLVER_H
+#define SUDOKU_MULTI_LINE_SOLVER_H
+
+#include <memory>
+#include <string>
+
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "puzzle/base/owned_solution.h"
+#include "thread/pool.h"
+
+namespace sudoku {
+
+// Solves many sudoku boards given in the single line format accepted by
+// LineBoard.
+//
+// Each board is set up and prepared from scratch as a LineBoard. Clues are
+// added as entry value predicates, which are applied from the process-wide
+// ValueToActiveSet tables rather than by scanning every permutation of every
+// class, but nothing else built for one board is reused by the next.
+//
+// TODO: Batch solving with a prepared skeleton, which builds the
+// board-independent FilterToActiveSet state once and applies each board's
+// clues as deltas, is not done. Preparing takes most of each board's time,
+// but none of it is board-independent: every row and box predicate is a pair
+// predicate, and pair active sets can only be built once the clues have
+// narrowed the single class active sets.
+//
+// Solve, SolveAll and SolveStream are thread-safe.
+class MultiLineSolver {
+ public:
+  struct Result {
+    absl::StatusOr<puzzle::OwnedSolution> solution;
+    // Time spent solving the board, excluding any time spent queued.
+    absl::Duration solve_time;
+  };
+
+  // If `num_threads` is greater than 1, SolveAll and SolveStream solve boards
+  // concurrently on a pool of `num_threads` threads, with at most
+  // `max_in_flight` boards read but not yet passed back to the caller. If
+  // `max_in_flight` is not positive, 4 per thread is used.
+  explicit MultiLineSolver(int num_threads = 1, int max_in_flight = 0);
+
+  MultiLineSolver(const MultiLineSolver&) = delete;
+  MultiLineSolver& operator=(const MultiLineSolver&) = delete;
+
+  absl::StatusOr<puzzle::OwnedSolution> Solve(absl::string_view line) const;
+
+  // Solves each element of `lines` in order, passing its index and result to
+  // `on_result`. Returns the first error returned by `on_result`, if any.
+  absl::Status SolveAll(
+      absl::Span<const std::string> lines,
+      absl::FunctionRef<absl::Status(
+          int index, absl::StatusOr<puzzle::OwnedSolution> result)>
+          on_result) const;
+
+  // Reads boards from `next_line` until it returns false and passes each,
+  // along with its index and result, to `on_result` in input order. Reading
+  // continues while earlier boards are being solved. If `on_result` returns
+  // an error, no further boards are read or reported and that error is
+  // returned.
+  absl::Status SolveStream(
+      absl::FunctionRef<bool(std::string* line)> next_line,
+      absl::FunctionRef<absl::Status(int index, absl::string_view line,
+                                     Result result)>
+          on_result) const;
+
+ private:
+  Result TimedSolve(absl::string_view line) const;
+
+  int max_in_flight_;
+  std::unique_ptr<::thread::Pool> pool_;
+};
+
+}  // namespace sudoku
+
+#endif  // SUDOKU_MULTI_LINE_SOLVER_H
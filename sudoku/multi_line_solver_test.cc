@@ -0,0 +1,137 @@
+#include "sudoku/multi_line_solver.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sudoku/line_board.h"
+
+ABSL_DECLARE_FLAG(bool, puzzle_prune_entry_value_predicates);
+
+namespace sudoku {
+
+struct BoardAndAnswer {
+  std::string board;
+  std::string answer;
+};
+
+static std::vector<BoardAndAnswer> TestBoards() {
+  return {
+      {"...2...39.1.8......7........6..1.4..3......2.....5........7.1..2..3....."
+       "4........",
+       "845261739913847265672539814768912453359784621124653978536478192281396"
+       "547497125386"},
+      {"...5..26.4.....3..7.........51....9.....4.....3.......68..7.........."
+       "5.1...2.....",
+       "193587264425619378768423159851362497276941835934758612682175943347896"
+       "521519234786"},
+      {"5.6...4.7.9....3......1....2......8....4..6............349........5.."
+       ".2........1.",
+       "516823497892754361473619258249136785751498632368275149134982576687541"
+       "923925367814"},
+  };
+}
+
+TEST(MultiLineSolverTest, Solve) {
+  MultiLineSolver solver;
+  for (const BoardAndAnswer& test : TestBoards()) {
+    absl::StatusOr<puzzle::OwnedSolution> got = solver.Solve(test.board);
+    ASSERT_TRUE(got.ok()) << got.status();
+    EXPECT_EQ(LineBoard::ToString(got->view()), test.answer);
+  }
+}
+
+TEST(MultiLineSolverTest, SolveWithoutEntryValuePruning) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_prune_entry_value_predicates, false);
+
+  MultiLineSolver solver;
+  for (const BoardAndAnswer& test : TestBoards()) {
+    absl::StatusOr<puzzle::OwnedSolution> got = solver.Solve(test.board);
+    ASSERT_TRUE(got.ok()) << got.status();
+    EXPECT_EQ(LineBoard::ToString(got->view()), test.answer);
+  }
+}
+
+TEST(MultiLineSolverTest, SolveAllInOrder) {
+  std::vector<std::string> lines;
+  std::vector<std::string> expected;
+  for (const BoardAndAnswer& test : TestBoards()) {
+    lines.push_back(test.board);
+    expected.push_back(test.answer);
+  }
+
+  MultiLineSolver solver;
+  std::vector<std::string> got;
+  absl::Status st = solver.SolveAll(
+      lines, [&](int index, absl::StatusOr<puzzle::OwnedSolution> result) {
+        EXPECT_EQ(index, got.size());
+        if (!result.ok()) return result.status();
+        got.push_back(LineBoard::ToString(result->view()));
+        return absl::OkStatus();
+      });
+  ASSERT_TRUE(st.ok()) << st;
+  EXPECT_EQ(got, expected);
+}
+
+TEST(MultiLineSolverTest, SolveStreamThreadedInOrder) {
+  std::vector<std::string> lines;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 3; ++i) {
+    for (const BoardAndAnswer& test : TestBoards()) {
+      lines.push_back(test.board);
+      expected.push_back(test.answer);
+    }
+  }
+
+  MultiLineSolver solver(/*num_threads=*/3, /*max_in_flight=*/4);
+  int next = 0;
+  std::vector<std::string> got;
+  absl::Status st = solver.SolveStream(
+      [&](std::string* line) {
+        if (next >= lines.size()) return false;
+        *line = lines[next++];
+        return true;
+      },
+      [&](int index, absl::string_view line, MultiLineSolver::Result result) {
+        EXPECT_EQ(index, got.size());
+        EXPECT_EQ(line, lines[index]);
+        // Reading is bounded by the number of unreported boards.
+        EXPECT_LE(next - index, 4);
+        if (!result.solution.ok()) return result.solution.status();
+        got.push_back(LineBoard::ToString(result.solution->view()));
+        return absl::OkStatus();
+      });
+  ASSERT_TRUE(st.ok()) << st;
+  EXPECT_EQ(got, expected);
+}
+
+TEST(MultiLineSolverTest, SolveStreamStopsOnError) {
+  std::vector<BoardAndAnswer> boards = TestBoards();
+  MultiLineSolver solver(/*num_threads=*/2);
+  int next = 0;
+  int reported = 0;
+  absl::Status st = solver.SolveStream(
+      [&](std::string* line) {
+        if (next >= boards.size()) return false;
+        *line = boards[next++].board;
+        return true;
+      },
+      [&](int index, absl::string_view line, MultiLineSolver::Result result) {
+        ++reported;
+        return absl::CancelledError("stop");
+      });
+  EXPECT_TRUE(absl::IsCancelled(st)) << st;
+  EXPECT_EQ(reported, 1);
+}
+
+TEST(MultiLineSolverTest, BadLine) {
+  MultiLineSolver solver;
+  EXPECT_FALSE(solver.Solve("12345").ok());
+}
+
+}  // namespace sudoku
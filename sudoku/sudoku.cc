@@ -102,35 +102,15 @@ absl::Status Sudoku::AddPredicatesPairwise() {
     const int box_base_x = kSubHeight * (box / kSubHeight);
     const int box_base_y = kSubHeight * (box % kSubHeight);
 
+    std::vector<Cell> cells;
     for (int i = 0; i < kWidth; ++i) {
-      const int box_i_x = box_base_x + (i / kSubHeight);
-      const int box_i_y = box_base_y + (i % kSubHeight);
-
-      for (int j = i + 1; j < kWidth; ++j) {
-        const int box_j_x = box_base_x + (j / kSubHeight);
-        const int box_j_y = box_base_y + (j % kSubHeight);
-
-        if (box_i_x == box_j_x && box_i_y == box_j_y) {
-          return absl::InternalError("box iteration wonky");
-        }
-
-        // Handled by class permutation.
-        if (box_i_x == box_j_x) continue;
-
-        // Handled by row predicate.
-        if (box_i_y == box_j_y) continue;
-
-        RETURN_IF_ERROR(AddPredicate(
-            absl::StrCat("No box dupes (", box_i_x + 1, ",", box_i_y + 1,
-                         ") vs (", box_j_x + 1, ",", box_j_y + 1, ")"),
-            [box_i_x, box_i_y, box_j_x,
-             box_j_y](const puzzle::SolutionView& s) {
-              return s.Id(box_i_x).Class(box_i_y) !=
-                     s.Id(box_j_x).Class(box_j_y);
-            },
-            {{box_i_y, box_i_x}, {box_j_y, box_j_x}}));
-      }
+      cells.push_back({.entry_id = box_base_x + (i / kSubHeight),
+                       .class_int = box_base_y + (i % kSubHeight)});
     }
+    // Pairs sharing a row or column are skipped as already covered by the
+    // row predicates or class permutation.
+    RETURN_IF_ERROR(AddAllDifferentPredicate(
+        absl::StrCat("No box dupes ", box + 1), std::move(cells)));
   }
   return absl::OkStatus();
 }
@@ -140,11 +120,10 @@ absl::Status Sudoku::AddComposedValuePredicates(int row, int col, int value) {
                 "Need to handle transpose if not square");
   for (int i = 0; i < kWidth; ++i) {
     if (i == col) continue;
-    RETURN_IF_ERROR(AddSpecificEntryPredicate(
+    RETURN_IF_ERROR(AddEntryValuePredicate(
         absl::StrCat("(", row + 1, ",", col + 1, ")=", value, " AND ",
                      "No row dupes(", i + 1, ")"),
-        [i, value](const puzzle::Entry& e) { return e.Class(i) != value; }, {i},
-        row));
+        /*entry_id=*/row, /*class_int=*/i, value, /*equal=*/false));
   }
 
   int base_box_x = kSubHeight * (row / kSubHeight);
@@ -155,25 +134,22 @@ absl::Status Sudoku::AddComposedValuePredicates(int row, int col, int value) {
     if (test_box_x == row && test_box_y == col) {
       continue;
     }
-    RETURN_IF_ERROR(AddPredicate(
+    RETURN_IF_ERROR(AddEntryValuePredicate(
         absl::StrCat("(", row + 1, ",", col + 1, ")=", value, " AND ",
                      "No box dupes "
                      "(",
                      test_box_x + 1, ",", test_box_y + 1, ")"),
-        [test_box_x, test_box_y, value](const puzzle::SolutionView& s) {
-          return s.Id(test_box_x).Class(test_box_y) != value;
-        },
-        absl::flat_hash_map<int, int>{{test_box_y, test_box_x}}));
+        /*entry_id=*/test_box_x, /*class_int=*/test_box_y, value,
+        /*equal=*/false));
   }
 
   return absl::OkStatus();
 }
 
 absl::Status Sudoku::AddValuePredicate(int row, int col, int value) {
-  RETURN_IF_ERROR(AddSpecificEntryPredicate(
+  RETURN_IF_ERROR(AddEntryValuePredicate(
       absl::StrCat("(", row + 1, ",", col + 1, ") = ", value),
-      [col, value](const puzzle::Entry& e) { return e.Class(col) == value; },
-      {col}, row));
+      /*entry_id=*/row, /*class_int=*/col, value, /*equal=*/true));
 
   if (absl::GetFlag(FLAGS_sudoku_setup_composed_value_predicates)) {
     RETURN_IF_ERROR(AddComposedValuePredicates(row, col, value));
@@ -4,6 +4,7 @@
 
 #include "absl/flags/declare.h"
 #include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
 #include "absl/strings/str_join.h"
 #include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
@@ -17,6 +18,7 @@ ABSL_FLAG(bool, puzzle_test_unique, true,
 ABSL_DECLARE_FLAG(std::string, sudoku_problem_setup);
 ABSL_DECLARE_FLAG(bool, puzzle_prune_pair_class_iterators);
 ABSL_DECLARE_FLAG(bool, puzzle_prune_pair_class_iterators_mode_pair);
+ABSL_DECLARE_FLAG(bool, puzzle_parallel_search);
 
 TEST(Puzzle, RightAnswer) {
   std::unique_ptr<puzzle::Problem> problem = puzzle::Problem::GetInstance();
@@ -48,6 +50,24 @@ TEST(Puzzle, UniqueAnswer) {
                                   << solutions->at(1);
 }
 
+TEST(Puzzle, RightAnswerParallelSearch) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_puzzle_parallel_search, true);
+
+  std::unique_ptr<puzzle::Problem> problem = puzzle::Problem::GetInstance();
+  absl::Status setup_status = problem->Setup();
+  ASSERT_TRUE(setup_status.ok()) << setup_status;
+
+  absl::StatusOr<std::vector<puzzle::OwnedSolution>> got =
+      problem->AllSolutions(/*limit=*/2);
+  ASSERT_TRUE(got.ok()) << got.status();
+  ASSERT_EQ(got->size(), 1);
+  absl::StatusOr<puzzle::OwnedSolution> expected = problem->GetSolution();
+  ASSERT_TRUE(expected.ok()) << expected.status();
+
+  EXPECT_EQ(got->at(0), *expected);
+}
+
 static void SetFlag(bool val, absl::string_view label, absl::Flag<bool>* flag,
                     std::vector<std::string>* labels) {
   absl::SetFlag(flag, val);
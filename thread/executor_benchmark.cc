@@ -0,0 +1,38 @@
+#include "benchmark/benchmark.h"
+#include "thread/future.h"
+#include "thread/pool.h"
+#include "thread/work_stealing_pool.h"
+
+namespace thread {
+
+// Simulates the shape of PairFilterBurnDown: many small, independent units of
+// work scheduled from one thread and collected through a FutureSet.
+template <typename ExecutorType>
+static void BM_ScheduleFutureSet(benchmark::State& state) {
+  ExecutorType executor(state.range(0));
+  const int kWork = 1000;
+  for (auto _ : state) {
+    FutureSet<int> set;
+    for (int i = 0; i < kWork; ++i) {
+      executor.ScheduleFuture(&set, [i]() {
+        int ret = i;
+        for (int j = 0; j < 100; ++j) benchmark::DoNotOptimize(ret += j);
+        return ret;
+      });
+    }
+    while (set.WaitForAny() != nullptr) {
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kWork);
+}
+
+BENCHMARK_TEMPLATE(BM_ScheduleFutureSet, Pool)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ScheduleFutureSet, WorkStealingPool)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+
+}  // namespace thread
@@ -0,0 +1,147 @@
+#ifndef THREAD_WORK_STEALING_POOL_H
+#define THREAD_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "thread/executor.h"
+
+namespace thread {
+
+// Executor implementation that performs the desired computations within a
+// pool of threads, where each thread owns its own queue of work.
+//
+// Work scheduled from a pool thread is pushed to the front of that thread's
+// queue and popped from the front again (LIFO, for cache locality of nested
+// work). Work scheduled from outside the pool is spread round-robin over the
+// queues. A thread whose queue is empty steals the oldest work from the back
+// of another thread's queue. Unlike `Pool` there is no single lock that every
+// `Schedule` and every worker pop contend on.
+class WorkStealingPool : public Executor {
+ public:
+  explicit WorkStealingPool(int num_threads) {
+    queues_.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    pool_.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      pool_.emplace_back([this, i]() { Run(i); });
+    }
+  }
+
+  ~WorkStealingPool() override {
+    {
+      absl::MutexLock l(&idle_mu_);
+      done_.store(true);
+    }
+    for (auto& thread : pool_) {
+      if (thread.joinable()) thread.join();
+    }
+  }
+
+  void Schedule(Fn fn) override {
+    if (current_pool_ == this) {
+      Queue& queue = *queues_[current_index_];
+      absl::MutexLock l(&queue.mu);
+      queue.fns.push_front(std::move(fn));
+    } else {
+      Queue& queue = *queues_[next_queue_.fetch_add(1) % queues_.size()];
+      absl::MutexLock l(&queue.mu);
+      queue.fns.push_back(std::move(fn));
+    }
+    pending_.fetch_add(1);
+    if (sleeping_.load() > 0) {
+      // Wake a single sleeping thread rather than all of them.
+      absl::MutexLock l(&idle_mu_);
+      if (wakeups_ < sleeping_.load()) ++wakeups_;
+    }
+  }
+
+ private:
+  struct Queue {
+    absl::Mutex mu;
+    std::deque<Fn> fns ABSL_GUARDED_BY(mu);
+  };
+
+  bool WakeupOrDone() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(idle_mu_) {
+    return wakeups_ > 0 || done_.load();
+  }
+
+  // Pops from the front of `queues_[index]`, or steals from the back of
+  // another queue. Returns false if no work was found.
+  bool Next(int index, Fn* fn) {
+    {
+      Queue& queue = *queues_[index];
+      absl::MutexLock l(&queue.mu);
+      if (!queue.fns.empty()) {
+        *fn = std::move(queue.fns.front());
+        queue.fns.pop_front();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      Queue& victim = *queues_[(index + i) % queues_.size()];
+      absl::MutexLock l(&victim.mu);
+      if (!victim.fns.empty()) {
+        *fn = std::move(victim.fns.back());
+        victim.fns.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Run(int index) {
+    current_pool_ = this;
+    current_index_ = index;
+    while (true) {
+      Fn fn;
+      if (Next(index, &fn)) {
+        pending_.fetch_sub(1);
+        fn();
+        continue;
+      }
+      if (done_.load() && pending_.load() == 0) break;
+      sleeping_.fetch_add(1);
+      // Re-check after announcing we are about to sleep. A concurrent
+      // Schedule either observes `sleeping_` (and leaves a wakeup) or its
+      // increment of `pending_` is visible here.
+      if (pending_.load() == 0) {
+        absl::MutexLock l(&idle_mu_);
+        idle_mu_.Await(
+            absl::Condition(this, &WorkStealingPool::WakeupOrDone));
+        if (wakeups_ > 0) --wakeups_;
+      }
+      sleeping_.fetch_sub(1);
+    }
+    current_pool_ = nullptr;
+  }
+
+  // Identifies the pool (and queue index) of the current thread, if it is a
+  // pool thread, so nested Schedule calls stay on the local queue.
+  inline static thread_local const WorkStealingPool* current_pool_ = nullptr;
+  inline static thread_local int current_index_ = 0;
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::atomic<unsigned int> next_queue_ = 0;
+
+  // Number of scheduled but not yet started functions. Used only to decide
+  // whether idle threads should sleep.
+  std::atomic<int> pending_ = 0;
+  std::atomic<int> sleeping_ = 0;
+  std::atomic<bool> done_ = false;
+  absl::Mutex idle_mu_;
+  int wakeups_ ABSL_GUARDED_BY(idle_mu_) = 0;
+
+  std::vector<std::thread> pool_;
+};
+
+}  // namespace thread
+
+#endif  // THREAD_WORK_STEALING_POOL_H
@@ -0,0 +1,78 @@
+#include "thread/work_stealing_pool.h"
+
+#include "absl/synchronization/notification.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace thread {
+
+TEST(WorkStealingPoolTest, Trivial) {
+  bool set = false;
+  {
+    WorkStealingPool p(/*num_workers=*/1);
+    p.Schedule([&set]() { set = true; });
+  }
+  EXPECT_TRUE(set);
+}
+
+TEST(WorkStealingPoolTest, ConcurrentWork) {
+  absl::Mutex mu;
+  int sum = 0;
+  bool done = false;
+  const int kNonWaitingThreads = 10;
+  absl::Notification wait;
+  {
+    WorkStealingPool p(/*num_workers=*/2);
+    p.Schedule([&]() {
+      wait.WaitForNotification();
+      absl::MutexLock l(&mu);
+      ++sum;
+    });
+    for (int i = 0; i < kNonWaitingThreads; ++i) {
+      p.Schedule([&]() {
+        absl::MutexLock l(&mu);
+        ++sum;
+        if (sum == kNonWaitingThreads) done = true;
+      });
+    }
+    absl::MutexLock l(&mu);
+    ASSERT_TRUE(mu.AwaitWithTimeout(absl::Condition(&done), absl::Seconds(1)));
+    wait.Notify();
+  }
+  EXPECT_EQ(sum, kNonWaitingThreads + 1);
+}
+
+TEST(WorkStealingPoolTest, StealsFromBlockedWorker) {
+  // Work scheduled from within a pool thread lands on that thread's queue. If
+  // that thread then blocks, the other thread must steal the work for the
+  // notification to ever fire.
+  absl::Notification stolen;
+  {
+    WorkStealingPool p(/*num_workers=*/2);
+    p.Schedule([&]() {
+      p.Schedule([&]() { stolen.Notify(); });
+      EXPECT_TRUE(
+          stolen.WaitForNotificationWithTimeout(absl::Seconds(10)));
+    });
+  }
+  EXPECT_TRUE(stolen.HasBeenNotified());
+}
+
+TEST(WorkStealingPoolTest, FutureSet) {
+  WorkStealingPool p(/*num_workers=*/4);
+  FutureSet<int> set;
+  const int kWork = 1000;
+  for (int i = 0; i < kWork; ++i) {
+    p.ScheduleFuture(&set, [i]() { return i; });
+  }
+  int count = 0;
+  int64_t sum = 0;
+  while (Future<int>* f = set.WaitForAny()) {
+    ++count;
+    sum += **f;
+  }
+  EXPECT_EQ(count, kWork);
+  EXPECT_EQ(sum, kWork * (kWork - 1) / 2);
+}
+
+}  // namespace thread